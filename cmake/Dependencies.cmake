@@ -10,6 +10,11 @@ list(APPEND Caffe_LINKER_LIBS ${Boost_LIBRARIES})
 find_package(Threads REQUIRED)
 list(APPEND Caffe_LINKER_LIBS ${CMAKE_THREAD_LIBS_INIT})
 
+# ---[ Realtime extensions (shm_open for the shared memory transport)
+if(UNIX AND NOT APPLE)
+  list(APPEND Caffe_LINKER_LIBS rt)
+endif()
+
 # ---[ OpenMP
 if(USE_OPENMP)
   find_package(OpenMP)
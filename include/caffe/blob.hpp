@@ -227,6 +227,21 @@ class Blob {
   Dtype* mutable_cpu_diff();
   Dtype* mutable_gpu_diff();
 
+  /**
+   * @brief Keeps the data in a half-width format (see caffe/util/half.hpp)
+   *        for the layers which read and write it with cpu_storage_data().
+   *
+   * cpu_data() and the like convert it back, so the Dtype copy is only
+   * allocated once something else reads the data. The format stays with the
+   * memory, so it only applies once the blob is shaped: blobs sharing the
+   * memory see it too, and it survives a Reshape.
+   */
+  void set_storage(Storage storage);
+  Storage storage() const;
+  /// @brief The data in the format of storage(): Dtype or uint16_t values.
+  const void* cpu_storage_data() const;
+  void* mutable_cpu_storage_data();
+
   void set_prv_data(Dtype* data, shared_ptr<PrvMemDescr> descriptor,
           bool same_data);
   void set_prv_diff(Dtype* diff, shared_ptr<PrvMemDescr> descriptor,
@@ -0,0 +1,54 @@
+#ifndef CAFFE_INFERENCE_HPP_
+#define CAFFE_INFERENCE_HPP_
+
+#include <string>
+
+#include "caffe/common.hpp"
+#include "caffe/net.hpp"
+#include "caffe/proto/caffe.pb.h"
+
+namespace caffe {
+
+/**
+ * @brief One set of trained weights, served by any number of concurrent
+ *        inference sessions.
+ *
+ * A session is a TEST phase Net of its own, with its own layers, activations
+ * and scratch buffers, whose params share the memory of the model's. Sessions
+ * can then run Forward concurrently, one per thread, without locking, as
+ * long as nothing modifies the weights while they run.
+ *
+ * Every thread using a session must set the same Caffe::mode() as the thread
+ * that created the model. Convolutions use the CAFFE engine: MKL2017 keeps
+ * private layouts of the weights in their blobs, which sessions would share.
+ */
+template <typename Dtype>
+class InferenceModel {
+ public:
+  /// @brief Loads the weights from a .caffemodel, .h5 or flat weights file.
+  InferenceModel(const string& param_file, const string& weights_file);
+  /// @brief Uses the weights in or initialized by the param.
+  explicit InferenceModel(const NetParameter& param);
+
+  /**
+   * @brief Creates a net sharing the weights of the model, for the calling
+   *        thread. Safe to call from any thread.
+   */
+  shared_ptr<Net<Dtype> > NewSession() const;
+
+  /// @brief The net holding the weights; must not run Forward itself while
+  ///        sessions do.
+  inline const Net<Dtype>& net() const { return *net_; }
+
+ protected:
+  void Init(const NetParameter& param, const string& weights_file);
+
+  NetParameter param_;
+  shared_ptr<Net<Dtype> > net_;
+
+  DISABLE_COPY_AND_ASSIGN(InferenceModel);
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_INFERENCE_HPP_
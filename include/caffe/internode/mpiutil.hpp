@@ -3,6 +3,7 @@
 
 #include <map>
 #include <string>
+#include <vector>
 
 namespace caffe {
 namespace internode {
@@ -10,6 +11,7 @@ namespace internode {
 int mpi_get_current_proc_rank();
 int mpi_get_comm_size();
 std::string mpi_get_current_proc_name();
+std::vector<std::string> mpi_get_all_proc_names();
 std::string mpi_get_error_string(int errorcode);
 
 void mpi_init(int argc, char** argv);
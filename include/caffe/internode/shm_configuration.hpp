@@ -0,0 +1,27 @@
+#ifndef CAFFE_INTERNODE_SHM_CONFIGURATION_H_
+#define CAFFE_INTERNODE_SHM_CONFIGURATION_H_
+
+#include <boost/shared_ptr.hpp>
+#include <string>
+#include "configuration.hpp"
+
+namespace caffe {
+namespace internode {
+
+// Transport for processes sharing one host (`shm://name`): messages go
+// through POSIX shared-memory ring buffers, with futex wakeups only when
+// a reader or a writer actually has to sleep.
+boost::shared_ptr<Waypoint> configure_shm_client(
+    boost::shared_ptr<Daemon> communication_daemon,
+    std::string name,
+    size_t max_buffer_size);
+boost::shared_ptr<MultiWaypoint> configure_shm_server(
+    boost::shared_ptr<Daemon> communication_daemon,
+    std::string name,
+    size_t max_buffer_size);
+
+}  // namespace internode
+}  // namespace caffe
+
+#endif  // CAFFE_INTERNODE_SHM_CONFIGURATION_H_
+
@@ -12,6 +12,29 @@ class Daemon;
 
 typedef size_t RemoteId;
 
+// Binary tree over the ranks of the cluster. Ranks are split into groups
+// (one group per host in hierarchical mode, a single group otherwise),
+// each group is a subtree rooted in its lowest rank and only these group
+// leaders are linked with each other, so gradients are first reduced
+// inside a host and only the leaders exchange them over the network.
+class TreeTopology {
+  std::vector<std::vector<RemoteId> > groups;
+  std::vector<size_t> group_of;
+  std::vector<size_t> index_in_group;
+
+  void add(RemoteId node, size_t group);
+
+ public:
+  explicit TreeTopology(int total_nodes);
+  // host_of_rank[i] is the host name of rank i
+  explicit TreeTopology(const std::vector<std::string>& host_of_rank);
+
+  RemoteId parent(RemoteId node) const;
+  std::vector<RemoteId> children(RemoteId node) const;
+  bool is_group_leader(RemoteId node) const;
+  int total_groups() const;
+};
+
 class TreeWaypoint {
  public:
   struct Handler {
@@ -25,6 +48,8 @@ class TreeWaypoint {
 
   virtual boost::shared_ptr<Daemon> get_daemon() = 0;
   virtual void set_buffer_size(size_t max_packet_size) = 0;
+  // collective, has to be called by all nodes before any communication
+  virtual void set_hierarchical(bool hierarchical) = 0;
 
   typedef boost::function<void(bool succesful) > SentCallback;
   virtual void async_send_to_parent(
@@ -38,6 +63,7 @@ class TreeWaypoint {
   virtual std::vector<RemoteId> children() const = 0;
   virtual RemoteId parent() const = 0;
   virtual int total_nodes() const = 0;
+  virtual const TreeTopology& topology() const = 0;
 };
 }  // namespace internode
 }  // namespace caffe
@@ -0,0 +1,67 @@
+#ifndef CAFFE_LAYER_AUTOTUNER_HPP_
+#define CAFFE_LAYER_AUTOTUNER_HPP_
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/proto/caffe.pb.h"
+
+namespace caffe {
+
+/**
+ * @brief Chooses the engine and the OpenMP thread count of layers by timing
+ *        the available candidates on the layer's actual bottom shapes
+ *        (see NetParameter.autotune_param).
+ *
+ * Only what the LayerParameter leaves to the defaults is tuned: an engine of
+ * DEFAULT, and a num_threads of 0. Decisions are cached per host CPU
+ * signature and layer configuration in the optional cache_file.
+ */
+template <typename Dtype>
+class LayerAutotuner {
+ public:
+  explicit LayerAutotuner(const AutotuneParameter& param);
+
+  /**
+   * @brief Sets the fastest engine and num_threads in layer_param, for the
+   *        given bottoms. The tops are reshaped by the candidates.
+   *
+   * The candidates are timed on copies of params, the already filled params
+   * of a layer set up from layer_param, and run no fillers of their own.
+   *
+   * @return whether layer_param has anything to tune.
+   */
+  bool Tune(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top,
+      const vector<shared_ptr<Blob<Dtype> > >& params,
+      LayerParameter* layer_param);
+
+  /// @brief Adds the new decisions to the cache file, if any.
+  void Save();
+
+  /// @brief The CPU signature under which decisions are cached.
+  static string HostSignature();
+
+ protected:
+  void Candidates(const LayerParameter& layer_param,
+      const vector<Blob<Dtype>*>& bottom, vector<AutotuneCache::Entry>* out);
+  float Time(const LayerParameter& layer_param,
+      const vector<shared_ptr<Blob<Dtype> > >& params,
+      const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top);
+
+  AutotuneParameter param_;
+  string host_;
+  AutotuneCache cache_;
+  // Entries of cache_ for host_, by layer key.
+  std::map<string, int> index_;
+  int num_loaded_;
+
+  DISABLE_COPY_AND_ASSIGN(LayerAutotuner);
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_LAYER_AUTOTUNER_HPP_
@@ -0,0 +1,99 @@
+#ifndef CAFFE_LAYER_PROFILE_HPP_
+#define CAFFE_LAYER_PROFILE_HPP_
+
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/layer.hpp"
+
+namespace caffe {
+
+/// @brief Rough count of the floating point operations of a layer's Forward.
+template <typename Dtype>
+double layer_forward_flops(Layer<Dtype>* layer,
+    const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top);
+/// @brief Rough count of the floating point operations of a layer's Backward:
+///        twice the Forward for the layers with weights, which compute both
+///        the gradients of the weights and of the bottoms.
+template <typename Dtype>
+double layer_backward_flops(Layer<Dtype>* layer,
+    const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top);
+/// @brief Bytes a layer's Forward reads and writes at least once: its
+///        bottoms, weights and tops.
+template <typename Dtype>
+double layer_forward_bytes(Layer<Dtype>* layer,
+    const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top);
+/// @brief Bytes a layer's Backward reads and writes at least once: the top
+///        diffs, the bottom data and diffs, the weights and their diffs.
+template <typename Dtype>
+double layer_backward_bytes(Layer<Dtype>* layer,
+    const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top);
+
+/**
+ * @brief Timing statistics of one pass of one layer, as measured by
+ *        caffe time, with the work the pass does.
+ */
+struct LayerProfile {
+  LayerProfile();
+
+  /// @brief Sets the time statistics from the times of the iterations, in
+  ///        milliseconds.
+  void SetTimes(vector<double> times);
+  inline double gflops_per_second() const {
+    return median_ms > 0 ? flops / median_ms / 1e6 : 0;
+  }
+  inline double gbytes_per_second() const {
+    return median_ms > 0 ? bytes / median_ms / 1e6 : 0;
+  }
+  inline double ipc() const {
+    return cycles > 0 ? instructions / cycles : 0;
+  }
+  /// @brief Bandwidth from memory estimated from the cache misses, in GB/s.
+  inline double memory_gbytes_per_second() const {
+    return mean_ms > 0 ? cache_misses * 64 / mean_ms / 1e6 : 0;
+  }
+
+  string layer;
+  string type;
+  /// "forward" or "backward".
+  string pass;
+  double min_ms;
+  double median_ms;
+  double p99_ms;
+  double mean_ms;
+  double flops;
+  double bytes;
+  /// Fraction of the total time of all the passes, by mean.
+  double share;
+  /// Hardware events per iteration (see PerfCounters), zero when not counted.
+  double cycles;
+  double instructions;
+  /// Last-level cache misses.
+  double cache_misses;
+  /// Packed floating point instructions.
+  double vector_instructions;
+};
+
+/// @brief Sets the share of each profile in their total mean time.
+void SetProfileShares(vector<LayerProfile>* profiles);
+
+/// @brief Writes the profiles as JSON, or as CSV if the file name ends in
+///        ".csv".
+void WriteProfiles(const string& filename,
+    const vector<LayerProfile>& profiles);
+void WriteProfilesJson(const vector<LayerProfile>& profiles,
+    std::ostream* stream);
+void WriteProfilesCsv(const vector<LayerProfile>& profiles,
+    std::ostream* stream);
+
+/// @brief Reads profiles written by WriteProfiles.
+bool ReadProfiles(const string& filename, vector<LayerProfile>* profiles);
+bool ReadProfilesJson(std::istream* stream, vector<LayerProfile>* profiles);
+bool ReadProfilesCsv(std::istream* stream, vector<LayerProfile>* profiles);
+
+}  // namespace caffe
+
+#endif  // CAFFE_LAYER_PROFILE_HPP_
@@ -0,0 +1,102 @@
+#ifndef CAFFE_LAYER_SCHEDULER_HPP_
+#define CAFFE_LAYER_SCHEDULER_HPP_
+
+#include <boost/thread.hpp>
+
+#include <vector>
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/layer.hpp"
+#include "caffe/layer_profile.hpp"
+
+namespace caffe {
+
+template <typename Dtype> class Net;
+
+/**
+ * @brief Runs the independent branches of a net concurrently
+ *        (see NetParameter.parallel_branches).
+ *
+ * The net is cut into stages at the layers every other layer depends on or
+ * is depended on by, e.g. the Split and Concat layers around an Inception
+ * module. The layers between two such cuts split into branches that share no
+ * memory that either writes, in Forward or Backward; when running them
+ * concurrently is estimated to be faster, each branch goes to one of the
+ * worker threads, whose OpenMP threads are bound to a partition of the cores.
+ * Every layer sees the same inputs as when run in order; layers whose results
+ * depend on their thread count, like the weight gradients of Convolution,
+ * may differ by rounding.
+ *
+ * Layers drawing from the Caffe random generator of the calling thread, i.e.
+ * Dropout and the layers without bottoms, keep their stage in order on the
+ * calling thread.
+ */
+template <typename Dtype>
+class LayerScheduler {
+ public:
+  LayerScheduler(const Net<Dtype>& net, int num_workers);
+  ~LayerScheduler();
+
+  /// @brief Runs the Forward of all the layers, returning the loss.
+  Dtype Forward();
+  /// @brief Runs the Backward of all the layers needing it.
+  void Backward();
+
+  /// @brief The stages, in execution order, as branches of layer ids.
+  inline const vector<vector<vector<int> > >& stages() const {
+    return stages_;
+  }
+  inline int num_workers() const { return workers_.size(); }
+
+ protected:
+  /// Appends the stages running the layers, given in order.
+  void Decompose(const vector<int>& layers);
+  /// Whether running the branches concurrently is estimated to pay off;
+  /// if so, fills the worker of each branch.
+  bool Assign(const vector<vector<int> >& branches, vector<int>* workers);
+  void AddStage(const vector<vector<int> >& branches,
+      const vector<int>& workers);
+  void RunStage(int stage, bool forward);
+  void RunBranch(const vector<int>& branch, bool forward);
+  void WorkerEntry(int worker);
+
+  const Net<Dtype>& net_;
+  const int num_workers_;
+  // OpenMP threads of the calling thread, and of each worker.
+  int num_threads_;
+  int threads_per_worker_;
+  // Whether two layers access memory that one of them writes.
+  vector<vector<bool> > conflicts_;
+  vector<vector<bool> > ancestors_;
+  vector<double> costs_;
+  // Images processed in parallel by each layer.
+  vector<int> widths_;
+  vector<bool> serial_;
+  vector<vector<vector<int> > > stages_;
+  // The worker of each branch of each stage; empty for stages run in order.
+  vector<vector<int> > branch_workers_;
+  // Blobs read by more than one branch of each stage.
+  vector<vector<Blob<Dtype>*> > shared_bottoms_;
+  vector<Dtype> losses_;
+
+  Caffe::Brew mode_;
+  bool root_solver_;
+  vector<shared_ptr<boost::thread> > workers_;
+  boost::mutex mutex_;
+  boost::condition_variable start_;
+  boost::condition_variable done_;
+  // The stage the workers run, in which direction, and how many of them are
+  // not done with it yet.
+  int stage_;
+  bool forward_;
+  int generation_;
+  int pending_;
+  bool stop_;
+
+  DISABLE_COPY_AND_ASSIGN(LayerScheduler);
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_LAYER_SCHEDULER_HPP_
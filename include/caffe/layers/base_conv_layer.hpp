@@ -7,6 +7,7 @@
 #include "caffe/layer.hpp"
 #include "caffe/proto/caffe.pb.h"
 #include "caffe/util/im2col.hpp"
+#include "caffe/util/int8.hpp"
 
 namespace caffe {
 
@@ -44,6 +45,12 @@ class BaseConvolutionLayer : public Layer<Dtype> {
   void clear_weight_mt(void);
   void sum_weight_mt(Dtype* weight_diff);
 
+  // Int8 inference (see QuantizationParameter): int8_weights_ must be set
+  // before calling forward_cpu_gemm_int8.
+  bool int8_forward();
+  void forward_cpu_gemm_int8(const Dtype* input, Dtype* output);
+  Int8Gemm<Dtype> int8_weights_;
+
 #ifndef CPU_ONLY
   void forward_gpu_gemm(const Dtype* col_input, const Dtype* weights,
       Dtype* output, bool skip_im2col = false);
@@ -184,6 +191,7 @@ class BaseConvolutionLayer : public Layer<Dtype> {
 
   std::vector<Dtype> col_buffer_mt_;   //  openmp
   std::vector<Dtype> weight_diff_mt_;  // openmp
+  std::vector<typename Int8Gemm<Dtype>::Buffers> int8_buffers_mt_;  // openmp
 };
 
 }  // namespace caffe
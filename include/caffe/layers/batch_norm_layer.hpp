@@ -27,11 +27,16 @@ namespace caffe {
  * param {lr_mult: 0} three times in the layer definition.
  *
  * Note that the original paper also included a per-channel learned bias and
- * scaling factor.  It is possible (though a bit cumbersome) to implement
- * this in caffe using a single-channel DummyDataLayer filled with zeros,
- * followed by a Convolution layer with output the same size as the current.
- * This produces a channel-specific value that can be added or multiplied by
- * the BatchNorm layer's output.
+ * scaling factor.  With the scale_bias option the layer learns them itself as
+ * its fourth and fifth parameter blobs, otherwise a ScaleLayer with bias_term
+ * can follow it. In CPU mode Net::Init folds such a ScaleLayer, computing in
+ * place on the top, into this layer (see FuseScale).
+ *
+ * On the CPU each channel is processed in one sweep: the mean and variance
+ * of each row of spatial values are merged across the batch with Chan et
+ * al.'s parallel update, then the row is normalized, scaled and shifted
+ * while it is still in cache. Backward likewise gathers the two sums it needs
+ * and applies the gradient per channel, without broadcast buffers.
  *
  * [1] S. Ioffe and C. Szegedy, "Batch Normalization: Accelerating Deep Network
  *     Training by Reducing Internal Covariate Shift." arXiv preprint
@@ -43,7 +48,7 @@ template <typename Dtype>
 class BatchNormLayer : public Layer<Dtype> {
  public:
   explicit BatchNormLayer(const LayerParameter& param)
-      : Layer<Dtype>(param) {}
+      : Layer<Dtype>(param), scale_layer_(NULL) {}
   virtual void LayerSetUp(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top);
   virtual void Reshape(const vector<Blob<Dtype>*>& bottom,
@@ -53,6 +58,15 @@ class BatchNormLayer : public Layer<Dtype> {
   virtual inline int ExactNumBottomBlobs() const { return 1; }
   virtual inline int ExactNumTopBlobs() const { return 1; }
 
+  /**
+   * @brief Applies the per-channel scale, and the bias if any, of scale in
+   *        the same sweep as the normalization, so that the caller can skip
+   *        that layer. Its blobs keep the parameters and receive their
+   *        gradients, as their param_propagate_down says. CPU only.
+   *        NULL makes the layer normalize only again.
+   */
+  void FuseScale(Layer<Dtype>* scale);
+
  protected:
   virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top);
@@ -63,25 +77,19 @@ class BatchNormLayer : public Layer<Dtype> {
   virtual void Backward_gpu(const vector<Blob<Dtype>*>& top,
      const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
 
-  void replicate(Dtype* buffer_to_write,
-                         int num_batches,
-                         unsigned int batch_offset_incr,
-                         unsigned int channel_offset_incr,
-                         const Dtype* data_to_be_replicated);
-
-  template <typename FuncTy>
-  void replicate_to_op(Dtype* buffer_to_write,
-                       int num_batches,
-                       unsigned int batch_offset_incr,
-                       unsigned int channel_offset_incr,
-                       const Dtype* data_to_be_replicated,
-                       FuncTy op_func);
+  /// @brief Gets the scale and bias applied to the normalized values (NULL
+  ///        where there is none) and whether their gradients are computed.
+  void ScaleBias(Blob<Dtype>** scale, Blob<Dtype>** bias, bool* scale_diff,
+      bool* bias_diff);
 
   Blob<Dtype> mean_, variance_, temp_, x_norm_;
   bool use_global_stats_;
+  bool scale_bias_;
   Dtype moving_average_fraction_;
   int channels_;
   Dtype eps_;
+  /// The ScaleLayer applied by FuseScale, if any.
+  Layer<Dtype>* scale_layer_;
 
   // extra temporarary variables is used to carry out sums/broadcasting
   // using BLAS
@@ -68,6 +68,8 @@ class DropoutLayer : public NeuronLayer<Dtype> {
 
   /// when divided by UINT_MAX, the randomly generated values @f$u\sim U(0,1)@f$
   Blob<unsigned int> rand_vec_;
+  /// whether each input is kept, bit i % 32 of word i / 32, on CPU
+  Blob<unsigned int> mask_;
   /// the probability @f$ p @f$ of dropping any input
   Dtype threshold_;
   /// the scale for undropped inputs at train time @f$ 1 / (1 - p) @f$
@@ -38,6 +38,9 @@ class EltwiseLayer : public Layer<Dtype> {
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
   virtual void Backward_gpu(const vector<Blob<Dtype>*>& top,
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
+  /// @brief Forward_cpu for half-width bottoms or top (see Blob::storage).
+  void ForwardStorage_cpu(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
 
   EltwiseParameter_EltwiseOp op_;
   vector<Dtype> coeffs_;
@@ -6,6 +6,7 @@
 #include "caffe/blob.hpp"
 #include "caffe/layer.hpp"
 #include "caffe/proto/caffe.pb.h"
+#include "caffe/util/int8.hpp"
 
 namespace caffe {
 
@@ -45,6 +46,9 @@ class InnerProductLayer : public Layer<Dtype> {
   bool bias_term_;
   Blob<Dtype> bias_multiplier_;
   bool transpose_;  ///< if true, assume transposed weights
+  /// int8 inference, see QuantizationParameter
+  Int8Gemm<Dtype> int8_weights_;
+  typename Int8Gemm<Dtype>::Buffers int8_buffers_;
 };
 
 }  // namespace caffe
@@ -62,6 +62,19 @@ class PoolingCodeGeneratorForward
     int64_t channel_end,
     PoolingLayer<Dtype>* layer,
     bool use_top_mask);
+#if defined __x86_64__ || defined _M_X64
+  static void Avx512(
+    const Dtype* bottom_data,
+    Dtype* top_data,
+    int top_count,
+    int batch_start,
+    int batch_end,
+    void* mask,
+    int64_t channel_start,
+    int64_t channel_end,
+    PoolingLayer<Dtype>* layer,
+    bool use_top_mask);
+#endif
   Callback_t* Callback;
   std::vector<int> Layer_output_shape_signature;
   bool Use_top_mask;
@@ -89,7 +102,10 @@ class PoolingCodeGeneratorBackward
     const void* mask,
     PoolingLayer<Dtype>* layer);
 
-  Callback_t* Get_callback(PoolingLayer<Dtype>* layer, Blob<Dtype>* top);
+  Callback_t* Get_callback(
+    PoolingLayer<Dtype>* layer,
+    Blob<Dtype>* top,
+    bool use_top_mask);
 
  private:
   void Create_callback(PoolingLayer<Dtype>* layer);
@@ -106,6 +122,8 @@ class PoolingCodeGeneratorBackward
     PoolingLayer<Dtype>* layer);
   Callback_t* Callback;
   std::vector<int> layer_output_shape_signature;
+  bool Use_top_mask;
+  PoolingParameter_PoolMethod Method;
 };
 }  // namespace caffe
 
@@ -13,16 +13,30 @@ namespace caffe {
  * @brief Creates a "split" path in the network by copying the bottom Blob
  *        into multiple top Blob%s to be used by multiple consuming layers.
  *
+ * Backward sums the top diffs into the bottom diff in one pass over memory,
+ * adding them in the order of the tops, so the sum does not depend on the
+ * number of threads.
+ *
  * TODO(dox): thorough documentation for Forward, Backward, and proto params.
  */
 template <typename Dtype>
 class SplitLayer : public Layer<Dtype> {
  public:
   explicit SplitLayer(const LayerParameter& param)
-      : Layer<Dtype>(param) {}
+      : Layer<Dtype>(param), accumulate_top_(-1) {}
   virtual void Reshape(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top);
 
+  /**
+   * @brief Sums only the diffs of the tops which are computed in Backward,
+   *        and lets the consumer of top accumulate_top (unless -1) write its
+   *        diff straight into the bottom diff, for the others to be added to.
+   *
+   * The consumer must overwrite the diff of its bottom in every Backward.
+   */
+  void SetBackwardTops(const vector<bool>& top_need_backward,
+      int accumulate_top);
+
   virtual inline const char* type() const { return "Split"; }
   virtual inline int ExactNumBottomBlobs() const { return 1; }
   virtual inline int MinTopBlobs() const { return 1; }
@@ -38,6 +52,10 @@ class SplitLayer : public Layer<Dtype> {
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
 
   int count_;
+  /// The tops whose diffs are summed; all if empty.
+  vector<bool> top_need_backward_;
+  /// The top sharing its diff with the bottom, or -1.
+  int accumulate_top_;
 };
 
 }  // namespace caffe
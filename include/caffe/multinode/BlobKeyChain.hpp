@@ -5,6 +5,10 @@
 
 namespace caffe {
 
+// Locks guarding the blobs of a net between the solver and communication.
+// Locking a layer excludes everyone else from it, locking a part of a blob
+// only excludes others from that part and from locking the whole layer.
+// A thread holding a part must not lock the whole layer.
 template <typename Dtype>
 class BlobKeyChain {
  public:
@@ -0,0 +1,23 @@
+#ifndef CAFFE_MULTINODE_MODEL_DOWNLOAD_HPP_
+#define CAFFE_MULTINODE_MODEL_DOWNLOAD_HPP_
+
+#include <string>
+
+namespace caffe {
+
+// Content hash of a serialized model, used to name cached copies of it.
+// Detects changed or damaged models, it is not meant to be secure.
+std::string model_hash(const std::string& model);
+
+// Downloads the weights served by a model server (a serialized NetParameter
+// with blobs) in chunks, keeping several chunk requests in flight.
+// If cache_dir is not empty, a model with the same hash found there is used
+// instead, and a downloaded model is stored there as <hash>.caffemodel.
+bool ReceiveModelFromRemote(const std::string& address,
+                            const std::string& cache_dir,
+                            std::string* model,
+                            std::string* hash);
+
+}  // namespace caffe
+
+#endif  // CAFFE_MULTINODE_MODEL_DOWNLOAD_HPP_
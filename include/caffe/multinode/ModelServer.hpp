@@ -8,19 +8,26 @@
 
 namespace caffe {
 
+// Serves the solver definition and, in chunks, the trained weights of the
+// net. Given an upstream model server address it relays that server's model
+// instead, so the upstream only sends it once per relay.
 template <typename Dtype>
 class ModelServer : public internode::Waypoint::Handler {
   shared_ptr<internode::Daemon> daemon;
   shared_ptr<Solver<Dtype> > solver;
   SolverParameter param_;
+  string model_;
+  string model_hash_;
+  uint32_t chunk_size_;
   shared_ptr<internode::MultiWaypoint> waypoint;
 
   SolverParameter prepare_model();
   BlobShape blob_shape_by_name(string name);
+  void send_chunk(const ModelReq& req, internode::Waypoint* remote);
  public:
   ModelServer(shared_ptr<Solver<Dtype> >,
               string bind_address,
-              string ignored_address,
+              string upstream_address,
               int ignored_threads);
   void run();
 
@@ -4,6 +4,7 @@
 #include "caffe/internode/configuration.hpp"
 #include "caffe/internode/mpiutil.hpp"
 #include "caffe/multinode/DataServer.hpp"
+#include "caffe/multinode/ModelDownload.hpp"
 #include "caffe/multinode/ModelServer.hpp"
 #include "caffe/multinode/Relay.hpp"
 #include "caffe/multinode/SynchronousNode.hpp"
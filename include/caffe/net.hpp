@@ -11,9 +11,47 @@
 #include "caffe/common.hpp"
 #include "caffe/layer.hpp"
 #include "caffe/proto/caffe.pb.h"
+#include "caffe/util/perf_counters.hpp"
+#include "caffe/util/rng.hpp"
 
 namespace caffe {
 
+template <typename Dtype> class Net;
+template <typename Dtype> class CPUParams;
+template <typename Dtype> class LayerScheduler;
+
+/**
+ * @brief The learned parameters of a Net, held apart from the layers so that
+ *        they can be serialized while the net keeps training.
+ *
+ * Filled by Net::CopyState, which takes a private copy of every parameter, or
+ * by Net::ShareState, which only references the live blobs.
+ */
+template <typename Dtype>
+class NetSnapshot {
+ public:
+  NetSnapshot() : write_diff_(false) {}
+
+  /// @brief Writes the snapshot as if by Net::ToProto.
+  void ToProto(NetParameter* param) const;
+  /// @brief Writes the snapshot as if by Net::ToHDF5.
+  void ToHDF5(const string& filename) const;
+
+  inline const string& name() const { return name_; }
+  inline bool write_diff() const { return write_diff_; }
+
+ protected:
+  string name_;
+  bool write_diff_;
+  /// Layer definitions without their blobs.
+  vector<LayerParameter> layer_params_;
+  vector<vector<shared_ptr<Blob<Dtype> > > > blobs_;
+  /// Whether blobs_[i][j] owns its data, i.e. is not shared with another layer.
+  vector<vector<bool> > blob_owners_;
+
+  friend class Net<Dtype>;
+};
+
 /**
  * @brief Connects Layer%s together into a directed acyclic graph (DAG)
  *        specified by a NetParameter.
@@ -115,10 +153,23 @@ class Net {
   void CopyTrainedLayersFrom(const string trained_filename);
   void CopyTrainedLayersFromBinaryProto(const string trained_filename);
   void CopyTrainedLayersFromHDF5(const string trained_filename);
+  /**
+   * @brief Maps a flat weights file (see flat_weights.hpp) and uses the
+   *        tensors in place as the param data, without copying them.
+   *        Written params get private copies of the touched pages only.
+   */
+  void CopyTrainedLayersFromFlat(const string trained_filename);
   /// @brief Writes the net to a proto.
   void ToProto(NetParameter* param, bool write_diff = false) const;
   /// @brief Writes the net to an HDF5 file.
   void ToHDF5(const string& filename, bool write_diff = false) const;
+  /**
+   * @brief Copies the learned parameters into a snapshot, reusing the
+   *        snapshot's blobs when it has been filled before.
+   */
+  void CopyState(NetSnapshot<Dtype>* snapshot, bool write_diff = false) const;
+  /// @brief Fills a snapshot that refers to the live parameters of the net.
+  void ShareState(NetSnapshot<Dtype>* snapshot, bool write_diff = false) const;
 
   /// @brief returns the network name.
   inline const string& name() const { return name_; }
@@ -171,6 +222,11 @@ class Net {
   inline const vector<bool>& layer_need_backward() const {
     return layer_need_backward_;
   }
+  /// @brief returns whether each layer is skipped, its work being done by
+  ///        the layer before it (see FuseBatchNormScale)
+  inline const vector<bool>& layer_fused() const {
+    return layer_fused_;
+  }
   /// @brief returns the parameters
   inline const vector<shared_ptr<Blob<Dtype> > >& params() const {
     return params_;
@@ -179,6 +235,13 @@ class Net {
     return learnable_params_;
   }
 
+  /**
+   * @brief returns the buffers holding all learnable params contiguously
+   *        (see NetParameter.contiguous_params), or NULL if they are not
+   *        used, e.g. in GPU mode or after a param moved to a private layout.
+   */
+  const CPUParams<Dtype>* contiguous_params() const;
+
   vector<int> get_layer_learnable_param_ids(int layer_id) const;
 
   /// @brief returns the learnable parameter learning rate multipliers
@@ -220,6 +283,24 @@ class Net {
 
   void set_debug_info(const bool value) { debug_info_ = value; }
 
+  /**
+   * @brief Counts the hardware events of the Forward and Backward of each
+   *        layer from now on, over the calling thread and its OpenMP threads;
+   *        independent branches then run in order.
+   *
+   * Returns false, counting nothing, if the counters are not available.
+   */
+  bool EnablePerfCounters();
+  /// @brief The events counted in the Forward and Backward of each layer
+  ///        since EnablePerfCounters or ClearPerfCounters.
+  inline const vector<PerfSample>& forward_perf() const {
+    return forward_perf_;
+  }
+  inline const vector<PerfSample>& backward_perf() const {
+    return backward_perf_;
+  }
+  void ClearPerfCounters();
+
   // Helpers for Init.
   /**
    * @brief Remove layers that the user specified should be excluded given the current
@@ -237,6 +318,8 @@ class Net {
   void AppendTop(const NetParameter& param, const int layer_id,
                  const int top_id, set<string>* available_blobs,
                  map<string, int>* blob_name_to_idx);
+  /// @brief Adds the events counted since begin to total.
+  void CountPerf(const PerfSample& begin, PerfSample* total);
   /// @brief Append a new bottom blob to the net.
   int AppendBottom(const NetParameter& param, const int layer_id,
                    const int bottom_id, set<string>* available_blobs,
@@ -251,6 +334,31 @@ class Net {
   void BackwardDebugInfo(const int layer_id);
   /// @brief Helper for displaying debug info in Update.
   void UpdateDebugInfo(const int param_id);
+  /// @brief Helper for CopyState and ShareState.
+  void InitState(NetSnapshot<Dtype>* snapshot, bool write_diff) const;
+  /// @brief Helper for Init: splits the net into the segments recomputed
+  ///        during Backward (see NetParameter.checkpoint_param).
+  void InitCheckpoints(const NetParameter& param);
+  /// @brief Frees the activations internal to a segment.
+  void ReleaseSegment(int segment);
+  /// @brief Recomputes the activations of a segment up to layer last.
+  void RecomputeSegment(int segment, int last);
+  /// @brief Helper for Init: has each BatchNorm layer apply the in-place
+  ///        Scale layer right after it, which is then skipped.
+  void FuseBatchNormScale();
+  /// @brief Has the BatchNorm layer_id apply the fused Scale after it or,
+  ///        when a Forward or Backward range separates them, not.
+  void SetScaleFused(int layer_id, bool fused);
+  /// @brief Helper for Init: has each SplitLayer skip the tops whose diffs
+  ///        are not computed and, if accumulate, the first consumer whose diff
+  ///        is write it straight into the bottom diff.
+  void FuseSplitGradients(bool accumulate);
+  /// @brief Helper for Init and Reshape: points the bottoms of Concat layers
+  ///        into their top and the tops of Slice layers into their bottom
+  ///        (see NetParameter.zero_copy_concat).
+  void AliasConcatBlobs();
+  /// @brief Whether a layer after layer_id computes in place on memory.
+  bool ModifiedInPlace(const SyncedMemory* memory, int layer_id) const;
 
   /// @brief The network name
   string name_;
@@ -261,6 +369,7 @@ class Net {
   vector<string> layer_names_;
   map<string, int> layer_names_index_;
   vector<bool> layer_need_backward_;
+  vector<bool> layer_fused_;
   /// @brief the blobs storing intermediate results between the layer.
   vector<shared_ptr<Blob<Dtype> > > blobs_;
   vector<string> blob_names_;
@@ -305,10 +414,32 @@ class Net {
   /// the weight decay multipliers for learnable_params_
   vector<float> params_weight_decay_;
   vector<bool> has_params_decay_;
+  /// learnable_params_ are views of it if contiguous_params is set
+  shared_ptr<CPUParams<Dtype> > contiguous_params_;
+  /// The checkpoint segment of each layer; empty if checkpointing is off.
+  vector<int> layer_segments_;
+  /// First and last layer of each segment.
+  vector<pair<int, int> > segments_;
+  /// Blobs freed once each segment is done with, none for the last one.
+  vector<vector<int> > segment_blobs_;
+  /// Whether the blobs of each segment have been freed since computed.
+  vector<bool> segment_released_;
+  /// The random generator state before the Forward of each layer from which
+  /// recomputation replays it: the first ones of segments and those after
+  /// layers that are not recomputed. NULL for the other layers.
+  vector<shared_ptr<rng_t> > layer_rngs_;
+  /// Runs independent branches concurrently, if parallel_branches is set.
+  shared_ptr<LayerScheduler<Dtype> > scheduler_;
+  /// Whether the parts of concatenations alias the whole.
+  bool zero_copy_concat_;
   /// The bytes of memory used by this net
   size_t memory_used_;
   /// Whether to compute and display debug info for the net.
   bool debug_info_;
+  /// The hardware counters read around each layer, if enabled.
+  shared_ptr<PerfCounters> perf_counters_;
+  vector<PerfSample> forward_perf_;
+  vector<PerfSample> backward_perf_;
   /// The root net that actually holds the shared layers in data parallelism
   const Net* const root_net_;
   DISABLE_COPY_AND_ASSIGN(Net);
@@ -23,6 +23,7 @@ template<typename Dtype>
 class Params {
  public:
   explicit Params(shared_ptr<Solver<Dtype> > root_solver);
+  explicit Params(const vector<Blob<Dtype>*>& blobs);
   virtual ~Params() {
   }
 
@@ -44,6 +45,28 @@ class Params {
 DISABLE_COPY_AND_ASSIGN(Params);
 };
 
+// Params stored in host memory. The blobs are turned into views of it, so
+// whole-model operations can run as a single kernel over data() and diff()
+// while layer-wise access to the blobs keeps working.
+template<typename Dtype>
+class CPUParams : public Params<Dtype> {
+ public:
+  explicit CPUParams(const vector<Blob<Dtype>*>& blobs);
+
+  // False once a blob stopped using the buffers on CPU, e.g. after being
+  // moved to a private (MKL) layout or shared with another net.
+  bool in_use() const;
+
+ protected:
+  using Params<Dtype>::size_;
+  using Params<Dtype>::data_;
+  using Params<Dtype>::diff_;
+  const vector<Blob<Dtype>*> blobs_;
+  // kept alive by the blobs as well
+  shared_ptr<SyncedMemory> data_memory_;
+  shared_ptr<SyncedMemory> diff_memory_;
+};
+
 // Params stored in GPU memory.
 template<typename Dtype>
 class GPUParams : public Params<Dtype> {
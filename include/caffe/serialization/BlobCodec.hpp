@@ -25,9 +25,12 @@ template <typename Dtype>
 class BlobCodec {
  public:
   typedef typename BlobEncoding::What What;
+  // If net is given, the comm_compression of its layers overrides the
+  // outgoing_compression of param for their blobs.
   static shared_ptr<BlobCodec> create_codec(
     const MultinodeParameter& param,
-    bool ensure_is_single_threaded);
+    bool ensure_is_single_threaded,
+    const Net<Dtype>* net = NULL);
 
   virtual uint32_t encode(BlobUpdate* msg,
                           const Blob<Dtype>* src,
@@ -8,6 +8,25 @@
 
 namespace caffe {
 
+/**
+ * @brief The gradient as seen by the fused CPU update kernels: scaled as by
+ *        SGDSolver::Normalize and SGDSolver::ClipGradients, and with the
+ *        weight decay of SGDSolver::Regularize added.
+ */
+template <typename Dtype>
+struct FusedGradient {
+  Dtype scale;
+  Dtype l2_decay;
+  Dtype l1_decay;
+  // the param is large enough to split its update among OpenMP threads
+  bool parallel;
+
+  inline Dtype operator()(Dtype g, Dtype w) const {
+    return scale * g + l2_decay * w
+      + l1_decay * ((Dtype(0) < w) - (w < Dtype(0)));
+  }
+};
+
 /**
  * @brief Optimizes the parameters of a Net using
  *        stochastic gradient descent (SGD) with momentum.
@@ -19,6 +38,7 @@ class SGDSolver : public Solver<Dtype> {
       : Solver<Dtype>(param) { PreSolve(); }
   explicit SGDSolver(const string& param_file)
       : Solver<Dtype>(param_file) { PreSolve(); }
+  virtual ~SGDSolver() { this->WaitForSnapshots(); }
   virtual inline const char* type() const { return "SGD"; }
 
   const vector<shared_ptr<Blob<Dtype> > >& history() { return history_; }
@@ -32,9 +52,22 @@ class SGDSolver : public Solver<Dtype> {
   virtual void Regularize(int param_id);
   virtual void ComputeUpdateValue(int param_id, Dtype rate);
   virtual void ClipGradients();
-  virtual void SnapshotSolverState(const string& model_filename);
-  virtual void SnapshotSolverStateToBinaryProto(const string& model_filename);
-  virtual void SnapshotSolverStateToHDF5(const string& model_filename);
+  // On CPU, each param is updated in a single pass over its memory by
+  // ApplyFusedUpdate, unless it is kept in a private (MKL) layout.
+  bool CanApplyFusedUpdate(int param_id);
+  FusedGradient<Dtype> GetFusedGradient(int param_id);
+  // Computes the update value into the param diff, as ComputeUpdateValue,
+  // and applies it to the param data. Solvers overriding ComputeUpdateValue
+  // have to override it as well.
+  virtual void ApplyFusedUpdate(int param_id, Dtype rate,
+      const FusedGradient<Dtype>& grad);
+  virtual void StageSolverState(SolverSnapshot<Dtype>* snapshot, bool copy);
+  virtual string SnapshotSolverState(const SolverSnapshot<Dtype>& snapshot,
+      const string& model_filename);
+  virtual string SnapshotSolverStateToBinaryProto(
+      const SolverSnapshot<Dtype>& snapshot, const string& model_filename);
+  virtual string SnapshotSolverStateToHDF5(
+      const SolverSnapshot<Dtype>& snapshot, const string& model_filename);
   virtual void RestoreSolverStateFromHDF5(const string& state_file);
   virtual void RestoreSolverStateFromBinaryProto(const string& state_file);
   // history maintains the historical momentum data.
@@ -42,6 +75,8 @@ class SGDSolver : public Solver<Dtype> {
   // temp maintains other information that might be needed in computation
   //   of gradients/updates and is not needed in snapshots
   vector<shared_ptr<Blob<Dtype> > > history_, update_, temp_;
+  // gradient scale factor set by ClipGradients, applied with the update
+  Dtype clip_scale_;
 
   DISABLE_COPY_AND_ASSIGN(SGDSolver);
 };
@@ -57,6 +92,8 @@ class NesterovSolver : public SGDSolver<Dtype> {
 
  protected:
   virtual void ComputeUpdateValue(int param_id, Dtype rate);
+  virtual void ApplyFusedUpdate(int param_id, Dtype rate,
+      const FusedGradient<Dtype>& grad);
 
   DISABLE_COPY_AND_ASSIGN(NesterovSolver);
 };
@@ -72,6 +109,8 @@ class AdaGradSolver : public SGDSolver<Dtype> {
 
  protected:
   virtual void ComputeUpdateValue(int param_id, Dtype rate);
+  virtual void ApplyFusedUpdate(int param_id, Dtype rate,
+      const FusedGradient<Dtype>& grad);
   void constructor_sanity_check() {
     CHECK_EQ(0, this->param_.momentum())
         << "Momentum cannot be used with AdaGrad.";
@@ -92,6 +131,8 @@ class RMSPropSolver : public SGDSolver<Dtype> {
 
  protected:
   virtual void ComputeUpdateValue(int param_id, Dtype rate);
+  virtual void ApplyFusedUpdate(int param_id, Dtype rate,
+      const FusedGradient<Dtype>& grad);
   void constructor_sanity_check() {
     CHECK_EQ(0, this->param_.momentum())
         << "Momentum cannot be used with RMSProp.";
@@ -116,6 +157,8 @@ class AdaDeltaSolver : public SGDSolver<Dtype> {
  protected:
   void AdaDeltaPreSolve();
   virtual void ComputeUpdateValue(int param_id, Dtype rate);
+  virtual void ApplyFusedUpdate(int param_id, Dtype rate,
+      const FusedGradient<Dtype>& grad);
 
   DISABLE_COPY_AND_ASSIGN(AdaDeltaSolver);
 };
@@ -140,6 +183,8 @@ class AdamSolver : public SGDSolver<Dtype> {
  protected:
   void AdamPreSolve();
   virtual void ComputeUpdateValue(int param_id, Dtype rate);
+  virtual void ApplyFusedUpdate(int param_id, Dtype rate,
+      const FusedGradient<Dtype>& grad);
 
   DISABLE_COPY_AND_ASSIGN(AdamSolver);
 };
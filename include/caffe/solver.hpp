@@ -31,6 +31,19 @@ namespace caffe {
  */
 typedef boost::function<SolverAction::Enum()> ActionCallback;
 
+/**
+ * @brief Everything a Solver snapshot writes, held apart from the solver so
+ *        that it can be written to disk while training continues.
+ */
+template <typename Dtype>
+struct SolverSnapshot {
+  int iter;
+  int current_step;
+  NetSnapshot<Dtype> net;
+  /// The solver-specific state, e.g. the momentum history of SGDSolver.
+  vector<shared_ptr<Blob<Dtype> > > history;
+};
+
 /**
  * @brief An interface for classes that perform optimization on Net%s.
  *
@@ -64,7 +77,7 @@ class Solver {
   // RestoreSolverStateFrom___ protected methods. You should implement these
   // methods to restore the state from the appropriate snapshot type.
   void Restore(const char* resume_file);
-  virtual ~Solver() {}
+  virtual ~Solver();
   inline const SolverParameter& param() const { return param_; }
   inline SolverParameter& param() { return param_; }
   inline shared_ptr<Net<Dtype> > net() { return net_; }
@@ -102,8 +115,13 @@ class Solver {
   // The Solver::Snapshot function implements the basic snapshotting utility
   // that stores the learned net. You should implement the SnapshotSolverState()
   // function that produces a SolverState protocol buffer that needs to be
-  // written to disk together with the learned net.
+  // written to disk together with the learned net, and StageSolverState() if
+  // that state is more than the iteration counters.
+  // With snapshot_async the net and solver state are only copied here, and
+  // are written by a background thread; WaitForSnapshots() blocks until all
+  // of them are on disk.
   void Snapshot();
+  void WaitForSnapshots();
 
   // Make and apply the update value for the current iteration.
   virtual void ApplyUpdate() = 0;
@@ -113,11 +131,20 @@ class Solver {
 
  protected:
   string SnapshotFilename(const string extension);
-  string SnapshotToBinaryProto();
-  string SnapshotToHDF5();
+  string SnapshotFilename(const string extension, int iter);
+  // Fills the snapshot with either copies of (copy = true) or references to
+  // the current net and solver state.
+  void StageSnapshot(SolverSnapshot<Dtype>* snapshot, bool copy);
+  // Writes a staged snapshot, optionally waiting until it is on disk.
+  void WriteSnapshot(const SolverSnapshot<Dtype>& snapshot, bool sync_to_disk);
+  string SnapshotToBinaryProto(const SolverSnapshot<Dtype>& snapshot);
+  string SnapshotToHDF5(const SolverSnapshot<Dtype>& snapshot);
   // The test routine
   void Test(const int test_net_id = 0);
-  virtual void SnapshotSolverState(const string& model_filename) = 0;
+  virtual void StageSolverState(SolverSnapshot<Dtype>* snapshot, bool copy) {}
+  // Writes the solver state and returns the name of the file written.
+  virtual string SnapshotSolverState(const SolverSnapshot<Dtype>& snapshot,
+      const string& model_filename) = 0;
   virtual void RestoreSolverStateFromHDF5(const string& state_file) = 0;
   virtual void RestoreSolverStateFromBinaryProto(const string& state_file) = 0;
   void DisplayOutputBlobs(const int net_id);
@@ -145,6 +172,12 @@ class Solver {
 
   ForwardBackwardFunc forward_backward_;
 
+  // Writes snapshots in the background when snapshot_async is set. Solvers
+  // that implement SnapshotSolverState() must call WaitForSnapshots() in their
+  // destructor, as the writer may still be calling it.
+  class AsyncSnapshotWriter;
+  shared_ptr<AsyncSnapshotWriter> snapshot_writer_;
+
   DISABLE_COPY_AND_ASSIGN(Solver);
 };
 
@@ -162,8 +195,10 @@ class WorkerSolver : public Solver<Dtype> {
  protected:
   void ApplyUpdate() { }
   void ApplyUpdate(int param_id) { }
-  void SnapshotSolverState(const string& model_filename) {
+  string SnapshotSolverState(const SolverSnapshot<Dtype>& snapshot,
+      const string& model_filename) {
     LOG(FATAL) << "Should not be called on worker solver.";
+    return string();
   }
   void RestoreSolverStateFromBinaryProto(const string& state_file) {
     LOG(FATAL) << "Should not be called on worker solver.";
@@ -59,6 +59,16 @@ struct PrvMemDescr {
   virtual PrvDescrType get_descr_type() = 0;
 };
 
+// Converts between the cpu data and a half-width copy of it, which is all
+// that is allocated while the layers using the memory read and write it
+// directly (see Blob::set_storage).
+struct HalfMemDescr {
+  virtual ~HalfMemDescr() {}
+  virtual size_t half_size() = 0;
+  virtual void convert_to_half(const void* cpu_ptr, void* half_ptr) = 0;
+  virtual void convert_from_half(const void* half_ptr, void* cpu_ptr) = 0;
+};
+
 /**
  * @brief Manages memory allocation and synchronization between the host (CPU)
  *        and device (GPU).
@@ -69,17 +79,20 @@ class SyncedMemory {
  public:
   SyncedMemory()
       : prv_descriptor_(), cpu_ptr_(NULL), gpu_ptr_(NULL), prv_ptr_(NULL),
-        size_(0), head_(UNINITIALIZED), own_cpu_data_(false),
+        half_ptr_(NULL), size_(0), head_(UNINITIALIZED), own_cpu_data_(false),
         cpu_malloc_use_cuda_(false), own_gpu_data_(false), own_prv_data_(false),
         gpu_device_(-1) {}
   explicit SyncedMemory(size_t size)
       : prv_descriptor_(), cpu_ptr_(NULL), gpu_ptr_(NULL), prv_ptr_(NULL),
-        size_(size), head_(UNINITIALIZED), own_cpu_data_(false),
+        half_ptr_(NULL), size_(size), head_(UNINITIALIZED),
+        own_cpu_data_(false),
         cpu_malloc_use_cuda_(false), own_gpu_data_(false), own_prv_data_(false),
         gpu_device_(-1) {}
   ~SyncedMemory();
   const void* cpu_data();
   void set_cpu_data(void* data);
+  // Uses data owned by owner, which is kept alive as long as it is used.
+  void set_cpu_data(void* data, const shared_ptr<void>& owner);
   const void* gpu_data();
   void set_gpu_data(void* data);
   void* mutable_cpu_data();
@@ -90,8 +103,17 @@ class SyncedMemory {
   void* mutable_prv_data();
   shared_ptr<PrvMemDescr> prv_descriptor_;
 
+  // The half-width copy is converted from and to the cpu data on demand;
+  // a NULL descriptor drops it.
+  void set_half_descriptor(shared_ptr<HalfMemDescr> descriptor);
+  const shared_ptr<HalfMemDescr>& half_descriptor() {
+    return half_descriptor_;
+  }
+  const void* half_data();
+  void* mutable_half_data();
+
   enum SyncedHead { UNINITIALIZED, HEAD_AT_CPU, HEAD_AT_GPU, SYNCED,
-                    HEAD_AT_PRV, SYNCED_PRV};
+                    HEAD_AT_PRV, SYNCED_PRV, HEAD_AT_HALF, SYNCED_HALF};
   SyncedHead head() { return head_; }
   size_t size() { return size_; }
 
@@ -102,9 +124,11 @@ class SyncedMemory {
  private:
   void to_cpu();
   void to_gpu();
+  void to_half();
   void* cpu_ptr_;
   void* gpu_ptr_;
   void* prv_ptr_;
+  void* half_ptr_;
   const size_t size_;
   SyncedHead head_;
   bool own_cpu_data_;
@@ -112,6 +136,8 @@ class SyncedMemory {
   bool own_gpu_data_;
   bool own_prv_data_;
   int gpu_device_;
+  shared_ptr<void> cpu_data_owner_;
+  shared_ptr<HalfMemDescr> half_descriptor_;
   boost::mutex mtx;
 
   DISABLE_COPY_AND_ASSIGN(SyncedMemory);
@@ -60,8 +60,11 @@ class OpenMpManager {
   static void setGpuDisabled();
 
   static void bindCurrentThreadToNonPrimaryCoreIfPossible();
+  static void bindCurrentThreadToSpareCpuIfPossible(unsigned threadId);
 
   static void bindOpenMpThreads();
+  static void bindOpenMpThreadsToPartition(unsigned partition,
+    unsigned numberOfPartitions);
   static void printVerboseInformation();
 
  private:
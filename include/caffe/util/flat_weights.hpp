@@ -0,0 +1,52 @@
+#ifndef CAFFE_UTIL_FLAT_WEIGHTS_H_
+#define CAFFE_UTIL_FLAT_WEIGHTS_H_
+
+#include <string>
+
+#include "caffe/common.hpp"
+#include "caffe/proto/caffe.pb.h"
+
+namespace caffe {
+
+// Flat weights files (.caffeflat) hold the param blobs of a net as raw
+// tensors in host byte order, each one aligned to kFlatWeightsAlignment,
+// after a small header and a FlatWeightsIndex. Unlike .caffemodel files
+// they are not parsed: the tensors are used in place from a memory mapping.
+const size_t kFlatWeightsAlignment = 64;
+
+// True if the filename has the .caffeflat extension.
+bool IsFlatWeightsFile(const string& filename);
+
+// Converts the blob data (not diffs) of the layers in param.
+void WriteFlatWeights(const NetParameter& param, const string& filename);
+void ReadFlatWeights(const string& filename, NetParameter* param);
+
+// Sets the shape of proto to that of the tensor, in the deprecated 4D
+// fields if the tensor was written from them.
+void GetFlatTensorShape(const FlatWeightsIndex::Tensor& tensor,
+                        BlobProto* proto);
+
+// A private (copy-on-write) mapping of a flat weights file: the tensors can
+// be written to, without changing the file. Unmapped when destroyed.
+class MappedFlatWeights {
+ public:
+  explicit MappedFlatWeights(const string& filename);
+  ~MappedFlatWeights();
+
+  const FlatWeightsIndex& index() const { return index_; }
+  void* data(int tensor) const;
+  // Size of the data of the tensor in bytes.
+  size_t size(int tensor) const;
+
+ private:
+  string filename_;
+  char* addr_;
+  size_t length_;
+  FlatWeightsIndex index_;
+
+  DISABLE_COPY_AND_ASSIGN(MappedFlatWeights);
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_FLAT_WEIGHTS_H_
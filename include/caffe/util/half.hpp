@@ -0,0 +1,162 @@
+#ifndef CAFFE_UTIL_HALF_HPP_
+#define CAFFE_UTIL_HALF_HPP_
+
+#include <stdint.h>
+#include <cmath>
+#include <cstring>
+
+#include "caffe/proto/caffe.pb.h"
+
+namespace caffe {
+
+// Half-width storage formats, converted from and to float with rounding to
+// nearest even:
+//  - bfloat16: the upper 16 bits of a float, same range with 8 bits of
+//    mantissa precision,
+//  - fp16 (IEEE binary16): 11 bits of precision, finite up to 65504.
+
+namespace half_detail {
+
+union FloatBits {
+  float f;
+  uint32_t u;
+};
+
+}  // namespace half_detail
+
+inline uint16_t float_to_bf16(float value) {
+  half_detail::FloatBits bits;
+  bits.f = value;
+  if ((bits.u & 0x7FFFFFFF) > 0x7F800000) {
+    // NaN, kept quiet
+    return static_cast<uint16_t>((bits.u >> 16) | 0x40);
+  }
+  bits.u += 0x7FFF + ((bits.u >> 16) & 1);
+  return static_cast<uint16_t>(bits.u >> 16);
+}
+
+inline float bf16_to_float(uint16_t value) {
+  half_detail::FloatBits bits;
+  bits.u = static_cast<uint32_t>(value) << 16;
+  return bits.f;
+}
+
+inline uint16_t float_to_fp16(float value) {
+  half_detail::FloatBits bits;
+  bits.f = value;
+  const uint16_t sign = static_cast<uint16_t>((bits.u >> 16) & 0x8000);
+  bits.u &= 0x7FFFFFFF;
+  if (bits.u >= 0x7F800000) {
+    // infinity or NaN
+    return sign | 0x7C00 | (bits.u > 0x7F800000 ? 0x200 : 0);
+  }
+  if (bits.u >= 0x477FF000) {
+    // rounds to above 65504
+    return sign | 0x7C00;
+  }
+  if (bits.u < 0x38800000) {
+    // below 2^-14: subnormal, in units of 2^-24
+    return sign | static_cast<uint16_t>(nearbyintf(bits.f * 16777216.f));
+  }
+  // rebias the exponent from 127 to 15, rounding the dropped 13 bits
+  bits.u += 0xC8000FFF + ((bits.u >> 13) & 1);
+  return sign | static_cast<uint16_t>(bits.u >> 13);
+}
+
+inline float fp16_to_float(uint16_t value) {
+  half_detail::FloatBits bits;
+  const uint32_t sign = static_cast<uint32_t>(value & 0x8000) << 16;
+  const uint32_t exponent = (value >> 10) & 0x1F;
+  const uint32_t mantissa = value & 0x3FF;
+  if (exponent == 0) {
+    bits.f = mantissa / 16777216.f;
+    bits.u |= sign;
+  } else if (exponent == 0x1F) {
+    bits.u = sign | 0x7F800000 | (mantissa << 13);
+  } else {
+    bits.u = sign | ((exponent + 112) << 23) | (mantissa << 13);
+  }
+  return bits.f;
+}
+
+template <typename Dtype>
+void caffe_cpu_to_bf16(int n, const Dtype* x, uint16_t* y);
+
+template <typename Dtype>
+void caffe_cpu_from_bf16(int n, const uint16_t* x, Dtype* y);
+
+template <typename Dtype>
+void caffe_cpu_to_fp16(int n, const Dtype* x, uint16_t* y);
+
+template <typename Dtype>
+void caffe_cpu_from_fp16(int n, const uint16_t* x, Dtype* y);
+
+// Whole blobs: y (x) holds Dtype values for STORAGE_DTYPE, else uint16_t.
+template <typename Dtype>
+void caffe_cpu_to_storage(Storage storage, int n, const Dtype* x, void* y);
+
+template <typename Dtype>
+void caffe_cpu_from_storage(Storage storage, int n, const void* x, Dtype* y);
+
+// Layer kernels convert half-width data (see Blob::cpu_storage_data) a chunk
+// of at most kStorageChunk values at a time, which they compute in Dtype.
+const int kStorageChunk = 1024;
+
+// The n values at offset of data as Dtype: the data itself for
+// STORAGE_DTYPE, else buffer after expanding them into it.
+template <typename Dtype>
+inline const Dtype* caffe_storage_load(Storage storage, const void* data,
+    int offset, int n, Dtype* buffer) {
+  const uint16_t* x = static_cast<const uint16_t*>(data) + offset;
+  switch (storage) {
+  case STORAGE_BF16:
+    for (int i = 0; i < n; ++i) {
+      buffer[i] = bf16_to_float(x[i]);
+    }
+    return buffer;
+  case STORAGE_FP16:
+    for (int i = 0; i < n; ++i) {
+      buffer[i] = fp16_to_float(x[i]);
+    }
+    return buffer;
+  default:
+    return static_cast<const Dtype*>(data) + offset;
+  }
+}
+
+// Where to compute the values at offset of data: the data itself for
+// STORAGE_DTYPE, else buffer, which caffe_storage_store then narrows.
+template <typename Dtype>
+inline Dtype* caffe_storage_target(Storage storage, void* data, int offset,
+    Dtype* buffer) {
+  return storage == STORAGE_DTYPE ?
+      static_cast<Dtype*>(data) + offset : buffer;
+}
+
+template <typename Dtype>
+inline void caffe_storage_store(Storage storage, const Dtype* values,
+    int offset, int n, void* data) {
+  uint16_t* y = static_cast<uint16_t*>(data) + offset;
+  switch (storage) {
+  case STORAGE_BF16:
+    for (int i = 0; i < n; ++i) {
+      y[i] = float_to_bf16(static_cast<float>(values[i]));
+    }
+    break;
+  case STORAGE_FP16:
+    for (int i = 0; i < n; ++i) {
+      y[i] = float_to_fp16(static_cast<float>(values[i]));
+    }
+    break;
+  default:
+    if (values != static_cast<Dtype*>(data) + offset) {
+      memcpy(static_cast<Dtype*>(data) + offset, values,  // NOLINT
+          n * sizeof(Dtype));
+    }
+    break;
+  }
+}
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_HALF_HPP_
@@ -0,0 +1,65 @@
+#ifndef CAFFE_UTIL_INT8_HPP_
+#define CAFFE_UTIL_INT8_HPP_
+
+#include <stdint.h>
+#include <vector>
+
+#include "caffe/common.hpp"
+
+namespace caffe {
+
+// Rows of int8 matrices are zero padded to a multiple of this many values,
+// so that the kernels need no remainder loops.
+const int kInt8RowAlignment = 16;
+
+inline int int8_row_size(int cols) {
+  return (cols + kInt8RowAlignment - 1)
+    / kInt8RowAlignment * kInt8RowAlignment;
+}
+
+// Symmetric quantization: y = round(x * scale), clipped to [-127, 127].
+// y has rows of int8_row_size(cols) values; x is rows x cols, or cols x rows
+// if transposed.
+template <typename Dtype>
+void caffe_cpu_quantize(int rows, int cols, bool transposed, const Dtype* x,
+    Dtype scale, int8_t* y);
+
+// C (M x N) = A (M x K) * B (N x K)^T, with int8 rows of int8_row_size(K)
+// values and int32 accumulation. Uses a JIT kernel on CPUs with AVX2.
+void caffe_cpu_gemm_s8(int M, int N, int K, const int8_t* A, const int8_t* B,
+    int32_t* C);
+
+// The weights GEMM of a layer, in int8 (see QuantizationParameter).
+template <typename Dtype>
+class Int8Gemm {
+ public:
+  // Scratch space of one calling thread.
+  struct Buffers {
+    vector<int8_t> input;
+    vector<int32_t> output;
+    vector<Dtype> dequantize;
+  };
+
+  Int8Gemm() : rows_(0), cols_(0) {}
+
+  // Quantizes the weights W (rows x cols, or cols x rows if transposed),
+  // with one scale per row mapping its largest absolute value to 127.
+  void SetWeights(int rows, int cols, bool transposed, const Dtype* weights);
+
+  // output (num_rows x n) = W[row_begin, row_begin + num_rows) * input
+  // (cols x n); or, if transposed, output (n x rows) = input (n x cols) * W^T.
+  // The input is quantized with input_scale.
+  void Forward(int row_begin, int num_rows, int n, bool transposed,
+      const Dtype* input, Dtype input_scale, Dtype* output,
+      Buffers* buffers) const;
+
+ private:
+  int rows_;
+  int cols_;
+  vector<int8_t> weights_;
+  vector<Dtype> scales_;
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_INT8_HPP_
@@ -95,6 +95,9 @@ inline void WriteProtoToBinaryFile(
   WriteProtoToBinaryFile(proto, filename.c_str());
 }
 
+// Flushes a file that has already been written and closed to stable storage.
+void SyncFileToDisk(const string& filename);
+
 bool ReadFileToDatum(const string& filename, const int label, Datum* datum);
 
 inline bool ReadFileToDatum(const string& filename, Datum* datum) {
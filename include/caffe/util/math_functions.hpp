@@ -82,18 +82,40 @@ template <typename Dtype>
 void caffe_rng_gaussian(const int n, const Dtype mu, const Dtype sigma,
                         Dtype* r);
 
+// Draws in parallel from a counter-based stream keyed from caffe_rng(): the
+// values only depend on the seed, not on the number of threads.
 template <typename Dtype>
 void caffe_rng_bernoulli(const int n, const Dtype p, int* r);
 
 template <typename Dtype>
 void caffe_rng_bernoulli(const int n, const Dtype p, unsigned int* r);
 
+// Sets the n bits of r, 32 per word from the lowest, to 1 with probability p;
+// bit i matches element i of caffe_rng_bernoulli from the same seed.
+template <typename Dtype>
+void caffe_rng_bernoulli_bits(const int n, const Dtype p, unsigned int* r);
+
+// Elementwise transcendental functions, parallel over OpenMP threads. With
+// MKL, exp, log and tanh are VML's; otherwise, and for sigmoid and softplus,
+// the float ones are vectorized polynomials within 3 ulp of the exact values
+// and the double ones call libm.
 template <typename Dtype>
 void caffe_exp(const int n, const Dtype* a, Dtype* y);
 
 template <typename Dtype>
 void caffe_log(const int n, const Dtype* a, Dtype* y);
 
+template <typename Dtype>
+void caffe_tanh(const int n, const Dtype* a, Dtype* y);
+
+// 1 / (1 + exp(-a))
+template <typename Dtype>
+void caffe_sigmoid(const int n, const Dtype* a, Dtype* y);
+
+// log(1 + exp(a))
+template <typename Dtype>
+void caffe_softplus(const int n, const Dtype* a, Dtype* y);
+
 template <typename Dtype>
 void caffe_abs(const int n, const Dtype* a, Dtype* y);
 
@@ -0,0 +1,75 @@
+#ifndef CAFFE_UTIL_PERF_COUNTERS_HPP_
+#define CAFFE_UTIL_PERF_COUNTERS_HPP_
+
+#include <vector>
+
+namespace caffe {
+
+/// @brief Counts of hardware events, summed over threads.
+struct PerfSample {
+  PerfSample();
+
+  /// @brief Instructions per cycle.
+  inline double ipc() const {
+    return cycles > 0 ? instructions / cycles : 0;
+  }
+  /// @brief Bytes read from memory, estimated as one 64 byte line per
+  ///        last-level cache miss.
+  inline double memory_bytes() const { return cache_misses * 64; }
+
+  PerfSample& operator+=(const PerfSample& other);
+  PerfSample& operator-=(const PerfSample& other);
+
+  double cycles;
+  double instructions;
+  double cache_references;
+  /// Last-level cache misses.
+  double cache_misses;
+  /// Packed floating point instructions (SSE, AVX, AVX-512); Intel only.
+  double vector_instructions;
+};
+
+/**
+ * @brief Hardware performance counters of the calling thread and of its
+ *        OpenMP threads, opened through perf_event_open.
+ *
+ * The counters only count in user space, which perf_event_paranoid allows up
+ * to 2. When no counter can be opened, e.g. in a virtual machine without a
+ * PMU, available() is false and the samples read stay zero, so that callers
+ * only report times.
+ */
+class PerfCounters {
+ public:
+  PerfCounters();
+  ~PerfCounters();
+
+  inline bool available() const { return !groups_.empty(); }
+  /// @brief Whether packed floating point instructions are counted.
+  inline bool has_vector_instructions() const { return has_vector_; }
+
+  /// @brief Reads the events counted by all the threads since the counters
+  ///        were opened, scaled up for the time they were multiplexed out.
+  void Read(PerfSample* sample) const;
+
+ private:
+  // The counters of one thread: the file of the group leader, of the
+  // other members, and the event each value read from the group counts.
+  struct Group {
+    int leader;
+    std::vector<int> members;
+    std::vector<int> events;
+  };
+
+  bool OpenGroup(int tid, Group* group);
+  void Close();
+
+  std::vector<Group> groups_;
+  bool has_vector_;
+
+  PerfCounters(const PerfCounters&);
+  PerfCounters& operator=(const PerfCounters&);
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_PERF_COUNTERS_HPP_
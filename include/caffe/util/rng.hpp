@@ -1,6 +1,8 @@
 #ifndef CAFFE_RNG_CPP_HPP_
 #define CAFFE_RNG_CPP_HPP_
 
+#include <stdint.h>
+
 #include <algorithm>
 #include <iterator>
 
@@ -17,6 +19,37 @@ inline rng_t* caffe_rng() {
   return static_cast<caffe::rng_t*>(Caffe::rng_stream().generator());
 }
 
+/**
+ * @brief The Philox4x32-10 counter-based generator (Salmon et al., "Parallel
+ *        random numbers: as easy as 1, 2, 3", 2011): the four random words of
+ *        a counter under a key.
+ *
+ * Any block of a stream is computed without the ones before it, so threads
+ * fill parts of an array with the same numbers whatever their count.
+ */
+inline void philox4x32(const uint32_t counter[4], const uint32_t key[2],
+    uint32_t out[4]) {
+  uint32_t c0 = counter[0], c1 = counter[1], c2 = counter[2],
+      c3 = counter[3];
+  uint32_t k0 = key[0], k1 = key[1];
+  for (int round = 0; round < 10; ++round) {
+    const uint64_t p0 = static_cast<uint64_t>(0xD2511F53) * c0;
+    const uint64_t p1 = static_cast<uint64_t>(0xCD9E8D57) * c2;
+    const uint32_t hi0 = p0 >> 32, lo0 = static_cast<uint32_t>(p0);
+    const uint32_t hi1 = p1 >> 32, lo1 = static_cast<uint32_t>(p1);
+    c0 = hi1 ^ c1 ^ k0;
+    c1 = lo1;
+    c2 = hi0 ^ c3 ^ k1;
+    c3 = lo0;
+    k0 += 0x9E3779B9;
+    k1 += 0xBB67AE85;
+  }
+  out[0] = c0;
+  out[1] = c1;
+  out[2] = c2;
+  out[3] = c3;
+}
+
 // Fisher–Yates algorithm
 template <class RandomAccessIterator, class RandomGenerator>
 inline void shuffle(RandomAccessIterator begin, RandomAccessIterator end,
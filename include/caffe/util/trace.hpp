@@ -0,0 +1,92 @@
+#ifndef CAFFE_UTIL_TRACE_HPP_
+#define CAFFE_UTIL_TRACE_HPP_
+
+#include <stdint.h>
+
+#include <iosfwd>
+#include <string>
+
+namespace caffe {
+
+/**
+ * @brief Records timed spans of the threads of the process, to be viewed in
+ *        chrome://tracing or Perfetto.
+ *
+ * Each thread records its spans into a ring buffer of its own, keeping its
+ * most recent ones; nothing is shared between the threads but the lock of
+ * each buffer, only contended while dumping. Once enabled, the spans are
+ * written as Chrome trace-event JSON when the process receives SIGUSR1 and
+ * when it exits. While disabled, a span costs the test of a flag.
+ */
+class Tracer {
+ public:
+  /// @brief Starts recording, keeping the last events_per_thread spans of
+  ///        each thread. "%p" in the file name is replaced by the process id;
+  ///        with an empty file name the spans are only written by Dump(stream).
+  static void Enable(const std::string& filename, int events_per_thread);
+  /// @brief Stops recording; the recorded spans are kept.
+  static void Disable();
+  static inline bool enabled() { return enabled_; }
+
+  /// @brief Microseconds of the monotonic clock.
+  static uint64_t Now();
+  /// @brief Records a span of the calling thread, named "name" or
+  ///        "name detail".
+  static void Record(const char* category, const char* name,
+      const char* detail, uint64_t begin, uint64_t end);
+
+  /// @brief Writes the recorded spans to the file given to Enable.
+  static void Dump();
+  static void Dump(std::ostream* stream);
+  /// @brief Forgets the recorded spans of all the threads.
+  static void Clear();
+
+ private:
+  static volatile bool enabled_;
+};
+
+/**
+ * @brief Records the time from its construction to its destruction as a span
+ *        of the calling thread, if the Tracer is enabled.
+ *
+ * The strings are copied when the span ends; the category must be a literal.
+ */
+class TraceSpan {
+ public:
+  inline TraceSpan(const char* category, const char* name,
+      const char* detail = NULL) : category_(NULL) {
+    if (Tracer::enabled()) {
+      category_ = category;
+      name_ = name;
+      detail_ = detail;
+      begin_ = Tracer::Now();
+    }
+  }
+  inline TraceSpan(const char* category, const std::string& name)
+      : category_(NULL) {
+    if (Tracer::enabled()) {
+      category_ = category;
+      name_ = name.c_str();
+      detail_ = NULL;
+      begin_ = Tracer::Now();
+    }
+  }
+  inline ~TraceSpan() {
+    if (category_) {
+      Tracer::Record(category_, name_, detail_, begin_, Tracer::Now());
+    }
+  }
+
+ private:
+  const char* category_;
+  const char* name_;
+  const char* detail_;
+  uint64_t begin_;
+
+  TraceSpan(const TraceSpan&);
+  TraceSpan& operator=(const TraceSpan&);
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_TRACE_HPP_
@@ -3,6 +3,7 @@
 #include <vector>
 #include "caffe/internode/tree_cluster.hpp"
 #include "caffe/MultiSolver.hpp"
+#include "caffe/util/trace.hpp"
 
 namespace caffe {
 
@@ -75,6 +76,7 @@ Dtype MultiSolver<Dtype>::ForwardBackwardImpl(bool first, bool last) {
   Net<Dtype>& net = *root_solver_->net();
   for (int i = 0; i < net.layers().size(); ++i) {
     if (first) {
+      TraceSpan span("callback", "on_start", net.layer_names()[i].c_str());
       for (int j = 0; j < callbacks_.size(); ++j) {
         callbacks_[j]->on_start(i);
       }
@@ -84,6 +86,8 @@ Dtype MultiSolver<Dtype>::ForwardBackwardImpl(bool first, bool last) {
       loss += worker_solvers[j]->net()->ForwardFromTo(i, i);
     }
     if (last) {
+      TraceSpan span("callback", "on_forward_finished",
+          net.layer_names()[i].c_str());
       for (int j = 0; j < callbacks_.size(); ++j) {
         callbacks_[j]->on_forward_finished(i);
       }
@@ -92,6 +96,8 @@ Dtype MultiSolver<Dtype>::ForwardBackwardImpl(bool first, bool last) {
 
   for (int i = net.layers().size() - 1; i >= 0; --i) {
     if (first) {
+      TraceSpan span("callback", "on_backward_start",
+          net.layer_names()[i].c_str());
       for (int j = 0; j < callbacks_.size(); ++j) {
         callbacks_[j]->on_backward_start(i);
       }
@@ -100,6 +106,8 @@ Dtype MultiSolver<Dtype>::ForwardBackwardImpl(bool first, bool last) {
       worker_solvers[j]->net()->BackwardFromTo(i, i);
     }
     if (last) {
+      TraceSpan span("callback", "on_gradients_ready",
+          net.layer_names()[i].c_str());
       for (int j = 0; j < callbacks_.size(); ++j) {
         callbacks_[j]->on_gradients_ready(i);
       }
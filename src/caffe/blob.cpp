@@ -4,10 +4,40 @@
 #include "caffe/blob.hpp"
 #include "caffe/common.hpp"
 #include "caffe/syncedmem.hpp"
+#include "caffe/util/half.hpp"
 #include "caffe/util/math_functions.hpp"
 
 namespace caffe {
 
+// The half-width copy of the data of a blob, tagged with its format.
+class BlobHalfMemDescr : public HalfMemDescr {
+ public:
+  explicit BlobHalfMemDescr(Storage storage) : storage_(storage) {}
+  Storage storage() const { return storage_; }
+
+ private:
+  Storage storage_;
+};
+
+template <typename Dtype>
+class BlobHalfConverter : public BlobHalfMemDescr {
+ public:
+  BlobHalfConverter(Storage storage, int count)
+      : BlobHalfMemDescr(storage), count_(count) {}
+  virtual size_t half_size() { return count_ * sizeof(uint16_t); }
+  virtual void convert_to_half(const void* cpu_ptr, void* half_ptr) {
+    caffe_cpu_to_storage(storage(), count_,
+        static_cast<const Dtype*>(cpu_ptr), half_ptr);
+  }
+  virtual void convert_from_half(const void* half_ptr, void* cpu_ptr) {
+    caffe_cpu_from_storage(storage(), count_, half_ptr,
+        static_cast<Dtype*>(cpu_ptr));
+  }
+
+ private:
+  int count_;
+};
+
 template <typename Dtype>
 void Blob<Dtype>::Reshape(const int num, const int channels, const int height,
     const int width) {
@@ -36,9 +66,13 @@ void Blob<Dtype>::Reshape(const vector<int>& shape) {
     shape_data[i] = shape[i];
   }
   if (count_ > capacity_) {
+    const Storage storage = this->storage();
     capacity_ = count_;
     data_.reset(new SyncedMemory(capacity_ * sizeof(Dtype)));
     diff_.reset(new SyncedMemory(capacity_ * sizeof(Dtype)));
+    if (storage != STORAGE_DTYPE) {
+      set_storage(storage);
+    }
   }
 }
 
@@ -90,6 +124,50 @@ void Blob<Dtype>::set_cpu_data(Dtype* data) {
   data_->set_cpu_data(data);
 }
 
+template <> void Blob<unsigned int>::set_storage(Storage storage) {
+  NOT_IMPLEMENTED;
+}
+
+template <> void Blob<int>::set_storage(Storage storage) {
+  NOT_IMPLEMENTED;
+}
+
+template <> void Blob<size_t>::set_storage(Storage storage) {
+  NOT_IMPLEMENTED;
+}
+
+template <typename Dtype>
+void Blob<Dtype>::set_storage(Storage storage) {
+  if (!data_) {
+    return;
+  }
+  data_->set_half_descriptor(storage == STORAGE_DTYPE ?
+      shared_ptr<HalfMemDescr>() : shared_ptr<HalfMemDescr>(
+      new BlobHalfConverter<Dtype>(storage, capacity_)));
+}
+
+template <typename Dtype>
+Storage Blob<Dtype>::storage() const {
+  if (!data_ || !data_->half_descriptor()) {
+    return STORAGE_DTYPE;
+  }
+  return static_cast<const BlobHalfMemDescr*>(
+      data_->half_descriptor().get())->storage();
+}
+
+template <typename Dtype>
+const void* Blob<Dtype>::cpu_storage_data() const {
+  CHECK(data_);
+  return data_->half_descriptor() ? data_->half_data() : data_->cpu_data();
+}
+
+template <typename Dtype>
+void* Blob<Dtype>::mutable_cpu_storage_data() {
+  CHECK(data_);
+  return data_->half_descriptor() ?
+      data_->mutable_half_data() : data_->mutable_cpu_data();
+}
+
 template <typename Dtype>
 const Dtype* Blob<Dtype>::gpu_data() const {
   CHECK(data_);
@@ -227,6 +305,8 @@ void Blob<Dtype>::Update() {
           static_cast<Dtype*>(data_->mutable_prv_data()));
       break;
     }
+  case SyncedMemory::HEAD_AT_HALF:
+  case SyncedMemory::SYNCED_HALF:
   case SyncedMemory::HEAD_AT_CPU:
     // perform computation on CPU
     caffe_axpy<Dtype>(count_, Dtype(-1),
@@ -264,6 +344,8 @@ Dtype Blob<Dtype>::asum_data() const {
   if (!data_) { return 0; }
   switch (data_->head()) {
   case SyncedMemory::HEAD_AT_CPU:
+  case SyncedMemory::HEAD_AT_HALF:
+  case SyncedMemory::SYNCED_HALF:
     return caffe_cpu_asum(count_, cpu_data());
   case SyncedMemory::HEAD_AT_GPU:
   case SyncedMemory::SYNCED:
@@ -336,6 +418,8 @@ Dtype Blob<Dtype>::sumsq_data() const {
   if (!data_) { return 0; }
   switch (data_->head()) {
   case SyncedMemory::HEAD_AT_CPU:
+  case SyncedMemory::HEAD_AT_HALF:
+  case SyncedMemory::SYNCED_HALF:
     data = cpu_data();
     sumsq = caffe_cpu_dot(count_, data, data);
     break;
@@ -407,6 +491,8 @@ void Blob<Dtype>::scale_data(Dtype scale_factor) {
   if (!data_) { return; }
   switch (data_->head()) {
   case SyncedMemory::HEAD_AT_CPU:
+  case SyncedMemory::HEAD_AT_HALF:
+  case SyncedMemory::SYNCED_HALF:
     data = mutable_cpu_data();
     caffe_scal(count_, scale_factor, data);
     return;
@@ -0,0 +1,75 @@
+#include <string>
+#include <vector>
+
+#include "caffe/inference.hpp"
+#include "caffe/util/upgrade_proto.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+InferenceModel<Dtype>::InferenceModel(const string& param_file,
+    const string& weights_file) {
+  NetParameter param;
+  ReadNetParamsFromTextFileOrDie(param_file, &param);
+  Init(param, weights_file);
+}
+
+template <typename Dtype>
+InferenceModel<Dtype>::InferenceModel(const NetParameter& param) {
+  Init(param, "");
+}
+
+template <typename Dtype>
+void InferenceModel<Dtype>::Init(const NetParameter& param,
+    const string& weights_file) {
+  param_.CopyFrom(param);
+  param_.mutable_state()->set_phase(TEST);
+  for (int i = 0; i < param_.layer_size(); ++i) {
+    LayerParameter* layer_param = param_.mutable_layer(i);
+    if (layer_param->type() != "Convolution") {
+      continue;
+    }
+    ConvolutionParameter* conv_param =
+        layer_param->mutable_convolution_param();
+#ifdef USE_MKL2017_AS_DEFAULT_ENGINE
+    const bool default_mkl2017 =
+        conv_param->engine() == ConvolutionParameter_Engine_DEFAULT;
+#else
+    const bool default_mkl2017 = false;
+#endif
+    if (conv_param->engine() == ConvolutionParameter_Engine_MKL2017 ||
+        default_mkl2017) {
+      LOG(WARNING) << "Using the CAFFE engine for layer "
+          << layer_param->name() << ", whose weights are shared by sessions";
+      conv_param->set_engine(ConvolutionParameter_Engine_CAFFE);
+    }
+  }
+  net_.reset(new Net<Dtype>(param_));
+  if (!weights_file.empty()) {
+    net_->CopyTrainedLayersFrom(weights_file);
+  }
+  // Sessions read the weights concurrently: move their memory to the state
+  // in which reading it no longer changes it.
+  const vector<shared_ptr<Blob<Dtype> > >& params = net_->params();
+  for (int i = 0; i < params.size(); ++i) {
+    params[i]->cpu_data();
+    if (Caffe::mode() == Caffe::GPU) {
+      params[i]->gpu_data();
+    }
+  }
+  // The weights are not needed in the layer definitions of the sessions.
+  for (int i = 0; i < param_.layer_size(); ++i) {
+    param_.mutable_layer(i)->clear_blobs();
+  }
+}
+
+template <typename Dtype>
+shared_ptr<Net<Dtype> > InferenceModel<Dtype>::NewSession() const {
+  shared_ptr<Net<Dtype> > session(new Net<Dtype>(param_));
+  session->ShareTrainedLayersWith(net_.get());
+  return session;
+}
+
+INSTANTIATE_CLASS(InferenceModel);
+
+}  // namespace caffe
@@ -8,6 +8,7 @@
 #include "caffe/internode/communication.hpp"
 #include "caffe/internode/configuration.hpp"
 #include "caffe/internode/mpi_configuration.hpp"
+#include "caffe/internode/shm_configuration.hpp"
 #include "caffe/internode/tcp_configuration.hpp"
 #include "caffe/internode/udp_configuration.hpp"
 
@@ -68,7 +69,7 @@ boost::shared_ptr<Daemon> create_communication_daemon() {
 
 struct Protocol {
   enum Type {
-    NONE, UDP, TCP, MPI
+    NONE, UDP, TCP, MPI, SHM
   };
 };
 
@@ -97,12 +98,15 @@ AddressInfo extract(string address) {
   static const string tcp_prefix = "tcp" + separator;
   static const string udp_prefix = "udp" + separator;
   static const string mpi_prefix = "mpi" + separator;
+  static const string shm_prefix = "shm" + separator;
   size_t tcp_protocol_pos = address.find(tcp_prefix);
   size_t udp_protocol_pos = address.find(udp_prefix);
   size_t mpi_protocol_pos = address.find(mpi_prefix);
+  size_t shm_protocol_pos = address.find(shm_prefix);
   if ((tcp_protocol_pos != 0)
       && (udp_protocol_pos != 0)
-      && (mpi_protocol_pos != 0)) {
+      && (mpi_protocol_pos != 0)
+      && (shm_protocol_pos != 0)) {
     return AddressInfo(Protocol::NONE);
   }
 
@@ -118,6 +122,9 @@ AddressInfo extract(string address) {
   if (mpi_protocol_pos == 0) {
     return AddressInfo(Protocol::MPI, address.substr(ip_pos));
   }
+  if (shm_protocol_pos == 0) {
+    return AddressInfo(Protocol::SHM, address.substr(ip_pos));
+  }
 if(group_ip_pos == std::string::npos) {
     string ip = address.substr(ip_pos, port_pos - ip_pos);
     string port = address.substr(port_pos + 1);
@@ -150,10 +157,13 @@ boost::shared_ptr<MultiWaypoint> configure_server(
     case Protocol::MPI:
       return configure_mpi_server(
         communication_daemon, info.ip, max_buffer_size);
+    case Protocol::SHM:
+      return configure_shm_server(
+        communication_daemon, info.ip, max_buffer_size);
     default:
       LOG(ERROR) << "unrecognized address: " << address
         << ", expected format is: `tcp://*:80` or `udp://*:777` "
-        << "or `mpi://server_name`";
+        << "or `mpi://server_name` or `shm://segment_name`";
       throw std::runtime_error("invalid address");
   }
 }
@@ -176,10 +186,13 @@ boost::shared_ptr<Waypoint> configure_client(
     case Protocol::MPI:
       return configure_mpi_client(
               communication_daemon, info.ip, max_buffer_size);
+    case Protocol::SHM:
+      return configure_shm_client(
+              communication_daemon, info.ip, max_buffer_size);
     default:
       LOG(ERROR) << "unrecognized address: " << address
         << ", expected format is: `tcp://*:80` or `udp://*:777` "
-        << "or `mpi://server_name`";
+        << "or `mpi://server_name` or `shm://segment_name`";
       throw std::runtime_error("invalid address");
   }
 }
@@ -1,7 +1,9 @@
 #include <glog/logging.h>
 #include <stdlib.h>
+#include <string.h>
 #include <stdexcept>
 #include <string>
+#include <vector>
 #include "caffe/internode/mpiutil.hpp"
 #ifdef USE_MPI
 #include <mpi.h>
@@ -66,6 +68,33 @@ std::string mpi_get_current_proc_name() {
 #endif
 }
 
+/**
+ * Returns processor names of all processes indexed by rank.
+ * Collective over MPI_COMM_WORLD communicator.
+ */
+std::vector<std::string> mpi_get_all_proc_names() {
+#ifdef USE_MPI
+  int size = mpi_get_comm_size();
+  std::string name = mpi_get_current_proc_name();
+  name.resize(MPI_MAX_PROCESSOR_NAME, '\0');
+  std::vector<char> all(size * MPI_MAX_PROCESSOR_NAME);
+
+  MPI_Allgather(&name[0], MPI_MAX_PROCESSOR_NAME, MPI_CHAR,
+                &all.front(), MPI_MAX_PROCESSOR_NAME, MPI_CHAR,
+                MPI_COMM_WORLD);
+
+  std::vector<std::string> names(size);
+  for (int i = 0; i < size; ++i) {
+    const char* begin = &all[i * MPI_MAX_PROCESSOR_NAME];
+    names[i] = std::string(begin, strnlen(begin, MPI_MAX_PROCESSOR_NAME));
+  }
+  return names;
+#else
+  throw std::runtime_error("can't use mpi");
+  return std::vector<std::string>();
+#endif
+}
+
 /**
  * Return a string for a given error code.
  */
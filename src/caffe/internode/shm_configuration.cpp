@@ -0,0 +1,777 @@
+#ifdef __linux__
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+#include <boost/asio.hpp>
+#include <boost/bind.hpp>
+#include <boost/enable_shared_from_this.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/make_shared.hpp>
+#include <boost/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/recursive_mutex.hpp>
+#include <boost/unordered_map.hpp>
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <deque>
+#include <string>
+#include <vector>
+#include "caffe/internode/broadcast_callback.hpp"
+#include "caffe/internode/communication.hpp"
+#include "caffe/internode/configuration.hpp"
+#include "caffe/internode/shm_configuration.hpp"
+
+#define shm_max_clients 64
+#define shm_min_ring_size (1lu << 20)
+#define shm_max_ring_size (64lu << 20)
+#define shm_poll_time_ms 100
+#define shm_connect_time_ms 10000
+
+namespace caffe {
+namespace internode {
+
+extern boost::asio::io_service& get_io_service(boost::shared_ptr<Daemon>);
+
+#ifdef __linux__
+namespace {
+
+typedef uint64_t MsgSize;
+typedef boost::function<bool()> AliveCheck;
+
+const uint32_t shm_magic = 0xCAFFE5A1;
+
+struct SlotState {
+  enum Type {
+    FREE = 0, CLAIMED, READY, ACCEPTED, CLOSED
+  };
+};
+
+// One direction of a connection. `head` and `tail` count bytes ever written
+// and read, the position in `data` is the counter modulo the capacity.
+// The *_seq words are futexes bumped on every publish, the *_sleeping flags
+// let the other side skip the wake syscall when nobody waits.
+struct RingHeader {
+  volatile uint64_t head;
+  volatile uint64_t tail;
+  volatile uint32_t data_seq;
+  volatile uint32_t space_seq;
+  volatile uint32_t reader_sleeping;
+  volatile uint32_t writer_sleeping;
+  char padding[32];
+};
+
+// Beginning of the segment created by a client for its connection,
+// followed by the data of both rings.
+struct ConnectionHeader {
+  uint64_t capacity;
+  char padding[56];
+  RingHeader to_server;
+  RingHeader to_client;
+};
+
+struct SlotHeader {
+  volatile uint32_t state;
+  volatile uint32_t generation;
+  volatile int32_t client_pid;
+  char padding[52];
+};
+
+// Segment created by the server, clients claim slots in it.
+struct ServerHeader {
+  uint32_t magic;
+  volatile int32_t server_pid;
+  volatile uint32_t accept_seq;
+  char padding[52];
+  SlotHeader slots[shm_max_clients];  // NOLINT(runtime/arrays)
+};
+
+void futex_wait(volatile uint32_t* addr, uint32_t expected) {
+  timespec timeout;
+  timeout.tv_sec = 0;
+  timeout.tv_nsec = shm_poll_time_ms * 1000000l;
+  syscall(SYS_futex, addr, FUTEX_WAIT, expected, &timeout, NULL, 0);
+}
+
+void futex_wake(volatile uint32_t* addr) {
+  syscall(SYS_futex, addr, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+}
+
+void notify(volatile uint32_t* seq) {
+  __sync_fetch_and_add(seq, 1);
+  futex_wake(seq);
+}
+
+// The pid is cleared before the slot can be claimed again, so that a new
+// client is never taken for the dead one before it has set its own.
+void free_slot(SlotHeader* slot) {
+  slot->client_pid = 0;
+  __sync_synchronize();
+  slot->state = SlotState::FREE;
+}
+
+bool process_alive(int32_t pid) {
+  if (pid <= 0) return false;
+  return (kill(pid, 0) == 0) || (errno == EPERM);
+}
+
+string segment_name(string name) {
+  return "/caffe_shm_" + name;
+}
+
+string connection_name(string name, int slot) {
+  return segment_name(name) + "." + boost::lexical_cast<string>(slot);
+}
+
+uint64_t ring_capacity(size_t max_buffer_size) {
+  uint64_t wanted = std::min<uint64_t>(max_buffer_size, shm_max_ring_size)
+    + sizeof(MsgSize);
+  uint64_t capacity = shm_min_ring_size;
+  while ((capacity < wanted) && (capacity < shm_max_ring_size)) capacity <<= 1;
+  return capacity;
+}
+
+size_t connection_size(uint64_t capacity) {
+  return sizeof(ConnectionHeader) + 2 * capacity;
+}
+
+class Mapping {
+  const string name_;
+  const bool unlink_on_close;
+  void* addr;
+  size_t size_;
+
+ public:
+  Mapping(string name, size_t size, bool create, bool unlink_on_close)
+    : name_(name)
+    , unlink_on_close(unlink_on_close)
+    , addr(MAP_FAILED)
+    , size_(size) {
+    if (create && (shm_unlink(name.c_str()) == 0)) {
+      LOG(WARNING) << "removed stale shared memory segment " << name;
+    }
+    int fd = shm_open(name.c_str(), O_RDWR | (create ? O_CREAT | O_EXCL : 0),
+                      S_IRUSR | S_IWUSR);
+    if (fd < 0) {
+      throw std::runtime_error(
+        "shm_open failed for " + name + ": " + strerror(errno));
+    }
+    struct stat st;
+    if (create && (ftruncate(fd, size) != 0)) {
+      close(fd);
+      shm_unlink(name.c_str());
+      throw std::runtime_error("ftruncate failed for " + name);
+    }
+    if (!create && (fstat(fd, &st) == 0)) size_ = st.st_size;
+    addr = mmap(NULL, size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED) {
+      if (create) shm_unlink(name.c_str());
+      throw std::runtime_error("mmap failed for " + name);
+    }
+  }
+
+  ~Mapping() {
+    munmap(addr, size_);
+    if (unlink_on_close) shm_unlink(name_.c_str());
+  }
+
+  char* data() const { return reinterpret_cast<char*>(addr); }
+  size_t size() const { return size_; }
+};
+
+class Ring {
+  RingHeader* header;
+  char* data;
+  uint64_t capacity;
+  MsgSize pending;
+
+  void copy_in(uint64_t pos, const char* src, uint64_t size) {
+    uint64_t offset = pos & (capacity - 1);
+    uint64_t first = std::min(size, capacity - offset);
+    memcpy(data + offset, src, first);  // NOLINT(caffe/alt_fn)
+    memcpy(data, src + first, size - first);  // NOLINT(caffe/alt_fn)
+  }
+
+  void copy_out(uint64_t pos, char* dst, uint64_t size) const {
+    uint64_t offset = pos & (capacity - 1);
+    uint64_t first = std::min(size, capacity - offset);
+    memcpy(dst, data + offset, first);  // NOLINT(caffe/alt_fn)
+    memcpy(dst + first, data, size - first);  // NOLINT(caffe/alt_fn)
+  }
+
+  static uint64_t footprint(MsgSize size) {
+    return sizeof(MsgSize)
+      + ((size + sizeof(MsgSize) - 1) & ~(sizeof(MsgSize) - 1));
+  }
+
+  uint64_t used() const {
+    return header->head - header->tail;
+  }
+
+ public:
+  Ring(RingHeader* header, char* data, uint64_t capacity)
+    : header(header)
+    , data(data)
+    , capacity(capacity)
+    , pending(0) {
+  }
+
+  size_t max_packet_size() const {
+    return capacity - sizeof(MsgSize);
+  }
+
+  // single producer, callers serialize
+  bool write(const char* buffer, MsgSize size, AliveCheck alive) {
+    const uint64_t needed = footprint(size);
+    if (needed > capacity) return false;
+    while (true) {
+      uint32_t seq = header->space_seq;
+      __sync_synchronize();
+      if (capacity - used() >= needed) break;
+      if (!alive()) return false;
+      header->writer_sleeping = 1;
+      __sync_synchronize();
+      if (capacity - used() < needed) futex_wait(&header->space_seq, seq);
+      header->writer_sleeping = 0;
+    }
+    uint64_t head = header->head;
+    copy_in(head, reinterpret_cast<const char*>(&size), sizeof(size));
+    copy_in(head + sizeof(MsgSize), buffer, size);
+    __sync_synchronize();
+    header->head = head + needed;
+    __sync_fetch_and_add(&header->data_seq, 1);
+    if (header->reader_sleeping) futex_wake(&header->data_seq);
+    return true;
+  }
+
+  // Waits for the next message and points `msg` at it. The message stays
+  // in place until consume(), unless it wraps around the end of the ring,
+  // in which case it is assembled in `scratch`.
+  bool peek(char** msg, MsgSize* size, std::vector<char>* scratch,
+            AliveCheck alive) {
+    while (true) {
+      uint32_t seq = header->data_seq;
+      __sync_synchronize();
+      if (used() > 0) break;
+      if (!alive()) return false;
+      header->reader_sleeping = 1;
+      __sync_synchronize();
+      if (used() == 0) futex_wait(&header->data_seq, seq);
+      header->reader_sleeping = 0;
+    }
+    __sync_synchronize();
+    uint64_t tail = header->tail;
+    copy_out(tail, reinterpret_cast<char*>(&pending), sizeof(pending));
+    *size = pending;
+    uint64_t offset = (tail + sizeof(MsgSize)) & (capacity - 1);
+    if (offset + pending <= capacity) {
+      *msg = data + offset;
+    } else {
+      scratch->resize(pending);
+      copy_out(tail + sizeof(MsgSize), &scratch->front(), pending);
+      *msg = &scratch->front();
+    }
+    return true;
+  }
+
+  void consume() {
+    __sync_synchronize();
+    header->tail = header->tail + footprint(pending);
+    __sync_fetch_and_add(&header->space_seq, 1);
+    if (header->writer_sleeping) futex_wake(&header->space_seq);
+  }
+
+  void wake_reader() {
+    notify(&header->data_seq);
+  }
+};
+
+class ShmConnection : public Waypoint
+                    , public boost::enable_shared_from_this<ShmConnection> {
+  boost::shared_ptr<Daemon> daemon;
+  // receiving happens off the daemon, keep it from running out of work
+  boost::asio::io_service::work work;
+  boost::shared_ptr<Mapping> server_mapping;
+  boost::shared_ptr<Mapping> mapping;
+  ServerHeader* server;
+  SlotHeader* slot;
+  const uint32_t generation;
+  const bool server_side;
+  const string address_;
+  Ring rx;
+  Ring tx;
+  AliveCheck alive_check;
+
+  std::vector<Handler*> handlers;
+  boost::recursive_mutex mtx;
+
+  // Writes block while the peer's ring is full and the peer drains it on
+  // its daemon thread, so they are queued and done by a thread of their own.
+  struct SendItem {
+    const char* buffer;
+    size_t size;
+    SentCallback callback;
+  };
+  boost::mutex send_mtx;
+  boost::condition_variable send_ready;
+  std::deque<SendItem> send_queue;
+  boost::thread sender;
+
+  boost::mutex delivery_mtx;
+  boost::condition_variable delivery_done;
+  bool delivered;
+  volatile bool stopped;
+  boost::thread receiver;
+
+  static RingHeader* ring_header(boost::shared_ptr<Mapping> mapping,
+                                 bool to_server) {
+    ConnectionHeader* conn =
+      reinterpret_cast<ConnectionHeader*>(mapping->data());
+    return to_server ? &conn->to_server : &conn->to_client;
+  }
+
+  static char* ring_data(boost::shared_ptr<Mapping> mapping, bool to_server) {
+    ConnectionHeader* conn =
+      reinterpret_cast<ConnectionHeader*>(mapping->data());
+    return mapping->data() + sizeof(ConnectionHeader)
+      + (to_server ? 0 : conn->capacity);
+  }
+
+  static uint64_t capacity(boost::shared_ptr<Mapping> mapping) {
+    return reinterpret_cast<ConnectionHeader*>(mapping->data())->capacity;
+  }
+
+  bool alive() const {
+    if (stopped) return false;
+    if (slot->generation != generation) return false;
+    if (slot->state == SlotState::CLOSED) return false;
+    return process_alive(server_side ? slot->client_pid : server->server_pid);
+  }
+
+  void deliver(char* msg, size_t size, boost::shared_ptr<ShmConnection>) {
+    std::vector<Handler*> current;
+    {
+      boost::recursive_mutex::scoped_lock lock(mtx);
+      current = handlers;
+    }
+    for (int i = 0; i < current.size(); ++i) {
+      current[i]->received(msg, size, this);
+    }
+    boost::mutex::scoped_lock lock(delivery_mtx);
+    delivered = true;
+    delivery_done.notify_all();
+  }
+
+  // Handlers run on the daemon thread like for the other transports, the
+  // message is handed over in place and released after they return.
+  void receive_loop(boost::weak_ptr<ShmConnection> weak_this) {
+    std::vector<char> scratch;
+    char* msg = NULL;
+    MsgSize size = 0;
+    while (rx.peek(&msg, &size, &scratch, alive_check)) {
+      {
+        boost::shared_ptr<ShmConnection> shared_this = weak_this.lock();
+        if (!shared_this) return;
+        boost::mutex::scoped_lock lock(delivery_mtx);
+        delivered = false;
+        get_io_service(daemon).post(
+          boost::bind(&ShmConnection::deliver, this, msg, size, shared_this));
+      }
+      boost::mutex::scoped_lock lock(delivery_mtx);
+      while (!delivered && !stopped) {
+        delivery_done.wait(lock);
+      }
+      if (stopped) return;
+      rx.consume();
+    }
+    DLOG(INFO) << "[" << address() << "] receiver finished";
+  }
+
+  void send_loop() {
+    while (true) {
+      SendItem item;
+      {
+        boost::mutex::scoped_lock lock(send_mtx);
+        while (send_queue.empty() && !stopped) {
+          send_ready.wait(lock);
+        }
+        if (send_queue.empty()) break;
+        item = send_queue.front();
+        send_queue.pop_front();
+      }
+      bool ok = !stopped && tx.write(item.buffer, item.size, alive_check);
+      if (!ok) {
+        LOG(ERROR) << "[" << address() << "] failed to send buffer of size: "
+                   << item.size << " (max packet size: " << max_packet_size()
+                   << ")";
+      }
+      // completion is reported on the daemon thread like the receptions
+      get_io_service(daemon).post(boost::bind(item.callback, ok));
+    }
+    DLOG(INFO) << "[" << address() << "] sender finished";
+  }
+
+ public:
+  ShmConnection(boost::shared_ptr<Daemon> daemon,
+                boost::shared_ptr<Mapping> server_mapping,
+                int slot_id,
+                boost::shared_ptr<Mapping> mapping,
+                bool server_side,
+                string address)
+    : daemon(daemon)
+    , work(get_io_service(daemon))
+    , server_mapping(server_mapping)
+    , mapping(mapping)
+    , server(reinterpret_cast<ServerHeader*>(server_mapping->data()))
+    , slot(&server->slots[slot_id])
+    , generation(slot->generation)
+    , server_side(server_side)
+    , address_(address)
+    , rx(ring_header(mapping, server_side),
+         ring_data(mapping, server_side),
+         capacity(mapping))
+    , tx(ring_header(mapping, !server_side),
+         ring_data(mapping, !server_side),
+         capacity(mapping))
+    , alive_check(boost::bind(&ShmConnection::alive, this))
+    , delivered(false)
+    , stopped(false) {
+  }
+
+  ~ShmConnection() {
+    {
+      boost::mutex::scoped_lock lock(delivery_mtx);
+      stopped = true;
+      delivery_done.notify_all();
+    }
+    {
+      boost::mutex::scoped_lock lock(send_mtx);
+      send_ready.notify_all();
+    }
+    if (!server_side && (slot->generation == generation)) {
+      slot->state = SlotState::CLOSED;
+      notify(&server->accept_seq);
+    }
+    rx.wake_reader();
+    if (receiver.get_id() == boost::this_thread::get_id()) {
+      receiver.detach();
+    } else {
+      receiver.join();
+    }
+    if (sender.get_id() == boost::this_thread::get_id()) {
+      sender.detach();
+    } else {
+      sender.join();
+    }
+    LOG(INFO) << "client " << address() << " destroyed";
+  }
+
+  void start() {
+    receiver = boost::thread(&ShmConnection::receive_loop, this,
+      boost::weak_ptr<ShmConnection>(shared_from_this()));
+    sender = boost::thread(&ShmConnection::send_loop, this);
+  }
+
+  // The buffer has to stay valid until the callback, as for tcp.
+  virtual void async_send(const char* buffer,
+                          size_t size,
+                          SentCallback callback) {
+    DLOG(INFO) << "sending to: " << address() << " buffer of size: " << size;
+    SendItem item = {buffer, size, callback};
+    boost::mutex::scoped_lock lock(send_mtx);
+    send_queue.push_back(item);
+    send_ready.notify_one();
+  }
+
+  virtual void register_receive_handler(Handler* handler) {
+    boost::recursive_mutex::scoped_lock lock(mtx);
+    handlers.push_back(handler);
+  }
+
+  virtual RemoteId id() const {
+    return reinterpret_cast<RemoteId>(this);
+  }
+
+  virtual string address() const {
+    return address_;
+  }
+
+  virtual bool guaranteed_comm() const {
+    return true;
+  }
+
+  virtual size_t max_packet_size() const {
+    return tx.max_packet_size();
+  }
+};
+
+class ShmServer : public MultiWaypoint {
+  typedef boost::shared_ptr<ShmConnection> Client;
+  typedef boost::unordered_map<int, Client> Clients;
+  typedef Clients::iterator ClientIt;
+
+  boost::shared_ptr<Daemon> daemon;
+  boost::asio::io_service::work work;
+  const string name;
+  const size_t max_buffer_size;
+  boost::shared_ptr<Mapping> mapping;
+  ServerHeader* header;
+  Clients clients;
+
+  std::vector<Handler*> accept_handlers;
+  std::vector<Waypoint::Handler*> receive_handlers;
+  boost::recursive_mutex mtx;
+
+  volatile bool stopped;
+  boost::thread acceptor;
+
+  void handle_accept(int slot) {
+    boost::recursive_mutex::scoped_lock lock(mtx);
+    string address = "shm://" + name + "/" + boost::lexical_cast<string>(slot);
+    Client client;
+    try {
+      boost::shared_ptr<Mapping> conn(
+        new Mapping(connection_name(name, slot), 0, false, true));
+      client.reset(new ShmConnection(
+        daemon, mapping, slot, conn, true, address));
+    } catch (std::exception& e) {
+      LOG(ERROR) << "[" << address << "] accept failed: " << e.what();
+      free_slot(&header->slots[slot]);
+      return;
+    }
+    LOG(INFO) << "accepted client from address: " << address
+      << " (pid " << header->slots[slot].client_pid << ")";
+    header->slots[slot].state = SlotState::ACCEPTED;
+    clients[slot] = client;
+    for (int i = 0; i < receive_handlers.size(); ++i) {
+      client->register_receive_handler(receive_handlers[i]);
+    }
+    client->start();
+    for (int i = 0; i < accept_handlers.size(); ++i) {
+      accept_handlers[i]->accepted(client);
+    }
+  }
+
+  void handle_disconnect(int slot) {
+    boost::recursive_mutex::scoped_lock lock(mtx);
+    ClientIt it = clients.find(slot);
+    if (it != clients.end()) {
+      LOG(INFO) << "[" << it->second->address() << "] client disconnected ("
+        << it->second->id() << ")";
+      for (int i = 0; i < accept_handlers.size(); ++i) {
+        accept_handlers[i]->disconnected(it->second->id());
+      }
+      clients.erase(it);
+    }
+    shm_unlink(connection_name(name, slot).c_str());
+    free_slot(&header->slots[slot]);
+    notify(&header->accept_seq);
+  }
+
+  // Watches the slot table and hands state changes over to the daemon.
+  void accept_loop() {
+    std::vector<uint32_t> known(shm_max_clients, SlotState::FREE);
+    while (!stopped) {
+      uint32_t seq = header->accept_seq;
+      __sync_synchronize();
+      for (int i = 0; i < shm_max_clients; ++i) {
+        SlotHeader& slot = header->slots[i];
+        uint32_t state = slot.state;
+        int32_t pid = slot.client_pid;
+        // a slot just claimed has no pid yet
+        bool client_alive = (pid == 0) || process_alive(pid);
+        if ((state == SlotState::CLAIMED) && !client_alive) {
+          // clear the pid first, the slot may be claimed again once free
+          if (__sync_bool_compare_and_swap(&slot.client_pid, pid, 0)) {
+            __sync_bool_compare_and_swap(
+              &slot.state, SlotState::CLAIMED, SlotState::FREE);
+          }
+        } else if ((state == SlotState::READY)
+            && (known[i] == SlotState::FREE)) {
+          known[i] = SlotState::READY;
+          get_io_service(daemon).post(
+            boost::bind(&ShmServer::handle_accept, this, i));
+        } else if (((state == SlotState::CLOSED) || !client_alive)
+            && ((known[i] == SlotState::READY)
+              || (known[i] == SlotState::ACCEPTED))) {
+          known[i] = SlotState::CLOSED;
+          get_io_service(daemon).post(
+            boost::bind(&ShmServer::handle_disconnect, this, i));
+        } else if ((state == SlotState::FREE)
+            && (known[i] == SlotState::CLOSED)) {
+          known[i] = SlotState::FREE;
+        } else if ((state == SlotState::ACCEPTED)
+            && (known[i] == SlotState::READY)) {
+          known[i] = SlotState::ACCEPTED;
+        }
+      }
+      futex_wait(&header->accept_seq, seq);
+    }
+  }
+
+ public:
+  ShmServer(boost::shared_ptr<Daemon> daemon,
+            string name,
+            size_t max_buffer_size)
+    : daemon(daemon)
+    , work(get_io_service(daemon))
+    , name(name)
+    , max_buffer_size(max_buffer_size)
+    , mapping(new Mapping(
+        segment_name(name), sizeof(ServerHeader), true, true))
+    , header(reinterpret_cast<ServerHeader*>(mapping->data()))
+    , stopped(false) {
+    header->server_pid = getpid();
+    __sync_synchronize();
+    header->magic = shm_magic;
+    acceptor = boost::thread(&ShmServer::accept_loop, this);
+  }
+
+  ~ShmServer() {
+    stopped = true;
+    header->server_pid = 0;
+    notify(&header->accept_seq);
+    acceptor.join();
+    boost::recursive_mutex::scoped_lock lock(mtx);
+    clients.clear();
+  }
+
+  virtual void register_peer_change_handler(Handler* handler) {
+    boost::recursive_mutex::scoped_lock lock(mtx);
+    accept_handlers.push_back(handler);
+  }
+
+  virtual void async_send(const char* buffer,
+                          size_t size,
+                          SentCallback callback) {
+    std::vector<Client> current;
+    {
+      boost::recursive_mutex::scoped_lock lock(mtx);
+      for (ClientIt it = clients.begin(); it != clients.end(); ++it) {
+        current.push_back(it->second);
+      }
+    }
+    if (current.empty()) return;
+    BroadcastCallback<SentCallback> broadcast_callback(callback);
+    for (int i = 0; i < current.size(); ++i) {
+      current[i]->async_send(buffer, size, broadcast_callback);
+    }
+  }
+
+  virtual void register_receive_handler(Waypoint::Handler* handler) {
+    boost::recursive_mutex::scoped_lock lock(mtx);
+    for (ClientIt it = clients.begin(); it != clients.end(); ++it) {
+      it->second->register_receive_handler(handler);
+    }
+    receive_handlers.push_back(handler);
+  }
+
+  virtual RemoteId id() const {
+    return reinterpret_cast<RemoteId>(this);
+  }
+
+  virtual string address() const {
+    return "shm://" + name;
+  }
+
+  virtual bool guaranteed_comm() const {
+    return true;
+  }
+
+  virtual size_t max_packet_size() const {
+    return ring_capacity(max_buffer_size) - sizeof(MsgSize);
+  }
+};
+
+boost::shared_ptr<Mapping> open_server_segment(string name) {
+  for (int waited = 0; ; waited += shm_poll_time_ms) {
+    try {
+      boost::shared_ptr<Mapping> mapping(
+        new Mapping(segment_name(name), sizeof(ServerHeader), false, false));
+      ServerHeader* header = reinterpret_cast<ServerHeader*>(mapping->data());
+      if ((mapping->size() >= sizeof(ServerHeader))
+          && (header->magic == shm_magic)
+          && process_alive(header->server_pid)) {
+        return mapping;
+      }
+    } catch (std::runtime_error& error) {
+      if (waited >= shm_connect_time_ms) throw;
+    }
+    if (waited >= shm_connect_time_ms) {
+      throw std::runtime_error("no live shm server named " + name);
+    }
+    boost::this_thread::sleep(
+      boost::posix_time::milliseconds(shm_poll_time_ms));
+  }
+}
+
+}  // namespace
+#endif
+
+boost::shared_ptr<Waypoint> configure_shm_client(
+    boost::shared_ptr<Daemon> communication_daemon,
+    std::string name,
+    size_t max_buffer_size) {
+#ifdef __linux__
+  boost::shared_ptr<Mapping> server_mapping = open_server_segment(name);
+  ServerHeader* header =
+    reinterpret_cast<ServerHeader*>(server_mapping->data());
+
+  int slot = 0;
+  while ((slot < shm_max_clients) && !__sync_bool_compare_and_swap(
+      &header->slots[slot].state, SlotState::FREE, SlotState::CLAIMED)) {
+    ++slot;
+  }
+  if (slot == shm_max_clients) {
+    throw std::runtime_error("all shm slots of " + name + " are taken");
+  }
+  header->slots[slot].client_pid = getpid();
+  __sync_fetch_and_add(&header->slots[slot].generation, 1);
+
+  uint64_t capacity = ring_capacity(max_buffer_size);
+  boost::shared_ptr<Mapping> mapping;
+  try {
+    mapping.reset(new Mapping(
+      connection_name(name, slot), connection_size(capacity), true, true));
+  } catch (...) {
+    free_slot(&header->slots[slot]);
+    throw;
+  }
+  reinterpret_cast<ConnectionHeader*>(mapping->data())->capacity = capacity;
+  __sync_synchronize();
+  header->slots[slot].state = SlotState::READY;
+  notify(&header->accept_seq);
+
+  boost::shared_ptr<ShmConnection> ret(new ShmConnection(
+    communication_daemon, server_mapping, slot, mapping, false,
+    "shm://" + name));
+  ret->start();
+  return ret;
+#else
+  throw std::runtime_error("shm transport is supported only on linux");
+#endif
+}
+
+boost::shared_ptr<MultiWaypoint> configure_shm_server(
+    boost::shared_ptr<Daemon> communication_daemon,
+    std::string name,
+    size_t max_buffer_size) {
+#ifdef __linux__
+  return boost::make_shared<ShmServer>(
+    communication_daemon, name, max_buffer_size);
+#else
+  throw std::runtime_error("shm transport is supported only on linux");
+#endif
+}
+
+}  // namespace internode
+}  // namespace caffe
+
@@ -9,6 +9,8 @@
 #include <boost/optional.hpp>
 #include <boost/thread/recursive_mutex.hpp>
 #include <cmath>
+#include <map>
+#include <string>
 #include <utility>
 #include <vector>
 
@@ -25,6 +27,62 @@ namespace internode {
 
 extern boost::asio::io_service& get_io_service(boost::shared_ptr<Daemon>);
 
+TreeTopology::TreeTopology(int total_nodes)
+  : groups(1) {
+  for (int i = 0; i < total_nodes; ++i) add(i, 0);
+}
+
+TreeTopology::TreeTopology(const std::vector<std::string>& host_of_rank) {
+  // groups are ordered by their lowest rank, so rank 0 stays the root
+  std::map<std::string, size_t> group_of_host;
+  for (int i = 0; i < host_of_rank.size(); ++i) {
+    std::map<std::string, size_t>::iterator it =
+      group_of_host.find(host_of_rank[i]);
+    if (it == group_of_host.end()) {
+      it = group_of_host.insert(
+        std::make_pair(host_of_rank[i], groups.size())).first;
+      groups.push_back(std::vector<RemoteId>());
+    }
+    add(i, it->second);
+  }
+}
+
+void TreeTopology::add(RemoteId node, size_t group) {
+  group_of.push_back(group);
+  index_in_group.push_back(groups[group].size());
+  groups[group].push_back(node);
+}
+
+RemoteId TreeTopology::parent(RemoteId node) const {
+  size_t group = group_of.at(node);
+  size_t index = index_in_group.at(node);
+  if (index > 0) return groups[group][(index - 1) / 2];
+  if (group > 0) return groups[(group - 1) / 2][0];
+  return node;
+}
+
+std::vector<RemoteId> TreeTopology::children(RemoteId node) const {
+  std::vector<RemoteId> ret;
+  size_t group = group_of.at(node);
+  size_t index = index_in_group.at(node);
+  for (size_t i = index * 2 + 1; i <= index * 2 + 2; ++i) {
+    if (i < groups[group].size()) ret.push_back(groups[group][i]);
+  }
+  if (index > 0) return ret;
+  for (size_t i = group * 2 + 1; i <= group * 2 + 2; ++i) {
+    if (i < groups.size()) ret.push_back(groups[i][0]);
+  }
+  return ret;
+}
+
+bool TreeTopology::is_group_leader(RemoteId node) const {
+  return index_in_group.at(node) == 0;
+}
+
+int TreeTopology::total_groups() const {
+  return groups.size();
+}
+
 #ifdef USE_MPI
 
 typedef boost::function<void(bool, int, int)> RequestCallback;
@@ -32,6 +90,7 @@ typedef std::pair<MPI_Request, RequestCallback> MpiRequestWithCallback;
 
 class MpiTreeClient : public TreeWaypoint {
   boost::shared_ptr<Daemon> daemon;
+  TreeTopology topology_;
   std::vector<Handler*> handlers;
   std::vector<MpiRequestWithCallback> requests;
   std::vector<char> buffer;
@@ -70,7 +129,8 @@ class MpiTreeClient : public TreeWaypoint {
 
  public:
   explicit MpiTreeClient(boost::shared_ptr<Daemon> daemon)
-      : daemon(daemon) {
+      : daemon(daemon)
+      , topology_(mpi_get_comm_size()) {
     post(daemon);
   }
 
@@ -84,6 +144,22 @@ class MpiTreeClient : public TreeWaypoint {
     set_recv();
   }
 
+  virtual void set_hierarchical(bool hierarchical) {
+    boost::recursive_mutex::scoped_lock lock(mtx);
+    if (!hierarchical) {
+      topology_ = TreeTopology(mpi_get_comm_size());
+      return;
+    }
+    topology_ = TreeTopology(mpi_get_all_proc_names());
+    if (id() == 0) {
+      LOG(INFO) << "hierarchical tree of " << total_nodes() << " nodes on "
+                << topology_.total_groups() << " hosts";
+    }
+    DLOG(INFO) << "[proc " << id() << "] "
+               << (topology_.is_group_leader(id()) ? "leads" : "joins")
+               << " host " << mpi_get_current_proc_name();
+  }
+
   virtual void async_send_to_parent(const char* buffer,
                                     size_t size,
                                     SentCallback callback) {
@@ -138,24 +214,15 @@ class MpiTreeClient : public TreeWaypoint {
   }
 
   virtual std::vector<RemoteId> children() const {
-    std::vector<RemoteId> children;
-    RemoteId parent = id();
-    int count = mpi_get_comm_size();
-
-    if (count < 2) return children;
-
-    if (parent * 2 + 1 < count) children.push_back( parent*2+1 );
-    if (parent * 2 + 2 < count) children.push_back( parent*2+2 );
-
-    return children;
+    return topology_.children(id());
   }
 
   virtual RemoteId parent() const {
-    RemoteId current = id();
-
-    if (current == 0) return 0;
+    return topology_.parent(id());
+  }
 
-    return floor( (current-1)/2 );
+  virtual const TreeTopology& topology() const {
+    return topology_;
   }
 
   virtual void poll_one(shared_ptr<Daemon> daemon) {
@@ -0,0 +1,346 @@
+#include <boost/filesystem.hpp>
+#include <google/protobuf/descriptor.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <map>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "caffe/layer.hpp"
+#include "caffe/layer_autotuner.hpp"
+#include "caffe/layer_factory.hpp"
+#include "caffe/util/benchmark.hpp"
+#include "caffe/util/cpu_info.hpp"
+#include "caffe/util/io.hpp"
+
+namespace caffe {
+
+namespace {
+
+using google::protobuf::EnumDescriptor;
+using google::protobuf::EnumValueDescriptor;
+using google::protobuf::FieldDescriptor;
+using google::protobuf::Message;
+
+// Layer types with an engine, and the parameter holding it.
+const char* const kEngineParams[][2] = {
+  {"Convolution", "convolution_param"},
+  {"LRN", "lrn_param"},
+  {"Pooling", "pooling_param"},
+  {"ReLU", "relu_param"},
+  {"Sigmoid", "sigmoid_param"},
+  {"Softmax", "softmax_param"},
+  {"TanH", "tanh_param"},
+};
+
+const FieldDescriptor* engine_param(const LayerParameter& layer_param) {
+  for (int i = 0; i < sizeof(kEngineParams) / sizeof(kEngineParams[0]); ++i) {
+    if (layer_param.type() == kEngineParams[i][0]) {
+      return LayerParameter::descriptor()->FindFieldByName(
+          kEngineParams[i][1]);
+    }
+  }
+  return NULL;
+}
+
+const FieldDescriptor* engine_field(const FieldDescriptor* param) {
+  return param->message_type()->FindFieldByName("engine");
+}
+
+const EnumValueDescriptor* get_engine(const LayerParameter& layer_param) {
+  const FieldDescriptor* param = engine_param(layer_param);
+  if (param == NULL) {
+    return NULL;
+  }
+  const Message& message =
+      layer_param.GetReflection()->GetMessage(layer_param, param);
+  return message.GetReflection()->GetEnum(message, engine_field(param));
+}
+
+void set_engine(int engine, LayerParameter* layer_param) {
+  const FieldDescriptor* param = engine_param(*layer_param);
+  CHECK(param) << "Layer " << layer_param->name() << " has no engine";
+  Message* message =
+      layer_param->GetReflection()->MutableMessage(layer_param, param);
+  const FieldDescriptor* field = engine_field(param);
+  const EnumValueDescriptor* value =
+      field->enum_type()->FindValueByNumber(engine);
+  CHECK(value) << "Unknown engine " << engine << " for layer "
+      << layer_param->name();
+  message->GetReflection()->SetEnum(message, field, value);
+}
+
+// Engines the layer factory can create for layer_param in CPU mode,
+// following its own restrictions on the MKL2017 layers.
+void cpu_engines(const LayerParameter& layer_param,
+    vector<const EnumValueDescriptor*>* engines) {
+  const EnumDescriptor* type =
+      engine_field(engine_param(layer_param))->enum_type();
+  engines->push_back(type->FindValueByName("CAFFE"));
+#ifdef MKL2017_SUPPORTED
+  const EnumValueDescriptor* mkl2017 = type->FindValueByName("MKL2017");
+  if (mkl2017 == NULL) {
+    return;
+  }
+  if (layer_param.type() == "Convolution") {
+    const ConvolutionParameter& conv_param = layer_param.convolution_param();
+    for (int i = 0; i < conv_param.dilation_size(); ++i) {
+      if (conv_param.dilation(i) > 1) {
+        return;
+      }
+    }
+  }
+  if (layer_param.type() == "Pooling" &&
+      layer_param.pooling_param().pool() != PoolingParameter_PoolMethod_MAX) {
+    return;
+  }
+  engines->push_back(mkl2017);
+#endif
+}
+
+// Whether the layer created for layer_param uses LayerParameter.num_threads.
+bool uses_num_threads(const LayerParameter& layer_param) {
+  if (layer_param.type() == "Deconvolution") {
+    return true;
+  }
+  if (layer_param.type() == "Convolution" || layer_param.type() == "LRN") {
+    return get_engine(layer_param)->name() == "CAFFE";
+  }
+  return false;
+}
+
+void apply(const AutotuneCache::Entry& entry, LayerParameter* layer_param) {
+  if (entry.engine() != 0) {
+    set_engine(entry.engine(), layer_param);
+  }
+  if (entry.num_threads() != 0) {
+    layer_param->set_num_threads(entry.num_threads());
+  }
+}
+
+string describe(const LayerParameter& layer_param) {
+  std::ostringstream description;
+  const EnumValueDescriptor* engine = get_engine(layer_param);
+  if (engine) {
+    description << "engine " << engine->name();
+  }
+  if (uses_num_threads(layer_param)) {
+    description << (engine ? ", " : "");
+    if (layer_param.num_threads() == 0) {
+      description << "all threads";
+    } else {
+      description << layer_param.num_threads() << " threads";
+    }
+  }
+  return description.str();
+}
+
+}  // namespace
+
+template <typename Dtype>
+LayerAutotuner<Dtype>::LayerAutotuner(const AutotuneParameter& param)
+    : param_(param), host_(HostSignature()), num_loaded_(0) {
+  CHECK_GT(param_.iterations(), 0);
+  if (param_.has_cache_file() &&
+      boost::filesystem::exists(param_.cache_file())) {
+    CHECK(ReadProtoFromTextFile(param_.cache_file(), &cache_))
+        << "Failed to parse autotune cache " << param_.cache_file();
+  }
+  num_loaded_ = cache_.entry_size();
+  for (int i = 0; i < cache_.entry_size(); ++i) {
+    if (cache_.entry(i).host() == host_) {
+      index_[cache_.entry(i).layer()] = i;
+    }
+  }
+}
+
+template <typename Dtype>
+string LayerAutotuner<Dtype>::HostSignature() {
+  std::ostringstream signature;
+  signature << "sockets: " << cpu::Collection::getTotalNumberOfSockets()
+      << " cores: " << cpu::Collection::getTotalNumberOfCpuCores()
+      << " processors: " << cpu::Collection::getNumberOfProcessors();
+#ifdef _OPENMP
+  signature << " threads: " << omp_get_max_threads();
+#endif
+  return signature.str();
+}
+
+template <typename Dtype>
+void LayerAutotuner<Dtype>::Candidates(const LayerParameter& layer_param,
+    const vector<Blob<Dtype>*>& bottom, vector<AutotuneCache::Entry>* out) {
+  vector<AutotuneCache::Entry> engines(1);
+  const EnumValueDescriptor* engine = get_engine(layer_param);
+  if (engine && engine->name() == "DEFAULT") {
+    vector<const EnumValueDescriptor*> values;
+    cpu_engines(layer_param, &values);
+    engines.resize(values.size());
+    for (int i = 0; i < values.size(); ++i) {
+      engines[i].set_engine(values[i]->number());
+    }
+  }
+  int max_threads = 1;
+#ifdef _OPENMP
+  max_threads = omp_get_max_threads();
+  if (bottom.size() > 0 && bottom[0]->num_axes() > 0) {
+    max_threads = std::min(max_threads, bottom[0]->shape(0));
+  }
+#endif
+  for (int i = 0; i < engines.size(); ++i) {
+    LayerParameter candidate(layer_param);
+    apply(engines[i], &candidate);
+    if (!uses_num_threads(candidate) || layer_param.num_threads() != 0 ||
+        max_threads <= 1) {
+      out->push_back(engines[i]);
+      continue;
+    }
+    for (int threads = 1; threads < max_threads; threads *= 2) {
+      out->push_back(engines[i]);
+      out->back().set_num_threads(threads);
+    }
+    out->push_back(engines[i]);
+    out->back().set_num_threads(max_threads);
+  }
+}
+
+template <typename Dtype>
+float LayerAutotuner<Dtype>::Time(const LayerParameter& layer_param,
+    const vector<shared_ptr<Blob<Dtype> > >& params,
+    const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+  shared_ptr<Layer<Dtype> > layer =
+      LayerRegistry<Dtype>::CreateLayer(layer_param);
+  // with params, the layer skips its fillers
+  layer->blobs() = params;
+  layer->SetUp(bottom, top);
+  const bool backward = layer_param.phase() == TRAIN;
+  const vector<bool> propagate_down(bottom.size(), true);
+  for (int i = 0; i < layer->blobs().size(); ++i) {
+    layer->set_param_propagate_down(i, true);
+  }
+  Timer timer;
+  float total = 0;
+  // the first pass warms up caches and allocates the buffers
+  for (int i = 0; i <= param_.iterations(); ++i) {
+    timer.Start();
+    layer->Forward(bottom, top);
+    if (backward) {
+      layer->Backward(top, propagate_down, bottom);
+    }
+    if (i > 0) {
+      total += timer.MilliSeconds();
+    }
+  }
+  return total / param_.iterations();
+}
+
+template <typename Dtype>
+bool LayerAutotuner<Dtype>::Tune(const vector<Blob<Dtype>*>& bottom,
+    const vector<Blob<Dtype>*>& top,
+    const vector<shared_ptr<Blob<Dtype> > >& params,
+    LayerParameter* layer_param) {
+  if (!engine_param(*layer_param) && !uses_num_threads(*layer_param)) {
+    return false;
+  }
+  vector<AutotuneCache::Entry> candidates;
+  Candidates(*layer_param, bottom, &candidates);
+  if (candidates.size() < 2) {
+    return false;
+  }
+
+  // The layer is identified by what affects its speed, not by its name.
+  LayerParameter key_param(*layer_param);
+  key_param.clear_name();
+  key_param.clear_bottom();
+  key_param.clear_top();
+  key_param.clear_loss_weight();
+  key_param.clear_param();
+  key_param.clear_blobs();
+  key_param.clear_propagate_down();
+  key_param.clear_include();
+  key_param.clear_exclude();
+  std::ostringstream key;
+  key << "dtype: " << (sizeof(Dtype) == sizeof(float) ? "float" : "double");
+  for (int i = 0; i < bottom.size(); ++i) {
+    key << " bottom: " << bottom[i]->shape_string();
+  }
+  key << " " << key_param.ShortDebugString();
+
+  std::map<string, int>::const_iterator cached = index_.find(key.str());
+  if (cached != index_.end()) {
+    apply(cache_.entry(cached->second), layer_param);
+    LOG_IF(INFO, Caffe::root_solver()) << "Autotuned " << layer_param->name()
+        << " from cache: " << describe(*layer_param);
+    return true;
+  }
+
+  // Backward of the candidates updates the diffs of the params, and some
+  // layers update their data in Forward.
+  vector<shared_ptr<Blob<Dtype> > > params_copy(params.size());
+  for (int i = 0; i < params.size(); ++i) {
+    params_copy[i].reset(new Blob<Dtype>());
+    params_copy[i]->CopyFrom(*params[i], false, true);
+  }
+  int best = -1;
+  float best_time = 0;
+  for (int i = 0; i < candidates.size(); ++i) {
+    LayerParameter candidate(*layer_param);
+    apply(candidates[i], &candidate);
+    const float time = Time(candidate, params_copy, bottom, top);
+    LOG_IF(INFO, Caffe::root_solver()) << "Autotuning " << candidate.name()
+        << ": " << describe(candidate) << ": " << time << " ms";
+    if (best < 0 || time < best_time) {
+      best = i;
+      best_time = time;
+    }
+  }
+  AutotuneCache::Entry* entry = cache_.add_entry();
+  entry->CopyFrom(candidates[best]);
+  entry->set_host(host_);
+  entry->set_layer(key.str());
+  index_[key.str()] = cache_.entry_size() - 1;
+  apply(*entry, layer_param);
+  LOG_IF(INFO, Caffe::root_solver()) << "Autotuned " << layer_param->name()
+      << ": " << describe(*layer_param);
+  return true;
+}
+
+template <typename Dtype>
+void LayerAutotuner<Dtype>::Save() {
+  if (!param_.has_cache_file() || cache_.entry_size() == num_loaded_) {
+    return;
+  }
+  // Merge with what other processes may have saved in the meantime.
+  AutotuneCache cache;
+  if (boost::filesystem::exists(param_.cache_file())) {
+    CHECK(ReadProtoFromTextFile(param_.cache_file(), &cache))
+        << "Failed to parse autotune cache " << param_.cache_file();
+  }
+  std::map<std::pair<string, string>, bool> saved;
+  for (int i = 0; i < cache.entry_size(); ++i) {
+    saved[std::make_pair(cache.entry(i).host(), cache.entry(i).layer())] =
+        true;
+  }
+  for (int i = num_loaded_; i < cache_.entry_size(); ++i) {
+    const AutotuneCache::Entry& entry = cache_.entry(i);
+    if (!saved.count(std::make_pair(entry.host(), entry.layer()))) {
+      cache.add_entry()->CopyFrom(entry);
+    }
+  }
+  const string temp_file = boost::filesystem::unique_path(
+      param_.cache_file() + ".%%%%%%").string();
+  WriteProtoToTextFile(cache, temp_file);
+  CHECK_EQ(std::rename(temp_file.c_str(), param_.cache_file().c_str()), 0)
+      << "Failed to write autotune cache " << param_.cache_file();
+  num_loaded_ = cache_.entry_size();
+}
+
+INSTANTIATE_CLASS(LayerAutotuner);
+
+}  // namespace caffe
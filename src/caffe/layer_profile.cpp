@@ -0,0 +1,434 @@
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>  // NOLINT(readability/streams)
+#include <iomanip>
+#include <iostream>  // NOLINT(readability/streams)
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "caffe/layer_profile.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+double layer_forward_flops(Layer<Dtype>* layer,
+    const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+  const string type = layer->type();
+  double flops = 0;
+  if (type == "Convolution" || type == "Deconvolution") {
+    // Each weight is used once per output (input for Deconvolution)
+    // position of each image.
+    const vector<Blob<Dtype>*>& spatial =
+        type == "Convolution" ? top : bottom;
+    const int axis = spatial[0]->CanonicalAxisIndex(
+        layer->layer_param().convolution_param().axis());
+    for (int i = 0; i < spatial.size(); ++i) {
+      flops += 2. * layer->blobs()[0]->count() * spatial[i]->count()
+          / spatial[i]->shape(axis);
+    }
+  } else if (type == "InnerProduct") {
+    const int axis = bottom[0]->CanonicalAxisIndex(
+        layer->layer_param().inner_product_param().axis());
+    flops = 2. * layer->blobs()[0]->count() * bottom[0]->count(0, axis);
+  } else {
+    for (int i = 0; i < top.size(); ++i) {
+      flops += top[i]->count();
+    }
+  }
+  return flops;
+}
+
+template <typename Dtype>
+double layer_backward_flops(Layer<Dtype>* layer,
+    const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+  const string type = layer->type();
+  if (type == "Convolution" || type == "Deconvolution" ||
+      type == "InnerProduct") {
+    return 2 * layer_forward_flops(layer, bottom, top);
+  }
+  double flops = 0;
+  for (int i = 0; i < bottom.size(); ++i) {
+    flops += bottom[i]->count();
+  }
+  return flops;
+}
+
+namespace {
+
+template <typename Dtype>
+double blobs_bytes(const vector<Blob<Dtype>*>& blobs) {
+  double count = 0;
+  for (int i = 0; i < blobs.size(); ++i) {
+    count += blobs[i]->count();
+  }
+  return count * sizeof(Dtype);
+}
+
+template <typename Dtype>
+double params_bytes(Layer<Dtype>* layer) {
+  double count = 0;
+  for (int i = 0; i < layer->blobs().size(); ++i) {
+    count += layer->blobs()[i]->count();
+  }
+  return count * sizeof(Dtype);
+}
+
+}  // namespace
+
+template <typename Dtype>
+double layer_forward_bytes(Layer<Dtype>* layer,
+    const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+  return blobs_bytes(bottom) + params_bytes(layer) + blobs_bytes(top);
+}
+
+template <typename Dtype>
+double layer_backward_bytes(Layer<Dtype>* layer,
+    const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+  return blobs_bytes(top) + 2 * blobs_bytes(bottom) + 2 * params_bytes(layer);
+}
+
+template double layer_forward_flops(Layer<float>* layer,
+    const vector<Blob<float>*>& bottom, const vector<Blob<float>*>& top);
+template double layer_forward_flops(Layer<double>* layer,
+    const vector<Blob<double>*>& bottom, const vector<Blob<double>*>& top);
+template double layer_backward_flops(Layer<float>* layer,
+    const vector<Blob<float>*>& bottom, const vector<Blob<float>*>& top);
+template double layer_backward_flops(Layer<double>* layer,
+    const vector<Blob<double>*>& bottom, const vector<Blob<double>*>& top);
+template double layer_forward_bytes(Layer<float>* layer,
+    const vector<Blob<float>*>& bottom, const vector<Blob<float>*>& top);
+template double layer_forward_bytes(Layer<double>* layer,
+    const vector<Blob<double>*>& bottom, const vector<Blob<double>*>& top);
+template double layer_backward_bytes(Layer<float>* layer,
+    const vector<Blob<float>*>& bottom, const vector<Blob<float>*>& top);
+template double layer_backward_bytes(Layer<double>* layer,
+    const vector<Blob<double>*>& bottom, const vector<Blob<double>*>& top);
+
+LayerProfile::LayerProfile()
+    : min_ms(0), median_ms(0), p99_ms(0), mean_ms(0), flops(0), bytes(0),
+      share(0), cycles(0), instructions(0), cache_misses(0),
+      vector_instructions(0) {}
+
+void LayerProfile::SetTimes(vector<double> times) {
+  CHECK(!times.empty());
+  std::sort(times.begin(), times.end());
+  const int n = times.size();
+  min_ms = times[0];
+  median_ms = n % 2 ? times[n / 2] : (times[n / 2 - 1] + times[n / 2]) / 2;
+  // Nearest rank.
+  p99_ms = times[std::max(0, static_cast<int>(std::ceil(0.99 * n)) - 1)];
+  double sum = 0;
+  for (int i = 0; i < n; ++i) {
+    sum += times[i];
+  }
+  mean_ms = sum / n;
+}
+
+void SetProfileShares(vector<LayerProfile>* profiles) {
+  double total = 0;
+  for (int i = 0; i < profiles->size(); ++i) {
+    total += (*profiles)[i].mean_ms;
+  }
+  for (int i = 0; i < profiles->size(); ++i) {
+    (*profiles)[i].share = total > 0 ? (*profiles)[i].mean_ms / total : 0;
+  }
+}
+
+namespace {
+
+const char* kCsvHeader = "layer,type,pass,min_ms,median_ms,p99_ms,mean_ms,"
+    "flops,bytes,gflops_per_second,gbytes_per_second,share,cycles,"
+    "instructions,ipc,cache_misses,memory_gbytes_per_second,"
+    "vector_instructions";
+
+bool ends_with(const string& s, const string& suffix) {
+  return s.size() >= suffix.size() &&
+      s.compare(s.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+string json_string(const string& s) {
+  string quoted = "\"";
+  for (int i = 0; i < s.size(); ++i) {
+    if (s[i] == '"' || s[i] == '\\') {
+      quoted += '\\';
+    }
+    quoted += s[i];
+  }
+  return quoted + "\"";
+}
+
+string csv_field(const string& s) {
+  if (s.find_first_of(",\"\n") == string::npos) {
+    return s;
+  }
+  string quoted = "\"";
+  for (int i = 0; i < s.size(); ++i) {
+    if (s[i] == '"') {
+      quoted += '"';
+    }
+    quoted += s[i];
+  }
+  return quoted + "\"";
+}
+
+// Sets the field of the profile named key, ignoring the derived ones.
+bool set_field(const string& key, const string& value,
+    LayerProfile* profile) {
+  if (key == "layer") {
+    profile->layer = value;
+  } else if (key == "type") {
+    profile->type = value;
+  } else if (key == "pass") {
+    profile->pass = value;
+  } else {
+    double* field = NULL;
+    if (key == "min_ms") {
+      field = &profile->min_ms;
+    } else if (key == "median_ms") {
+      field = &profile->median_ms;
+    } else if (key == "p99_ms") {
+      field = &profile->p99_ms;
+    } else if (key == "mean_ms") {
+      field = &profile->mean_ms;
+    } else if (key == "flops") {
+      field = &profile->flops;
+    } else if (key == "bytes") {
+      field = &profile->bytes;
+    } else if (key == "share") {
+      field = &profile->share;
+    } else if (key == "cycles") {
+      field = &profile->cycles;
+    } else if (key == "instructions") {
+      field = &profile->instructions;
+    } else if (key == "cache_misses") {
+      field = &profile->cache_misses;
+    } else if (key == "vector_instructions") {
+      field = &profile->vector_instructions;
+    }
+    if (field) {
+      char* end;
+      *field = strtod(value.c_str(), &end);
+      return end != value.c_str() && *end == '\0';
+    }
+  }
+  return true;
+}
+
+// Minimal reader for the JSON WriteProfilesJson writes.
+class JsonReader {
+ public:
+  explicit JsonReader(const string& text) : text_(text), pos_(0) {}
+
+  bool Consume(char c) {
+    SkipSpaces();
+    if (pos_ < text_.size() && text_[pos_] == c) {
+      ++pos_;
+      return true;
+    }
+    return false;
+  }
+  bool ReadString(string* s) {
+    if (!Consume('"')) {
+      return false;
+    }
+    s->clear();
+    while (pos_ < text_.size() && text_[pos_] != '"') {
+      if (text_[pos_] == '\\' && pos_ + 1 < text_.size()) {
+        ++pos_;
+      }
+      *s += text_[pos_++];
+    }
+    return Consume('"');
+  }
+  // A string or a number, as text.
+  bool ReadValue(string* s) {
+    SkipSpaces();
+    if (pos_ < text_.size() && text_[pos_] == '"') {
+      return ReadString(s);
+    }
+    const size_t end = text_.find_first_of(",}] \t\r\n", pos_);
+    if (end == string::npos || end == pos_) {
+      return false;
+    }
+    *s = text_.substr(pos_, end - pos_);
+    pos_ = end;
+    return true;
+  }
+
+ private:
+  void SkipSpaces() {
+    while (pos_ < text_.size() && isspace(text_[pos_])) {
+      ++pos_;
+    }
+  }
+
+  const string text_;
+  size_t pos_;
+};
+
+bool read_csv_line(std::istream* stream, vector<string>* fields) {
+  string line;
+  if (!std::getline(*stream, line)) {
+    return false;
+  }
+  fields->clear();
+  string field;
+  bool quoted = false;
+  for (int i = 0; i < line.size(); ++i) {
+    const char c = line[i];
+    if (quoted) {
+      if (c == '"' && i + 1 < line.size() && line[i + 1] == '"') {
+        field += c;
+        ++i;
+      } else if (c == '"') {
+        quoted = false;
+      } else {
+        field += c;
+      }
+    } else if (c == '"') {
+      quoted = true;
+    } else if (c == ',') {
+      fields->push_back(field);
+      field.clear();
+    } else if (c != '\r') {
+      field += c;
+    }
+  }
+  fields->push_back(field);
+  return true;
+}
+
+}  // namespace
+
+void WriteProfiles(const string& filename,
+    const vector<LayerProfile>& profiles) {
+  std::ofstream file(filename.c_str());
+  CHECK(file) << "Failed to open " << filename;
+  if (ends_with(filename, ".csv")) {
+    WriteProfilesCsv(profiles, &file);
+  } else {
+    WriteProfilesJson(profiles, &file);
+  }
+  CHECK(file) << "Failed to write " << filename;
+}
+
+void WriteProfilesJson(const vector<LayerProfile>& profiles,
+    std::ostream* stream) {
+  std::ostream& out = *stream;
+  out << std::setprecision(9);
+  out << "{\n  \"layers\": [";
+  for (int i = 0; i < profiles.size(); ++i) {
+    const LayerProfile& p = profiles[i];
+    out << (i ? ",\n" : "\n") << "    {"
+        << "\"layer\": " << json_string(p.layer)
+        << ", \"type\": " << json_string(p.type)
+        << ", \"pass\": " << json_string(p.pass)
+        << ", \"min_ms\": " << p.min_ms
+        << ", \"median_ms\": " << p.median_ms
+        << ", \"p99_ms\": " << p.p99_ms
+        << ", \"mean_ms\": " << p.mean_ms
+        << ", \"flops\": " << p.flops
+        << ", \"bytes\": " << p.bytes
+        << ", \"gflops_per_second\": " << p.gflops_per_second()
+        << ", \"gbytes_per_second\": " << p.gbytes_per_second()
+        << ", \"share\": " << p.share
+        << ", \"cycles\": " << p.cycles
+        << ", \"instructions\": " << p.instructions
+        << ", \"ipc\": " << p.ipc()
+        << ", \"cache_misses\": " << p.cache_misses
+        << ", \"memory_gbytes_per_second\": "
+        << p.memory_gbytes_per_second()
+        << ", \"vector_instructions\": " << p.vector_instructions << "}";
+  }
+  out << "\n  ]\n}\n";
+}
+
+void WriteProfilesCsv(const vector<LayerProfile>& profiles,
+    std::ostream* stream) {
+  std::ostream& out = *stream;
+  out << std::setprecision(9);
+  out << kCsvHeader << "\n";
+  for (int i = 0; i < profiles.size(); ++i) {
+    const LayerProfile& p = profiles[i];
+    out << csv_field(p.layer) << "," << csv_field(p.type) << ","
+        << csv_field(p.pass) << "," << p.min_ms << "," << p.median_ms << ","
+        << p.p99_ms << "," << p.mean_ms << "," << p.flops << "," << p.bytes
+        << "," << p.gflops_per_second() << "," << p.gbytes_per_second()
+        << "," << p.share << "," << p.cycles << "," << p.instructions << ","
+        << p.ipc() << "," << p.cache_misses << ","
+        << p.memory_gbytes_per_second() << "," << p.vector_instructions
+        << "\n";
+  }
+}
+
+bool ReadProfiles(const string& filename, vector<LayerProfile>* profiles) {
+  std::ifstream file(filename.c_str());
+  if (!file) {
+    return false;
+  }
+  return ends_with(filename, ".csv") ? ReadProfilesCsv(&file, profiles) :
+      ReadProfilesJson(&file, profiles);
+}
+
+bool ReadProfilesJson(std::istream* stream, vector<LayerProfile>* profiles) {
+  std::stringstream buffer;
+  buffer << stream->rdbuf();
+  JsonReader reader(buffer.str());
+  string key;
+  if (!reader.Consume('{') || !reader.ReadString(&key) || key != "layers" ||
+      !reader.Consume(':') || !reader.Consume('[')) {
+    return false;
+  }
+  profiles->clear();
+  if (reader.Consume(']')) {
+    return reader.Consume('}');
+  }
+  do {
+    LayerProfile profile;
+    if (!reader.Consume('{')) {
+      return false;
+    }
+    do {
+      string value;
+      if (!reader.ReadString(&key) || !reader.Consume(':') ||
+          !reader.ReadValue(&value) || !set_field(key, value, &profile)) {
+        return false;
+      }
+    } while (reader.Consume(','));
+    if (!reader.Consume('}')) {
+      return false;
+    }
+    profiles->push_back(profile);
+  } while (reader.Consume(','));
+  return reader.Consume(']') && reader.Consume('}');
+}
+
+bool ReadProfilesCsv(std::istream* stream, vector<LayerProfile>* profiles) {
+  vector<string> header;
+  if (!read_csv_line(stream, &header)) {
+    return false;
+  }
+  profiles->clear();
+  vector<string> fields;
+  while (read_csv_line(stream, &fields)) {
+    if (fields.size() == 1 && fields[0].empty()) {
+      continue;
+    }
+    if (fields.size() != header.size()) {
+      return false;
+    }
+    LayerProfile profile;
+    for (int i = 0; i < fields.size(); ++i) {
+      if (!set_field(header[i], fields[i], &profile)) {
+        return false;
+      }
+    }
+    profiles->push_back(profile);
+  }
+  return true;
+}
+
+}  // namespace caffe
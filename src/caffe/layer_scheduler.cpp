@@ -0,0 +1,392 @@
+#include <algorithm>
+#include <map>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "caffe/layer_scheduler.hpp"
+#include "caffe/net.hpp"
+#include "caffe/util/cpu_info.hpp"
+#include "caffe/util/trace.hpp"
+
+namespace caffe {
+
+namespace {
+
+void add_memory(const shared_ptr<SyncedMemory>& memory,
+    vector<SyncedMemory*>* memories) {
+  memories->push_back(memory.get());
+}
+
+bool intersect(const vector<SyncedMemory*>& a,
+    const vector<SyncedMemory*>& b) {
+  vector<SyncedMemory*>::const_iterator i = a.begin();
+  vector<SyncedMemory*>::const_iterator j = b.begin();
+  while (i != a.end() && j != b.end()) {
+    if (*i < *j) {
+      ++i;
+    } else if (*j < *i) {
+      ++j;
+    } else {
+      return true;
+    }
+  }
+  return false;
+}
+
+}  // namespace
+
+template <typename Dtype>
+LayerScheduler<Dtype>::LayerScheduler(const Net<Dtype>& net, int num_workers)
+    : net_(net), num_workers_(num_workers), num_threads_(1),
+      threads_per_worker_(1), mode_(Caffe::mode()),
+      root_solver_(Caffe::root_solver()), stage_(0), forward_(true),
+      generation_(0), pending_(0), stop_(false) {
+  CHECK_GT(num_workers_, 1);
+#ifdef _OPENMP
+  num_threads_ = omp_get_max_threads();
+  threads_per_worker_ = std::max(1, num_threads_ / num_workers_);
+#endif
+  const int num_layers = net.layers().size();
+  // The memory each layer reads and writes, in Forward or Backward.
+  vector<vector<SyncedMemory*> > reads(num_layers);
+  vector<vector<SyncedMemory*> > writes(num_layers);
+  costs_.resize(num_layers);
+  widths_.resize(num_layers, 1);
+  serial_.resize(num_layers);
+  for (int layer_id = 0; layer_id < num_layers; ++layer_id) {
+    Layer<Dtype>* layer = net.layers()[layer_id].get();
+    const vector<Blob<Dtype>*>& bottom = net.bottom_vecs()[layer_id];
+    const vector<Blob<Dtype>*>& top = net.top_vecs()[layer_id];
+    for (int i = 0; i < bottom.size(); ++i) {
+      if (bottom[i]->count() > 0) {
+        add_memory(bottom[i]->data(), &reads[layer_id]);
+        add_memory(bottom[i]->diff(), &writes[layer_id]);
+      }
+    }
+    for (int i = 0; i < top.size(); ++i) {
+      if (top[i]->count() > 0) {
+        add_memory(top[i]->data(), &writes[layer_id]);
+        add_memory(top[i]->diff(), &reads[layer_id]);
+      }
+    }
+    for (int i = 0; i < layer->blobs().size(); ++i) {
+      const Blob<Dtype>& param = *layer->blobs()[i];
+      if (param.count() > 0) {
+        // Params that are not learned may be updated by Forward, like the
+        // running statistics of BatchNorm.
+        add_memory(param.data(), layer->param_propagate_down(i) ?
+                                 &reads[layer_id] : &writes[layer_id]);
+        add_memory(param.diff(), &writes[layer_id]);
+      }
+    }
+    std::sort(reads[layer_id].begin(), reads[layer_id].end());
+    std::sort(writes[layer_id].begin(), writes[layer_id].end());
+    costs_[layer_id] = layer_forward_flops(layer, bottom, top);
+    if (!bottom.empty() && bottom[0]->num_axes() > 0) {
+      widths_[layer_id] = std::max(1, bottom[0]->shape(0));
+    }
+    serial_[layer_id] = bottom.empty() || (layer->type() == string("Dropout")
+        && layer->layer_param().phase() == TRAIN);
+  }
+  conflicts_.assign(num_layers, vector<bool>(num_layers, false));
+  ancestors_.assign(num_layers, vector<bool>(num_layers, false));
+  for (int j = 0; j < num_layers; ++j) {
+    for (int i = j - 1; i >= 0; --i) {
+      conflicts_[i][j] = conflicts_[j][i] =
+          intersect(writes[i], reads[j]) || intersect(writes[i], writes[j]) ||
+          intersect(reads[i], writes[j]);
+      if (conflicts_[i][j] && !ancestors_[j][i]) {
+        ancestors_[j][i] = true;
+        for (int k = 0; k < i; ++k) {
+          if (ancestors_[i][k]) {
+            ancestors_[j][k] = true;
+          }
+        }
+      }
+    }
+  }
+
+  vector<int> layers(num_layers);
+  for (int layer_id = 0; layer_id < num_layers; ++layer_id) {
+    layers[layer_id] = layer_id;
+  }
+  Decompose(layers);
+  losses_.resize(num_layers);
+  int num_parallel = 0;
+  for (int stage = 0; stage < stages_.size(); ++stage) {
+    if (!branch_workers_[stage].empty()) {
+      ++num_parallel;
+    }
+  }
+  LOG_IF(INFO, Caffe::root_solver()) << "Running " << num_parallel << " of "
+      << stages_.size() << " stages of layers as concurrent branches on "
+      << num_workers_ << " workers of " << threads_per_worker_ << " threads";
+  if (num_parallel > 0) {
+    for (int worker = 0; worker < num_workers_; ++worker) {
+      workers_.push_back(shared_ptr<boost::thread>(new boost::thread(
+          &LayerScheduler<Dtype>::WorkerEntry, this, worker)));
+    }
+  }
+}
+
+template <typename Dtype>
+LayerScheduler<Dtype>::~LayerScheduler() {
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+    stop_ = true;
+  }
+  start_.notify_all();
+  for (int i = 0; i < workers_.size(); ++i) {
+    workers_[i]->join();
+  }
+}
+
+template <typename Dtype>
+void LayerScheduler<Dtype>::Decompose(const vector<int>& layers) {
+  vector<int> region;
+  for (int i = 0; i <= layers.size(); ++i) {
+    // Whether every other layer runs before or after this one.
+    bool cut = i == layers.size();
+    if (!cut) {
+      const int layer_id = layers[i];
+      cut = true;
+      for (int j = 0; j < layers.size() && cut; ++j) {
+        cut = j == i || ancestors_[layer_id][layers[j]] ||
+            ancestors_[layers[j]][layer_id];
+      }
+      if (!cut) {
+        region.push_back(layer_id);
+        continue;
+      }
+    }
+    if (!region.empty()) {
+      // The connected components of the region are independent branches.
+      vector<int> component(region.size());
+      for (int j = 0; j < region.size(); ++j) {
+        component[j] = j;
+        for (int k = 0; k < j; ++k) {
+          if (conflicts_[region[k]][region[j]] &&
+              component[k] != component[j]) {
+            const int from = component[j];
+            for (int l = 0; l <= j; ++l) {
+              if (component[l] == from) {
+                component[l] = component[k];
+              }
+            }
+          }
+        }
+      }
+      vector<vector<int> > branches;
+      vector<int> branch_ids(region.size(), -1);
+      vector<bool> branch_serial;
+      for (int j = 0; j < region.size(); ++j) {
+        if (branch_ids[component[j]] < 0) {
+          branch_ids[component[j]] = branches.size();
+          branches.push_back(vector<int>());
+          branch_serial.push_back(false);
+        }
+        branches[branch_ids[component[j]]].push_back(region[j]);
+        if (serial_[region[j]]) {
+          branch_serial[branch_ids[component[j]]] = true;
+        }
+      }
+      const int num_serial =
+          std::count(branch_serial.begin(), branch_serial.end(), true);
+      vector<int> workers;
+      if (branches.size() == 1 || num_serial > 1) {
+        // Keep the order, and with it that of the random numbers drawn.
+        AddStage(vector<vector<int> >(1, region), workers);
+      } else if (num_serial == 0 && Assign(branches, &workers)) {
+        AddStage(branches, workers);
+      } else {
+        for (int j = 0; j < branches.size(); ++j) {
+          Decompose(branches[j]);
+        }
+      }
+      region.clear();
+    }
+    if (i < layers.size()) {
+      AddStage(vector<vector<int> >(1, vector<int>(1, layers[i])),
+               vector<int>());
+    }
+  }
+}
+
+template <typename Dtype>
+void LayerScheduler<Dtype>::AddStage(const vector<vector<int> >& branches,
+    const vector<int>& workers) {
+  stages_.push_back(branches);
+  branch_workers_.push_back(workers);
+  // Reading a blob can convert its memory, e.g. from a private layout, which
+  // branches must not do concurrently.
+  vector<Blob<Dtype>*> shared;
+  if (!workers.empty()) {
+    std::map<SyncedMemory*, int> readers;
+    for (int i = 0; i < branches.size(); ++i) {
+      std::set<SyncedMemory*> branch_reads;
+      for (int j = 0; j < branches[i].size(); ++j) {
+        const vector<Blob<Dtype>*>& bottom = net_.bottom_vecs()[branches[i][j]];
+        for (int k = 0; k < bottom.size(); ++k) {
+          if (bottom[k]->count() > 0 &&
+              branch_reads.insert(bottom[k]->data().get()).second &&
+              ++readers[bottom[k]->data().get()] == 2) {
+            shared.push_back(bottom[k]);
+          }
+        }
+      }
+    }
+  }
+  shared_bottoms_.push_back(shared);
+}
+
+template <typename Dtype>
+bool LayerScheduler<Dtype>::Assign(const vector<vector<int> >& branches,
+    vector<int>* workers) {
+  // Layers split their images over the threads they get, so that the time
+  // of a layer is its cost over the threads, up to the number of images.
+  const double worker_threads =
+      static_cast<double>(num_threads_) / num_workers_;
+  double serial_time = 0;
+  vector<pair<double, int> > times;
+  for (int i = 0; i < branches.size(); ++i) {
+    double time = 0;
+    for (int j = 0; j < branches[i].size(); ++j) {
+      const int layer_id = branches[i][j];
+      serial_time += costs_[layer_id] /
+          std::min<double>(num_threads_, widths_[layer_id]);
+      time += costs_[layer_id] /
+          std::min<double>(worker_threads, widths_[layer_id]);
+    }
+    times.push_back(make_pair(-time, i));
+  }
+  // Longest branches first, each to the least loaded worker.
+  std::sort(times.begin(), times.end());
+  vector<double> loads(num_workers_, 0);
+  workers->resize(branches.size());
+  for (int i = 0; i < times.size(); ++i) {
+    const int worker = std::min_element(loads.begin(), loads.end())
+        - loads.begin();
+    loads[worker] -= times[i].first;
+    (*workers)[times[i].second] = worker;
+  }
+  if (*std::max_element(loads.begin(), loads.end()) < serial_time) {
+    return true;
+  }
+  workers->clear();
+  return false;
+}
+
+template <typename Dtype>
+Dtype LayerScheduler<Dtype>::Forward() {
+  for (int stage = 0; stage < stages_.size(); ++stage) {
+    RunStage(stage, true);
+  }
+  // Summed in layer order, as by Net::ForwardFromTo.
+  Dtype loss = 0;
+  for (int layer_id = 0; layer_id < losses_.size(); ++layer_id) {
+    loss += losses_[layer_id];
+  }
+  return loss;
+}
+
+template <typename Dtype>
+void LayerScheduler<Dtype>::Backward() {
+  for (int stage = stages_.size() - 1; stage >= 0; --stage) {
+    RunStage(stage, false);
+  }
+}
+
+template <typename Dtype>
+void LayerScheduler<Dtype>::RunStage(int stage, bool forward) {
+  if (branch_workers_[stage].empty()) {
+    RunBranch(stages_[stage][0], forward);
+    return;
+  }
+  for (int i = 0; i < shared_bottoms_[stage].size(); ++i) {
+    shared_bottoms_[stage][i]->cpu_data();
+  }
+  boost::mutex::scoped_lock lock(mutex_);
+  stage_ = stage;
+  forward_ = forward;
+  pending_ = workers_.size();
+  ++generation_;
+  start_.notify_all();
+  while (pending_ > 0) {
+    done_.wait(lock);
+  }
+}
+
+template <typename Dtype>
+void LayerScheduler<Dtype>::RunBranch(const vector<int>& branch,
+    bool forward) {
+  const vector<shared_ptr<Layer<Dtype> > >& layers = net_.layers();
+  if (forward) {
+    for (int i = 0; i < branch.size(); ++i) {
+      const int layer_id = branch[i];
+      if (net_.layer_fused()[layer_id]) {
+        continue;
+      }
+      TraceSpan span("forward", net_.layer_names()[layer_id]);
+      losses_[layer_id] = layers[layer_id]->Forward(
+          net_.bottom_vecs()[layer_id], net_.top_vecs()[layer_id]);
+    }
+  } else {
+    for (int i = branch.size() - 1; i >= 0; --i) {
+      const int layer_id = branch[i];
+      if (net_.layer_need_backward()[layer_id] &&
+          !net_.layer_fused()[layer_id]) {
+        TraceSpan span("backward", net_.layer_names()[layer_id]);
+        layers[layer_id]->Backward(net_.top_vecs()[layer_id],
+            net_.bottom_need_backward()[layer_id],
+            net_.bottom_vecs()[layer_id]);
+      }
+    }
+  }
+}
+
+template <typename Dtype>
+void LayerScheduler<Dtype>::WorkerEntry(int worker) {
+  Caffe::set_mode(mode_);
+  Caffe::set_root_solver(root_solver_);
+#ifdef _OPENMP
+  omp_set_num_threads(threads_per_worker_);
+  caffe::cpu::OpenMpManager::bindOpenMpThreadsToPartition(worker,
+                                                          num_workers_);
+#endif
+  int generation = 0;
+  while (true) {
+    int stage;
+    bool forward;
+    {
+      boost::mutex::scoped_lock lock(mutex_);
+      while (!stop_ && generation == generation_) {
+        start_.wait(lock);
+      }
+      if (stop_) {
+        return;
+      }
+      generation = generation_;
+      stage = stage_;
+      forward = forward_;
+    }
+    for (int i = 0; i < stages_[stage].size(); ++i) {
+      if (branch_workers_[stage][i] == worker) {
+        RunBranch(stages_[stage][i], forward);
+      }
+    }
+    boost::mutex::scoped_lock lock(mutex_);
+    if (--pending_ == 0) {
+      done_.notify_one();
+    }
+  }
+}
+
+INSTANTIATE_CLASS(LayerScheduler);
+
+}  // namespace caffe
@@ -266,6 +266,10 @@ void BaseConvolutionLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
                   << num_of_threads_;
      num_of_threads_ = 1;
   }
+  if (this->layer_param_.num_threads() > 0) {
+    num_of_threads_ = std::min(num_of_threads_,
+        static_cast<int>(this->layer_param_.num_threads()));
+  }
 #ifdef USE_MKL
   num_mkl_local_threads_ = omp_get_max_threads() > this->num_of_threads_ ?
                            omp_get_max_threads()/this->num_of_threads_ : 1;
@@ -278,6 +282,7 @@ void BaseConvolutionLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
 
   col_buffer_mt_.resize(col_buffer_mt_size);
   weight_diff_mt_.resize(weight_diff_mt_size);
+  int8_buffers_mt_.resize(num_of_threads_);
 }
 
 template <typename Dtype>
@@ -311,6 +316,38 @@ void BaseConvolutionLayer<Dtype>::forward_cpu_gemm(const Dtype* input,
   }
 }
 
+template <typename Dtype>
+bool BaseConvolutionLayer<Dtype>::int8_forward() {
+  return (this->phase_ == TEST) && !reverse_dimensions() &&
+    (this->layer_param_.quantization_param().input_range() > 0);
+}
+
+template <typename Dtype>
+void BaseConvolutionLayer<Dtype>::forward_cpu_gemm_int8(const Dtype* input,
+    Dtype* output) {
+  int tid = 0;
+#ifdef _OPENMP
+  tid = omp_get_thread_num() % num_of_threads_;
+#endif
+  int col_data_buffer_size = col_buffer_mt_.size()/num_of_threads_;
+
+  const Dtype* col_buff = input;
+  if (!is_1x1_) {
+    Dtype* col_data = & col_buffer_mt_[ tid* col_data_buffer_size];
+    conv_im2col_cpu(input, col_data);
+    col_buff = col_data;
+  }
+
+  const Dtype input_scale =
+    Dtype(127) / this->layer_param_.quantization_param().input_range();
+  for (int g = 0; g < group_; ++g) {
+    int8_weights_.Forward(g * conv_out_channels_ / group_,
+        conv_out_channels_ / group_, conv_out_spatial_dim_, false,
+        col_buff + col_offset_ * g, input_scale, output + output_offset_ * g,
+        &int8_buffers_mt_[tid]);
+  }
+}
+
 template <typename Dtype>
 void BaseConvolutionLayer<Dtype>::forward_cpu_bias(Dtype* output,
     const Dtype* bias) {
@@ -8,6 +8,7 @@
 #include "caffe/layers/base_data_layer.hpp"
 #include "caffe/proto/caffe.pb.h"
 #include "caffe/util/blocking_queue.hpp"
+#include "caffe/util/trace.hpp"
 
 namespace caffe {
 
@@ -88,7 +89,10 @@ void BasePrefetchingDataLayer<Dtype>::InternalThreadEntry() {
   try {
     while (!must_stop()) {
       Batch<Dtype>* batch = prefetch_free_.pop();
-      load_batch(batch);
+      {
+        TraceSpan span("data", this->layer_param_.name());
+        load_batch(batch);
+      }
 #ifndef CPU_ONLY
       if (Caffe::mode() == Caffe::GPU) {
         batch->data_.data().get()->async_gpu_push(stream);
@@ -112,7 +116,10 @@ template <typename Dtype>
 void BasePrefetchingDataLayer<Dtype>::GetBatch() {
   try {
       Batch<Dtype>* batch = prefetch_free_.pop();
-      load_batch(batch);
+      {
+        TraceSpan span("data", this->layer_param_.name());
+        load_batch(batch);
+      }
       prefetch_full_.push(batch);
   } catch (boost::thread_interrupted&) {
     // Interrupted exception is expected on shutdown
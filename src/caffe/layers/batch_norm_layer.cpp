@@ -1,7 +1,7 @@
-#include <algorithm>
-#include <functional>
+#include <cmath>
 #include <vector>
 
+#include "caffe/filler.hpp"
 #include "caffe/layers/batch_norm_layer.hpp"
 #include "caffe/util/math_functions.hpp"
 
@@ -20,10 +20,15 @@ void BatchNormLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
   else
     channels_ = bottom[0]->shape(1);
   eps_ = param.eps();
+  scale_bias_ = param.scale_bias();
+  const int num_blobs = scale_bias_ ? 5 : 3;
   if (this->blobs_.size() > 0) {
+    CHECK_EQ(this->blobs_.size(), num_blobs)
+        << "Incorrect number of parameter blobs for scale_bias = "
+        << scale_bias_;
     LOG(INFO) << "Skipping parameter initialization";
   } else {
-    this->blobs_.resize(3);
+    this->blobs_.resize(num_blobs);
     vector<int> sz;
     sz.push_back(channels_);
     this->blobs_[0].reset(new Blob<Dtype>(sz));
@@ -34,6 +39,58 @@ void BatchNormLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
       caffe_set(this->blobs_[i]->count(), Dtype(0),
                 this->blobs_[i]->mutable_cpu_data());
     }
+    if (scale_bias_) {
+      sz[0] = channels_;
+      this->blobs_[3].reset(new Blob<Dtype>(sz));
+      this->blobs_[4].reset(new Blob<Dtype>(sz));
+      FillerParameter scale_filler_param(param.scale_filler());
+      if (!param.has_scale_filler()) {
+        // Default to unit (1) filler for identity operation.
+        scale_filler_param.set_type("constant");
+        scale_filler_param.set_value(1);
+      }
+      shared_ptr<Filler<Dtype> > scale_filler(
+          GetFiller<Dtype>(scale_filler_param));
+      scale_filler->Fill(this->blobs_[3].get());
+      shared_ptr<Filler<Dtype> > bias_filler(
+          GetFiller<Dtype>(param.bias_filler()));
+      bias_filler->Fill(this->blobs_[4].get());
+    }
+  }
+  // The statistics are updated by Forward, only the scale and bias learned.
+  this->param_propagate_down_.resize(num_blobs, true);
+  for (int i = 0; i < 3; ++i) {
+    this->param_propagate_down_[i] = false;
+  }
+}
+
+template <typename Dtype>
+void BatchNormLayer<Dtype>::FuseScale(Layer<Dtype>* scale) {
+  CHECK(!scale_bias_) << "BatchNorm with scale_bias already scales";
+  CHECK(!scale || scale->blobs()[0]->count() == channels_)
+      << "Only a per-channel scale can be fused";
+  scale_layer_ = scale;
+}
+
+template <typename Dtype>
+void BatchNormLayer<Dtype>::ScaleBias(Blob<Dtype>** scale, Blob<Dtype>** bias,
+    bool* scale_diff, bool* bias_diff) {
+  *scale = NULL;
+  *bias = NULL;
+  *scale_diff = false;
+  *bias_diff = false;
+  if (scale_bias_) {
+    *scale = this->blobs_[3].get();
+    *bias = this->blobs_[4].get();
+    *scale_diff = this->param_propagate_down_[3];
+    *bias_diff = this->param_propagate_down_[4];
+  } else if (scale_layer_) {
+    *scale = scale_layer_->blobs()[0].get();
+    *scale_diff = scale_layer_->param_propagate_down(0);
+    if (scale_layer_->blobs().size() > 1) {
+      *bias = scale_layer_->blobs()[1].get();
+      *bias_diff = scale_layer_->param_propagate_down(1);
+    }
   }
 }
 
@@ -72,149 +129,118 @@ void BatchNormLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
   }
 }
 
-template <typename Dtype>
-void BatchNormLayer<Dtype>::replicate(Dtype* buffer_to_write,
-                                      int num_batches,
-                                      unsigned int batch_offset_incr,
-                                      unsigned int channel_offset_incr,
-                                      const Dtype* data_to_be_replicated) {
-#ifdef _OPENMP
-  #pragma omp parallel for collapse(2)
-#endif
-  for (unsigned int j = 0; j< channels_; ++j) {
-    for (unsigned int n = 0; n < num_batches; ++n) {
-      caffe_set(channel_offset_incr, data_to_be_replicated[j],
-        buffer_to_write + j * channel_offset_incr + n * batch_offset_incr);
-    }
-  }
-}
-
-template <typename Dtype>
-template <typename FuncTy>
-void BatchNormLayer<Dtype>::replicate_to_op(Dtype* buffer_to_write,
-                                      int num_batches,
-                                      unsigned int batch_offset_incr,
-                                      unsigned int channel_offset_incr,
-                                      const Dtype* data_to_be_replicated,
-                                      FuncTy op_func) {
-#ifdef _OPENMP
-  #pragma omp parallel for collapse(2)
-#endif
-  for (unsigned int j = 0; j< channels_; ++j) {
-    for (unsigned int n = 0; n < num_batches; ++n) {
-      Dtype value = data_to_be_replicated[j];
-      Dtype* buffer_offsetted =
-        buffer_to_write + j * channel_offset_incr + n * batch_offset_incr;
-      for (unsigned int k = 0; k < channel_offset_incr; ++k) {
-        buffer_offsetted[k] = op_func(buffer_offsetted[k], value);
-      }
-    }
-  }
-}
-
-
-
 template <typename Dtype>
 void BatchNormLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
     const vector<Blob<Dtype>*>& top) {
   const Dtype* bottom_data = bottom[0]->cpu_data();
   Dtype* top_data = top[0]->mutable_cpu_data();
-  int num = bottom[0]->shape(0);
-  int spatial_dim = bottom[0]->count()/(bottom[0]->shape(0)*channels_);
-
-  if (bottom[0] != top[0]) {
-    caffe_copy(bottom[0]->count(), bottom_data, top_data);
-  }
+  // TODO(cdoersch): The caching is only needed because later in-place layers
+  //                 might clobber the data.  Can we skip this if they won't?
+  Dtype* x_norm_data = x_norm_.mutable_cpu_data();
+  const int num = bottom[0]->shape(0);
+  const int spatial_dim = bottom[0]->count()/(num*channels_);
+  Dtype* mean_data = mean_.mutable_cpu_data();
+  // Holds sqrt(var(X) + eps) once the channel is normalized.
+  Dtype* std_data = variance_.mutable_cpu_data();
+  Blob<Dtype>* scale;
+  Blob<Dtype>* bias;
+  bool scale_diff, bias_diff;
+  ScaleBias(&scale, &bias, &scale_diff, &bias_diff);
+  const Dtype* scale_data = scale ? scale->cpu_data() : NULL;
+  const Dtype* bias_data = bias ? bias->cpu_data() : NULL;
+  Dtype* moving_mean = NULL;
+  Dtype* moving_variance = NULL;
+  int m = bottom[0]->count()/channels_;
+  const Dtype bias_correction_factor = m > 1 ? Dtype(m)/(m-1) : 1;
 
   if (use_global_stats_) {
     // use the stored mean/variance estimates.
     const Dtype scale_factor = this->blobs_[2]->cpu_data()[0] == 0 ?
         0 : 1 / this->blobs_[2]->cpu_data()[0];
     caffe_cpu_scale(variance_.count(), scale_factor,
-        this->blobs_[0]->cpu_data(), mean_.mutable_cpu_data());
+        this->blobs_[0]->cpu_data(), mean_data);
     caffe_cpu_scale(variance_.count(), scale_factor,
-        this->blobs_[1]->cpu_data(), variance_.mutable_cpu_data());
+        this->blobs_[1]->cpu_data(), std_data);
   } else {
-    // compute mean
-    caffe_cpu_gemv<Dtype>(CblasNoTrans, channels_ * num, spatial_dim,
-        1. / (num * spatial_dim), bottom_data,
-        spatial_sum_multiplier_.cpu_data(), 0.,
-        num_by_chans_.mutable_cpu_data());
-    caffe_cpu_gemv<Dtype>(CblasTrans, num, channels_, 1.,
-        num_by_chans_.cpu_data(), batch_sum_multiplier_.cpu_data(), 0.,
-        mean_.mutable_cpu_data());
-  }
-
-  // subtract mean
-  replicate_to_op(top_data,
-                  num,
-                  spatial_dim*channels_,
-                  spatial_dim,
-                  mean_.cpu_data(),
-                  std::minus<Dtype>());
-
-  if (!use_global_stats_) {
-    // compute variance using var(X) = E((X-EX)^2)
-    caffe_powx(top[0]->count(), top_data, Dtype(2),
-        temp_.mutable_cpu_data());  // (X-EX)^2
-    caffe_cpu_gemv<Dtype>(CblasNoTrans, channels_ * num, spatial_dim,
-        1. / (num * spatial_dim), temp_.cpu_data(),
-        spatial_sum_multiplier_.cpu_data(), 0.,
-        num_by_chans_.mutable_cpu_data());
-    caffe_cpu_gemv<Dtype>(CblasTrans, num, channels_, 1.,
-        num_by_chans_.cpu_data(), batch_sum_multiplier_.cpu_data(), 0.,
-        variance_.mutable_cpu_data());  // E((X_EX)^2)
-
     // compute and save moving average
     this->blobs_[2]->mutable_cpu_data()[0] *= moving_average_fraction_;
     this->blobs_[2]->mutable_cpu_data()[0] += 1;
-    caffe_cpu_axpby(mean_.count(), Dtype(1), mean_.cpu_data(),
-        moving_average_fraction_, this->blobs_[0]->mutable_cpu_data());
-    int m = bottom[0]->count()/channels_;
-    Dtype bias_correction_factor = m > 1 ? Dtype(m)/(m-1) : 1;
-    caffe_cpu_axpby(variance_.count(), bias_correction_factor,
-        variance_.cpu_data(), moving_average_fraction_,
-        this->blobs_[1]->mutable_cpu_data());
+    moving_mean = this->blobs_[0]->mutable_cpu_data();
+    moving_variance = this->blobs_[1]->mutable_cpu_data();
   }
 
-  // normalize variance
-  caffe_add_scalar(variance_.count(), eps_, variance_.mutable_cpu_data());
-  caffe_powx(variance_.count(), variance_.cpu_data(), Dtype(0.5),
-             variance_.mutable_cpu_data());
-
-  // replicate variance to input size
-  this->replicate(temp_.mutable_cpu_data(),
-                  num,
-                  spatial_dim*channels_,
-                  spatial_dim,
-                  variance_.cpu_data());
-
-  caffe_div(temp_.count(), top_data, temp_.cpu_data(), top_data);
-  // TODO(cdoersch): The caching is only needed because later in-place layers
-  //                 might clobber the data.  Can we skip this if they won't?
-  caffe_copy(x_norm_.count(), top_data,
-      x_norm_.mutable_cpu_data());
+#ifdef _OPENMP
+  #pragma omp parallel for
+#endif
+  for (int c = 0; c < channels_; ++c) {
+    if (!use_global_stats_) {
+      // The mean and the sum of squared deviations of each row, merged into
+      // those of the rows before it.
+      double mean = 0, m2 = 0, count = 0;
+      for (int n = 0; n < num; ++n) {
+        const Dtype* x = bottom_data + (n * channels_ + c) * spatial_dim;
+        Dtype sum = 0;
+        for (int i = 0; i < spatial_dim; ++i) {
+          sum += x[i];
+        }
+        const Dtype row_mean = sum / spatial_dim;
+        Dtype row_m2 = 0;
+        for (int i = 0; i < spatial_dim; ++i) {
+          const Dtype deviation = x[i] - row_mean;
+          row_m2 += deviation * deviation;
+        }
+        const double delta = row_mean - mean;
+        const double merged = count + spatial_dim;
+        mean += delta * spatial_dim / merged;
+        m2 += row_m2 + delta * delta * count * spatial_dim / merged;
+        count = merged;
+      }
+      mean_data[c] = mean;
+      std_data[c] = m2 / count;
+      moving_mean[c] = mean_data[c] + moving_average_fraction_ * moving_mean[c];
+      moving_variance[c] = bias_correction_factor * std_data[c] +
+          moving_average_fraction_ * moving_variance[c];
+    }
+    // normalize variance
+    std_data[c] = sqrt(std_data[c] + eps_);
+    const Dtype mean = mean_data[c];
+    const Dtype inv_std = 1 / std_data[c];
+    const Dtype scale = scale_data ? scale_data[c] : Dtype(1);
+    const Dtype bias = bias_data ? bias_data[c] : Dtype(0);
+    for (int n = 0; n < num; ++n) {
+      const int offset = (n * channels_ + c) * spatial_dim;
+      const Dtype* x = bottom_data + offset;
+      Dtype* x_norm = x_norm_data + offset;
+      Dtype* y = top_data + offset;
+      for (int i = 0; i < spatial_dim; ++i) {
+        x_norm[i] = (x[i] - mean) * inv_std;
+        y[i] = x_norm[i] * scale + bias;
+      }
+    }
+  }
 }
 
 template <typename Dtype>
 void BatchNormLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
     const vector<bool>& propagate_down,
     const vector<Blob<Dtype>*>& bottom) {
-  const Dtype* top_diff;
-  if (bottom[0] != top[0]) {
-    top_diff = top[0]->cpu_diff();
-  } else {
-    caffe_copy(x_norm_.count(), top[0]->cpu_diff(), x_norm_.mutable_cpu_diff());
-    top_diff = x_norm_.cpu_diff();
-  }
-  Dtype* bottom_diff = bottom[0]->mutable_cpu_diff();
-  if (use_global_stats_) {
-    caffe_div(temp_.count(), top_diff, temp_.cpu_data(), bottom_diff);
-    return;
-  }
+  const Dtype* top_diff = top[0]->cpu_diff();
+  Dtype* bottom_diff = propagate_down[0] ? bottom[0]->mutable_cpu_diff() : NULL;
   const Dtype* top_data = x_norm_.cpu_data();
-  int num = bottom[0]->shape()[0];
-  int spatial_dim = bottom[0]->count()/(bottom[0]->shape(0)*channels_);
+  // note: variance_ still contains sqrt(var(X)+eps), computed during the
+  // forward pass.
+  const Dtype* std_data = variance_.cpu_data();
+  Blob<Dtype>* scale;
+  Blob<Dtype>* bias;
+  bool scale_propagate_down, bias_propagate_down;
+  ScaleBias(&scale, &bias, &scale_propagate_down, &bias_propagate_down);
+  const Dtype* scale_data = scale ? scale->cpu_data() : NULL;
+  Dtype* scale_diff = scale_propagate_down ? scale->mutable_cpu_diff() : NULL;
+  Dtype* bias_diff = bias_propagate_down ? bias->mutable_cpu_diff() : NULL;
+  const int num = bottom[0]->shape(0);
+  const int spatial_dim = bottom[0]->count()/(num*channels_);
+  const Dtype m = Dtype(num) * spatial_dim;
+  const bool need_sums = !use_global_stats_ || scale_diff || bias_diff;
   // if Y = (X-mean(X))/(sqrt(var(X)+eps)), then
   //
   // dE(Y)/dX =
@@ -223,52 +249,50 @@ void BatchNormLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
   //
   // where \cdot and ./ are hadamard product and elementwise division,
   // respectively, dE/dY is the top diff, and mean/var/sum are all computed
-  // along all dimensions except the channels dimension.  In the above
-  // equation, the operations allow for expansion (i.e. broadcast) along all
-  // dimensions except the channels dimension where required.
-
-  // sum(dE/dY \cdot Y)
-  caffe_mul(temp_.count(), top_data, top_diff, bottom_diff);
-  caffe_cpu_gemv<Dtype>(CblasNoTrans, channels_ * num, spatial_dim, 1.,
-      bottom_diff, spatial_sum_multiplier_.cpu_data(), 0.,
-      num_by_chans_.mutable_cpu_data());
-  caffe_cpu_gemv<Dtype>(CblasTrans, num, channels_, 1.,
-      num_by_chans_.cpu_data(), batch_sum_multiplier_.cpu_data(), 0.,
-      mean_.mutable_cpu_data());
-
-  this->replicate(bottom_diff,
-                  num,
-                  spatial_dim*channels_,
-                  spatial_dim,
-                  mean_.cpu_data());
-
-  // sum(dE/dY \cdot Y) \cdot Y
-  caffe_mul(temp_.count(), top_data, bottom_diff, bottom_diff);
-
-  // sum(dE/dY)-sum(dE/dY \cdot Y) \cdot Y
-  caffe_cpu_gemv<Dtype>(CblasNoTrans, channels_ * num, spatial_dim, 1.,
-      top_diff, spatial_sum_multiplier_.cpu_data(), 0.,
-      num_by_chans_.mutable_cpu_data());
-  caffe_cpu_gemv<Dtype>(CblasTrans, num, channels_, 1.,
-      num_by_chans_.cpu_data(), batch_sum_multiplier_.cpu_data(), 0.,
-      mean_.mutable_cpu_data());
-  // reshape (broadcast) the above to make
-  // sum(dE/dY)-sum(dE/dY \cdot Y) \cdot Y
-
-  replicate_to_op(bottom_diff,
-                  num,
-                  spatial_dim*channels_,
-                  spatial_dim,
-                  mean_.cpu_data(),
-                  std::plus<Dtype>());
-
-  // dE/dY - mean(dE/dY)-mean(dE/dY \cdot Y) \cdot Y
-  caffe_cpu_axpby(temp_.count(), Dtype(1), top_diff,
-      Dtype(-1. / (num * spatial_dim)), bottom_diff);
-
-  // note: temp_ still contains sqrt(var(X)+eps), computed during the forward
-  // pass.
-  caffe_div(temp_.count(), bottom_diff, temp_.cpu_data(), bottom_diff);
+  // along all dimensions except the channels dimension.  With the scale,
+  // dE/dY is the top diff times the scale, and sum(dE/dY) and
+  // sum(dE/dY \cdot Y) are the scale times the bias and scale gradients.
+#ifdef _OPENMP
+  #pragma omp parallel for
+#endif
+  for (int c = 0; c < channels_; ++c) {
+    double sum_diff = 0, sum_diff_data = 0;
+    if (need_sums) {
+      for (int n = 0; n < num; ++n) {
+        const int offset = (n * channels_ + c) * spatial_dim;
+        const Dtype* dy = top_diff + offset;
+        const Dtype* y = top_data + offset;
+        Dtype row_diff = 0, row_diff_data = 0;
+        for (int i = 0; i < spatial_dim; ++i) {
+          row_diff += dy[i];
+          row_diff_data += dy[i] * y[i];
+        }
+        sum_diff += row_diff;
+        sum_diff_data += row_diff_data;
+      }
+    }
+    if (scale_diff) {
+      scale_diff[c] += sum_diff_data;
+    }
+    if (bias_diff) {
+      bias_diff[c] += sum_diff;
+    }
+    if (!bottom_diff) {
+      continue;
+    }
+    const Dtype factor = (scale_data ? scale_data[c] : Dtype(1)) / std_data[c];
+    const Dtype mean_diff = use_global_stats_ ? 0 : sum_diff / m;
+    const Dtype mean_diff_data = use_global_stats_ ? 0 : sum_diff_data / m;
+    for (int n = 0; n < num; ++n) {
+      const int offset = (n * channels_ + c) * spatial_dim;
+      const Dtype* dy = top_diff + offset;
+      const Dtype* y = top_data + offset;
+      Dtype* dx = bottom_diff + offset;
+      for (int i = 0; i < spatial_dim; ++i) {
+        dx[i] = factor * (dy[i] - mean_diff - mean_diff_data * y[i]);
+      }
+    }
+  }
 }
 
 
@@ -9,6 +9,8 @@ namespace caffe {
 template <typename Dtype>
 void BatchNormLayer<Dtype>::Forward_gpu(const vector<Blob<Dtype>*>& bottom,
     const vector<Blob<Dtype>*>& top) {
+  CHECK(!scale_bias_) << "BatchNorm scale_bias is only implemented on the CPU";
+  CHECK(!scale_layer_) << "BatchNorm FuseScale is only implemented on the CPU";
   const Dtype* bottom_data = bottom[0]->gpu_data();
   Dtype* top_data = top[0]->mutable_gpu_data();
   int num = bottom[0]->shape(0);
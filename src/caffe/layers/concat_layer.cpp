@@ -1,3 +1,5 @@
+#include <algorithm>
+#include <cstring>
 #include <vector>
 
 #ifdef _OPENMP
@@ -5,6 +7,7 @@
 #endif
 
 #include "caffe/layers/concat_layer.hpp"
+#include "caffe/util/half.hpp"
 #include "caffe/util/math_functions.hpp"
 
 namespace caffe {
@@ -61,22 +64,47 @@ template <typename Dtype>
 void ConcatLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
   if (bottom.size() == 1) { return; }
-  Dtype* top_data = top[0]->mutable_cpu_data();
+  const Storage top_storage = top[0]->storage();
+  void* top_data = top[0]->mutable_cpu_storage_data();
   int offset_concat_axis = 0;
   const int top_concat_axis = top[0]->shape(concat_axis_);
   for (int i = 0; i < bottom.size(); ++i) {
-    const Dtype* bottom_data = bottom[i]->cpu_data();
+    const Storage bottom_storage = bottom[i]->storage();
+    const void* bottom_data = bottom[i]->cpu_storage_data();
     const int bottom_concat_axis = bottom[i]->shape(concat_axis_);
     const int offset_value = offset_concat_axis;
     offset_concat_axis += bottom_concat_axis;
+    const bool dtype = bottom_storage == STORAGE_DTYPE &&
+        top_storage == STORAGE_DTYPE;
+    // Written in place by its producer (see NetParameter.zero_copy_concat).
+    if (dtype && num_concats_ == 1 && bottom_data ==
+        static_cast<Dtype*>(top_data) + offset_value * concat_input_size_) {
+      continue;
+    }
+    const int size = bottom_concat_axis * concat_input_size_;
 #ifdef _OPENMP
   #pragma omp parallel for
 #endif
     for (int n = 0; n < num_concats_; ++n) {
-      caffe_copy(bottom_concat_axis * concat_input_size_,
-          bottom_data + n * bottom_concat_axis * concat_input_size_,
-          top_data + (n * top_concat_axis + offset_value)
-              * concat_input_size_);
+      const int bottom_offset = n * size;
+      const int top_offset =
+          (n * top_concat_axis + offset_value) * concat_input_size_;
+      if (dtype) {
+        caffe_copy(size, static_cast<const Dtype*>(bottom_data) + bottom_offset,
+            static_cast<Dtype*>(top_data) + top_offset);
+      } else if (bottom_storage == top_storage) {
+        memcpy(static_cast<uint16_t*>(top_data) + top_offset,  // NOLINT
+            static_cast<const uint16_t*>(bottom_data) + bottom_offset,
+            size * sizeof(uint16_t));
+      } else {
+        for (int start = 0; start < size; start += kStorageChunk) {
+          Dtype buffer[kStorageChunk];
+          const int count = std::min(kStorageChunk, size - start);
+          caffe_storage_store(top_storage, caffe_storage_load(bottom_storage,
+              bottom_data, bottom_offset + start, count, buffer),
+              top_offset + start, count, top_data);
+        }
+      }
     }
   }
 }
@@ -94,6 +122,10 @@ void ConcatLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
     offset_concat_axis += bottom_concat_axis;
     if (propagate_down[i]) {
       Dtype* bottom_diff = bottom[i]->mutable_cpu_diff();
+      if (num_concats_ == 1 &&
+          bottom_diff == top_diff + offset_value * concat_input_size_) {
+        continue;
+      }
 #ifdef _OPENMP
   #pragma omp parallel for
 #endif
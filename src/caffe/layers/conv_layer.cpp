@@ -32,6 +32,12 @@ template <typename Dtype>
 void ConvolutionLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
   const Dtype* weight = this->blobs_[0]->cpu_data();
+  // Quantized on every pass, test nets share the weights of a training net.
+  const bool int8_forward = this->int8_forward();
+  if (int8_forward) {
+    this->int8_weights_.SetWeights(this->num_output_,
+        this->blobs_[0]->count(1), false, weight);
+  }
   // If we have more threads available than batches to be prcessed then
   // we are wasting resources (lower batches than 36 on XeonE5)
   // So we instruct MKL
@@ -53,9 +59,14 @@ void ConvolutionLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
 #     pragma omp for
 #endif
       for (int n = 0; n < this->num_; ++n) {
-        this->forward_cpu_gemm(bottom_data + n*this->bottom_dim_,
-                               weight,
-                               top_data + n*this->top_dim_);
+        if (int8_forward) {
+          this->forward_cpu_gemm_int8(bottom_data + n*this->bottom_dim_,
+                                      top_data + n*this->top_dim_);
+        } else {
+          this->forward_cpu_gemm(bottom_data + n*this->bottom_dim_,
+                                 weight,
+                                 top_data + n*this->top_dim_);
+        }
         if (this->bias_term_) {
           const Dtype* bias = this->blobs_[1]->cpu_data();
           this->forward_cpu_bias(top_data + n * this->top_dim_, bias);
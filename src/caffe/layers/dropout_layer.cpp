@@ -1,5 +1,6 @@
 // TODO (sergeyk): effect should not be dependent on phase. wasted memcpy.
 
+#include <algorithm>
 #include <vector>
 
 #include "caffe/layers/dropout_layer.hpp"
@@ -25,6 +26,7 @@ void DropoutLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
   // Set up the cache for random number generation
   // ReshapeLike does not work because rand_vec_ is of Dtype uint
   rand_vec_.Reshape(bottom[0]->shape());
+  mask_.Reshape(vector<int>(1, (bottom[0]->count() + 31) / 32));
 }
 
 template <typename Dtype>
@@ -32,16 +34,19 @@ void DropoutLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
     const vector<Blob<Dtype>*>& top) {
   const Dtype* bottom_data = bottom[0]->cpu_data();
   Dtype* top_data = top[0]->mutable_cpu_data();
-  unsigned int* mask = rand_vec_.mutable_cpu_data();
   const int count = bottom[0]->count();
   if (this->phase_ == TRAIN) {
-    // Create random numbers
-    caffe_rng_bernoulli(count, 1. - threshold_, mask);
+    unsigned int* mask = mask_.mutable_cpu_data();
+    caffe_rng_bernoulli_bits(count, 1. - threshold_, mask);
 #ifdef _OPENMP
     #pragma omp parallel for
 #endif
-    for (int i = 0; i < count; ++i) {
-      top_data[i] = bottom_data[i] * mask[i] * scale_;
+    for (int w = 0; w < mask_.count(); ++w) {
+      const int end = std::min(count - 32 * w, 32);
+      for (int j = 0; j < end; ++j) {
+        const int i = 32 * w + j;
+        top_data[i] = bottom_data[i] * ((mask[w] >> j) & 1) * scale_;
+      }
     }
   } else {
     caffe_copy(bottom[0]->count(), bottom_data, top_data);
@@ -56,13 +61,17 @@ void DropoutLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
     const Dtype* top_diff = top[0]->cpu_diff();
     Dtype* bottom_diff = bottom[0]->mutable_cpu_diff();
     if (this->phase_ == TRAIN) {
-      const unsigned int* mask = rand_vec_.cpu_data();
+      const unsigned int* mask = mask_.cpu_data();
       const int count = bottom[0]->count();
 #ifdef _OPENMP
       #pragma omp parallel for
 #endif
-      for (int i = 0; i < count; ++i) {
-        bottom_diff[i] = top_diff[i] * mask[i] * scale_;
+      for (int w = 0; w < mask_.count(); ++w) {
+        const int end = std::min(count - 32 * w, 32);
+        for (int j = 0; j < end; ++j) {
+          const int i = 32 * w + j;
+          bottom_diff[i] = top_diff[i] * ((mask[w] >> j) & 1) * scale_;
+        }
       }
     } else {
       caffe_copy(top[0]->count(), top_diff, bottom_diff);
@@ -1,7 +1,9 @@
+#include <algorithm>
 #include <cfloat>
 #include <vector>
 
 #include "caffe/layers/eltwise_layer.hpp"
+#include "caffe/util/half.hpp"
 #include "caffe/util/math_functions.hpp"
 
 namespace caffe {
@@ -48,6 +50,14 @@ void EltwiseLayer<Dtype>::Forward_cpu(
   const Dtype* bottom_data_a = NULL;
   const Dtype* bottom_data_b = NULL;
   const int count = top[0]->count();
+  bool half = top[0]->storage() != STORAGE_DTYPE;
+  for (int i = 0; i < bottom.size(); ++i) {
+    half |= bottom[i]->storage() != STORAGE_DTYPE;
+  }
+  if (half) {
+    ForwardStorage_cpu(bottom, top);
+    return;
+  }
   Dtype* top_data = top[0]->mutable_cpu_data();
   switch (op_) {
   case EltwiseParameter_EltwiseOp_PROD:
@@ -96,6 +106,59 @@ void EltwiseLayer<Dtype>::Forward_cpu(
   }
 }
 
+template <typename Dtype>
+void EltwiseLayer<Dtype>::ForwardStorage_cpu(
+    const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+  vector<Storage> bottom_storage(bottom.size());
+  vector<const void*> bottom_data(bottom.size());
+  for (int i = 0; i < bottom.size(); ++i) {
+    bottom_storage[i] = bottom[i]->storage();
+    bottom_data[i] = bottom[i]->cpu_storage_data();
+  }
+  const Storage top_storage = top[0]->storage();
+  void* top_data = top[0]->mutable_cpu_storage_data();
+  int* mask = op_ == EltwiseParameter_EltwiseOp_MAX ?
+      max_idx_.mutable_cpu_data() : NULL;
+  const int count = top[0]->count();
+#ifdef _OPENMP
+  #pragma omp parallel for
+#endif
+  for (int start = 0; start < count; start += kStorageChunk) {
+    Dtype x_buffer[kStorageChunk];
+    Dtype y_buffer[kStorageChunk];
+    const int n = std::min(kStorageChunk, count - start);
+    Dtype* y = caffe_storage_target(top_storage, top_data, start, y_buffer);
+    for (int b = 0; b < bottom.size(); ++b) {
+      const Dtype* x = caffe_storage_load(bottom_storage[b], bottom_data[b],
+          start, n, x_buffer);
+      switch (op_) {
+      case EltwiseParameter_EltwiseOp_PROD:
+        for (int i = 0; i < n; ++i) {
+          y[i] = b == 0 ? x[i] : y[i] * x[i];
+        }
+        break;
+      case EltwiseParameter_EltwiseOp_SUM:
+        for (int i = 0; i < n; ++i) {
+          y[i] = b == 0 ? coeffs_[b] * x[i] : y[i] + coeffs_[b] * x[i];
+        }
+        break;
+      case EltwiseParameter_EltwiseOp_MAX:
+        // Ties go to the second bottom, as in Forward_cpu.
+        for (int i = 0; i < n; ++i) {
+          if (b == 0 || (b == 1 ? !(y[i] > x[i]) : x[i] > y[i])) {
+            y[i] = x[i];
+            mask[start + i] = b;
+          }
+        }
+        break;
+      default:
+        LOG(FATAL) << "Unknown elementwise operation.";
+      }
+    }
+    caffe_storage_store(top_storage, y, start, n, top_data);
+  }
+}
+
 template <typename Dtype>
 void EltwiseLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
     const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom) {
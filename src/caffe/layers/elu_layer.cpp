@@ -2,6 +2,7 @@
 #include <vector>
 
 #include "caffe/layers/elu_layer.hpp"
+#include "caffe/util/math_functions.hpp"
 
 namespace caffe {
 
@@ -12,12 +13,23 @@ void ELULayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
   Dtype* top_data = top[0]->mutable_cpu_data();
   const int count = bottom[0]->count();
   Dtype alpha = this->layer_param_.elu_param().alpha();
+  // exp(min(x, 0)) is computed a chunk at a time on the stack, as the top
+  // may be the bottom.
+  const int kChunkSize = 1024;
 #ifdef _OPENMP
 #pragma omp parallel for
 #endif
-  for (int i = 0; i < count; ++i) {
-    top_data[i] = std::max(bottom_data[i], Dtype(0))
-        + alpha * (exp(std::min(bottom_data[i], Dtype(0))) - Dtype(1));
+  for (int start = 0; start < count; start += kChunkSize) {
+    Dtype exp_data[kChunkSize];
+    const int n = std::min(kChunkSize, count - start);
+    for (int i = 0; i < n; ++i) {
+      exp_data[i] = std::min(bottom_data[start + i], Dtype(0));
+    }
+    caffe_exp(n, exp_data, exp_data);
+    for (int i = 0; i < n; ++i) {
+      top_data[start + i] = std::max(bottom_data[start + i], Dtype(0))
+          + alpha * (exp_data[i] - Dtype(1));
+    }
   }
 }
 
@@ -86,9 +86,19 @@ void InnerProductLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
   const Dtype* bottom_data = bottom[0]->cpu_data();
   Dtype* top_data = top[0]->mutable_cpu_data();
   const Dtype* weight = this->blobs_[0]->cpu_data();
-  caffe_cpu_gemm<Dtype>(CblasNoTrans, transpose_ ? CblasNoTrans : CblasTrans,
-      M_, N_, K_, (Dtype)1.,
-      bottom_data, weight, (Dtype)0., top_data);
+  const QuantizationParameter& quantization_param =
+    this->layer_param_.quantization_param();
+  if ((this->phase_ == TEST) && (quantization_param.input_range() > 0)) {
+    // Quantized on every pass, test nets share the weights of a training net.
+    int8_weights_.SetWeights(N_, K_, transpose_, weight);
+    int8_weights_.Forward(0, N_, M_, true, bottom_data,
+        Dtype(127) / quantization_param.input_range(), top_data,
+        &int8_buffers_);
+  } else {
+    caffe_cpu_gemm<Dtype>(CblasNoTrans, transpose_ ? CblasNoTrans : CblasTrans,
+        M_, N_, K_, (Dtype)1.,
+        bottom_data, weight, (Dtype)0., top_data);
+  }
   if (bias_term_) {
     caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, M_, N_, 1, (Dtype)1.,
         bias_multiplier_.cpu_data(),
@@ -1,6 +1,8 @@
+#include <algorithm>
 #include <vector>
 
 #include "caffe/layers/lrn_layer.hpp"
+#include "caffe/util/half.hpp"
 #include "caffe/util/math_functions.hpp"
 #ifdef _OPENMP
 #include <omp.h>
@@ -85,6 +87,10 @@ void LRNLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
      LOG(WARNING) << "LRN layer: omp_get_max_threads() =" << num_of_threads_;
      num_of_threads_ = 1;
   }
+  if (this->layer_param_.num_threads() > 0) {
+    num_of_threads_ = std::min(num_of_threads_,
+        static_cast<int>(this->layer_param_.num_threads()));
+  }
 #ifdef USE_MKL
   num_mkl_local_threads_ = omp_get_max_threads() > num_of_threads_ ?
                            omp_get_max_threads()/num_of_threads_ : 1;
@@ -127,46 +133,62 @@ void LRNLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
 template <typename Dtype>
 void LRNLayer<Dtype>::CrossChannelForward_cpu(
     const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
-  const Dtype* bottom_data = bottom[0]->cpu_data();
-  Dtype* top_data = top[0]->mutable_cpu_data();
+  const Storage bottom_storage = bottom[0]->storage();
+  const Storage top_storage = top[0]->storage();
+  const void* bottom_data = bottom[0]->cpu_storage_data();
+  void* top_data = top[0]->mutable_cpu_storage_data();
   Dtype* scale_data = scale_.mutable_cpu_data();
   Dtype alpha_over_size = alpha_ / size_;
   int limit = pre_pad_ < (channels_-1) ? pre_pad_ : (channels_-1);
+  const int image_size = channels_ * height_ * width_;
 
-  caffe_sqr(num_ * channels_ * height_ * width_, bottom_data, top_data);
-
 #ifdef _OPENMP
-#pragma omp parallel for
+#pragma omp parallel
+#endif
+  {
+    // Half-width images are converted to and from Dtype here.
+    vector<Dtype> x_buffer(bottom_storage == STORAGE_DTYPE ? 0 : image_size);
+    vector<Dtype> y_buffer(top_storage == STORAGE_DTYPE ? 0 : image_size);
+#ifdef _OPENMP
+#pragma omp for
 #endif
-  for (int n = 0; n < num_; ++n) {
-    caffe_set(limit * height_ * width_, Dtype(k_),
-      scale_data + scale_.offset(n, 0));
-    for (int c = 0; c <= limit; ++c) {
-      caffe_axpy<Dtype>(height_ * width_, alpha_over_size,
-        top_data + scale_.offset(n, c),
+    for (int n = 0; n < num_; ++n) {
+      const Dtype* x = caffe_storage_load(bottom_storage, bottom_data,
+          n * image_size, image_size, x_buffer.empty() ? NULL : &x_buffer[0]);
+      Dtype* y = caffe_storage_target(top_storage, top_data, n * image_size,
+          y_buffer.empty() ? NULL : &y_buffer[0]);
+      // y holds the squares of x until the scale is complete.
+      caffe_sqr(image_size, x, y);
+      caffe_set(limit * height_ * width_, Dtype(k_),
         scale_data + scale_.offset(n, 0));
-    }
-    for (int c = 1; c < channels_; ++c) {
-      caffe_cpu_copy<Dtype>(height_ * width_,
-        scale_data + scale_.offset(n, c - 1),
-        scale_data + scale_.offset(n, c));
-      // copy previous scale
-      if (c < (channels_ - pre_pad_)) {
+      for (int c = 0; c <= limit; ++c) {
         caffe_axpy<Dtype>(height_ * width_, alpha_over_size,
-          top_data + scale_.offset(n, c + pre_pad_),
-          scale_data + scale_.offset(n, c));
+          y + c * height_ * width_,
+          scale_data + scale_.offset(n, 0));
       }
-      // subtract tail
-      if (c > pre_pad_) {
-        caffe_axpy<Dtype>(height_ * width_, -alpha_over_size,
-          top_data + scale_.offset(n, c - pre_pad_ - 1),
+      for (int c = 1; c < channels_; ++c) {
+        caffe_cpu_copy<Dtype>(height_ * width_,
+          scale_data + scale_.offset(n, c - 1),
           scale_data + scale_.offset(n, c));
+        // copy previous scale
+        if (c < (channels_ - pre_pad_)) {
+          caffe_axpy<Dtype>(height_ * width_, alpha_over_size,
+            y + (c + pre_pad_) * height_ * width_,
+            scale_data + scale_.offset(n, c));
+        }
+        // subtract tail
+        if (c > pre_pad_) {
+          caffe_axpy<Dtype>(height_ * width_, -alpha_over_size,
+            y + (c - pre_pad_ - 1) * height_ * width_,
+            scale_data + scale_.offset(n, c));
+        }
       }
+      caffe_powx<Dtype>(image_size, scale_data + scale_.offset(n), -beta_, y);
+      caffe_mul<Dtype>(image_size, y, x, y);
+      caffe_storage_store(top_storage, y, n * image_size, image_size,
+          top_data);
     }
   }
-
-  caffe_powx<Dtype>(scale_.count(), scale_data, -beta_, top_data);
-  caffe_mul<Dtype>(scale_.count(), top_data, bottom_data, top_data);
 }
 
 template <typename Dtype>
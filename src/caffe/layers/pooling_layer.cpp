@@ -3,6 +3,7 @@
 #include <vector>
 
 #include "caffe/layers/pooling_layer.hpp"
+#include "caffe/util/half.hpp"
 #include "caffe/util/math_functions.hpp"
 
 namespace caffe {
@@ -124,8 +125,8 @@ void PoolingLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
 template <typename Dtype>
 void PoolingLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
-  const Dtype* bottom_data = bottom[0]->cpu_data();
-  Dtype* top_data = top[0]->mutable_cpu_data();
+  const Storage bottom_storage = bottom[0]->storage();
+  const Storage top_storage = top[0]->storage();
   const int top_count = top[0]->count();
   // We'll output the mask to top[1] if it's of size >1.
   const bool use_top_mask = top.size() > 1;
@@ -144,21 +145,60 @@ void PoolingLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
   const int num_batches = bottom[0]->num();
   const int num_channels = bottom[0]->channels();
 
+  if (bottom_storage == STORAGE_DTYPE && top_storage == STORAGE_DTYPE) {
+    const Dtype* bottom_data = bottom[0]->cpu_data();
+    Dtype* top_data = top[0]->mutable_cpu_data();
 #ifdef _OPENMP
   #pragma omp parallel for collapse(2)
 #endif
-  for (int image = 0; image < num_batches; ++image)
-    for (int channel = 0; channel < num_channels; ++channel)
-      generator_func(bottom_data,
-                     top_data,
-                     top_count,
-                     image,
-                     image+1,
-                     mask,
-                     channel,
-                     channel+1,
-                     this,
-                     use_top_mask);
+    for (int image = 0; image < num_batches; ++image)
+      for (int channel = 0; channel < num_channels; ++channel)
+        generator_func(bottom_data,
+                       top_data,
+                       top_count,
+                       image,
+                       image+1,
+                       mask,
+                       channel,
+                       channel+1,
+                       this,
+                       use_top_mask);
+    return;
+  }
+
+  // Half-width planes are converted to Dtype and pooled one at a time.
+  const void* bottom_data = bottom[0]->cpu_storage_data();
+  void* top_data = top[0]->mutable_cpu_storage_data();
+  const int fm_size = height_ * width_;
+  const int pooled_fm_size = pooled_height_ * pooled_width_;
+#ifdef _OPENMP
+  #pragma omp parallel
+#endif
+  {
+    vector<Dtype> x_buffer(fm_size);
+    vector<Dtype> y_buffer(pooled_fm_size);
+#ifdef _OPENMP
+  #pragma omp for collapse(2)
+#endif
+    for (int image = 0; image < num_batches; ++image)
+      for (int channel = 0; channel < num_channels; ++channel) {
+        const int plane = image * num_channels + channel;
+        const Dtype* x = caffe_storage_load(bottom_storage, bottom_data,
+            plane * fm_size, fm_size, &x_buffer[0]);
+        Dtype* y = caffe_storage_target(top_storage, top_data,
+            plane * pooled_fm_size, &y_buffer[0]);
+        void* plane_mask = NULL;
+        if (mask && use_top_mask) {
+          plane_mask = static_cast<Dtype*>(mask) + plane * pooled_fm_size;
+        } else if (mask) {
+          plane_mask = static_cast<int*>(mask) + plane * pooled_fm_size;
+        }
+        generator_func(x, y, top_count, 0, 1, plane_mask, 0, 1, this,
+                       use_top_mask);
+        caffe_storage_store(top_storage, y, plane * pooled_fm_size,
+            pooled_fm_size, top_data);
+      }
+  }
 }
 
 template <typename Dtype>
@@ -174,7 +214,7 @@ void PoolingLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
   const bool use_top_mask = top.size() > 1;
 
   typename PoolingCodeGeneratorBackward<Dtype>::Callback_t* generator_func =
-                          Backward_code_generator.Get_callback(this, top[0]);
+          Backward_code_generator.Get_callback(this, top[0], use_top_mask);
 
   // We are getting top_mask here as mutable_cpu_data is not thread safe
   // and doing it inside parallel region creates of risk of race condition
@@ -1,12 +1,85 @@
 #include <algorithm>
 #include <cfloat>
+#include <cstdlib>
+#include <cstring>
 
 #include "caffe/layers/pooling_layer.hpp"
 
+// AVX-512 kernels are written with intrinsics in functions compiled for
+// the ISA, as the bundled xbyak predates EVEX encoding.
+#if (defined __x86_64__ || defined _M_X64) && defined __GNUC__ && \
+    (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))
+#define CAFFE_POOLING_AVX512
+#include <immintrin.h>  // NOLINT(build/include_order)
+#endif
+
 namespace caffe {
 using std::min;
 using std::max;
 
+namespace {
+
+enum PoolingIsa {
+  POOLING_ISA_NAIVE,
+  POOLING_ISA_AVX2,
+  POOLING_ISA_AVX512
+};
+
+const char* pooling_isa_names[] = { "naive", "avx2", "avx512" };
+
+PoolingIsa supported_pooling_isa() {
+#if defined __x86_64__ || defined _M_X64
+  using Xbyak::util::Cpu;
+  Cpu current_cpu;
+  if (!current_cpu.has(Cpu::tAVX2)) {
+    return POOLING_ISA_NAIVE;
+  }
+#ifdef CAFFE_POOLING_AVX512
+  unsigned int data[4];
+  Cpu::getCpuidEx(7, 0, data);
+  const bool avx512f = data[1] & (1U << 16);
+  // The OS has to save the opmask and the upper zmm registers too.
+  if (avx512f && (Cpu::getXfeature() & 0xE6) == 0xE6) {
+    return POOLING_ISA_AVX512;
+  }
+#endif
+  return POOLING_ISA_AVX2;
+#else
+  return POOLING_ISA_NAIVE;
+#endif
+}
+
+PoolingIsa select_pooling_isa() {
+  PoolingIsa isa = supported_pooling_isa();
+  const char* forced = getenv("CAFFE_POOLING_ISA");
+  if (forced) {
+    int i = POOLING_ISA_NAIVE;
+    while (i <= POOLING_ISA_AVX512 && strcmp(forced, pooling_isa_names[i])) {
+      ++i;
+    }
+    CHECK_LE(i, POOLING_ISA_AVX512) << "Unknown CAFFE_POOLING_ISA " << forced
+        << ", expected naive, avx2 or avx512";
+    if (i > isa) {
+      LOG(WARNING) << "CAFFE_POOLING_ISA=" << forced << " is not supported "
+          << "by this CPU, using " << pooling_isa_names[isa];
+    } else {
+      isa = static_cast<PoolingIsa>(i);
+    }
+  }
+  LOG(INFO) << "Pooling kernels: " << pooling_isa_names[isa];
+  return isa;
+}
+
+// The best instruction set of the CPU, unless the CAFFE_POOLING_ISA
+// environment variable forces a lower one, e.g. to compare them with
+// caffe time.
+PoolingIsa pooling_isa() {
+  static const PoolingIsa isa = select_pooling_isa();
+  return isa;
+}
+
+}  // namespace
+
 template <typename Dtype>
 PoolingCodeGeneratorForward<Dtype>::PoolingCodeGeneratorForward() {
   Callback = NULL;
@@ -169,16 +242,140 @@ void PoolingCodeGeneratorForward<Dtype>::Create_callback(
 
 #if defined __x86_64__ || defined _M_X64
 // Here we have specialized versions for supported formats in x64 architectures.
+#ifdef CAFFE_POOLING_AVX512
+// AVX-512 version: computes 16 outputs of a row at once. The mask registers
+// disable the lanes past the end of the row, and the lanes whose window
+// element falls in the padding.
+template <>
+__attribute__((target("avx512f")))
+void PoolingCodeGeneratorForward<float>::Avx512(
+  const float* bottom_data,
+  float* top_data,
+  int top_count,
+  int batch_start,
+  int batch_end,
+  void* mask_ptr,
+  int64_t channel_start,
+  int64_t channel_end,
+  PoolingLayer<float>* layer,
+  bool use_top_mask) {
+  const bool max_pool = layer->layer_param_.pooling_param().pool()
+      == PoolingParameter_PoolMethod_MAX;
+  const int pooled_fm_size = layer->pooled_height_ * layer->pooled_width_;
+  const int fm_size = layer->height_ * layer->width_;
+  const int width = layer->width_;
+  const int pooled_width = layer->pooled_width_;
+
+  const __m512i lanes = _mm512_set_epi32(15, 14, 13, 12, 11, 10, 9, 8,
+                                         7, 6, 5, 4, 3, 2, 1, 0);
+  const __m512i zero = _mm512_setzero_si512();
+  const __m512i width_v = _mm512_set1_epi32(width);
+  const __m512i padded_width_v = _mm512_set1_epi32(width + layer->pad_w_);
+  const __m512i kernel_w_v = _mm512_set1_epi32(layer->kernel_w_);
+  const __m512i stride_w_v = _mm512_set1_epi32(layer->stride_w_);
+  const __m512i pad_w_v = _mm512_set1_epi32(layer->pad_w_);
+
+  for (int n = batch_start; n < batch_end; ++n) {
+    for (int64_t c = channel_start; c < channel_end; ++c) {
+      const int64_t plane = n * layer->channels_ + c;
+      const float* bottom = bottom_data + plane * fm_size;
+      float* top = top_data + plane * pooled_fm_size;
+      float* top_mask = NULL;
+      int* mask = NULL;
+      if (max_pool) {
+        top_mask = static_cast<float*>(mask_ptr) + plane * pooled_fm_size;
+        mask = static_cast<int*>(mask_ptr) + plane * pooled_fm_size;
+      }
+
+      for (int ph = 0; ph < layer->pooled_height_; ++ph) {
+        int hstart = ph * layer->stride_h_ - layer->pad_h_;
+        const int pool_h =
+          min(hstart + layer->kernel_h_, layer->height_ + layer->pad_h_)
+          - hstart;
+        const int hend = min(hstart + layer->kernel_h_, layer->height_);
+        hstart = max(hstart, 0);
+
+        for (int pw0 = 0; pw0 < pooled_width; pw0 += 16) {
+          const __mmask16 valid = pooled_width - pw0 >= 16 ? 0xFFFF :
+              static_cast<__mmask16>((1 << (pooled_width - pw0)) - 1);
+          const __m512i pw = _mm512_add_epi32(_mm512_set1_epi32(pw0), lanes);
+          const __m512i wstart =
+            _mm512_sub_epi32(_mm512_mullo_epi32(pw, stride_w_v), pad_w_v);
+          const int offset = ph * pooled_width + pw0;
+
+          __m512 acc = max_pool ? _mm512_set1_ps(-FLT_MAX) :
+                                  _mm512_setzero_ps();
+          __m512i index = _mm512_set1_epi32(-1);
+          for (int h = hstart; h < hend; ++h) {
+            const float* row = bottom + h * width;
+            const __m512i row_index = _mm512_set1_epi32(h * width);
+            for (int kw = 0; kw < layer->kernel_w_; ++kw) {
+              const __m512i w = _mm512_add_epi32(wstart, _mm512_set1_epi32(kw));
+              __mmask16 inside =
+                _mm512_mask_cmp_epi32_mask(valid, w, zero, _MM_CMPINT_NLT);
+              inside =
+                _mm512_mask_cmp_epi32_mask(inside, w, width_v, _MM_CMPINT_LT);
+              // Masked lanes are not read, even out of the row.
+              const __m512 value = layer->stride_w_ == 1 ?
+                _mm512_maskz_loadu_ps(inside, row + pw0 - layer->pad_w_ + kw) :
+                _mm512_mask_i32gather_ps(_mm512_setzero_ps(), inside, w, row,
+                                         sizeof(float));
+              if (max_pool) {
+                const __mmask16 greater =
+                  _mm512_mask_cmp_ps_mask(inside, value, acc, _CMP_GT_OQ);
+                acc = _mm512_mask_mov_ps(acc, greater, value);
+                index = _mm512_mask_mov_epi32(index, greater,
+                                              _mm512_add_epi32(row_index, w));
+              } else {
+                acc = _mm512_mask_add_ps(acc, inside, acc, value);
+              }
+            }
+          }
+
+          if (max_pool) {
+            _mm512_mask_storeu_ps(top + offset, valid, acc);
+            if (use_top_mask) {
+              _mm512_mask_storeu_ps(top_mask + offset, valid,
+                                    _mm512_cvtepi32_ps(index));
+            } else {
+              _mm512_mask_storeu_epi32(mask + offset, valid, index);
+            }
+          } else {
+            // pool_size = (hend - hstart) * (wend - wstart), with the window
+            // clipped to the padded input.
+            const __m512i pool_w = _mm512_sub_epi32(
+              _mm512_min_epi32(_mm512_add_epi32(wstart, kernel_w_v),
+                               padded_width_v),
+              wstart);
+            const __m512 pool_size = _mm512_cvtepi32_ps(
+              _mm512_mullo_epi32(pool_w, _mm512_set1_epi32(pool_h)));
+            _mm512_mask_storeu_ps(top + offset, valid,
+                                  _mm512_div_ps(acc, pool_size));
+          }
+        }
+      }
+    }
+  }
+}
+#endif
+
 template <>
 void PoolingCodeGeneratorForward<float>::Create_callback(
   PoolingLayer<float>* layer) {
-  using Xbyak::util::Cpu;
   using Xbyak::Reg64;
   using Xbyak::Reg32;
   using Xbyak::Address;
-  Cpu Current_cpu;
   const LayerParameter& param = layer->layer_param();
-  if (Current_cpu.has(Cpu::tAVX2) &&
+  const PoolingIsa isa = pooling_isa();
+#ifdef CAFFE_POOLING_AVX512
+  if (isa == POOLING_ISA_AVX512 &&
+      (param.pooling_param().pool() == PoolingParameter_PoolMethod_AVE ||
+       param.pooling_param().pool() == PoolingParameter_PoolMethod_MAX)) {
+    Callback = Avx512;
+    return;
+  }
+#endif
+  if (isa >= POOLING_ISA_AVX2 &&
       (param.pooling_param().pool() == PoolingParameter_PoolMethod_AVE ||
        param.pooling_param().pool() == PoolingParameter_PoolMethod_MAX)) {
     // AVX2 optimized version.
@@ -674,13 +871,18 @@ PoolingCodeGeneratorBackward<Dtype>::~PoolingCodeGeneratorBackward() {
 template <typename Dtype>
 typename PoolingCodeGeneratorBackward<Dtype>::Callback_t*
   PoolingCodeGeneratorBackward<Dtype>::Get_callback(
-    PoolingLayer<Dtype>* layer, Blob<Dtype>* top) {
+    PoolingLayer<Dtype>* layer, Blob<Dtype>* top, bool use_top_mask) {
   // Wrapper for lazy initialization.
   // Also check if top shape din't change.
   // TODO: do we need to check all blobs' shapes?
   // In future we may add cache for all already found options.
   // Currently there is only one code for last used shape.
-  if (Callback == NULL || top->shape() != layer_output_shape_signature) {
+  if (Callback == NULL ||
+      top->shape() != layer_output_shape_signature ||
+      Use_top_mask != use_top_mask ||
+      Method != layer->layer_param_.pooling_param().pool()) {
+    Method = layer->layer_param_.pooling_param().pool();
+    Use_top_mask = use_top_mask;
     layer_output_shape_signature = top->shape();
     Create_callback(layer);
   }
@@ -797,6 +999,7 @@ void PoolingCodeGeneratorBackward<Dtype>::Naive(
   }
 }
 
+// Generic datatypes - use naive versions.
 template <typename Dtype>
 void PoolingCodeGeneratorBackward<Dtype>::Create_callback(
   PoolingLayer<Dtype>* layer) {
@@ -805,29 +1008,319 @@ void PoolingCodeGeneratorBackward<Dtype>::Create_callback(
 
 #if defined __x86_64__ || defined _M_X64
 // Here we have specialized versions for supported formats in x64 architectures.
-/*
 template <>
 void PoolingCodeGeneratorBackward<float>::Create_callback(
-  PoolingLayer<float>* layer)
-{
-  using namespace ::Xbyak;
-  util::Cpu Current_cpu;
-  if (Current_cpu.has(util::Cpu::tAVX2))
-  { // AVX2 optimized version.
-    const LayerParameter& param = layer->layer_param();
-
-    // It seems we are regenerating the code due to output reshape.
+  PoolingLayer<float>* layer) {
+  using Xbyak::Reg64;
+  using Xbyak::Address;
+  const LayerParameter& param = layer->layer_param();
+  // The AVX2 code also serves AVX-512 CPUs.
+  if (pooling_isa() >= POOLING_ISA_AVX2 &&
+      (param.pooling_param().pool() == PoolingParameter_PoolMethod_AVE ||
+       param.pooling_param().pool() == PoolingParameter_PoolMethod_MAX)) {
+    // AVX2 optimized version.
+    // Runtime constants.
+    const int pooled_fm_size = layer->pooled_height_ * layer->pooled_width_;
+    const int fm_size = layer->height_ * layer->width_;
+
+    // Without padding and with the windows covering the input exactly,
+    // every window has kernel_h_ x kernel_w_ elements: the accumulation into
+    // a window is unrolled. Bigger kernels are looped over so that the code
+    // fits the buffer.
+    bool optimal_version = false;
+
+    if (layer->pad_h_ == 0 &&
+        layer->pad_w_ == 0 &&
+        (layer->pooled_height_-1) * layer->stride_h_ + layer->kernel_h_
+         == layer->height_ &&
+        (layer->pooled_width_-1) * layer->stride_w_ + layer->kernel_w_
+         == layer->width_ &&
+        layer->kernel_h_ * layer->kernel_w_ <= 64)
+      optimal_version = true;
+
+    // Register names.
+    const Reg64& reg_top_ptr = rdi;
+    const Reg64& reg_bottom_ptr = rsi;
+    const Reg64& reg_mask_ptr = rdx;
+    const Reg64& reg_index_cnt = rcx;
+    const Reg64& reg_batch_cnt = rbx;
+    const Reg64& reg_out_h_cnt = rcx;
+    const Reg64& reg_out_w_cnt = rdx;
+    const Reg64& reg_hstart = r8;
+    const Reg64& reg_wstart = r9;
+    const Reg64& reg_wend = r10;
+    const Reg64& reg_hend = r11;
+    const Reg64& reg_w_cnt = r12;
+    const Reg64& reg_row_ptr = r13;
+    const Reg64& reg_h_cnt = r14;
+
+    const Reg64& reg_scratch0 = rax;
+    const Reg64& reg_scratch1 = r15;
+
+    const Reg64& reg_arg0 = rdi;
+    const Reg64& reg_arg1 = rsi;
+    const Reg64& reg_arg4 = r8;
+    const Reg64& reg_arg5 = r9;
+    const Address& stackarg_mask = qword[rbp + 24];
+
+    // Stack variable names residing inside red zone.
+    int stack_qwords = 0;
+    const Address& stack_top_orig      = qword[rbp - (++stack_qwords * 8)];
+    const Address& stack_bottom_orig   = qword[rbp - (++stack_qwords * 8)];
+    const Address& stack_mask_orig     = qword[rbp - (++stack_qwords * 8)];
+    const Address& stack_batch_end     = qword[rbp - (++stack_qwords * 8)];
+    const Address& stack_channel_start = qword[rbp - (++stack_qwords * 8)];
+    const Address& stack_channel_end   = qword[rbp - (++stack_qwords * 8)];
+    const Address& stack_channel_cnt   = qword[rbp - (++stack_qwords * 8)];
+    const Address& stack_pool_h        = qword[rbp - (++stack_qwords * 8)];
+
+    // ASSEMBLY STARTS HERE.
+    // It seems we are regenerating the code due to output reshape
     if (Callback)
       reset();
 
+    // Prologue.
+    push(rbp);
+    mov(rbp, rsp);
+    sub(rsp, stack_qwords * 8);
+
+    // Save r12-r15 and rbx registers.
+    push(r12); push(r13); push(r14); push(r15); push(rbx);
+
+    // Move arguments to the stack, we gonna need the registers for other
+    // purposes. use_top_mask and layer_ptr are ignored, the code is
+    // specialized on them.
+    mov(stack_top_orig, reg_arg0);
+    mov(stack_bottom_orig, reg_arg1);
+    movsxd(reg_batch_cnt, edx);
+    movsxd(reg_scratch0, ecx);
+    mov(stack_batch_end, reg_scratch0);
+    mov(stack_channel_start, reg_arg4);
+    mov(stack_channel_end, reg_arg5);
+    if (param.pooling_param().pool() == PoolingParameter_PoolMethod_MAX) {
+      mov(reg_scratch0, stackarg_mask);
+      mov(stack_mask_orig, reg_scratch0);
+    }
+
+    // Iterate through batches.
+    L("batch_loop_start");
+    cmp(reg_batch_cnt, stack_batch_end);
+    jge("batch_loop_end", T_NEAR);
+
+      // Iterate through channels.
+      mov(reg_scratch0, stack_channel_start);
+      mov(stack_channel_cnt, reg_scratch0);
+      L("channel_loop_start");
+      mov(reg_scratch0, stack_channel_cnt);
+      cmp(reg_scratch0, stack_channel_end);
+      jge("channel_loop_end", T_NEAR);
+
+        // Compute the feature map offsets of the buffers.
+        // plane = batch*channels_ + channel
+        imul(reg_scratch1, reg_batch_cnt, layer->channels_);
+        add(reg_scratch1, reg_scratch0);
+
+        // top (and mask): plane*pooled_fm_size*4 + ptr
+        imul(reg_top_ptr, reg_scratch1, pooled_fm_size * sizeof(float));
+        if (param.pooling_param().pool() == PoolingParameter_PoolMethod_MAX) {
+          mov(reg_mask_ptr, reg_top_ptr);
+          add(reg_mask_ptr, stack_mask_orig);
+        }
+        add(reg_top_ptr, stack_top_orig);
+
+        // bottom: plane*fm_size*4 + ptr
+        imul(reg_bottom_ptr, reg_scratch1, fm_size * sizeof(float));
+        add(reg_bottom_ptr, stack_bottom_orig);
+
+        if (param.pooling_param().pool() == PoolingParameter_PoolMethod_MAX) {
+          // Scatter each top diff to the bottom element its mask points to,
+          // four outputs at a time.
+          const int unrolled = pooled_fm_size / 4 * 4;
+          for (int tail = 0; tail < 2; ++tail) {
+            if (!tail) {
+              xor_(reg_index_cnt, reg_index_cnt);
+              L("out_loop_start");
+              cmp(reg_index_cnt, unrolled);
+              jge("out_loop_end", T_NEAR);
+            }
+            const int count = tail ? pooled_fm_size - unrolled : 4;
+            for (int i = 0; i < count; ++i) {
+              const int offset = (tail ? unrolled + i : i) * sizeof(float);
+              const Address& mask = tail ?
+                  dword[reg_mask_ptr + offset] :
+                  dword[reg_mask_ptr + reg_index_cnt*4 + offset];
+              const Address& top = tail ?
+                  dword[reg_top_ptr + offset] :
+                  dword[reg_top_ptr + reg_index_cnt*4 + offset];
+              if (Use_top_mask) {
+                // Float mask, truncate to the index.
+                cvttss2si(eax, mask);
+                movsxd(reg_scratch0, eax);
+              } else {  // 32bit integer mask.
+                movsxd(reg_scratch0, mask);
+              }
+              vmovss(xmm0, dword[reg_bottom_ptr + reg_scratch0*4]);
+              vaddss(xmm0, xmm0, top);
+              vmovss(dword[reg_bottom_ptr + reg_scratch0*4], xmm0);
+            }
+            if (!tail) {
+              add(reg_index_cnt, 4);
+              jmp("out_loop_start", T_NEAR);
+              L("out_loop_end");
+            }
+          }
+        } else if (optimal_version) {
+          // Every window has the same size: spread top_diff / pool_size over
+          // it, with the offsets of the window elements as immediates.
+          mov(reg_scratch0, layer->kernel_h_ * layer->kernel_w_);
+          cvtsi2ss(xmm1, reg_scratch0);
+
+          xor_(reg_out_h_cnt, reg_out_h_cnt);
+          L("out_h_loop_start");
+          cmp(reg_out_h_cnt, layer->pooled_height_);
+          jge("out_h_loop_end", T_NEAR);
+
+            // row = ph*stride_h_*width_*4 + bottom_ptr
+            imul(reg_row_ptr, reg_out_h_cnt,
+                 layer->stride_h_ * layer->width_ * sizeof(float));
+            add(reg_row_ptr, reg_bottom_ptr);
+
+            xor_(reg_out_w_cnt, reg_out_w_cnt);
+            L("out_w_loop_start");
+            cmp(reg_out_w_cnt, layer->pooled_width_);
+            jge("out_w_loop_end", T_NEAR);
+
+              vmovss(xmm0, dword[reg_top_ptr]);
+              vdivss(xmm0, xmm0, xmm1);
+              for (int kernel_h = 0; kernel_h < layer->kernel_h_; ++kernel_h) {
+                for (int kernel_w = 0;
+                         kernel_w < layer->kernel_w_; ++kernel_w) {
+                  const Address& bottom = dword[reg_row_ptr
+                      + kernel_w*sizeof(float)
+                      + kernel_h*layer->width_*sizeof(float)];
+                  vaddss(xmm2, xmm0, bottom);
+                  vmovss(bottom, xmm2);
+                }
+              }
+
+              add(reg_top_ptr, sizeof(float));
+              add(reg_row_ptr, layer->stride_w_ * sizeof(float));
+              inc(reg_out_w_cnt);
+              jmp("out_w_loop_start", T_NEAR);
+            L("out_w_loop_end");
+
+            inc(reg_out_h_cnt);
+            jmp("out_h_loop_start", T_NEAR);
+          L("out_h_loop_end");
+        } else {
+          // Clip the windows to the padded and then to the real input, as
+          // the naive version does.
+          xor_(reg_out_h_cnt, reg_out_h_cnt);
+          L("out_h_loop_start");
+          cmp(reg_out_h_cnt, layer->pooled_height_);
+          jge("out_h_loop_end", T_NEAR);
+
+            // hstart = ph*stride_h_ - pad_h_
+            // hend = min(hstart + kernel_h_, height_ + pad_h_)
+            imul(reg_hstart, reg_out_h_cnt, layer->stride_h_);
+            sub(reg_hstart, layer->pad_h_);
+            lea(reg_hend, ptr[reg_hstart + layer->kernel_h_]);
+            mov(reg_scratch0, layer->height_ + layer->pad_h_);
+            cmp(reg_hend, reg_scratch0);
+            cmovg(reg_hend, reg_scratch0);
+            mov(reg_scratch0, reg_hend);
+            sub(reg_scratch0, reg_hstart);
+            mov(stack_pool_h, reg_scratch0);
+            xor_(reg_scratch0, reg_scratch0);
+            cmp(reg_hstart, reg_scratch0);
+            cmovl(reg_hstart, reg_scratch0);
+            mov(reg_scratch0, layer->height_);
+            cmp(reg_hend, reg_scratch0);
+            cmovg(reg_hend, reg_scratch0);
+
+            xor_(reg_out_w_cnt, reg_out_w_cnt);
+            L("out_w_loop_start");
+            cmp(reg_out_w_cnt, layer->pooled_width_);
+            jge("out_w_loop_end", T_NEAR);
+
+              // Same for the width.
+              imul(reg_wstart, reg_out_w_cnt, layer->stride_w_);
+              sub(reg_wstart, layer->pad_w_);
+              lea(reg_wend, ptr[reg_wstart + layer->kernel_w_]);
+              mov(reg_scratch0, layer->width_ + layer->pad_w_);
+              cmp(reg_wend, reg_scratch0);
+              cmovg(reg_wend, reg_scratch0);
+
+              // pool_size = (hend - hstart) * (wend - wstart)
+              mov(reg_scratch0, reg_wend);
+              sub(reg_scratch0, reg_wstart);
+              imul(reg_scratch0, stack_pool_h);
+              cvtsi2ss(xmm1, reg_scratch0);
+              vmovss(xmm0, dword[reg_top_ptr]);
+              vdivss(xmm0, xmm0, xmm1);
+
+              xor_(reg_scratch0, reg_scratch0);
+              cmp(reg_wstart, reg_scratch0);
+              cmovl(reg_wstart, reg_scratch0);
+              mov(reg_scratch0, layer->width_);
+              cmp(reg_wend, reg_scratch0);
+              cmovg(reg_wend, reg_scratch0);
+
+              // Iterate through the window.
+              mov(reg_h_cnt, reg_hstart);
+              L("kern_h_loop_start");
+              cmp(reg_h_cnt, reg_hend);
+              jge("kern_h_loop_end", T_NEAR);
+
+                imul(reg_row_ptr, reg_h_cnt, layer->width_ * sizeof(float));
+                add(reg_row_ptr, reg_bottom_ptr);
+
+                mov(reg_w_cnt, reg_wstart);
+                L("kern_w_loop_start");
+                cmp(reg_w_cnt, reg_wend);
+                jge("kern_w_loop_end", T_NEAR);
+
+                  vaddss(xmm2, xmm0, dword[reg_row_ptr + reg_w_cnt*4]);
+                  vmovss(dword[reg_row_ptr + reg_w_cnt*4], xmm2);
+
+                  inc(reg_w_cnt);
+                  jmp("kern_w_loop_start", T_NEAR);
+                L("kern_w_loop_end");
+
+                inc(reg_h_cnt);
+                jmp("kern_h_loop_start", T_NEAR);
+              L("kern_h_loop_end");
+
+              add(reg_top_ptr, sizeof(float));
+              inc(reg_out_w_cnt);
+              jmp("out_w_loop_start", T_NEAR);
+            L("out_w_loop_end");
+
+            inc(reg_out_h_cnt);
+            jmp("out_h_loop_start", T_NEAR);
+          L("out_h_loop_end");
+        }
+
+        inc(stack_channel_cnt);
+        jmp("channel_loop_start", T_NEAR);
+      L("channel_loop_end");
+
+      inc(reg_batch_cnt);
+      jmp("batch_loop_start", T_NEAR);
+    L("batch_loop_end");
+
+    // Restore r12-r15 and rbx registers.
+    pop(rbx); pop(r15); pop(r14); pop(r13); pop(r12);
+
+    add(rsp, stack_qwords * 8);
+    pop(rbp);
+    ret();
+
     Callback = getCode<Callback_t*>();
-  }
-  else
-  { // Take naive path.
+  } else {  // Take naive path.
     Callback = Naive;
   }
-}*/
-
+}
 #endif
 
 INSTANTIATE_CLASS(PoolingCodeGeneratorForward);
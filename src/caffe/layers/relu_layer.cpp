@@ -2,22 +2,34 @@
 #include <vector>
 
 #include "caffe/layers/relu_layer.hpp"
+#include "caffe/util/half.hpp"
 
 namespace caffe {
 
 template <typename Dtype>
 void ReLULayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
     const vector<Blob<Dtype>*>& top) {
-  const Dtype* bottom_data = bottom[0]->cpu_data();
-  Dtype* top_data = top[0]->mutable_cpu_data();
+  const Storage bottom_storage = bottom[0]->storage();
+  const Storage top_storage = top[0]->storage();
+  const void* bottom_data = bottom[0]->cpu_storage_data();
+  void* top_data = top[0]->mutable_cpu_storage_data();
   const int count = bottom[0]->count();
   Dtype negative_slope = this->layer_param_.relu_param().negative_slope();
 #ifdef _OPENMP
 #pragma omp parallel for
 #endif
-  for (int i = 0; i < count; ++i) {
-    top_data[i] = std::max(bottom_data[i], Dtype(0))
-        + negative_slope * std::min(bottom_data[i], Dtype(0));
+  for (int start = 0; start < count; start += kStorageChunk) {
+    Dtype x_buffer[kStorageChunk];
+    Dtype y_buffer[kStorageChunk];
+    const int n = std::min(kStorageChunk, count - start);
+    const Dtype* x =
+        caffe_storage_load(bottom_storage, bottom_data, start, n, x_buffer);
+    Dtype* y = caffe_storage_target(top_storage, top_data, start, y_buffer);
+    for (int i = 0; i < n; ++i) {
+      y[i] = std::max(x[i], Dtype(0))
+          + negative_slope * std::min(x[i], Dtype(0));
+    }
+    caffe_storage_store(top_storage, y, start, n, top_data);
   }
 }
 
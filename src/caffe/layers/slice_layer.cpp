@@ -82,6 +82,12 @@ void SliceLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
   for (int i = 0; i < top.size(); ++i) {
     Dtype* top_data = top[i]->mutable_cpu_data();
     const int top_slice_axis = top[i]->shape(slice_axis_);
+    // Read in place by its consumers (see NetParameter.zero_copy_concat).
+    if (num_slices_ == 1 &&
+        top_data == bottom_data + offset_slice_axis * slice_size_) {
+      offset_slice_axis += top_slice_axis;
+      continue;
+    }
     for (int n = 0; n < num_slices_; ++n) {
       const int top_offset = n * top_slice_axis * slice_size_;
       const int bottom_offset =
@@ -103,6 +109,11 @@ void SliceLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
   for (int i = 0; i < top.size(); ++i) {
     const Dtype* top_diff = top[i]->cpu_diff();
     const int top_slice_axis = top[i]->shape(slice_axis_);
+    if (num_slices_ == 1 &&
+        top_diff == bottom_diff + offset_slice_axis * slice_size_) {
+      offset_slice_axis += top_slice_axis;
+      continue;
+    }
     for (int n = 0; n < num_slices_; ++n) {
       const int top_offset = n * top_slice_axis * slice_size_;
       const int bottom_offset =
@@ -1,5 +1,10 @@
+#include <algorithm>
 #include <vector>
 
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
 #include "caffe/layers/split_layer.hpp"
 #include "caffe/util/math_functions.hpp"
 
@@ -20,6 +25,19 @@ void SplitLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
     top[i]->ReshapeLike(*bottom[0]);
     CHECK_EQ(count_, top[i]->count());
   }
+  // Again after the bottom got memory of its own.
+  if (accumulate_top_ >= 0) {
+    top[accumulate_top_]->ShareDiff(*bottom[0]);
+  }
+}
+
+template <typename Dtype>
+void SplitLayer<Dtype>::SetBackwardTops(const vector<bool>& top_need_backward,
+    int accumulate_top) {
+  CHECK_LT(accumulate_top, static_cast<int>(top_need_backward.size()));
+  CHECK(accumulate_top < 0 || top_need_backward[accumulate_top]);
+  top_need_backward_ = top_need_backward;
+  accumulate_top_ = accumulate_top;
 }
 
 template <typename Dtype>
@@ -34,17 +52,44 @@ template <typename Dtype>
 void SplitLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom) {
   if (!propagate_down[0]) { return; }
-  if (top.size() == 1) {
-    caffe_copy(count_, top[0]->cpu_diff(), bottom[0]->mutable_cpu_diff());
+  CHECK(top_need_backward_.empty() || top_need_backward_.size() == top.size());
+  // The bottom diff holds the diff of the top sharing it, if any.
+  bool accumulate = false;
+  vector<const Dtype*> top_diffs;
+  for (int i = 0; i < top.size(); ++i) {
+    if (top[i]->diff() == bottom[0]->diff()) {
+      accumulate = true;
+    } else if (top_need_backward_.empty() || top_need_backward_[i]) {
+      top_diffs.push_back(top[i]->cpu_diff());
+    }
+  }
+  Dtype* bottom_diff = bottom[0]->mutable_cpu_diff();
+  if (top_diffs.empty()) {
+    if (!accumulate) {
+      caffe_set(count_, Dtype(0), bottom_diff);
+    }
     return;
   }
-  caffe_add(count_, top[0]->cpu_diff(), top[1]->cpu_diff(),
-            bottom[0]->mutable_cpu_diff());
-  // Add remaining top blob diffs.
-  for (int i = 2; i < top.size(); ++i) {
-    const Dtype* top_diff = top[i]->cpu_diff();
-    Dtype* bottom_diff = bottom[0]->mutable_cpu_diff();
-    caffe_axpy(count_, Dtype(1.), top_diff, bottom_diff);
+  // Sums block by block, each staying in cache while the tops are added.
+  const int kBlockSize = 4096;
+  const int num_tops = top_diffs.size();
+#ifdef _OPENMP
+  #pragma omp parallel for
+#endif
+  for (int begin = 0; begin < count_; begin += kBlockSize) {
+    const int n = std::min(kBlockSize, count_ - begin);
+    Dtype* sum = bottom_diff + begin;
+    int i = 0;
+    if (!accumulate) {
+      caffe_copy(n, top_diffs[0] + begin, sum);
+      i = 1;
+    }
+    for (; i < num_tops; ++i) {
+      const Dtype* top_diff = top_diffs[i] + begin;
+      for (int j = 0; j < n; ++j) {
+        sum[j] += top_diff[j];
+      }
+    }
   }
 }
 
@@ -1,4 +1,5 @@
 #include <boost/bind.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
 #include <boost/enable_shared_from_this.hpp>
 #include <boost/make_shared.hpp>
 #include <boost/optional.hpp>
@@ -15,7 +16,9 @@
 #include "caffe/serialization/BlobCodec.hpp"
 #include "caffe/serialization/ProtoSerialize.hpp"
 #include "caffe/util/blocking_queue.hpp"
+#include "caffe/util/cpu_info.hpp"
 #include "caffe/util/math_functions.hpp"
+#include "caffe/util/trace.hpp"
 
 namespace caffe {
 
@@ -24,6 +27,9 @@ using internode::Waypoint;
 
 namespace {
 
+// How often workers report their utilization, to help sizing --comm_threads.
+const int kUtilizationReportSeconds = 60;
+
 struct Part {
   int layer_id;
   int blob_id;
@@ -46,30 +52,56 @@ struct BlobCommsImpl : BlobComms<Dtype> {
 
   char* buffer;
 
+  struct SendJob : Element {
+  };
+  struct StopJob : Element {
+  };
+
+  // Workers take jobs from their own queue first, then steal from the queues
+  // of the others before they block waiting for a new job.
   struct Worker {
     struct Job : Element {
       std::vector<char> buffer;
       size_t size;
       RemoteId id;
     };
-    struct SendJob : Element {
-    };
     BlockingQueue<Element*> jobs_to_run;
     boost::mutex mtx;
     std::vector<Job*> available_jobs;
-    boost::thread thread;
     BlobCommsImpl* impl;
-    boost::shared_ptr<SendJob> send_job;
+    const int id;
+    SendJob send_job;
+    StopJob stop_job;
+    // jobs queued or running, used to pick the least loaded worker
+    int load;
+    // utilization since the last report
+    uint64_t busy_us;
+    uint64_t jobs_done;
+    uint64_t jobs_stolen;
+    boost::thread thread;
+
+    Worker(BlobCommsImpl* impl, int id)
+      : impl(impl)
+      , id(id)
+      , load(0)
+      , busy_us(0)
+      , jobs_done(0)
+      , jobs_stolen(0) {
+    }
+
+    // only once all the workers exist, as they steal from each other
+    void start() {
+      thread = boost::thread(boost::bind(&Worker::execute, this));
+    }
 
-    Worker(BlobCommsImpl* impl, size_t packet_size)
-      : thread(boost::bind(&Worker::execute, this))
-      , impl(impl)
-      , send_job(new SendJob()) {
+    void push(Element* elem) {
+      __sync_add_and_fetch(&load, 1);
+      jobs_to_run.push(elem);
+      impl->job_pushed();
     }
 
-    ~Worker() {
-      push_job(NULL, 0, 0);
-      thread.join();
+    void stop() {
+      push(&stop_job);
     }
 
     void push_job(char* data, size_t size, RemoteId id) {
@@ -87,38 +119,76 @@ struct BlobCommsImpl : BlobComms<Dtype> {
       caffe_copy(size, data, &job->buffer.front());
       job->size = size;
       job->id = id;
-      jobs_to_run.push(job);
+      push(job);
     }
 
     void push_send_job() {
-      jobs_to_run.push(send_job.get());
+      push(&send_job);
+    }
+
+    // called by the other workers
+    bool try_steal(Element** elem) {
+      if (!jobs_to_run.try_pop(elem)) return false;
+      if (*elem == &stop_job) {
+        // the owner may have missed it while it was out of the queue
+        jobs_to_run.push(*elem);
+        impl->job_pushed();
+        return false;
+      }
+      __sync_sub_and_fetch(&load, 1);
+      return true;
     }
 
     void execute() {
       DLOG(INFO) << "Worker started " << this;
+#ifdef _OPENMP
+      cpu::OpenMpManager::bindCurrentThreadToSpareCpuIfPossible(id);
+#endif
       while (true) {
-        Element* elem = jobs_to_run.pop();
-        if (elem == send_job.get()) {
-          impl->send();
+        Element* elem = NULL;
+        bool stolen = false;
+        uint64_t pushed = impl->jobs_pushed();
+        if (jobs_to_run.try_pop(&elem)) {
+          __sync_sub_and_fetch(&load, 1);
+        } else if (impl->steal(this, &elem)) {
+          stolen = true;
+        } else {
+          impl->wait_for_job(pushed);
           continue;
         }
-        Job* job = elem->cast<Job>();
-        if ((job->size == 0) && (job->id == 0)) {
+        if (elem == &stop_job) {
           break;
         }
-        impl->handle(&job->buffer.front(), job->size, job->id);
-        {
+        __sync_add_and_fetch(&load, 1);
+        boost::posix_time::ptime start =
+          boost::posix_time::microsec_clock::universal_time();
+        if (dynamic_cast<SendJob*>(elem)) {
+          impl->send();
+        } else {
+          Job* job = elem->cast<Job>();
+          impl->handle(&job->buffer.front(), job->size, job->id);
           boost::mutex::scoped_lock lock(mtx);
           available_jobs.push_back(job);
         }
+        __sync_sub_and_fetch(&load, 1);
+        __sync_add_and_fetch(&busy_us,
+          (boost::posix_time::microsec_clock::universal_time() - start)
+            .total_microseconds());
+        __sync_add_and_fetch(&jobs_done, 1);
+        if (stolen) __sync_add_and_fetch(&jobs_stolen, 1);
+        impl->report_utilization();
       }
       DLOG(INFO) << "Worker finished " << this;
     }
   };
 
   std::vector<boost::shared_ptr<Worker> > all_workers;
-  uint32_t worker;
-  mutable boost::recursive_mutex worker_mtx;
+  // counts the jobs pushed to any worker, idle workers wait for it to change
+  boost::mutex work_mtx;
+  boost::condition_variable work_ready;
+  uint64_t work_pushed;
+  boost::mutex stats_mtx;
+  boost::posix_time::ptime stats_start;
   mutable boost::recursive_mutex mtx;
 
   vector<uint32_t> sending_version;
@@ -144,7 +214,8 @@ struct BlobCommsImpl : BlobComms<Dtype> {
     , settings(settings)
     , buffer(new char[codec->packet_size()])
     , all_workers(threads)
-    , worker(0)
+    , work_pushed(0)
+    , stats_start(boost::posix_time::microsec_clock::universal_time())
     , sending_version(const_info->layers(), 0)
     , cancelled_version(const_info->layers(), 0)
     , during_sending(false) {
@@ -159,16 +230,77 @@ struct BlobCommsImpl : BlobComms<Dtype> {
       all_parts.push_back(parts);
     }
     for (int i = 0; i < threads; ++i)
-      all_workers[i].reset(new Worker(this, codec->packet_size()));
+      all_workers[i].reset(new Worker(this, i));
+    for (int i = 0; i < threads; ++i)
+      all_workers[i]->start();
+  }
+
+  ~BlobCommsImpl() {
+    // workers steal from each other, so all stop before any is destroyed
+    for (int i = 0; i < all_workers.size(); ++i) {
+      all_workers[i]->stop();
+    }
+    for (int i = 0; i < all_workers.size(); ++i) {
+      all_workers[i]->thread.join();
+    }
   }
 
   Worker* get_worker() {
-    boost::recursive_mutex::scoped_lock lock(worker_mtx);
-    Worker* ret = all_workers[worker].get();
-    worker = (worker + 1) % all_workers.size();
+    Worker* ret = all_workers[0].get();
+    for (int i = 1; i < all_workers.size(); ++i) {
+      if (all_workers[i]->load < ret->load) {
+        ret = all_workers[i].get();
+      }
+    }
     return ret;
   }
 
+  void job_pushed() {
+    boost::mutex::scoped_lock lock(work_mtx);
+    ++work_pushed;
+    work_ready.notify_all();
+  }
+
+  uint64_t jobs_pushed() {
+    boost::mutex::scoped_lock lock(work_mtx);
+    return work_pushed;
+  }
+
+  // Returns once a job was pushed to any worker after `seen` were.
+  void wait_for_job(uint64_t seen) {
+    boost::mutex::scoped_lock lock(work_mtx);
+    while (work_pushed == seen) {
+      work_ready.wait(lock);
+    }
+  }
+
+  bool steal(Worker* thief, Element** elem) {
+    for (int i = 1; i < all_workers.size(); ++i) {
+      Worker* victim = all_workers[(thief->id + i) % all_workers.size()].get();
+      if (victim->try_steal(elem)) return true;
+    }
+    return false;
+  }
+
+  void report_utilization() {
+    boost::mutex::scoped_lock lock(stats_mtx, boost::try_to_lock);
+    if (!lock.owns_lock()) return;
+    boost::posix_time::ptime now =
+      boost::posix_time::microsec_clock::universal_time();
+    int64_t elapsed_us = (now - stats_start).total_microseconds();
+    if (elapsed_us < kUtilizationReportSeconds * 1000000LL) return;
+    stats_start = now;
+    for (int i = 0; i < all_workers.size(); ++i) {
+      Worker* worker = all_workers[i].get();
+      uint64_t busy_us = __sync_lock_test_and_set(&worker->busy_us, 0);
+      uint64_t jobs = __sync_lock_test_and_set(&worker->jobs_done, 0);
+      uint64_t stolen = __sync_lock_test_and_set(&worker->jobs_stolen, 0);
+      LOG(INFO) << "comm worker " << i << " utilization: "
+        << (100.0 * busy_us / elapsed_us) << "%, jobs: " << jobs
+        << " (stolen: " << stolen << ")";
+    }
+  }
+
   Blob<Dtype>* get_blob(int layer_id, int blob_id) {
     CHECK_GE(layer_id, 0);
     CHECK_GE(blob_id, 0);
@@ -217,6 +349,8 @@ struct BlobCommsImpl : BlobComms<Dtype> {
       during_sending = true;
     }
 
+    TraceSpan span("comms", "send",
+      solver->net()->layer_names()[next->layer_id].c_str());
     update.mutable_info()->set_layer_id(next->layer_id);
     update.mutable_info()->set_blob_id(next->blob_id);
     update.mutable_info()->set_part(next->part);
@@ -226,11 +360,15 @@ struct BlobCommsImpl : BlobComms<Dtype> {
       << ", part " << update.info().part()
       << " of version: " << update.info().version();
 
-    keychain->lock(next->layer_id);
-    codec->encode(
-      &update, get_blob(*next), settings.what_sent, update.info().part());
+    {
+      TraceSpan encode_span("comms", "encode",
+        solver->net()->layer_names()[next->layer_id].c_str());
+      keychain->lock(next->layer_id, next->blob_id, next->part);
+      codec->encode(
+        &update, get_blob(*next), settings.what_sent, update.info().part());
+      keychain->unlock(next->layer_id, next->blob_id, next->part);
+    }
     update.SerializeToArray(buffer, codec->packet_size());
-    keychain->unlock(next->layer_id);
 
     waypoint->async_send(
       buffer, update.ByteSize(), boost::bind(&BlobCommsImpl::sent, this));
@@ -343,39 +481,42 @@ struct BlobCommsImpl : BlobComms<Dtype> {
       return;
     }
 
+    const BlobPartInfo& info = msg.info();
+    Blob<Dtype>* blob = get_blob(info.layer_id(), info.blob_id());
+    keychain->lock(info.layer_id(), info.blob_id(), info.part());
     // expected to be thread safe
-    if (sync_info->received_version(
-          id, msg.info().layer_id(), msg.info().blob_id(), msg.info().part())
-        >= msg.info().version()) {
+    uint32_t current_version = sync_info->received_version(
+      id, info.layer_id(), info.blob_id(), info.part());
+    if (current_version >= info.version()) {
+      keychain->unlock(info.layer_id(), info.blob_id(), info.part());
       DLOG(INFO) << "ignoring old blob update for blob: "
-            << msg.info().blob_id()
-            << " of layer " << msg.info().layer_id()
-            << ", blob: " << msg.info().blob_id()
-            << ", part: " << msg.info().part()
-            << " with version " << msg.info().version();
+            << info.blob_id()
+            << " of layer " << info.layer_id()
+            << ", blob: " << info.blob_id()
+            << ", part: " << info.part()
+            << " with version " << info.version();
       return;
     }
 
-    DLOG(INFO) << "received update for blob: " << msg.info().blob_id()
-               << " of layer " << msg.info().layer_id()
-               << ", part " << msg.info().part()
-               << "/" << const_info->parts(msg.info().layer_id(),
-                                           msg.info().blob_id())
-               << " with version " << msg.info().version()
-               << " current version: "
-               << sync_info->received_version(
-                    id, msg.info().layer_id(), msg.info().blob_id(),
-                    msg.info().part())
+    DLOG(INFO) << "received update for blob: " << info.blob_id()
+               << " of layer " << info.layer_id()
+               << ", part " << info.part()
+               << "/" << const_info->parts(info.layer_id(), info.blob_id())
+               << " with version " << info.version()
+               << " current version: " << current_version
                << " data size: " << msg.data().size();
 
-    Blob<Dtype>* blob = get_blob(msg.info().layer_id(), msg.info().blob_id());
-    keychain->lock(msg.info().layer_id());
-    bool result = codec->decode(msg,
-                                blob,
-                                settings.what_received,
-                                settings.received_incoming_multiplier,
-                                settings.received_current_multiplier);
-    keychain->unlock(msg.info().layer_id());
+    bool result;
+    {
+      TraceSpan span("comms", "decode",
+        solver->net()->layer_names()[info.layer_id()].c_str());
+      result = codec->decode(msg,
+                             blob,
+                             settings.what_received,
+                             settings.received_incoming_multiplier,
+                             settings.received_current_multiplier);
+    }
+    keychain->unlock(info.layer_id(), info.blob_id(), info.part());
     if (!result) {
       LOG(ERROR) << "decoding failed";
       return;
@@ -427,8 +568,9 @@ shared_ptr<BlobComms<Dtype> > BlobComms<Dtype>::create(
     return boost::make_shared<BlobCommsImpl<Dtype, false> >(
         solver, const_info, sync_info, waypoint, codec, keychain, settings, 0);
   }
-  return boost::make_shared<BlobCommsImpl<Dtype, false> >(
-      solver, const_info, sync_info, waypoint, codec, keychain, settings, 0);
+  return boost::make_shared<BlobCommsImpl<Dtype, true> >(
+      solver, const_info, sync_info, waypoint, codec, keychain, settings,
+      num_of_threads);
 }
 
 template <typename Dtype>
@@ -1,3 +1,5 @@
+#include <set>
+#include <utility>
 #include <vector>
 #include "boost/make_shared.hpp"
 #include "boost/thread.hpp"
@@ -10,31 +12,94 @@ namespace {
 
 template <typename Dtype, bool IsStub>
 struct BlobKeyChainImpl : public BlobKeyChain<Dtype> {
-  std::vector<shared_ptr<boost::recursive_mutex> > mtxs;
+  // The whole layer is held by one thread at a time (which may take it again),
+  // while its parts can be held by many threads, one thread per part.
+  // Threads waiting for the whole layer keep new parts from being taken.
+  struct LayerKeys {
+    boost::mutex mtx;
+    boost::condition_variable cond;
+    boost::thread::id owner;
+    int depth;
+    int waiting;
+    std::set<std::pair<int, int> > parts;
+
+    LayerKeys() : depth(0), waiting(0) {}
+  };
+  std::vector<shared_ptr<LayerKeys> > keys;
 
   explicit BlobKeyChainImpl(size_t layers)
-    : mtxs(layers) {
-    for (int i = 0; i < mtxs.size(); ++i) {
-      mtxs[i].reset(new boost::recursive_mutex());
+    : keys(layers) {
+    for (int i = 0; i < keys.size(); ++i) {
+      keys[i].reset(new LayerKeys());
     }
   }
 
-  virtual void lock(int layer_id) {
+  LayerKeys& layer_keys(int layer_id) {
     CHECK_GE(layer_id, 0);
-    CHECK(layer_id < mtxs.size());
-    if (!IsStub) mtxs[layer_id]->lock();
+    CHECK(layer_id < keys.size());
+    return *keys[layer_id];
+  }
+
+  virtual void lock(int layer_id) {
+    LayerKeys& layer = layer_keys(layer_id);
+    if (IsStub) return;
+    boost::mutex::scoped_lock lock(layer.mtx);
+    boost::thread::id self = boost::this_thread::get_id();
+    if ((layer.depth > 0) && (layer.owner == self)) {
+      ++layer.depth;
+      return;
+    }
+    ++layer.waiting;
+    while ((layer.depth > 0) || !layer.parts.empty()) {
+      layer.cond.wait(lock);
+    }
+    --layer.waiting;
+    layer.owner = self;
+    layer.depth = 1;
   }
+
   virtual void unlock(int layer_id) {
-    CHECK_GE(layer_id, 0);
-    CHECK(layer_id < mtxs.size());
-    if (!IsStub) mtxs[layer_id]->unlock();
+    LayerKeys& layer = layer_keys(layer_id);
+    if (IsStub) return;
+    {
+      boost::mutex::scoped_lock lock(layer.mtx);
+      CHECK_GT(layer.depth, 0);
+      CHECK(layer.owner == boost::this_thread::get_id());
+      if (--layer.depth > 0) return;
+      layer.owner = boost::thread::id();
+    }
+    layer.cond.notify_all();
   }
 
   virtual void lock(int layer_id, int blob_id, int part) {
-    if (!IsStub) lock(layer_id);
+    LayerKeys& layer = layer_keys(layer_id);
+    if (IsStub) return;
+    boost::mutex::scoped_lock lock(layer.mtx);
+    if ((layer.depth > 0) && (layer.owner == boost::this_thread::get_id())) {
+      ++layer.depth;
+      return;
+    }
+    std::pair<int, int> key(blob_id, part);
+    while ((layer.depth > 0) || (layer.waiting > 0)
+           || (layer.parts.count(key) > 0)) {
+      layer.cond.wait(lock);
+    }
+    layer.parts.insert(key);
   }
+
   virtual void unlock(int layer_id, int blob_id, int part) {
-    if (!IsStub) unlock(layer_id);
+    LayerKeys& layer = layer_keys(layer_id);
+    if (IsStub) return;
+    {
+      boost::mutex::scoped_lock lock(layer.mtx);
+      if ((layer.depth > 0) && (layer.owner == boost::this_thread::get_id())) {
+        if (--layer.depth > 0) return;
+        layer.owner = boost::thread::id();
+      } else {
+        CHECK_EQ(layer.parts.erase(std::make_pair(blob_id, part)), 1);
+      }
+    }
+    layer.cond.notify_all();
   }
 };
 }  // namespace
@@ -0,0 +1,204 @@
+#include <glog/logging.h>
+#include <stdint.h>
+#include <cstdio>
+#include <cstring>
+#include <fstream>  // NOLINT(readability/streams)
+#include <sstream>
+#include <string>
+#include "caffe/internode/configuration.hpp"
+#include "caffe/multinode/ModelDownload.hpp"
+#include "caffe/multinode/SendCallback.hpp"
+#include "caffe/proto/caffe.pb.h"
+#include "caffe/util/io.hpp"
+
+namespace caffe {
+
+using internode::Daemon;
+using internode::Waypoint;
+
+namespace {
+
+// Chunk requests kept in flight, so the server streams without waiting
+// for a round trip per chunk.
+const uint32_t kChunkWindow = 4;
+
+bool read_cached(const string& filename, string* model) {
+  std::ifstream in(filename.c_str(), std::ios::in | std::ios::binary);
+  if (!in.good()) return false;
+  std::ostringstream contents;
+  contents << in.rdbuf();
+  *model = contents.str();
+  return true;
+}
+
+void write_cached(const string& filename, const string& model) {
+  string temp_filename = filename + ".part";
+  {
+    std::ofstream out(temp_filename.c_str(),
+      std::ios::out | std::ios::trunc | std::ios::binary);
+    out.write(model.data(), model.size());
+    if (!out.good()) {
+      LOG(WARNING) << "could not write model cache " << temp_filename;
+      return;
+    }
+  }
+  SyncFileToDisk(temp_filename);
+  if (std::rename(temp_filename.c_str(), filename.c_str()) != 0) {
+    LOG(WARNING) << "could not write model cache " << filename;
+    std::remove(temp_filename.c_str());
+  }
+}
+
+struct ChunkReceiver : Waypoint::Handler {
+  shared_ptr<Waypoint> server;
+  string* model;
+  ModelChunk manifest;
+  bool has_manifest;
+  bool failed;
+  uint32_t chunks;
+  uint32_t requested;
+  uint32_t received_chunks;
+
+  ChunkReceiver(shared_ptr<Waypoint> server, string* model)
+    : server(server)
+    , model(model)
+    , has_manifest(false)
+    , failed(false)
+    , chunks(0)
+    , requested(0)
+    , received_chunks(0) {
+  }
+
+  void request(bool with_chunk) {
+    ModelReq request;
+    request.set_name(ModelChunk::default_instance().GetTypeName());
+    if (with_chunk) {
+      request.set_hash(manifest.hash());
+      request.set_chunk(requested++);
+    }
+    SendCallback callback;
+    request.SerializeToString(callback.buffer.get());
+    server->async_send(
+      callback.buffer->c_str(), callback.buffer->size(), callback);
+  }
+
+  void start_download() {
+    chunks = (manifest.size() + manifest.chunk_size() - 1)
+      / manifest.chunk_size();
+    model->resize(manifest.size());
+    while ((requested < chunks) && (requested < kChunkWindow)) {
+      request(true);
+    }
+  }
+
+  bool done() const {
+    return failed || (has_manifest && (received_chunks == chunks));
+  }
+
+  virtual void received(char* data, size_t size, Waypoint*) {
+    ModelChunk chunk;
+    if (!chunk.ParseFromArray(data, size)) {
+      LOG(ERROR) << "model chunk parsing failed";
+      failed = true;
+      return;
+    }
+    if (!has_manifest) {
+      if (chunk.chunk_size() == 0) {
+        LOG(ERROR) << "model server sent an invalid manifest";
+        failed = true;
+        return;
+      }
+      manifest = chunk;
+      has_manifest = true;
+      return;
+    }
+    if ((chunk.hash() != manifest.hash()) || !chunk.has_index()) {
+      LOG(ERROR) << "model " << manifest.hash()
+                 << " is not served anymore, it changed to " << chunk.hash();
+      failed = true;
+      return;
+    }
+    size_t offset = static_cast<size_t>(chunk.index()) * manifest.chunk_size();
+    if ((chunk.index() >= chunks)
+        || (offset + chunk.data().size() > model->size())) {
+      LOG(ERROR) << "model chunk " << chunk.index() << " is out of range";
+      failed = true;
+      return;
+    }
+    memcpy(&(*model)[offset], chunk.data().data(),  // NOLINT(caffe/alt_fn)
+      chunk.data().size());
+    ++received_chunks;
+    VLOG(1) << "received model chunk " << chunk.index() << " of " << chunks;
+    if (requested < chunks) {
+      request(true);
+    }
+  }
+};
+
+}  // namespace
+
+string model_hash(const string& model) {
+  // 64-bit FNV-1a
+  uint64_t hash = 14695981039346656037ULL;
+  for (size_t i = 0; i < model.size(); ++i) {
+    hash ^= static_cast<unsigned char>(model[i]);
+    hash *= 1099511628211ULL;
+  }
+  std::ostringstream ret;
+  ret << std::hex;
+  ret.width(16);
+  ret.fill('0');
+  ret << hash;
+  return ret.str();
+}
+
+bool ReceiveModelFromRemote(const string& address,
+                            const string& cache_dir,
+                            string* model,
+                            string* hash) {
+  try {
+    shared_ptr<Daemon> comm = internode::create_communication_daemon();
+    shared_ptr<Waypoint> remote_client =
+      internode::configure_client(comm, address, UINT_MAX);
+    ChunkReceiver receiver(remote_client, model);
+    remote_client->register_receive_handler(&receiver);
+
+    receiver.request(false);
+    while (!receiver.has_manifest && !receiver.failed) {
+      internode::poll_one(comm);
+    }
+    if (receiver.failed) return false;
+    *hash = receiver.manifest.hash();
+
+    string cached_filename;
+    if (!cache_dir.empty()) {
+      cached_filename = cache_dir + "/" + *hash + ".caffemodel";
+      if (read_cached(cached_filename, model)
+          && (model->size() == receiver.manifest.size())
+          && (model_hash(*model) == *hash)) {
+        LOG(INFO) << "using cached model " << cached_filename;
+        return true;
+      }
+    }
+
+    LOG(INFO) << "downloading model " << *hash << " of "
+              << receiver.manifest.size() << " bytes from " << address;
+    receiver.start_download();
+    while (!receiver.done()) {
+      internode::poll_one(comm);
+    }
+    if (receiver.failed) return false;
+    if (model_hash(*model) != *hash) {
+      LOG(ERROR) << "downloaded model does not match its hash " << *hash;
+      return false;
+    }
+    if (!cached_filename.empty()) {
+      write_cached(cached_filename, *model);
+    }
+    return true;
+  } catch(...) {
+    return false;
+  }
+}
+
+}  // namespace caffe
@@ -3,8 +3,10 @@
 #include <algorithm>
 #include <string>
 #include <vector>
+#include "caffe/multinode/ModelDownload.hpp"
 #include "caffe/multinode/ModelServer.hpp"
 #include "caffe/multinode/SendCallback.hpp"
+#include "caffe/util/io.hpp"
 
 namespace caffe {
 
@@ -15,14 +17,30 @@ using internode::Waypoint;
 template <typename Dtype>
 ModelServer<Dtype>::ModelServer(shared_ptr<Solver<Dtype> > solver,
                                 string bind_address,
-                                string,
+                                string upstream_address,
                                 int)
   : daemon(internode::create_communication_daemon())
   , solver(solver)
-  , param_(prepare_model())
+  , chunk_size_(solver->param().multinode_param().model_chunk_size())
   , waypoint(internode::configure_server(daemon, bind_address, UINT_MAX)) {
+  CHECK_GT(chunk_size_, 0) << "model_chunk_size must be positive";
+  if (upstream_address.empty()) {
+    param_ = prepare_model();
+    NetParameter net;
+    solver->net()->ToProto(&net);
+    net.SerializeToString(&model_);
+    model_hash_ = model_hash(model_);
+  } else {
+    LOG(INFO) << "relaying model from " << upstream_address;
+    ReceiveProtoFromRemoteOrDie(upstream_address, &param_);
+    CHECK(ReceiveModelFromRemote(
+      upstream_address, "", &model_, &model_hash_))
+      << "failed to receive model from " << upstream_address;
+  }
   waypoint->register_receive_handler(this);
   LOG(INFO) << param_.DebugString();
+  LOG(INFO) << "serving model " << model_hash_ << " of " << model_.size()
+            << " bytes in chunks of " << chunk_size_ << " bytes";
 }
 
 
@@ -70,12 +88,17 @@ template <typename DType>
 void ModelServer<DType>::received(char* data, size_t size, Waypoint* remote) {
   ModelReq req;
   bool ret = req.ParseFromArray(data, size);
-  LOG(INFO) << "received message of size " << size;
+  VLOG(1) << "received message of size " << size;
   if (!ret) {
     LOG(ERROR) << "model request parsing failed, ignoring";
     return;
   }
 
+  if (req.name() == ModelChunk::default_instance().GetTypeName()) {
+    send_chunk(req, remote);
+    return;
+  }
+
   if (req.name() != param_.GetTypeName()) {
     LOG(ERROR) << "model request for something else than SolverParam: "
                << req.name() << ", ignoring";
@@ -88,6 +111,31 @@ void ModelServer<DType>::received(char* data, size_t size, Waypoint* remote) {
     callback.buffer->c_str(), callback.buffer->size(), callback);
 }
 
+template <typename Dtype>
+void ModelServer<Dtype>::send_chunk(const ModelReq& req, Waypoint* remote) {
+  ModelChunk chunk;
+  chunk.set_hash(model_hash_);
+  chunk.set_size(model_.size());
+  chunk.set_chunk_size(chunk_size_);
+  // a request for a model that is not served anymore gets the manifest back
+  if (req.has_chunk() && (req.hash() == model_hash_)) {
+    size_t offset = static_cast<size_t>(req.chunk()) * chunk_size_;
+    if (offset >= model_.size()) {
+      LOG(ERROR) << "request for model chunk " << req.chunk()
+                 << " out of range, ignoring";
+      return;
+    }
+    chunk.set_index(req.chunk());
+    chunk.set_data(model_.data() + offset,
+      std::min(static_cast<size_t>(chunk_size_), model_.size() - offset));
+  }
+
+  SendCallback callback;
+  chunk.SerializeToString(callback.buffer.get());
+  remote->async_send(
+    callback.buffer->c_str(), callback.buffer->size(), callback);
+}
+
 template <typename Dtype>
 void ModelServer<Dtype>::run() {
   while (true) {
@@ -233,7 +233,7 @@ class ParamRelay<Dtype>::Impl : MultiWaypoint::Handler {
        string param_server_address)
     : comm(internode::create_communication_daemon())
     , codec(BlobCodec<Dtype>::create_codec(
-        solver->param().multinode_param(), false))
+        solver->param().multinode_param(), false, solver->net().get()))
     , down_waypoint(
         internode::configure_server(comm, bind_address, codec->packet_size()))
     , up_waypoint(
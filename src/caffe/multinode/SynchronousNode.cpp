@@ -23,6 +23,7 @@
 #include "caffe/MultiSolver.hpp"
 #include "caffe/serialization/BlobCodec.hpp"
 #include "caffe/serialization/ProtoSerialize.hpp"
+#include "caffe/util/trace.hpp"
 
 namespace caffe {
 
@@ -257,7 +258,7 @@ class SynchronousSync : public InternalThread
     , waypoint(waypoint)
     , solver(solver)
     , codec(BlobCodec<Dtype>::create_codec(
-        solver->param().multinode_param(), true))
+        solver->param().multinode_param(), true, solver->net().get()))
     , up_waypoint(new UpDownWaypoint<true>(waypoint->parent()))
     , down_waypoint(new UpDownWaypoint<false>(waypoint->id()))
     , const_info(BlobInfoFactory<Dtype>::create_const_info(
@@ -282,7 +283,9 @@ class SynchronousSync : public InternalThread
     if (!is_root()) solver->param().clear_snapshot();
     if (!is_root()) solver->param().clear_snapshot_after_train();
     MLOG(1) << "initialized sync node with parent: " << waypoint->parent()
-      << ", and num of children " << waypoint->children().size();
+      << ", and num of children " << waypoint->children().size()
+      << (waypoint->topology().is_group_leader(waypoint->id())
+        ? " (host leader)" : "");
 
     comms_down->register_iter_size_handler(this);
     waypoint->register_receive_handler(this);
@@ -423,6 +426,8 @@ class SynchronousSync : public InternalThread
           break;
         }
         }
+        TraceSpan span("update", "apply_update",
+          solver->net()->layer_names()[layer_id].c_str());
         solver->ApplyUpdate(param_ids[j]);
       }
       keychain->unlock(layer_id);
@@ -535,6 +540,13 @@ class SynchronousSync : public InternalThread
   }
 };
 
+template <typename Dtype>
+TreeWaypoint* configure_tree(boost::shared_ptr<Solver<Dtype> > solver) {
+  TreeWaypoint* waypoint = TreeWaypoint::get_instance();
+  waypoint->set_hierarchical(solver->param().multinode_param().hierarchical());
+  return waypoint;
+}
+
 }  // namespace
 
 template <typename Dtype>
@@ -558,7 +570,7 @@ class SynchronousNode<Dtype>::Impl : public MultiSolver<Dtype>::Callback {
   Impl(boost::shared_ptr<Solver<Dtype> > solver)
     : solver(boost::make_shared<MultiSolver<Dtype> >(
         solver, (Caffe::mode() != Caffe::CPU)))
-    , waypoint(TreeWaypoint::get_instance())
+    , waypoint(configure_tree(solver))
     , sync(waypoint, solver)
     , partial_checksums(solver->net()->layers().size() * max_blobs()) {
   }
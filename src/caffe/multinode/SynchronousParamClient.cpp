@@ -110,12 +110,15 @@ struct SynchronousParamSyncingImpl
     : solver(solver)
     , comm(internode::create_communication_daemon())
     , codec(BlobCodec<Dtype>::create_codec(
-        solver->param().multinode_param(), true))
+        solver->param().multinode_param(), true, solver->net().get()))
     , waypoint(internode::configure_client(comm, address, codec->packet_size()))
     , const_info(BlobInfoFactory<Dtype>::create_const_info(
         solver, codec->max_elements_per_part()))
     , sync_info(BlobInfoFactory<Dtype>::create_sync_info(const_info))
-    , keychain(BlobKeyChain<Dtype>::create_empty(const_info->layers()))
+    // comm workers decode parts of one blob concurrently
+    , keychain(num_of_threads > 1
+        ? BlobKeyChain<Dtype>::create(const_info->layers())
+        : BlobKeyChain<Dtype>::create_empty(const_info->layers()))
     , comms(
         BlobComms<Dtype>::create(
           solver, const_info, sync_info, waypoint, codec, keychain,
@@ -13,6 +13,7 @@
 #include "caffe/multinode/SynchronousParamServer.hpp"
 #include "caffe/serialization/BlobCodec.hpp"
 #include "caffe/serialization/ProtoSerialize.hpp"
+#include "caffe/util/trace.hpp"
 
 namespace caffe {
 
@@ -63,6 +64,8 @@ class SynchronousParamServer<Dtype>::Impl
     // when synced it should be after all parts are received
     // and before anything is being send
     // so no locking is needed here
+    TraceSpan span("update", "apply_update",
+      solver->net()->layer_names()[layer_id].c_str());
     for (int j = 0; j < param_ids.size(); ++j) {
       solver->ApplyUpdate(param_ids[j]);
       solver->net()->ClearParamDiffs(param_ids[j]);
@@ -144,14 +147,17 @@ class SynchronousParamServer<Dtype>::Impl
        int num_of_threads)
     : comm(internode::create_communication_daemon())
     , codec(BlobCodec<Dtype>::create_codec(
-        solver->param().multinode_param(), false))
+        solver->param().multinode_param(), false, solver->net().get()))
     , waypoint(internode::configure_server(
         comm, bind_address, codec->packet_size()))
     , solver(solver)
     , const_info(BlobInfoFactory<Dtype>::create_const_info(
         solver, codec->max_elements_per_part()))
     , sync_info(BlobInfoFactory<Dtype>::create_sync_info(const_info))
-    , keychain(BlobKeyChain<Dtype>::create_empty(const_info->layers()))
+    // comm workers decode parts of one blob concurrently
+    , keychain(num_of_threads > 1
+        ? BlobKeyChain<Dtype>::create(const_info->layers())
+        : BlobKeyChain<Dtype>::create_empty(const_info->layers()))
     , comms(
         BlobComms<Dtype>::create(
           solver, const_info, sync_info, waypoint, codec, keychain,
@@ -1,4 +1,5 @@
 #include <algorithm>
+#include <cmath>
 #include <map>
 #include <set>
 #include <string>
@@ -9,13 +10,19 @@
 
 #include "caffe/common.hpp"
 #include "caffe/layer.hpp"
+#include "caffe/layer_autotuner.hpp"
+#include "caffe/layer_scheduler.hpp"
+#include "caffe/layers/batch_norm_layer.hpp"
+#include "caffe/layers/split_layer.hpp"
 #include "caffe/net.hpp"
 #include "caffe/parallel.hpp"
 #include "caffe/proto/caffe.pb.h"
 #include "caffe/util/cpu_info.hpp"
+#include "caffe/util/flat_weights.hpp"
 #include "caffe/util/hdf5.hpp"
 #include "caffe/util/insert_splits.hpp"
 #include "caffe/util/math_functions.hpp"
+#include "caffe/util/trace.hpp"
 #include "caffe/util/upgrade_proto.hpp"
 
 #include "caffe/test/test_caffe_main.hpp"
@@ -53,6 +60,7 @@ void Net<Dtype>::Init(const NetParameter& in_param) {
 
     caffe::cpu::OpenMpManager::bindOpenMpThreads();
     caffe::cpu::OpenMpManager::printVerboseInformation();
+    executed = true;
   }
 #endif
 
@@ -80,6 +88,10 @@ void Net<Dtype>::Init(const NetParameter& in_param) {
   param_id_vecs_.resize(param.layer_size());
   top_id_vecs_.resize(param.layer_size());
   bottom_need_backward_.resize(param.layer_size());
+  shared_ptr<LayerAutotuner<Dtype> > autotuner;
+  if (param.has_autotune_param() && Caffe::mode() == Caffe::CPU) {
+    autotuner.reset(new LayerAutotuner<Dtype>(param.autotune_param()));
+  }
   for (int layer_id = 0; layer_id < param.layer_size(); ++layer_id) {
     // For non-root solvers, whether this layer is shared from root_net_.
     bool share_from_root = !Caffe::root_solver()
@@ -153,6 +165,28 @@ void Net<Dtype>::Init(const NetParameter& in_param) {
       }
     } else {
       layers_[layer_id]->SetUp(bottom_vecs_[layer_id], top_vecs_[layer_id]);
+      // Now that the shapes of its bottoms are known, pick the fastest engine
+      // and thread count of the layer. The tuned layer takes over the params
+      // filled by the first, so that tuning leaves the random stream alone.
+      if (autotuner &&
+          autotuner->Tune(bottom_vecs_[layer_id], top_vecs_[layer_id],
+                          layer->blobs(), param.mutable_layer(layer_id))) {
+        shared_ptr<Layer<Dtype> > tuned =
+            LayerRegistry<Dtype>::CreateLayer(layer_param);
+        tuned->blobs() = layer->blobs();
+        layers_[layer_id] = tuned;
+        layer = tuned.get();
+        layer->SetUp(bottom_vecs_[layer_id], top_vecs_[layer_id]);
+      }
+    }
+    if (layer_param.top_storage() != STORAGE_DTYPE) {
+      if (Caffe::mode() == Caffe::CPU) {
+        for (int top_id = 0; top_id < top_vecs_[layer_id].size(); ++top_id) {
+          top_vecs_[layer_id][top_id]->set_storage(layer_param.top_storage());
+        }
+      } else {
+        LOG(WARNING) << "top_storage is only supported in CPU mode";
+      }
     }
     LOG_IF(INFO, Caffe::root_solver())
         << "Setting up " << layer_names_[layer_id];
@@ -195,6 +229,9 @@ void Net<Dtype>::Init(const NetParameter& in_param) {
       }
     }
   }
+  if (autotuner) {
+    autotuner->Save();
+  }
 
   // Go through the net backwards to determine which blobs contribute to the
   // loss.  We can skip backward computation for blobs that don't contribute
@@ -272,6 +309,11 @@ void Net<Dtype>::Init(const NetParameter& in_param) {
       }
     }
   }
+  layer_fused_.assign(layers_.size(), false);
+  if (Caffe::mode() == Caffe::CPU) {
+    FuseBatchNormScale();
+    FuseSplitGradients(param.accumulate_split_diffs());
+  }
   // In the end, all remaining blobs are considered output blobs.
   for (set<string>::iterator it = available_blobs.begin();
       it != available_blobs.end(); ++it) {
@@ -287,7 +329,44 @@ void Net<Dtype>::Init(const NetParameter& in_param) {
     layer_names_index_[layer_names_[layer_id]] = layer_id;
   }
   ShareWeights();
+  if (param.contiguous_params()) {
+    if (Caffe::mode() == Caffe::CPU) {
+      contiguous_params_.reset(new CPUParams<Dtype>(learnable_params_));
+      LOG_IF(INFO, Caffe::root_solver()) << "Placed "
+          << contiguous_params_->size() << " learnable params contiguously";
+    } else {
+      LOG(WARNING) << "contiguous_params is only supported in CPU mode";
+    }
+  }
   debug_info_ = param.debug_info();
+  if (param.has_checkpoint_param()) {
+    if (phase_ == TRAIN) {
+      InitCheckpoints(param);
+    } else {
+      LOG_IF(INFO, Caffe::root_solver())
+          << "Ignoring checkpoint_param outside the TRAIN phase";
+    }
+  }
+  if (param.parallel_branches() > 1) {
+    if (Caffe::mode() != Caffe::CPU) {
+      LOG(WARNING) << "parallel_branches is only supported in CPU mode";
+    } else if (!layer_segments_.empty()) {
+      LOG(WARNING) << "parallel_branches is not supported with "
+          << "checkpoint_param";
+    } else {
+      scheduler_.reset(
+          new LayerScheduler<Dtype>(*this, param.parallel_branches()));
+    }
+  }
+  zero_copy_concat_ = false;
+  if (param.zero_copy_concat()) {
+    if (Caffe::mode() == Caffe::CPU) {
+      zero_copy_concat_ = true;
+      AliasConcatBlobs();
+    } else {
+      LOG(WARNING) << "zero_copy_concat is only supported in CPU mode";
+    }
+  }
 
   LOG_IF(INFO, Caffe::root_solver()) << "Network initialization done.";
 }
@@ -550,16 +629,434 @@ void Net<Dtype>::AppendParam(const NetParameter& param, const int layer_id,
   }
 }
 
+template <typename Dtype>
+void Net<Dtype>::InitCheckpoints(const NetParameter& param) {
+  const int num_layers = layers_.size();
+  const int num_blobs = blobs_.size();
+  vector<int> first_writer(num_blobs, num_layers);
+  vector<int> last_writer(num_blobs, -1);
+  vector<int> last_reader(num_blobs, -1);
+  for (int layer_id = 0; layer_id < num_layers; ++layer_id) {
+    for (int i = 0; i < top_id_vecs_[layer_id].size(); ++i) {
+      const int blob_id = top_id_vecs_[layer_id][i];
+      first_writer[blob_id] = std::min(first_writer[blob_id], layer_id);
+      last_writer[blob_id] = layer_id;
+    }
+    for (int i = 0; i < bottom_id_vecs_[layer_id].size(); ++i) {
+      last_reader[bottom_id_vecs_[layer_id][i]] = layer_id;
+    }
+  }
+  // A segment cannot end between two writers of a blob, i.e. inside a chain
+  // of in-place layers: recomputing the first part would start from the
+  // values the second part overwrote.
+  vector<bool> can_end(num_layers, true);
+  for (int blob_id = 0; blob_id < num_blobs; ++blob_id) {
+    for (int i = first_writer[blob_id]; i < last_writer[blob_id]; ++i) {
+      can_end[i] = false;
+    }
+  }
+  const CheckpointParameter& checkpoint_param = param.checkpoint_param();
+  const int sqrt_length =
+      static_cast<int>(std::ceil(std::sqrt(static_cast<double>(num_layers))));
+  layer_segments_.resize(num_layers);
+  int start = 0;
+  bool pending = false;
+  for (int layer_id = 0; layer_id < num_layers; ++layer_id) {
+    layer_segments_[layer_id] = segments_.size();
+    bool end = layer_id == num_layers - 1;
+    if (checkpoint_param.segments() == CheckpointParameter_Segments_SQRT) {
+      end = end || (can_end[layer_id] && layer_id - start + 1 >= sqrt_length);
+    } else if (param.layer(layer_id).checkpoint() || pending) {
+      if (can_end[layer_id]) {
+        end = true;
+      } else if (!pending) {
+        LOG(WARNING) << "Moving the checkpoint of layer "
+            << layer_names_[layer_id] << " past the layers computing in "
+            << "place on its outputs";
+        pending = true;
+      }
+    }
+    if (end) {
+      segments_.push_back(make_pair(start, layer_id));
+      start = layer_id + 1;
+      pending = false;
+    }
+  }
+  const int num_segments = segments_.size();
+
+  // The blobs a segment can free are those only its layers write and read,
+  // other than the inputs, outputs and losses of the net. Layers without
+  // bottoms, like data layers, are not recomputed and keep their tops.
+  vector<int> blob_segments(num_blobs, -1);
+  for (int blob_id = 0; blob_id < num_blobs; ++blob_id) {
+    if (last_writer[blob_id] < 0) {
+      continue;
+    }
+    const int segment = layer_segments_[last_writer[blob_id]];
+    if (blobs_[blob_id]->count() > 0 && blob_loss_weights_[blob_id] == 0 &&
+        segment < num_segments - 1 &&
+        layer_segments_[first_writer[blob_id]] == segment &&
+        last_reader[blob_id] >= 0 &&
+        layer_segments_[last_reader[blob_id]] == segment) {
+      blob_segments[blob_id] = segment;
+    }
+  }
+  for (int layer_id = 0; layer_id < num_layers; ++layer_id) {
+    if (bottom_vecs_[layer_id].empty()) {
+      for (int i = 0; i < top_id_vecs_[layer_id].size(); ++i) {
+        blob_segments[top_id_vecs_[layer_id][i]] = -1;
+      }
+    }
+  }
+  for (int i = 0; i < net_output_blob_indices_.size(); ++i) {
+    blob_segments[net_output_blob_indices_[i]] = -1;
+  }
+  // Blobs sharing memory with a kept blob, like the bottom of a Flatten
+  // layer whose top is kept, are kept too.
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    set<SyncedMemory*> kept;
+    for (int blob_id = 0; blob_id < num_blobs; ++blob_id) {
+      if (blob_segments[blob_id] < 0 && blobs_[blob_id]->count() > 0) {
+        kept.insert(blobs_[blob_id]->data().get());
+        kept.insert(blobs_[blob_id]->diff().get());
+      }
+    }
+    for (int blob_id = 0; blob_id < num_blobs; ++blob_id) {
+      if (blob_segments[blob_id] >= 0 &&
+          (kept.count(blobs_[blob_id]->data().get()) ||
+           kept.count(blobs_[blob_id]->diff().get()))) {
+        blob_segments[blob_id] = -1;
+        changed = true;
+      }
+    }
+  }
+
+  segment_blobs_.assign(num_segments, vector<int>());
+  segment_released_.assign(num_segments, false);
+  set<SyncedMemory*> all_memory;
+  vector<set<SyncedMemory*> > freed_memory(num_segments);
+  for (int blob_id = 0; blob_id < num_blobs; ++blob_id) {
+    if (blobs_[blob_id]->count() == 0) {
+      continue;
+    }
+    all_memory.insert(blobs_[blob_id]->data().get());
+    all_memory.insert(blobs_[blob_id]->diff().get());
+    const int segment = blob_segments[blob_id];
+    if (segment >= 0) {
+      segment_blobs_[segment].push_back(blob_id);
+      freed_memory[segment].insert(blobs_[blob_id]->data().get());
+      freed_memory[segment].insert(blobs_[blob_id]->diff().get());
+    }
+  }
+  layer_rngs_.resize(num_layers);
+  for (int segment = 0; segment < num_segments; ++segment) {
+    if (segment_blobs_[segment].empty()) {
+      continue;
+    }
+    for (int layer_id = segments_[segment].first;
+         layer_id <= segments_[segment].second; ++layer_id) {
+      if (!bottom_vecs_[layer_id].empty() &&
+          (layer_id == segments_[segment].first ||
+           bottom_vecs_[layer_id - 1].empty())) {
+        layer_rngs_[layer_id].reset(new rng_t());
+      }
+    }
+  }
+  size_t total_bytes = 0;
+  for (set<SyncedMemory*>::iterator it = all_memory.begin();
+       it != all_memory.end(); ++it) {
+    total_bytes += (*it)->size();
+  }
+  size_t freed_bytes = 0;
+  size_t max_segment_bytes = 0;
+  double forward = 0;
+  double recomputed = 0;
+  for (int segment = 0; segment < num_segments; ++segment) {
+    size_t segment_bytes = 0;
+    for (set<SyncedMemory*>::iterator it =
+         freed_memory[segment].begin(); it != freed_memory[segment].end();
+         ++it) {
+      segment_bytes += (*it)->size();
+    }
+    freed_bytes += segment_bytes;
+    max_segment_bytes = std::max(max_segment_bytes, segment_bytes);
+    for (int layer_id = segments_[segment].first;
+         layer_id <= segments_[segment].second; ++layer_id) {
+      const double flops = layer_forward_flops(layers_[layer_id].get(),
+          bottom_vecs_[layer_id], top_vecs_[layer_id]);
+      forward += flops;
+      if (!segment_blobs_[segment].empty() &&
+          !bottom_vecs_[layer_id].empty()) {
+        recomputed += flops;
+      }
+    }
+  }
+  LOG_IF(INFO, Caffe::root_solver()) << "Checkpointing " << num_segments
+      << " segments: frees " << freed_bytes << " of " << total_bytes
+      << " bytes of activations and diffs, of which Backward needs up to "
+      << max_segment_bytes << " again at a time";
+  LOG_IF(INFO, Caffe::root_solver()) << "Recomputing segments adds "
+      << recomputed << " FLOPs to the " << forward << " of Forward ("
+      << (forward > 0 ? 100 * recomputed / forward : 0) << "%)";
+}
+
+template <typename Dtype>
+void Net<Dtype>::ReleaseSegment(int segment) {
+  for (int i = 0; i < segment_blobs_[segment].size(); ++i) {
+    Blob<Dtype>* blob = blobs_[segment_blobs_[segment][i]].get();
+    // Memory is allocated on first use.
+    Blob<Dtype> released(blob->shape());
+    released.set_storage(blob->storage());
+    blob->ShareData(released);
+    blob->ShareDiff(released);
+  }
+  segment_released_[segment] = true;
+}
+
+template <typename Dtype>
+void Net<Dtype>::FuseBatchNormScale() {
+  int num_fused = 0;
+  for (int layer_id = 0; layer_id + 1 < layers_.size(); ++layer_id) {
+    BatchNormLayer<Dtype>* batch_norm =
+        dynamic_cast<BatchNormLayer<Dtype>*>(layers_[layer_id].get());
+    const int scale_id = layer_id + 1;
+    Layer<Dtype>* scale = layers_[scale_id].get();
+    // The Scale must learn one value per channel and compute in place on the
+    // top, which then feeds nothing else before it.
+    if (!batch_norm ||
+        batch_norm->layer_param().batch_norm_param().scale_bias() ||
+        scale->type() != string("Scale") ||
+        bottom_id_vecs_[scale_id].size() != 1 ||
+        bottom_id_vecs_[scale_id][0] != top_id_vecs_[layer_id][0] ||
+        top_id_vecs_[scale_id][0] != top_id_vecs_[layer_id][0]) {
+      continue;
+    }
+    const Blob<Dtype>* top = top_vecs_[layer_id][0];
+    const ScaleParameter& scale_param = scale->layer_param().scale_param();
+    if (top->num_axes() < 2 ||
+        top->CanonicalAxisIndex(scale_param.axis()) != 1 ||
+        scale->blobs()[0]->num_axes() != 1 ||
+        scale->blobs()[0]->count() != top->shape(1)) {
+      continue;
+    }
+    batch_norm->FuseScale(scale);
+    layer_fused_[scale_id] = true;
+    // The BatchNorm now computes the gradients of the Scale too. The Scale
+    // keeps its own for the Backward ranges starting at it.
+    layer_need_backward_[layer_id] =
+        layer_need_backward_[layer_id] || layer_need_backward_[scale_id];
+    ++num_fused;
+  }
+  LOG_IF(INFO, Caffe::root_solver() && num_fused) << "Fused " << num_fused
+      << " Scale layers into the BatchNorm layers before them";
+}
+
+template <typename Dtype>
+void Net<Dtype>::SetScaleFused(int layer_id, bool fused) {
+  static_cast<BatchNormLayer<Dtype>*>(layers_[layer_id].get())->FuseScale(
+      fused ? layers_[layer_id + 1].get() : NULL);
+}
+
+template <typename Dtype>
+void Net<Dtype>::FuseSplitGradients(bool accumulate) {
+  int num_fused = 0;
+  for (int layer_id = 0; layer_id < layers_.size(); ++layer_id) {
+    SplitLayer<Dtype>* split =
+        dynamic_cast<SplitLayer<Dtype>*>(layers_[layer_id].get());
+    if (!split || !layer_need_backward_[layer_id]) {
+      continue;
+    }
+    const vector<int>& top_ids = top_id_vecs_[layer_id];
+    vector<bool> top_need_backward(top_ids.size(), false);
+    int accumulate_top = -1;
+    for (int i = 0; i < top_ids.size(); ++i) {
+      // The diffs of loss tops are preset, not computed by a consumer.
+      if (split->loss(i)) {
+        top_need_backward[i] = true;
+        continue;
+      }
+      for (int consumer = layer_id + 1; consumer < layers_.size();
+           ++consumer) {
+        for (int j = 0; j < bottom_id_vecs_[consumer].size(); ++j) {
+          if (bottom_id_vecs_[consumer][j] == top_ids[i]) {
+            top_need_backward[i] = top_need_backward[i] ||
+                (layer_need_backward_[consumer] &&
+                 bottom_need_backward_[consumer][j]);
+          }
+        }
+      }
+      if (accumulate && top_need_backward[i] && accumulate_top < 0) {
+        accumulate_top = i;
+      }
+    }
+    split->SetBackwardTops(top_need_backward, accumulate_top);
+    split->Reshape(bottom_vecs_[layer_id], top_vecs_[layer_id]);
+    num_fused += accumulate_top >= 0;
+  }
+  LOG_IF(INFO, Caffe::root_solver() && num_fused) << "Summing the diffs of "
+      << num_fused << " splits in place of their bottoms";
+}
+
+template <typename Dtype>
+void Net<Dtype>::AliasConcatBlobs() {
+  // The memories pointed into and those pointed elsewhere so far: a memory
+  // is only pointed elsewhere once, and never after being pointed into.
+  set<const SyncedMemory*> targets;
+  set<const SyncedMemory*> moved;
+  int num_aliased = 0;
+  for (int layer_id = 0; layer_id < layers_.size(); ++layer_id) {
+    const LayerParameter& layer_param = layers_[layer_id]->layer_param();
+    const bool concat = layer_param.type() == "Concat";
+    if (!concat && layer_param.type() != "Slice") {
+      continue;
+    }
+    Blob<Dtype>* whole = concat ?
+        top_vecs_[layer_id][0] : bottom_vecs_[layer_id][0];
+    const vector<Blob<Dtype>*>& parts = concat ?
+        bottom_vecs_[layer_id] : top_vecs_[layer_id];
+    const vector<int>& part_ids = concat ?
+        bottom_id_vecs_[layer_id] : top_id_vecs_[layer_id];
+    int axis;
+    if (concat && layer_param.concat_param().has_concat_dim()) {
+      axis = layer_param.concat_param().concat_dim();
+    } else if (!concat && layer_param.slice_param().has_slice_dim()) {
+      axis = layer_param.slice_param().slice_dim();
+    } else {
+      axis = whole->CanonicalAxisIndex(concat ?
+          layer_param.concat_param().axis() : layer_param.slice_param().axis());
+    }
+    if (parts.size() < 2 || whole->count(0, axis) != 1) {
+      continue;
+    }
+    // The parts must stay as computed as long as the whole is used, and
+    // Dtype: a half-width whole would not see what they write.
+    const bool alias_data = whole->storage() == STORAGE_DTYPE &&
+        !ModifiedInPlace(whole->data().get(), layer_id);
+    targets.insert(whole->data().get());
+    targets.insert(whole->diff().get());
+    Dtype* whole_data = whole->mutable_cpu_data();
+    Dtype* whole_diff = whole->mutable_cpu_diff();
+    int offset = 0;
+    for (int i = 0; i < parts.size(); offset += parts[i]->count(), ++i) {
+      Blob<Dtype>* part = parts[i];
+      // Loss weights are preset in the diffs of their blobs.
+      if (blob_loss_weights_[part_ids[i]] != Dtype(0)) {
+        continue;
+      }
+      SyncedMemory* data = part->data().get();
+      if (alias_data && part->storage() == STORAGE_DTYPE &&
+          !ModifiedInPlace(data, layer_id)
+          && !targets.count(data) && moved.insert(data).second) {
+        if (concat && part->cpu_data() != whole_data + offset) {
+          caffe_copy(part->count(), part->cpu_data(), whole_data + offset);
+        }
+        data->set_cpu_data(whole_data + offset, whole->data());
+        ++num_aliased;
+      }
+      SyncedMemory* diff = part->diff().get();
+      if (!targets.count(diff) && moved.insert(diff).second) {
+        if (!concat && part->cpu_diff() != whole_diff + offset) {
+          caffe_copy(part->count(), part->cpu_diff(), whole_diff + offset);
+        }
+        diff->set_cpu_data(whole_diff + offset, whole->diff());
+        ++num_aliased;
+      }
+    }
+  }
+  LOG_IF(INFO, Caffe::root_solver()) << "Aliased " << num_aliased
+      << " data and diffs of the parts of concatenations";
+}
+
+template <typename Dtype>
+bool Net<Dtype>::ModifiedInPlace(const SyncedMemory* memory,
+    int layer_id) const {
+  for (int i = layer_id + 1; i < layers_.size(); ++i) {
+    for (int j = 0; j < top_vecs_[i].size(); ++j) {
+      if (top_vecs_[i][j]->data().get() == memory &&
+          std::find(bottom_vecs_[i].begin(), bottom_vecs_[i].end(),
+                    top_vecs_[i][j]) != bottom_vecs_[i].end()) {
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+template <typename Dtype>
+void Net<Dtype>::RecomputeSegment(int segment, int last) {
+  const int first = segments_[segment].first;
+  // Blobs the layers update without learning them, like the running
+  // statistics of BatchNorm, must not see the segment twice.
+  vector<Blob<Dtype>*> stateful;
+  vector<shared_ptr<Blob<Dtype> > > states;
+  for (int layer_id = first; layer_id <= last; ++layer_id) {
+    for (int i = 0; i < layers_[layer_id]->blobs().size(); ++i) {
+      if (!layers_[layer_id]->param_propagate_down(i)) {
+        stateful.push_back(layers_[layer_id]->blobs()[i].get());
+        states.push_back(shared_ptr<Blob<Dtype> >(new Blob<Dtype>()));
+        states.back()->CopyFrom(*stateful.back(), false, true);
+      }
+    }
+  }
+  // Replay the random numbers drawn the first time, e.g. by Dropout.
+  const rng_t rng = *caffe_rng();
+  for (int layer_id = first; layer_id <= last; ++layer_id) {
+    if (layer_rngs_[layer_id]) {
+      *caffe_rng() = *layer_rngs_[layer_id];
+    }
+    if (!bottom_vecs_[layer_id].empty() && !layer_fused_[layer_id]) {
+      layers_[layer_id]->Forward(bottom_vecs_[layer_id], top_vecs_[layer_id]);
+    }
+  }
+  *caffe_rng() = rng;
+  for (int i = 0; i < stateful.size(); ++i) {
+    stateful[i]->CopyFrom(*states[i]);
+  }
+  segment_released_[segment] = false;
+}
+
 template <typename Dtype>
 Dtype Net<Dtype>::ForwardFromTo(int start, int end) {
   CHECK_GE(start, 0);
   CHECK_LT(end, layers_.size());
+  if (scheduler_ && !debug_info_ && !perf_counters_ && start == 0 &&
+      end == layers_.size() - 1) {
+    return scheduler_->Forward();
+  }
   Dtype loss = 0;
   for (int i = start; i <= end; ++i) {
-    // LOG(ERROR) << "Forwarding " << layer_names_[i];
-    Dtype layer_loss = layers_[i]->Forward(bottom_vecs_[i], top_vecs_[i]);
-    loss += layer_loss;
-    if (debug_info_) { ForwardDebugInfo(i); }
+    const int segment = layer_segments_.empty() ? -1 : layer_segments_[i];
+    const bool recomputed =
+        segment >= 0 && !segment_blobs_[segment].empty();
+    if (recomputed && i == start && i > segments_[segment].first &&
+        segment_released_[segment]) {
+      RecomputeSegment(segment, i - 1);
+    }
+    if (recomputed && layer_rngs_[i]) {
+      *layer_rngs_[i] = *caffe_rng();
+    }
+    // Fused layers are computed by the layer before them, unless the range
+    // starts at them; then they run on their own, as does the layer before
+    // them in a range ending with it.
+    if (!layer_fused_[i] || i == start) {
+      const bool unfused =
+          i == end && i + 1 < layers_.size() && layer_fused_[i + 1];
+      if (unfused) { SetScaleFused(i, false); }
+      // LOG(ERROR) << "Forwarding " << layer_names_[i];
+      TraceSpan span("forward", layer_names_[i]);
+      PerfSample begin;
+      if (perf_counters_) { perf_counters_->Read(&begin); }
+      Dtype layer_loss = layers_[i]->Forward(bottom_vecs_[i], top_vecs_[i]);
+      if (perf_counters_) { CountPerf(begin, &forward_perf_[i]); }
+      loss += layer_loss;
+      if (debug_info_) { ForwardDebugInfo(i); }
+      if (unfused) { SetScaleFused(i, true); }
+    }
+    if (recomputed && i == segments_[segment].second) {
+      ReleaseSegment(segment);
+    }
   }
   return loss;
 }
@@ -600,15 +1097,66 @@ template <typename Dtype>
 void Net<Dtype>::BackwardFromTo(int start, int end) {
   CHECK_GE(end, 0);
   CHECK_LT(start, layers_.size());
+  if (scheduler_ && !debug_info_ && !perf_counters_ &&
+      start == layers_.size() - 1 && end == 0) {
+    scheduler_->Backward();
+    return;
+  }
   for (int i = start; i >= end; --i) {
-    if (layer_need_backward_[i]) {
+    const int segment = layer_segments_.empty() ? -1 : layer_segments_[i];
+    const bool recomputed =
+        segment >= 0 && !segment_blobs_[segment].empty();
+    // As in ForwardFromTo, fused layers run on their own only when the
+    // range separates them from the layer before them.
+    if (layer_need_backward_[i] && (!layer_fused_[i] || i == end)) {
+      if (recomputed && segment_released_[segment]) {
+        RecomputeSegment(segment, segments_[segment].second);
+      }
+      const bool unfused =
+          i == start && i + 1 < layers_.size() && layer_fused_[i + 1];
+      if (unfused) { SetScaleFused(i, false); }
+      TraceSpan span("backward", layer_names_[i]);
+      PerfSample begin;
+      if (perf_counters_) { perf_counters_->Read(&begin); }
       layers_[i]->Backward(
           top_vecs_[i], bottom_need_backward_[i], bottom_vecs_[i]);
+      if (perf_counters_) { CountPerf(begin, &backward_perf_[i]); }
       if (debug_info_) { BackwardDebugInfo(i); }
+      if (unfused) { SetScaleFused(i, true); }
+    }
+    if (recomputed && i == segments_[segment].first) {
+      ReleaseSegment(segment);
     }
   }
 }
 
+template <typename Dtype>
+bool Net<Dtype>::EnablePerfCounters() {
+  if (!perf_counters_) {
+    shared_ptr<PerfCounters> counters(new PerfCounters());
+    if (!counters->available()) {
+      return false;
+    }
+    perf_counters_ = counters;
+  }
+  ClearPerfCounters();
+  return true;
+}
+
+template <typename Dtype>
+void Net<Dtype>::ClearPerfCounters() {
+  forward_perf_.assign(layers_.size(), PerfSample());
+  backward_perf_.assign(layers_.size(), PerfSample());
+}
+
+template <typename Dtype>
+void Net<Dtype>::CountPerf(const PerfSample& begin, PerfSample* total) {
+  PerfSample end;
+  perf_counters_->Read(&end);
+  end -= begin;
+  *total += end;
+}
+
 template <typename Dtype>
 void Net<Dtype>::ForwardDebugInfo(const int layer_id) {
   for (int top_id = 0; top_id < top_vecs_[layer_id].size(); ++top_id) {
@@ -754,6 +1302,10 @@ void Net<Dtype>::Reshape() {
   for (int i = 0; i < layers_.size(); ++i) {
     layers_[i]->Reshape(bottom_vecs_[i], top_vecs_[i]);
   }
+  // Blobs which grew got memory of their own.
+  if (zero_copy_concat_) {
+    AliasConcatBlobs();
+  }
 }
 
 template <typename Dtype>
@@ -799,6 +1351,8 @@ void Net<Dtype>::CopyTrainedLayersFrom(const string trained_filename) {
   if (trained_filename.size() >= 3 &&
       trained_filename.compare(trained_filename.size() - 3, 3, ".h5") == 0) {
     CopyTrainedLayersFromHDF5(trained_filename);
+  } else if (IsFlatWeightsFile(trained_filename)) {
+    CopyTrainedLayersFromFlat(trained_filename);
   } else {
     CopyTrainedLayersFromBinaryProto(trained_filename);
   }
@@ -862,6 +1416,71 @@ void Net<Dtype>::CopyTrainedLayersFromHDF5(const string trained_filename) {
   H5Fclose(file_hid);
 }
 
+template <typename Source, typename Dtype>
+static void convert_flat_tensor(const void* source, Blob<Dtype>* blob) {
+  const Source* source_data = static_cast<const Source*>(source);
+  Dtype* target_data = blob->mutable_cpu_data();
+  for (int i = 0; i < blob->count(); ++i) {
+    target_data[i] = source_data[i];
+  }
+}
+
+template <typename Dtype>
+void Net<Dtype>::CopyTrainedLayersFromFlat(const string trained_filename) {
+  shared_ptr<MappedFlatWeights> weights(
+    new MappedFlatWeights(trained_filename));
+  const FlatWeightsIndex& index = weights->index();
+  for (int i = 0; i < index.tensor_size(); ++i) {
+    const FlatWeightsIndex::Tensor& tensor = index.tensor(i);
+    const string& source_layer_name = tensor.layer();
+    if (!layer_names_index_.count(source_layer_name)) {
+      if (tensor.param() == 0) {
+        LOG(INFO) << "Ignoring source layer " << source_layer_name;
+      }
+      continue;
+    }
+    int target_layer_id = layer_names_index_[source_layer_name];
+    DLOG(INFO) << "Mapping source layer " << source_layer_name
+               << " param " << tensor.param();
+    vector<shared_ptr<Blob<Dtype> > >& target_blobs =
+        layers_[target_layer_id]->blobs();
+    CHECK_LT(tensor.param(), target_blobs.size())
+        << "Incompatible number of blobs for layer " << source_layer_name;
+    Blob<Dtype>* target_blob = target_blobs[tensor.param()].get();
+    vector<int> source_shape(tensor.shape().dim().begin(),
+                             tensor.shape().dim().end());
+    BlobProto source_proto;
+    GetFlatTensorShape(tensor, &source_proto);
+    if (!target_blob->ShapeEquals(source_proto)) {
+      LOG(FATAL) << "Cannot copy param " << tensor.param()
+          << " weights from layer '" << source_layer_name
+          << "'; shape mismatch.  Source param shape is "
+          << Blob<Dtype>(source_shape).shape_string()
+          << "; target param shape is " << target_blob->shape_string() << ". "
+          << "To learn this layer's parameters from scratch rather than "
+          << "copying from a saved net, rename the layer.";
+    }
+    if (target_blob->count() == 0) {
+      continue;
+    }
+    if (tensor.double_data() != (sizeof(Dtype) == sizeof(double))) {
+      if (tensor.double_data()) {
+        convert_flat_tensor<double>(weights->data(i), target_blob);
+      } else {
+        convert_flat_tensor<float>(weights->data(i), target_blob);
+      }
+    } else if (target_blob->data()->size() != weights->size(i)) {
+      // a blob reshaped to less than its capacity, copy into it
+      caffe_copy(target_blob->count(),
+                 static_cast<const Dtype*>(weights->data(i)),
+                 target_blob->mutable_cpu_data());
+    } else {
+      // the blob keeps the mapping alive
+      target_blob->data()->set_cpu_data(weights->data(i), weights);
+    }
+  }
+}
+
 template <typename Dtype>
 void Net<Dtype>::ToProto(NetParameter* param, bool write_diff) const {
   param->Clear();
@@ -876,6 +1495,87 @@ void Net<Dtype>::ToProto(NetParameter* param, bool write_diff) const {
 
 template <typename Dtype>
 void Net<Dtype>::ToHDF5(const string& filename, bool write_diff) const {
+  NetSnapshot<Dtype> snapshot;
+  ShareState(&snapshot, write_diff);
+  snapshot.ToHDF5(filename);
+}
+
+template <typename Dtype>
+void Net<Dtype>::InitState(NetSnapshot<Dtype>* snapshot,
+    bool write_diff) const {
+  snapshot->name_ = name_;
+  snapshot->write_diff_ = write_diff;
+  if (snapshot->layer_params_.size() == layers_.size()) {
+    return;
+  }
+  snapshot->layer_params_.resize(layers_.size());
+  snapshot->blobs_.resize(layers_.size());
+  snapshot->blob_owners_.resize(layers_.size());
+  for (int layer_id = 0; layer_id < layers_.size(); ++layer_id) {
+    snapshot->layer_params_[layer_id].CopyFrom(
+        layers_[layer_id]->layer_param());
+    snapshot->layer_params_[layer_id].clear_blobs();
+    const int num_params = layers_[layer_id]->blobs().size();
+    snapshot->blobs_[layer_id].resize(num_params);
+    snapshot->blob_owners_[layer_id].resize(num_params);
+    for (int param_id = 0; param_id < num_params; ++param_id) {
+      const int net_param_id = param_id_vecs_[layer_id][param_id];
+      snapshot->blob_owners_[layer_id][param_id] =
+          (param_owners_[net_param_id] == -1);
+    }
+  }
+}
+
+template <typename Dtype>
+void Net<Dtype>::CopyState(NetSnapshot<Dtype>* snapshot,
+    bool write_diff) const {
+  InitState(snapshot, write_diff);
+  for (int layer_id = 0; layer_id < layers_.size(); ++layer_id) {
+    const vector<shared_ptr<Blob<Dtype> > >& source =
+        layers_[layer_id]->blobs();
+    for (int param_id = 0; param_id < source.size(); ++param_id) {
+      shared_ptr<Blob<Dtype> >& target = snapshot->blobs_[layer_id][param_id];
+      if (!target || target == source[param_id]) {
+        target.reset(new Blob<Dtype>());
+      }
+      // Always stage in host memory so the writer never touches the device.
+      target->ReshapeLike(*source[param_id]);
+      caffe_copy(target->count(), source[param_id]->cpu_data(),
+          target->mutable_cpu_data());
+      if (write_diff) {
+        caffe_copy(target->count(), source[param_id]->cpu_diff(),
+            target->mutable_cpu_diff());
+      }
+    }
+  }
+}
+
+template <typename Dtype>
+void Net<Dtype>::ShareState(NetSnapshot<Dtype>* snapshot,
+    bool write_diff) const {
+  InitState(snapshot, write_diff);
+  for (int layer_id = 0; layer_id < layers_.size(); ++layer_id) {
+    snapshot->blobs_[layer_id] = layers_[layer_id]->blobs();
+  }
+}
+
+template <typename Dtype>
+void NetSnapshot<Dtype>::ToProto(NetParameter* param) const {
+  param->Clear();
+  param->set_name(name_);
+  DLOG(INFO) << "Serializing " << layer_params_.size() << " layers";
+  for (int layer_id = 0; layer_id < layer_params_.size(); ++layer_id) {
+    LayerParameter* layer_param = param->add_layer();
+    layer_param->CopyFrom(layer_params_[layer_id]);
+    for (int param_id = 0; param_id < blobs_[layer_id].size(); ++param_id) {
+      blobs_[layer_id][param_id]->ToProto(layer_param->add_blobs(),
+          write_diff_);
+    }
+  }
+}
+
+template <typename Dtype>
+void NetSnapshot<Dtype>::ToHDF5(const string& filename) const {
   hid_t file_hid = H5Fcreate(filename.c_str(), H5F_ACC_TRUNC, H5P_DEFAULT,
       H5P_DEFAULT);
   CHECK_GE(file_hid, 0)
@@ -884,48 +1584,46 @@ void Net<Dtype>::ToHDF5(const string& filename, bool write_diff) const {
       H5P_DEFAULT);
   CHECK_GE(data_hid, 0) << "Error saving weights to " << filename << ".";
   hid_t diff_hid = -1;
-  if (write_diff) {
+  if (write_diff_) {
     diff_hid = H5Gcreate2(file_hid, "diff", H5P_DEFAULT, H5P_DEFAULT,
         H5P_DEFAULT);
     CHECK_GE(diff_hid, 0) << "Error saving weights to " << filename << ".";
   }
-  for (int layer_id = 0; layer_id < layers_.size(); ++layer_id) {
-    const LayerParameter& layer_param = layers_[layer_id]->layer_param();
-    string layer_name = layer_param.name();
+  for (int layer_id = 0; layer_id < layer_params_.size(); ++layer_id) {
+    const string& layer_name = layer_params_[layer_id].name();
     hid_t layer_data_hid = H5Gcreate2(data_hid, layer_name.c_str(),
         H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
     CHECK_GE(layer_data_hid, 0)
         << "Error saving weights to " << filename << ".";
     hid_t layer_diff_hid = -1;
-    if (write_diff) {
+    if (write_diff_) {
       layer_diff_hid = H5Gcreate2(diff_hid, layer_name.c_str(),
           H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
       CHECK_GE(layer_diff_hid, 0)
           << "Error saving weights to " << filename << ".";
     }
-    int num_params = layers_[layer_id]->blobs().size();
+    int num_params = blobs_[layer_id].size();
     for (int param_id = 0; param_id < num_params; ++param_id) {
       ostringstream dataset_name;
       dataset_name << param_id;
-      const int net_param_id = param_id_vecs_[layer_id][param_id];
-      if (param_owners_[net_param_id] == -1) {
+      if (blob_owners_[layer_id][param_id]) {
         // Only save params that own themselves
         hdf5_save_nd_dataset<Dtype>(layer_data_hid, dataset_name.str(),
-            *params_[net_param_id]);
+            *blobs_[layer_id][param_id]);
       }
-      if (write_diff) {
+      if (write_diff_) {
         // Write diffs regardless of weight-sharing
         hdf5_save_nd_dataset<Dtype>(layer_diff_hid, dataset_name.str(),
-            *params_[net_param_id], true);
+            *blobs_[layer_id][param_id], true);
       }
     }
     H5Gclose(layer_data_hid);
-    if (write_diff) {
+    if (write_diff_) {
       H5Gclose(layer_diff_hid);
     }
   }
   H5Gclose(data_hid);
-  if (write_diff) {
+  if (write_diff_) {
     H5Gclose(diff_hid);
   }
   H5Fclose(file_hid);
@@ -933,6 +1631,12 @@ void Net<Dtype>::ToHDF5(const string& filename, bool write_diff) const {
 
 template <typename Dtype>
 void Net<Dtype>::Update() {
+  const CPUParams<Dtype>* params = contiguous_params();
+  if (params) {
+    caffe_axpy<Dtype>(params->size(), Dtype(-1), params->diff(),
+                      params->data());
+    return;
+  }
   for (int i = 0; i < learnable_params_.size(); ++i) {
     learnable_params_[i]->Update();
   }
@@ -963,11 +1667,25 @@ void Net<Dtype>::ClearParamDiffs(int learnable_param_id) {
 
 template <typename Dtype>
 void Net<Dtype>::ClearParamDiffs() {
+  const CPUParams<Dtype>* params = contiguous_params();
+  if (params) {
+    caffe_set(params->size(), Dtype(0), params->diff());
+    return;
+  }
   for (int i = 0; i < learnable_params_.size(); ++i) {
     ClearParamDiffs(i);
   }
 }
 
+template <typename Dtype>
+const CPUParams<Dtype>* Net<Dtype>::contiguous_params() const {
+  if (contiguous_params_ && (Caffe::mode() == Caffe::CPU)
+      && contiguous_params_->in_use()) {
+    return contiguous_params_.get();
+  }
+  return NULL;
+}
+
 template <typename Dtype>
 void Net<Dtype>::ShareWeights() {
   for (int i = 0; i < params_.size(); ++i) {
@@ -1027,5 +1745,6 @@ const shared_ptr<Layer<Dtype> > Net<Dtype>::layer_by_name(
 }
 
 INSTANTIATE_CLASS(Net);
+INSTANTIATE_CLASS(NetSnapshot);
 
 }  // namespace caffe
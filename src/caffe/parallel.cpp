@@ -73,6 +73,54 @@ Params<Dtype>::Params(shared_ptr<Solver<Dtype> > root_solver)
       diff_() {
 }
 
+template<typename Dtype>
+Params<Dtype>::Params(const vector<Blob<Dtype>*>& blobs)
+    : size_(total_size<Dtype>(blobs)),
+      data_(),
+      diff_() {
+}
+
+template<typename Dtype>
+CPUParams<Dtype>::CPUParams(const vector<Blob<Dtype>*>& blobs)
+    : Params<Dtype>(blobs),
+      blobs_(blobs),
+      data_memory_(new SyncedMemory(size_ * sizeof(Dtype))),
+      diff_memory_(new SyncedMemory(size_ * sizeof(Dtype))) {
+  data_ = static_cast<Dtype*>(data_memory_->mutable_cpu_data());
+  diff_ = static_cast<Dtype*>(diff_memory_->mutable_cpu_data());
+  Dtype* data = data_;
+  Dtype* diff = diff_;
+  for (int i = 0; i < blobs_.size(); ++i) {
+    Blob<Dtype>* blob = blobs_[i];
+    if (blob->count() == 0) continue;
+    caffe_copy(blob->count(), blob->cpu_data(), data);
+    caffe_copy(blob->count(), blob->cpu_diff(), diff);
+    blob->data()->set_cpu_data(data, data_memory_);
+    blob->diff()->set_cpu_data(diff, diff_memory_);
+    data += blob->count();
+    diff += blob->count();
+  }
+}
+
+template<typename Dtype>
+bool CPUParams<Dtype>::in_use() const {
+  const Dtype* data = data_;
+  const Dtype* diff = diff_;
+  for (int i = 0; i < blobs_.size(); ++i) {
+    Blob<Dtype>* blob = blobs_[i];
+    if (blob->count() == 0) continue;
+    if ((blob->data()->head() != SyncedMemory::HEAD_AT_CPU)
+        || (blob->diff()->head() != SyncedMemory::HEAD_AT_CPU)
+        || (blob->cpu_data() != data)
+        || (blob->cpu_diff() != diff)) {
+      return false;
+    }
+    data += blob->count();
+    diff += blob->count();
+  }
+  return true;
+}
+
 template<typename Dtype>
 GPUParams<Dtype>::GPUParams(shared_ptr<Solver<Dtype> > root_solver, int device)
     : Params<Dtype>(root_solver) {
@@ -431,6 +479,7 @@ void P2PSync<Dtype>::run(const vector<int>& gpus) {
 }
 
 INSTANTIATE_CLASS(Params);
+INSTANTIATE_CLASS(CPUParams);
 INSTANTIATE_CLASS(GPUParams);
 INSTANTIATE_CLASS(P2PSync);
 
@@ -1,10 +1,14 @@
 #include <algorithm>
 #include <cfloat>
 #include <numeric>
+#include <string>
+#include <vector>
 #include "boost/make_shared.hpp"
+#include "caffe/net.hpp"
 #include "caffe/proto/caffe.pb.h"
 #include "caffe/serialization/bitfield.hpp"
 #include "caffe/serialization/BlobCodec.hpp"
+#include "caffe/util/half.hpp"
 #include "caffe/util/math_functions.hpp"
 
 namespace caffe {
@@ -71,6 +75,59 @@ bool decode_simple(Dtype* dest,
   return true;
 }
 
+template <typename Dtype>
+void encode_half(const Dtype* data, BlobUpdate* msg, uint32_t size) {
+  string* buffer = msg->mutable_data();
+  buffer->resize(size * sizeof(uint16_t));
+  uint16_t* dest = reinterpret_cast<uint16_t*>(&(*buffer)[0]);
+  if (msg->compression_param().algo() == COMPRESSION_BF16) {
+    caffe_cpu_to_bf16(size, data, dest);
+  } else {
+    caffe_cpu_to_fp16(size, data, dest);
+  }
+}
+
+template <typename Dtype>
+bool decode_half(Dtype* dest,
+                 int32_t max_size,
+                 const BlobUpdate& update,
+                 Dtype alpha,
+                 Dtype beta) {
+  if (update.data().size() % sizeof(uint16_t) != 0) {
+    LOG(ERROR) << "ignoring received data for layer: "
+               << update.info().layer_id()
+               << " because data is corrupted, data size is not divisable"
+               << " by size of element";
+    return false;
+  }
+  int32_t encoded_elements = update.data().size() / sizeof(uint16_t);
+  if (max_size < encoded_elements) {
+    LOG(ERROR) << "ignoring received data for layer: "
+               << update.info().layer_id()
+               << " because part is over destination blob: "
+               << "(available elements: " << max_size << ", "
+               << "encoded elements: " << encoded_elements << ")";
+    return false;
+  }
+
+  const uint16_t* src =
+    reinterpret_cast<const uint16_t*>(update.data().data());
+  const bool bf16 = (update.compression_param().algo() == COMPRESSION_BF16);
+  if ((alpha == 1.0) && (beta == 0.0)) {
+    if (bf16) {
+      caffe_cpu_from_bf16(encoded_elements, src, dest);
+    } else {
+      caffe_cpu_from_fp16(encoded_elements, src, dest);
+    }
+    return true;
+  }
+  for (int i = 0; i < encoded_elements; ++i) {
+    const Dtype val = bf16 ? bf16_to_float(src[i]) : fp16_to_float(src[i]);
+    dest[i] = val * alpha + dest[i] * beta;
+  }
+  return true;
+}
+
 template <typename Dtype>
 void encode_averaging(Dtype* data, BlobUpdate* msg, uint32_t size) {
   ThresholdCompressionConfig& config =
@@ -146,8 +203,10 @@ struct BlobCodecImpl : BlobCodec<Dtype> {
   const size_t max_header_size;
   const size_t max_packet_size;
   const size_t elements_per_part;
+  // per layer id
+  vector<CompressionParam> layer_compression;
 
-  explicit BlobCodecImpl(MultinodeParameter param)
+  BlobCodecImpl(MultinodeParameter param, const Net<Dtype>* net)
     : param(param)
     , max_header_size(get_max_header_size())
     , max_packet_size(param.max_packet_size())
@@ -156,6 +215,20 @@ struct BlobCodecImpl : BlobCodec<Dtype> {
       << "packet size must accomodate for proto msg size, "
       << "min packet size must be greater than: "
       << (max_header_size + sizeof(Dtype));
+    if (net) {
+      for (int i = 0; i < net->layers().size(); ++i) {
+        const LayerParameter& layer_param = net->layers()[i]->layer_param();
+        layer_compression.push_back(layer_param.has_comm_compression() ?
+          layer_param.comm_compression() : param.outgoing_compression());
+      }
+    }
+  }
+
+  const CompressionParam& outgoing_compression(int layer_id) const {
+    if ((layer_id >= 0) && (layer_id < layer_compression.size())) {
+      return layer_compression[layer_id];
+    }
+    return param.outgoing_compression();
   }
 
   virtual size_t max_elements_per_part() const {
@@ -176,7 +249,8 @@ struct BlobCodecImpl : BlobCodec<Dtype> {
       std::min(uint32_t(start_element + elements_per_part),
                uint32_t(src->count())) - start_element;
     msg->mutable_info()->set_part(part);
-    *msg->mutable_compression_param() = param.outgoing_compression();
+    *msg->mutable_compression_param() =
+      outgoing_compression(msg->info().layer_id());
 
     const Dtype* data =
       ((what == BlobEncoding::GRADS) ?
@@ -191,10 +265,16 @@ struct BlobCodecImpl : BlobCodec<Dtype> {
       << ", starting from: " << start_element
       << ", total size: " << src->count();
 
-    if (param.outgoing_compression().algo() == COMPRESSION_AVERAGING) {
-      encode_averaging(data, msg, size);
-    } else {
-      encode_simple(data, msg, size);
+    switch (msg->compression_param().algo()) {
+      case COMPRESSION_AVERAGING:
+        encode_averaging(data, msg, size);
+        break;
+      case COMPRESSION_BF16:
+      case COMPRESSION_FP16:
+        encode_half(data, msg, size);
+        break;
+      default:
+        encode_simple(data, msg, size);
     }
 
     return size;
@@ -205,7 +285,9 @@ struct BlobCodecImpl : BlobCodec<Dtype> {
                       typename BlobCodec<Dtype>::What what,
                       Dtype alpha,
                       Dtype beta) const {
-    if (update.data().size() % sizeof(Dtype) != 0) {
+    const CompressionAlgo algo = update.compression_param().algo();
+    const bool half = (algo == COMPRESSION_BF16) || (algo == COMPRESSION_FP16);
+    if (!half && (update.data().size() % sizeof(Dtype) != 0)) {
       LOG(ERROR) << "ignoring received data for layer: "
                  << update.info().layer_id()
                  << " because data is corrupted, data size is not divisable"
@@ -226,10 +308,13 @@ struct BlobCodecImpl : BlobCodec<Dtype> {
       << ", part: " << update.info().part()
       << ", starting from: " << update.info().part() * elements_per_part
       << ", total size: " << dest->count();
-    if (update.compression_param().algo() == COMPRESSION_AVERAGING) {
+    if (algo == COMPRESSION_AVERAGING) {
       return decode_averaging(
         data, max_size, elements_per_part, update, alpha, beta);
     }
+    if (half) {
+      return decode_half(data, max_size, update, alpha, beta);
+    }
     return decode_simple<SingleThreaded>(
         data, max_size, elements_per_part, update, alpha, beta);
   }
@@ -240,10 +325,11 @@ struct BlobCodecImpl : BlobCodec<Dtype> {
 template <typename Dtype>
 shared_ptr<BlobCodec<Dtype> > BlobCodec<Dtype>::create_codec(
   const MultinodeParameter& param,
-  bool single_threaded) {
+  bool single_threaded,
+  const Net<Dtype>* net) {
   if (single_threaded)
-    return boost::make_shared<BlobCodecImpl<Dtype, true> >(param);
-  return boost::make_shared<BlobCodecImpl<Dtype, false> >(param);
+    return boost::make_shared<BlobCodecImpl<Dtype, true> >(param, net);
+  return boost::make_shared<BlobCodecImpl<Dtype, false> >(param, net);
 }
 
 INSTANTIATE_CLASS(BlobCodec);
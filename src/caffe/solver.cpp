@@ -1,16 +1,120 @@
+#include <boost/thread.hpp>
 #include <cstdio>
+#include <deque>
 #include <string>
 #include <vector>
 
 #include "boost/bind.hpp"
 #include "caffe/solver.hpp"
+#include "caffe/util/benchmark.hpp"
 #include "caffe/util/format.hpp"
 #include "caffe/util/hdf5.hpp"
 #include "caffe/util/io.hpp"
+#include "caffe/util/trace.hpp"
 #include "caffe/util/upgrade_proto.hpp"
 
 namespace caffe {
 
+// Hands staged snapshots to a background thread. A fixed pool of
+// snapshot_max_pending staging buffers is reused, so at most that many
+// snapshots are in flight and the solver only blocks when all are taken.
+template <typename Dtype>
+class Solver<Dtype>::AsyncSnapshotWriter {
+ public:
+  explicit AsyncSnapshotWriter(Solver* solver)
+      : solver_(solver)
+      , total_(solver->param().snapshot_max_pending())
+      , stop_(false) {
+    CHECK_GT(total_, 0) << "snapshot_max_pending must be positive.";
+    for (int i = 0; i < total_; ++i) {
+      free_.push_back(
+          shared_ptr<SolverSnapshot<Dtype> >(new SolverSnapshot<Dtype>()));
+    }
+    thread_.reset(new boost::thread(&AsyncSnapshotWriter::Run, this));
+  }
+
+  ~AsyncSnapshotWriter() {
+    {
+      boost::mutex::scoped_lock lock(mutex_);
+      stop_ = true;
+    }
+    cond_.notify_all();
+    thread_->join();
+  }
+
+  void Snapshot() {
+    CPUTimer stall_timer;
+    CPUTimer wait_timer;
+    stall_timer.Start();
+    wait_timer.Start();
+    shared_ptr<SolverSnapshot<Dtype> > snapshot;
+    {
+      boost::mutex::scoped_lock lock(mutex_);
+      while (free_.empty()) {
+        cond_.wait(lock);
+      }
+      snapshot = free_.front();
+      free_.pop_front();
+    }
+    wait_timer.Stop();
+    solver_->StageSnapshot(snapshot.get(), true);
+    {
+      boost::mutex::scoped_lock lock(mutex_);
+      queue_.push_back(snapshot);
+    }
+    cond_.notify_all();
+    stall_timer.Stop();
+    LOG(INFO) << "Staged snapshot of iteration " << snapshot->iter
+        << ", training stalled for " << stall_timer.MilliSeconds() << " ms ("
+        << wait_timer.MilliSeconds() << " ms waiting for pending snapshots)";
+  }
+
+  void Wait() {
+    boost::mutex::scoped_lock lock(mutex_);
+    while (free_.size() < static_cast<size_t>(total_)) {
+      cond_.wait(lock);
+    }
+  }
+
+ private:
+  void Run() {
+    while (true) {
+      shared_ptr<SolverSnapshot<Dtype> > snapshot;
+      {
+        boost::mutex::scoped_lock lock(mutex_);
+        while (queue_.empty() && !stop_) {
+          cond_.wait(lock);
+        }
+        if (queue_.empty()) {
+          return;
+        }
+        snapshot = queue_.front();
+        queue_.pop_front();
+      }
+      CPUTimer timer;
+      timer.Start();
+      solver_->WriteSnapshot(*snapshot, true);
+      timer.Stop();
+      LOG(INFO) << "Snapshot of iteration " << snapshot->iter
+          << " written to disk in " << timer.MilliSeconds() << " ms";
+      {
+        boost::mutex::scoped_lock lock(mutex_);
+        free_.push_back(snapshot);
+      }
+      cond_.notify_all();
+    }
+  }
+
+  Solver* solver_;
+  const int total_;
+  bool stop_;
+  std::deque<shared_ptr<SolverSnapshot<Dtype> > > free_;
+  std::deque<shared_ptr<SolverSnapshot<Dtype> > > queue_;
+  boost::mutex mutex_;
+  boost::condition_variable cond_;
+  shared_ptr<boost::thread> thread_;
+};
+
 template<typename Dtype>
 void Solver<Dtype>::SetActionFunction(ActionCallback func) {
   action_request_function_ = func;
@@ -43,6 +147,11 @@ Solver<Dtype>::Solver(const string& param_file, const Solver* root_solver)
   Init(param);
 }
 
+template <typename Dtype>
+Solver<Dtype>::~Solver() {
+  WaitForSnapshots();
+}
+
 template <typename Dtype>
 void Solver<Dtype>::Init(const SolverParameter& param) {
   CHECK(Caffe::root_solver() || root_solver_)
@@ -310,6 +419,7 @@ void Solver<Dtype>::Solve(const char* resume_file) {
       && (!param_.snapshot() || iter_ % param_.snapshot() != 0)) {
     Snapshot();
   }
+  WaitForSnapshots();
   if (requested_early_exit_) {
     LOG(INFO) << "Optimization stopped early.";
     return;
@@ -422,19 +532,60 @@ void Solver<Dtype>::Test(const int test_net_id) {
 template <typename Dtype>
 void Solver<Dtype>::Snapshot() {
   CHECK(Caffe::root_solver());
+  TraceSpan span("solver", "snapshot");
+  if (!param_.snapshot_async()) {
+    SolverSnapshot<Dtype> snapshot;
+    StageSnapshot(&snapshot, false);
+    WriteSnapshot(snapshot, false);
+    return;
+  }
+  if (!snapshot_writer_) {
+    snapshot_writer_.reset(new AsyncSnapshotWriter(this));
+  }
+  snapshot_writer_->Snapshot();
+}
+
+template <typename Dtype>
+void Solver<Dtype>::WaitForSnapshots() {
+  if (snapshot_writer_) {
+    snapshot_writer_->Wait();
+  }
+}
+
+template <typename Dtype>
+void Solver<Dtype>::StageSnapshot(SolverSnapshot<Dtype>* snapshot,
+    bool copy) {
+  snapshot->iter = iter_;
+  snapshot->current_step = current_step_;
+  if (copy) {
+    net_->CopyState(&snapshot->net, param_.snapshot_diff());
+  } else {
+    net_->ShareState(&snapshot->net, param_.snapshot_diff());
+  }
+  StageSolverState(snapshot, copy);
+}
+
+template <typename Dtype>
+void Solver<Dtype>::WriteSnapshot(const SolverSnapshot<Dtype>& snapshot,
+    bool sync_to_disk) {
+  TraceSpan span("solver", "write snapshot");
   string model_filename;
   switch (param_.snapshot_format()) {
   case caffe::SolverParameter_SnapshotFormat_BINARYPROTO:
-    model_filename = SnapshotToBinaryProto();
+    model_filename = SnapshotToBinaryProto(snapshot);
     break;
   case caffe::SolverParameter_SnapshotFormat_HDF5:
-    model_filename = SnapshotToHDF5();
+    model_filename = SnapshotToHDF5(snapshot);
     break;
   default:
     LOG(FATAL) << "Unsupported snapshot format.";
   }
 
-  SnapshotSolverState(model_filename);
+  string state_filename = SnapshotSolverState(snapshot, model_filename);
+  if (sync_to_disk) {
+    SyncFileToDisk(model_filename);
+    SyncFileToDisk(state_filename);
+  }
 }
 
 template <typename Dtype>
@@ -457,25 +608,31 @@ void Solver<Dtype>::CheckSnapshotWritePermissions() {
 
 template <typename Dtype>
 string Solver<Dtype>::SnapshotFilename(const string extension) {
-  return param_.snapshot_prefix() + "_iter_" + caffe::format_int(iter_)
+  return SnapshotFilename(extension, iter_);
+}
+
+template <typename Dtype>
+string Solver<Dtype>::SnapshotFilename(const string extension, int iter) {
+  return param_.snapshot_prefix() + "_iter_" + caffe::format_int(iter)
     + extension;
 }
 
 template <typename Dtype>
-string Solver<Dtype>::SnapshotToBinaryProto() {
-  string model_filename = SnapshotFilename(".caffemodel");
+string Solver<Dtype>::SnapshotToBinaryProto(
+    const SolverSnapshot<Dtype>& snapshot) {
+  string model_filename = SnapshotFilename(".caffemodel", snapshot.iter);
   LOG(INFO) << "Snapshotting to binary proto file " << model_filename;
   NetParameter net_param;
-  net_->ToProto(&net_param, param_.snapshot_diff());
+  snapshot.net.ToProto(&net_param);
   WriteProtoToBinaryFile(net_param, model_filename);
   return model_filename;
 }
 
 template <typename Dtype>
-string Solver<Dtype>::SnapshotToHDF5() {
-  string model_filename = SnapshotFilename(".caffemodel.h5");
+string Solver<Dtype>::SnapshotToHDF5(const SolverSnapshot<Dtype>& snapshot) {
+  string model_filename = SnapshotFilename(".caffemodel.h5", snapshot.iter);
   LOG(INFO) << "Snapshotting to HDF5 file " << model_filename;
-  net_->ToHDF5(model_filename, param_.snapshot_diff());
+  snapshot.net.ToHDF5(model_filename);
   return model_filename;
 }
 
@@ -106,6 +106,37 @@ void AdaDeltaSolver<Dtype>::ComputeUpdateValue(int param_id, Dtype rate) {
   }
 }
 
+template <typename Dtype>
+void adadelta_update_cpu(int N, Dtype* w, Dtype* g, Dtype* h, Dtype* h2,
+    const FusedGradient<Dtype>& grad, Dtype momentum, Dtype delta,
+    Dtype local_rate) {
+#ifdef _OPENMP
+  #pragma omp parallel for if (grad.parallel)
+#endif
+  for (int i = 0; i < N; ++i) {
+    Dtype gi = grad(g[i], w[i]);
+    Dtype hi = h[i] = momentum * h[i] + (1 - momentum) * gi * gi;
+    gi = gi * std::sqrt((h2[i] + delta) / (hi + delta));
+    h2[i] = momentum * h2[i] + (1 - momentum) * gi * gi;
+    Dtype ui = local_rate * gi;
+    g[i] = ui;
+    w[i] -= ui;
+  }
+}
+
+template <typename Dtype>
+void AdaDeltaSolver<Dtype>::ApplyFusedUpdate(int param_id, Dtype rate,
+    const FusedGradient<Dtype>& grad) {
+  Blob<Dtype>* param = this->net_->learnable_params()[param_id];
+  Dtype local_rate = rate * this->net_->params_lr()[param_id];
+  size_t update_history_offset = this->net_->learnable_params().size();
+  adadelta_update_cpu(param->count(), param->mutable_cpu_data(),
+      param->mutable_cpu_diff(), this->history_[param_id]->mutable_cpu_data(),
+      this->history_[update_history_offset + param_id]->mutable_cpu_data(),
+      grad, Dtype(this->param_.momentum()), Dtype(this->param_.delta()),
+      local_rate);
+}
+
 INSTANTIATE_CLASS(AdaDeltaSolver);
 REGISTER_SOLVER_CLASS(AdaDelta);
 
@@ -64,6 +64,31 @@ void AdaGradSolver<Dtype>::ComputeUpdateValue(int param_id, Dtype rate) {
   }
 }
 
+template <typename Dtype>
+void adagrad_update_cpu(int N, Dtype* w, Dtype* g, Dtype* h,
+    const FusedGradient<Dtype>& grad, Dtype delta, Dtype local_rate) {
+#ifdef _OPENMP
+  #pragma omp parallel for if (grad.parallel)
+#endif
+  for (int i = 0; i < N; ++i) {
+    Dtype gi = grad(g[i], w[i]);
+    Dtype hi = h[i] = h[i] + gi * gi;
+    Dtype ui = local_rate * gi / (std::sqrt(hi) + delta);
+    g[i] = ui;
+    w[i] -= ui;
+  }
+}
+
+template <typename Dtype>
+void AdaGradSolver<Dtype>::ApplyFusedUpdate(int param_id, Dtype rate,
+    const FusedGradient<Dtype>& grad) {
+  Blob<Dtype>* param = this->net_->learnable_params()[param_id];
+  Dtype local_rate = rate * this->net_->params_lr()[param_id];
+  adagrad_update_cpu(param->count(), param->mutable_cpu_data(),
+      param->mutable_cpu_diff(), this->history_[param_id]->mutable_cpu_data(),
+      grad, Dtype(this->param_.delta()), local_rate);
+}
+
 INSTANTIATE_CLASS(AdaGradSolver);
 REGISTER_SOLVER_CLASS(AdaGrad);
 
@@ -88,6 +88,41 @@ void AdamSolver<Dtype>::ComputeUpdateValue(int param_id, Dtype rate) {
   }
 }
 
+template <typename Dtype>
+void adam_update_cpu(int N, Dtype* w, Dtype* g, Dtype* m, Dtype* v,
+    const FusedGradient<Dtype>& grad, Dtype beta1, Dtype beta2,
+    Dtype eps_hat, Dtype corrected_local_rate) {
+#ifdef _OPENMP
+  #pragma omp parallel for if (grad.parallel)
+#endif
+  for (int i = 0; i < N; ++i) {
+    Dtype gi = grad(g[i], w[i]);
+    Dtype mi = m[i] = m[i] * beta1 + gi * (1 - beta1);
+    Dtype vi = v[i] = v[i] * beta2 + gi * gi * (1 - beta2);
+    Dtype ui = corrected_local_rate * mi / (std::sqrt(vi) + eps_hat);
+    g[i] = ui;
+    w[i] -= ui;
+  }
+}
+
+template <typename Dtype>
+void AdamSolver<Dtype>::ApplyFusedUpdate(int param_id, Dtype rate,
+    const FusedGradient<Dtype>& grad) {
+  Blob<Dtype>* param = this->net_->learnable_params()[param_id];
+  Dtype local_rate = rate * this->net_->params_lr()[param_id];
+  const Dtype beta1 = this->param_.momentum();
+  const Dtype beta2 = this->param_.momentum2();
+  size_t update_history_offset = this->net_->learnable_params().size();
+  const int t = this->iter_ + 1;
+  const Dtype correction = std::sqrt(Dtype(1) - pow(beta2, t)) /
+      (Dtype(1.) - pow(beta1, t));
+  adam_update_cpu(param->count(), param->mutable_cpu_data(),
+      param->mutable_cpu_diff(), this->history_[param_id]->mutable_cpu_data(),
+      this->history_[update_history_offset + param_id]->mutable_cpu_data(),
+      grad, beta1, beta2, Dtype(this->param_.delta()),
+      local_rate * correction);
+}
+
 INSTANTIATE_CLASS(AdamSolver);
 REGISTER_SOLVER_CLASS(Adam);
 
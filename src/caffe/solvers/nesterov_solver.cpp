@@ -56,6 +56,31 @@ void NesterovSolver<Dtype>::ComputeUpdateValue(int param_id, Dtype rate) {
   }
 }
 
+template <typename Dtype>
+void nesterov_update_cpu(int N, Dtype* w, Dtype* g, Dtype* h,
+    const FusedGradient<Dtype>& grad, Dtype momentum, Dtype local_rate) {
+#ifdef _OPENMP
+  #pragma omp parallel for if (grad.parallel)
+#endif
+  for (int i = 0; i < N; ++i) {
+    Dtype hi = h[i];
+    Dtype hi_new = h[i] = momentum * hi + local_rate * grad(g[i], w[i]);
+    Dtype ui = (1 + momentum) * hi_new - momentum * hi;
+    g[i] = ui;
+    w[i] -= ui;
+  }
+}
+
+template <typename Dtype>
+void NesterovSolver<Dtype>::ApplyFusedUpdate(int param_id, Dtype rate,
+    const FusedGradient<Dtype>& grad) {
+  Blob<Dtype>* param = this->net_->learnable_params()[param_id];
+  Dtype local_rate = rate * this->net_->params_lr()[param_id];
+  nesterov_update_cpu(param->count(), param->mutable_cpu_data(),
+      param->mutable_cpu_diff(), this->history_[param_id]->mutable_cpu_data(),
+      grad, Dtype(this->param_.momentum()), local_rate);
+}
+
 INSTANTIATE_CLASS(NesterovSolver);
 REGISTER_SOLVER_CLASS(Nesterov);
 
@@ -1,6 +1,11 @@
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
 #include <string>
 #include <vector>
 
+#include "caffe/parallel.hpp"
 #include "caffe/sgd_solvers.hpp"
 #include "caffe/util/hdf5.hpp"
 #include "caffe/util/io.hpp"
@@ -69,6 +74,7 @@ void SGDSolver<Dtype>::PreSolve() {
   history_.clear();
   update_.clear();
   temp_.clear();
+  clip_scale_ = Dtype(1);
   for (int i = 0; i < net_params.size(); ++i) {
     const vector<int>& shape = net_params[i]->shape();
     history_.push_back(shared_ptr<Blob<Dtype> >(new Blob<Dtype>(shape)));
@@ -77,14 +83,21 @@ void SGDSolver<Dtype>::PreSolve() {
   }
 }
 
+// Only computes the scale factor, the gradients are scaled by ApplyUpdate.
 template <typename Dtype>
 void SGDSolver<Dtype>::ClipGradients() {
   const Dtype clip_gradients = this->param_.clip_gradients();
+  clip_scale_ = Dtype(1);
   if (clip_gradients < 0) { return; }
   const vector<Blob<Dtype>*>& net_params = this->net_->learnable_params();
+  const CPUParams<Dtype>* params = this->net_->contiguous_params();
   Dtype sumsq_diff = 0;
-  for (int i = 0; i < net_params.size(); ++i) {
-    sumsq_diff += net_params[i]->sumsq_diff();
+  if (params) {
+    sumsq_diff = caffe_cpu_dot(params->size(), params->diff(), params->diff());
+  } else {
+    for (int i = 0; i < net_params.size(); ++i) {
+      sumsq_diff += net_params[i]->sumsq_diff();
+    }
   }
   const Dtype l2norm_diff = std::sqrt(sumsq_diff);
   if (l2norm_diff > clip_gradients) {
@@ -92,9 +105,7 @@ void SGDSolver<Dtype>::ClipGradients() {
     LOG(INFO) << "Gradient clipping: scaling down gradients (L2 norm "
         << l2norm_diff << " > " << clip_gradients << ") "
         << "by scale factor " << scale_factor;
-    for (int i = 0; i < net_params.size(); ++i) {
-      net_params[i]->scale_diff(scale_factor);
-    }
+    clip_scale_ = scale_factor;
   }
 }
 
@@ -110,6 +121,7 @@ void SGDSolver<Dtype>::ApplyUpdate() {
        ++param_id) {
     ApplyUpdate(param_id);
   }
+  clip_scale_ = Dtype(1);
 }
 
 template <typename Dtype>
@@ -117,12 +129,56 @@ void SGDSolver<Dtype>::ApplyUpdate(int param_id) {
   CHECK(Caffe::root_solver());
   Dtype rate = GetLearningRate();
 
+  if (CanApplyFusedUpdate(param_id)) {
+    ApplyFusedUpdate(param_id, rate, GetFusedGradient(param_id));
+    return;
+  }
+  if (clip_scale_ != Dtype(1)) {
+    this->net_->learnable_params()[param_id]->scale_diff(clip_scale_);
+  }
   Normalize(param_id);
   Regularize(param_id);
   ComputeUpdateValue(param_id, rate);
   this->net_->learnable_params()[param_id]->Update();
 }
 
+template <typename Dtype>
+bool SGDSolver<Dtype>::CanApplyFusedUpdate(int param_id) {
+  Blob<Dtype>* param = this->net_->learnable_params()[param_id];
+  return (Caffe::mode() == Caffe::CPU)
+    && (param->data()->head() == SyncedMemory::HEAD_AT_CPU)
+    && (param->prv_diff() == NULL);
+}
+
+template <typename Dtype>
+FusedGradient<Dtype> SGDSolver<Dtype>::GetFusedGradient(int param_id) {
+  const string& regularization_type = this->param_.regularization_type();
+  Dtype local_decay = this->param_.weight_decay()
+    * this->net_->params_weight_decay()[param_id];
+  FusedGradient<Dtype> grad;
+  grad.scale = clip_scale_ / this->param_.iter_size();
+  grad.l2_decay = Dtype(0);
+  grad.l1_decay = Dtype(0);
+  if (local_decay) {
+    if (regularization_type == "L2") {
+      grad.l2_decay = local_decay;
+    } else if (regularization_type == "L1") {
+      grad.l1_decay = local_decay;
+    } else {
+      LOG(FATAL) << "Unknown regularization type: " << regularization_type;
+    }
+  }
+#ifdef _OPENMP
+  // same threshold as caffe_set
+  grad.parallel = (omp_in_parallel() == 0) &&
+    (this->net_->learnable_params()[param_id]->count()
+      >= omp_get_max_threads() * 768);
+#else
+  grad.parallel = false;
+#endif
+  return grad;
+}
+
 template <typename Dtype>
 void SGDSolver<Dtype>::Normalize(int param_id) {
   if (this->param_.iter_size() == 1) { return; }
@@ -272,62 +328,107 @@ void SGDSolver<Dtype>::ComputeUpdateValue(int param_id, Dtype rate) {
 }
 
 template <typename Dtype>
-void SGDSolver<Dtype>::SnapshotSolverState(const string& model_filename) {
+void sgd_update_cpu(int N, Dtype* w, Dtype* g, Dtype* h,
+    const FusedGradient<Dtype>& grad, Dtype momentum, Dtype local_rate) {
+#ifdef _OPENMP
+  #pragma omp parallel for if (grad.parallel)
+#endif
+  for (int i = 0; i < N; ++i) {
+    Dtype hi = h[i] = momentum * h[i] + local_rate * grad(g[i], w[i]);
+    g[i] = hi;
+    w[i] -= hi;
+  }
+}
+
+template <typename Dtype>
+void SGDSolver<Dtype>::ApplyFusedUpdate(int param_id, Dtype rate,
+    const FusedGradient<Dtype>& grad) {
+  Blob<Dtype>* param = this->net_->learnable_params()[param_id];
+  Dtype local_rate = rate * this->net_->params_lr()[param_id];
+  sgd_update_cpu(param->count(), param->mutable_cpu_data(),
+      param->mutable_cpu_diff(), history_[param_id]->mutable_cpu_data(),
+      grad, Dtype(this->param_.momentum()), local_rate);
+}
+
+template <typename Dtype>
+void SGDSolver<Dtype>::StageSolverState(SolverSnapshot<Dtype>* snapshot,
+    bool copy) {
+  if (!copy) {
+    snapshot->history = history_;
+    return;
+  }
+  snapshot->history.resize(history_.size());
+  for (int i = 0; i < history_.size(); ++i) {
+    shared_ptr<Blob<Dtype> >& target = snapshot->history[i];
+    if (!target || target == history_[i]) {
+      target.reset(new Blob<Dtype>());
+    }
+    target->ReshapeLike(*history_[i]);
+    caffe_copy(target->count(), history_[i]->cpu_data(),
+        target->mutable_cpu_data());
+  }
+}
+
+template <typename Dtype>
+string SGDSolver<Dtype>::SnapshotSolverState(
+    const SolverSnapshot<Dtype>& snapshot, const string& model_filename) {
   switch (this->param_.snapshot_format()) {
     case caffe::SolverParameter_SnapshotFormat_BINARYPROTO:
-      SnapshotSolverStateToBinaryProto(model_filename);
-      break;
+      return SnapshotSolverStateToBinaryProto(snapshot, model_filename);
     case caffe::SolverParameter_SnapshotFormat_HDF5:
-      SnapshotSolverStateToHDF5(model_filename);
-      break;
+      return SnapshotSolverStateToHDF5(snapshot, model_filename);
     default:
       LOG(FATAL) << "Unsupported snapshot format.";
   }
+  return string();
 }
 
 template <typename Dtype>
-void SGDSolver<Dtype>::SnapshotSolverStateToBinaryProto(
-    const string& model_filename) {
+string SGDSolver<Dtype>::SnapshotSolverStateToBinaryProto(
+    const SolverSnapshot<Dtype>& snapshot, const string& model_filename) {
   SolverState state;
-  state.set_iter(this->iter_);
+  state.set_iter(snapshot.iter);
   state.set_learned_net(model_filename);
-  state.set_current_step(this->current_step_);
+  state.set_current_step(snapshot.current_step);
   state.clear_history();
-  for (int i = 0; i < history_.size(); ++i) {
+  for (int i = 0; i < snapshot.history.size(); ++i) {
     // Add history
     BlobProto* history_blob = state.add_history();
-    history_[i]->ToProto(history_blob);
+    snapshot.history[i]->ToProto(history_blob);
   }
-  string snapshot_filename = Solver<Dtype>::SnapshotFilename(".solverstate");
+  string snapshot_filename =
+      Solver<Dtype>::SnapshotFilename(".solverstate", snapshot.iter);
   LOG(INFO)
     << "Snapshotting solver state to binary proto file " << snapshot_filename;
   WriteProtoToBinaryFile(state, snapshot_filename.c_str());
+  return snapshot_filename;
 }
 
 template <typename Dtype>
-void SGDSolver<Dtype>::SnapshotSolverStateToHDF5(
-    const string& model_filename) {
+string SGDSolver<Dtype>::SnapshotSolverStateToHDF5(
+    const SolverSnapshot<Dtype>& snapshot, const string& model_filename) {
   string snapshot_filename =
-      Solver<Dtype>::SnapshotFilename(".solverstate.h5");
+      Solver<Dtype>::SnapshotFilename(".solverstate.h5", snapshot.iter);
   LOG(INFO) << "Snapshotting solver state to HDF5 file " << snapshot_filename;
   hid_t file_hid = H5Fcreate(snapshot_filename.c_str(), H5F_ACC_TRUNC,
       H5P_DEFAULT, H5P_DEFAULT);
   CHECK_GE(file_hid, 0)
       << "Couldn't open " << snapshot_filename << " to save solver state.";
-  hdf5_save_int(file_hid, "iter", this->iter_);
+  hdf5_save_int(file_hid, "iter", snapshot.iter);
   hdf5_save_string(file_hid, "learned_net", model_filename);
-  hdf5_save_int(file_hid, "current_step", this->current_step_);
+  hdf5_save_int(file_hid, "current_step", snapshot.current_step);
   hid_t history_hid = H5Gcreate2(file_hid, "history", H5P_DEFAULT, H5P_DEFAULT,
       H5P_DEFAULT);
   CHECK_GE(history_hid, 0)
       << "Error saving solver state to " << snapshot_filename << ".";
-  for (int i = 0; i < history_.size(); ++i) {
+  for (int i = 0; i < snapshot.history.size(); ++i) {
     ostringstream oss;
     oss << i;
-    hdf5_save_nd_dataset<Dtype>(history_hid, oss.str(), *history_[i]);
+    hdf5_save_nd_dataset<Dtype>(history_hid, oss.str(), *snapshot.history[i]);
   }
   H5Gclose(history_hid);
   H5Fclose(file_hid);
+  return snapshot_filename;
 }
 
 template <typename Dtype>
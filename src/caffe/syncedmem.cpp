@@ -13,6 +13,10 @@ SyncedMemory::~SyncedMemory() {
     CaffeFreeHost(prv_ptr_, cpu_malloc_use_cuda_);
   }
 
+  if (half_ptr_) {
+    CaffeFreeHost(half_ptr_, cpu_malloc_use_cuda_);
+  }
+
 #ifndef CPU_ONLY
   if (gpu_ptr_ && own_gpu_data_) {
     int initial_device;
@@ -55,9 +59,19 @@ inline void SyncedMemory::to_cpu() {
     prv_descriptor_->convert_from_prv(prv_ptr_, cpu_ptr_);
     head_ = SYNCED_PRV;
     break;
+  case HEAD_AT_HALF:
+    if (cpu_ptr_ == NULL) {
+      CaffeMallocHost(&cpu_ptr_, size_, &cpu_malloc_use_cuda_);
+      own_cpu_data_ = true;
+    }
+    CHECK(half_descriptor_.get());
+    half_descriptor_->convert_from_half(half_ptr_, cpu_ptr_);
+    head_ = SYNCED_HALF;
+    break;
   case SYNCED_PRV:
   case HEAD_AT_CPU:
   case SYNCED:
+  case SYNCED_HALF:
     break;
   }
 }
@@ -73,8 +87,10 @@ inline void SyncedMemory::to_gpu() {
     own_gpu_data_ = true;
     break;
   case HEAD_AT_PRV:
+  case HEAD_AT_HALF:
     to_cpu();
   case HEAD_AT_CPU:
+  case SYNCED_HALF:
     if (gpu_ptr_ == NULL) {
       CUDA_CHECK(cudaGetDevice(&gpu_device_));
       CUDA_CHECK(cudaMalloc(&gpu_ptr_, size_));
@@ -92,6 +108,30 @@ inline void SyncedMemory::to_gpu() {
 #endif
 }
 
+inline void SyncedMemory::to_half() {
+  CHECK(half_descriptor_.get());
+  switch (head_) {
+  case UNINITIALIZED:
+    CaffeMallocHost(&half_ptr_, half_descriptor_->half_size(),
+        &cpu_malloc_use_cuda_);
+    caffe_memset(half_descriptor_->half_size(), 0, half_ptr_);
+    head_ = HEAD_AT_HALF;
+    break;
+  case HEAD_AT_HALF:
+  case SYNCED_HALF:
+    break;
+  default:
+    to_cpu();
+    if (half_ptr_ == NULL) {
+      CaffeMallocHost(&half_ptr_, half_descriptor_->half_size(),
+          &cpu_malloc_use_cuda_);
+    }
+    half_descriptor_->convert_to_half(cpu_ptr_, half_ptr_);
+    head_ = SYNCED_HALF;
+    break;
+  }
+}
+
 const void* SyncedMemory::cpu_data() {
   boost::mutex::scoped_lock lock(mtx);
   to_cpu();
@@ -99,12 +139,17 @@ const void* SyncedMemory::cpu_data() {
 }
 
 void SyncedMemory::set_cpu_data(void* data) {
+  set_cpu_data(data, shared_ptr<void>());
+}
+
+void SyncedMemory::set_cpu_data(void* data, const shared_ptr<void>& owner) {
   boost::mutex::scoped_lock lock(mtx);
   CHECK(data);
   if (own_cpu_data_) {
     CaffeFreeHost(cpu_ptr_, cpu_malloc_use_cuda_);
   }
   cpu_ptr_ = data;
+  cpu_data_owner_ = owner;
   head_ = HEAD_AT_CPU;
   own_cpu_data_ = false;
 }
@@ -176,6 +221,34 @@ void SyncedMemory::async_gpu_push(const cudaStream_t& stream) {
 }
 #endif
 
+void SyncedMemory::set_half_descriptor(shared_ptr<HalfMemDescr> descriptor) {
+  boost::mutex::scoped_lock lock(mtx);
+  if (head_ == HEAD_AT_HALF) {
+    to_cpu();
+  }
+  if (head_ == SYNCED_HALF) {
+    head_ = HEAD_AT_CPU;
+  }
+  if (half_ptr_) {
+    CaffeFreeHost(half_ptr_, cpu_malloc_use_cuda_);
+    half_ptr_ = NULL;
+  }
+  half_descriptor_ = descriptor;
+}
+
+const void* SyncedMemory::half_data() {
+  boost::mutex::scoped_lock lock(mtx);
+  to_half();
+  return (const void*)half_ptr_;
+}
+
+void* SyncedMemory::mutable_half_data() {
+  boost::mutex::scoped_lock lock(mtx);
+  to_half();
+  head_ = HEAD_AT_HALF;
+  return half_ptr_;
+}
+
 /*
   If data is NULL, then allocate the memory here.
   same_data - shall be true if data will be the same as in cpu_ptr_
@@ -130,4 +130,63 @@ namespace caffe {
         this->blob_top_vec_);
   }
 
+  TYPED_TEST(BatchNormLayerTest, TestForwardScaleBias) {
+    typedef typename TypeParam::Dtype Dtype;
+    if (Caffe::mode() != Caffe::CPU) {
+      return;
+    }
+    LayerParameter layer_param;
+    BatchNormLayer<Dtype> layer(layer_param);
+    layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+    layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+
+    BatchNormParameter* param = layer_param.mutable_batch_norm_param();
+    param->set_scale_bias(true);
+    param->mutable_scale_filler()->set_type("gaussian");
+    param->mutable_bias_filler()->set_type("gaussian");
+    BatchNormLayer<Dtype> scale_bias_layer(layer_param);
+    Blob<Dtype> top;
+    vector<Blob<Dtype>*> top_vec(1, &top);
+    scale_bias_layer.SetUp(this->blob_bottom_vec_, top_vec);
+    ASSERT_EQ(5, scale_bias_layer.blobs().size());
+    scale_bias_layer.Forward(this->blob_bottom_vec_, top_vec);
+
+    const Dtype* scale = scale_bias_layer.blobs()[3]->cpu_data();
+    const Dtype* bias = scale_bias_layer.blobs()[4]->cpu_data();
+    for (int i = 0; i < top.num(); ++i) {
+      for (int j = 0; j < top.channels(); ++j) {
+        for (int k = 0; k < top.height(); ++k) {
+          for (int l = 0; l < top.width(); ++l) {
+            EXPECT_NEAR(this->blob_top_->data_at(i, j, k, l) * scale[j] +
+                bias[j], top.data_at(i, j, k, l), 1e-5);
+          }
+        }
+      }
+    }
+    // The running statistics are the same.
+    for (int i = 0; i < 3; ++i) {
+      for (int j = 0; j < layer.blobs()[i]->count(); ++j) {
+        EXPECT_FLOAT_EQ(layer.blobs()[i]->cpu_data()[j],
+            scale_bias_layer.blobs()[i]->cpu_data()[j]);
+      }
+    }
+  }
+
+  TYPED_TEST(BatchNormLayerTest, TestGradientScaleBias) {
+    typedef typename TypeParam::Dtype Dtype;
+    if (Caffe::mode() != Caffe::CPU) {
+      return;
+    }
+    LayerParameter layer_param;
+    BatchNormParameter* param = layer_param.mutable_batch_norm_param();
+    param->set_scale_bias(true);
+    param->mutable_scale_filler()->set_type("gaussian");
+    param->mutable_bias_filler()->set_type("gaussian");
+
+    BatchNormLayer<Dtype> layer(layer_param);
+    GradientChecker<Dtype> checker(1e-2, 1e-4);
+    checker.CheckGradientExhaustive(&layer, this->blob_bottom_vec_,
+        this->blob_top_vec_);
+  }
+
 }  // namespace caffe
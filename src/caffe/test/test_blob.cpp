@@ -5,6 +5,7 @@
 #include "caffe/blob.hpp"
 #include "caffe/common.hpp"
 #include "caffe/filler.hpp"
+#include "caffe/util/half.hpp"
 
 #include "caffe/test/test_caffe_main.hpp"
 
@@ -51,6 +52,41 @@ TYPED_TEST(BlobSimpleTest, TestReshape) {
   EXPECT_EQ(this->blob_->count(), 120);
 }
 
+TYPED_TEST(BlobSimpleTest, TestHalfStorage) {
+  typedef TypeParam Dtype;
+  Blob<Dtype>* blob = this->blob_preshaped_;
+  const int count = blob->count();
+  for (int i = 0; i < count; ++i) {
+    blob->mutable_cpu_data()[i] = Dtype(1) + Dtype(i) / 1024;
+  }
+  blob->set_storage(STORAGE_BF16);
+  EXPECT_EQ(STORAGE_BF16, blob->storage());
+  const uint16_t* half = static_cast<const uint16_t*>(
+      blob->cpu_storage_data());
+  for (int i = 0; i < count; ++i) {
+    EXPECT_EQ(float_to_bf16(blob->cpu_data()[i]), half[i]);
+  }
+  EXPECT_EQ(SyncedMemory::SYNCED_HALF, blob->data()->head());
+  // Written as half-width values, the data is read back rounded.
+  uint16_t* mutable_half = static_cast<uint16_t*>(
+      blob->mutable_cpu_storage_data());
+  EXPECT_EQ(SyncedMemory::HEAD_AT_HALF, blob->data()->head());
+  mutable_half[0] = float_to_bf16(3.f);
+  EXPECT_EQ(Dtype(3), blob->cpu_data()[0]);
+  for (int i = 1; i < count; ++i) {
+    EXPECT_EQ(bf16_to_float(half[i]), blob->cpu_data()[i]);
+  }
+  // The format is shared and survives reallocation.
+  Blob<Dtype> other(blob->shape());
+  other.ShareData(*blob);
+  EXPECT_EQ(STORAGE_BF16, other.storage());
+  blob->Reshape(3, 3, 4, 5);
+  EXPECT_EQ(STORAGE_BF16, blob->storage());
+  blob->set_storage(STORAGE_DTYPE);
+  EXPECT_EQ(STORAGE_DTYPE, blob->storage());
+  EXPECT_EQ(blob->cpu_data(), blob->cpu_storage_data());
+}
+
 TYPED_TEST(BlobSimpleTest, TestLegacyBlobProtoShapeEquals) {
   BlobProto blob_proto;
 
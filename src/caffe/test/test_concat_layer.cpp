@@ -6,6 +6,7 @@
 #include "caffe/common.hpp"
 #include "caffe/filler.hpp"
 #include "caffe/layers/concat_layer.hpp"
+#include "caffe/util/half.hpp"
 
 #include "caffe/test/test_caffe_main.hpp"
 #include "caffe/test/test_gradient_check_util.hpp"
@@ -166,6 +167,35 @@ TYPED_TEST(ConcatLayerTest, TestForwardChannels) {
   }
 }
 
+TYPED_TEST(ConcatLayerTest, TestForwardHalfStorage) {
+  typedef typename TypeParam::Dtype Dtype;
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  filler.Fill(this->blob_bottom_0_);
+  filler.Fill(this->blob_bottom_1_);
+  // An fp16 and a Dtype bottom, concatenated into bf16.
+  this->blob_bottom_0_->set_storage(STORAGE_FP16);
+  this->blob_bottom_0_->mutable_cpu_storage_data();
+  LayerParameter layer_param;
+  ConcatLayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_0_, this->blob_top_vec_);
+  this->blob_top_->set_storage(STORAGE_BF16);
+  layer.Forward(this->blob_bottom_vec_0_, this->blob_top_vec_);
+  const uint16_t* top_data =
+      static_cast<const uint16_t*>(this->blob_top_->cpu_storage_data());
+  for (int n = 0; n < this->blob_top_->num(); ++n) {
+    for (int c = 0; c < this->blob_top_->channels(); ++c) {
+      Blob<Dtype>* bottom = c < 3 ? this->blob_bottom_0_ : this->blob_bottom_1_;
+      for (int h = 0; h < this->blob_top_->height(); ++h) {
+        for (int w = 0; w < this->blob_top_->width(); ++w) {
+          EXPECT_EQ(float_to_bf16(bottom->data_at(n, c < 3 ? c : c - 3, h, w)),
+              top_data[this->blob_top_->offset(n, c, h, w)]);
+        }
+      }
+    }
+  }
+}
+
 TYPED_TEST(ConcatLayerTest, TestGradientTrivial) {
   typedef typename TypeParam::Dtype Dtype;
   LayerParameter layer_param;
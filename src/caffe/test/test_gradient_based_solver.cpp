@@ -26,7 +26,7 @@ class GradientBasedSolverTest : public MultiDeviceTest<TypeParam> {
  protected:
   GradientBasedSolverTest() :
       seed_(1701), num_(4), channels_(3), height_(10), width_(10),
-      share_(false) {
+      share_(false), snapshot_async_(false), clip_gradients_(-1) {
         input_file_ = new string(
         CMAKE_SOURCE_DIR "caffe/test/test_data/solver_data_list.txt" CMAKE_EXT);
       }
@@ -42,6 +42,8 @@ class GradientBasedSolverTest : public MultiDeviceTest<TypeParam> {
   // TODO this is brittle and the hdf5 file should be checked instead.
   int num_, channels_, height_, width_;
   bool share_;
+  bool snapshot_async_;
+  Dtype clip_gradients_;
   Dtype delta_;  // Stability constant for RMSProp, AdaGrad, AdaDelta and Adam
 
   // Test data: check out generate_sample_data.py in the same directory.
@@ -181,6 +183,12 @@ class GradientBasedSolverTest : public MultiDeviceTest<TypeParam> {
     if (snapshot) {
       proto << "snapshot: " << num_iters << " ";
     }
+    if (snapshot_async_) {
+      proto << "snapshot_async: true ";
+    }
+    if (clip_gradients_ >= 0) {
+      proto << "clip_gradients: " << clip_gradients_ << " ";
+    }
     Caffe::set_random_seed(this->seed_);
     this->InitSolverFromProtoString(proto.str());
     if (from_snapshot != NULL) {
@@ -694,6 +702,59 @@ TYPED_TEST(SGDSolverTest, TestSnapshotShare) {
   }
 }
 
+TYPED_TEST(SGDSolverTest, TestLeastSquaresUpdateWithClipping) {
+  typedef typename TypeParam::Dtype Dtype;
+  const Dtype kLearningRate = 1;
+  const Dtype kClipGradients = 0.01;
+  this->RunLeastSquaresSolver(kLearningRate, 0, 0, 0);
+  const vector<Blob<Dtype>*>& initial_params =
+      this->solver_->net()->learnable_params();
+  vector<shared_ptr<Blob<Dtype> > > params(initial_params.size());
+  for (int i = 0; i < initial_params.size(); ++i) {
+    params[i].reset(new Blob<Dtype>());
+    params[i]->CopyFrom(*initial_params[i], false, true);
+  }
+  // Without momentum the update of all the params is the clipped gradient.
+  this->clip_gradients_ = kClipGradients;
+  this->RunLeastSquaresSolver(kLearningRate, 0, 0, 1);
+  const vector<Blob<Dtype>*>& updated_params =
+      this->solver_->net()->learnable_params();
+  Dtype sumsq_update = 0;
+  for (int i = 0; i < updated_params.size(); ++i) {
+    for (int j = 0; j < params[i]->count(); ++j) {
+      Dtype update =
+          params[i]->cpu_data()[j] - updated_params[i]->cpu_data()[j];
+      sumsq_update += update * update;
+    }
+  }
+  EXPECT_NEAR(kClipGradients, std::sqrt(sumsq_update), kClipGradients * 1e-3);
+}
+
+TYPED_TEST(SGDSolverTest, TestSnapshotAsync) {
+  typedef typename TypeParam::Dtype Dtype;
+  const Dtype kLearningRate = 0.01;
+  const Dtype kWeightDecay = 0.5;
+  const Dtype kMomentum = 0.9;
+  const int kNumIters = 4;
+  this->snapshot_async_ = true;
+  for (int i = 1; i <= kNumIters; ++i) {
+    this->TestSnapshot(kLearningRate, kWeightDecay, kMomentum, i);
+  }
+}
+
+TYPED_TEST(SGDSolverTest, TestSnapshotAsyncShare) {
+  typedef typename TypeParam::Dtype Dtype;
+  const Dtype kLearningRate = 0.01;
+  const Dtype kWeightDecay = 0.5;
+  const Dtype kMomentum = 0.9;
+  const int kNumIters = 4;
+  this->share_ = true;
+  this->snapshot_async_ = true;
+  for (int i = 1; i <= kNumIters; ++i) {
+    this->TestSnapshot(kLearningRate, kWeightDecay, kMomentum, i);
+  }
+}
+
 
 template <typename TypeParam>
 class AdaGradSolverTest : public GradientBasedSolverTest<TypeParam> {
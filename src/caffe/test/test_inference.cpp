@@ -0,0 +1,147 @@
+#include <boost/thread.hpp>
+#include <google/protobuf/text_format.h>
+
+#include <algorithm>
+#include <cmath>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/filler.hpp"
+#include "caffe/inference.hpp"
+#include "caffe/net.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+class InferenceModelTest : public CPUDeviceTest<Dtype> {
+ protected:
+  InferenceModelTest() {
+    const string proto =
+        "name: 'TestNetwork' "
+        "layer { "
+        "  name: 'data' "
+        "  type: 'Input' "
+        "  top: 'data' "
+        "  input_param { shape: { dim: 2 dim: 3 dim: 6 dim: 6 } } "
+        "} "
+        "layer { "
+        "  name: 'conv' "
+        "  type: 'Convolution' "
+        "  bottom: 'data' "
+        "  top: 'conv' "
+        "  convolution_param { "
+        "    num_output: 4 "
+        "    kernel_size: 3 "
+        "    weight_filler { type: 'gaussian' std: 0.1 } "
+        "    bias_filler { type: 'gaussian' std: 0.1 } "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'relu' "
+        "  type: 'ReLU' "
+        "  bottom: 'conv' "
+        "  top: 'conv' "
+        "} "
+        "layer { "
+        "  name: 'ip' "
+        "  type: 'InnerProduct' "
+        "  bottom: 'conv' "
+        "  top: 'ip' "
+        "  inner_product_param { "
+        "    num_output: 5 "
+        "    weight_filler { type: 'gaussian' std: 0.1 } "
+        "  } "
+        "} ";
+    NetParameter param;
+    CHECK(google::protobuf::TextFormat::ParseFromString(proto, &param));
+    model_.reset(new InferenceModel<Dtype>(param));
+  }
+
+  shared_ptr<InferenceModel<Dtype> > model_;
+};
+
+TYPED_TEST_CASE(InferenceModelTest, TestDtypes);
+
+TYPED_TEST(InferenceModelTest, TestSharedWeights) {
+  shared_ptr<Net<TypeParam> > session = this->model_->NewSession();
+  EXPECT_EQ(TEST, session->phase());
+  const vector<shared_ptr<Blob<TypeParam> > >& params =
+      this->model_->net().params();
+  ASSERT_EQ(params.size(), session->params().size());
+  for (int i = 0; i < params.size(); ++i) {
+    EXPECT_EQ(params[i]->cpu_data(), session->params()[i]->cpu_data());
+  }
+  // Activations are not shared.
+  shared_ptr<Net<TypeParam> > other_session = this->model_->NewSession();
+  EXPECT_NE(session->blob_by_name("conv")->cpu_data(),
+            other_session->blob_by_name("conv")->cpu_data());
+}
+
+template <typename Dtype>
+class InferenceWorker {
+ public:
+  InferenceWorker(const InferenceModel<Dtype>* model, const Blob<Dtype>* input,
+      const Blob<Dtype>* expected, int iterations)
+      : model_(model), input_(input), expected_(expected),
+        iterations_(iterations), max_error_(0) {}
+
+  void Run() {
+    shared_ptr<Net<Dtype> > session = model_->NewSession();
+    for (int i = 0; i < iterations_; ++i) {
+      session->input_blobs()[0]->CopyFrom(*input_);
+      const Blob<Dtype>* output = session->Forward()[0];
+      for (int j = 0; j < output->count(); ++j) {
+        max_error_ = std::max(max_error_,
+            std::abs(output->cpu_data()[j] - expected_->cpu_data()[j]));
+      }
+    }
+  }
+
+  Dtype max_error() const { return max_error_; }
+
+ private:
+  const InferenceModel<Dtype>* model_;
+  const Blob<Dtype>* input_;
+  const Blob<Dtype>* expected_;
+  int iterations_;
+  Dtype max_error_;
+};
+
+TYPED_TEST(InferenceModelTest, TestConcurrentForward) {
+  typedef TypeParam Dtype;
+  const int kNumThreads = 4;
+  vector<shared_ptr<Blob<Dtype> > > inputs(kNumThreads);
+  vector<shared_ptr<Blob<Dtype> > > expected(kNumThreads);
+  shared_ptr<Net<Dtype> > session = this->model_->NewSession();
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  for (int i = 0; i < kNumThreads; ++i) {
+    inputs[i].reset(new Blob<Dtype>(session->input_blobs()[0]->shape()));
+    filler.Fill(inputs[i].get());
+    session->input_blobs()[0]->CopyFrom(*inputs[i]);
+    expected[i].reset(new Blob<Dtype>());
+    expected[i]->CopyFrom(*session->Forward()[0], false, true);
+  }
+
+  vector<shared_ptr<InferenceWorker<Dtype> > > workers;
+  vector<shared_ptr<boost::thread> > threads;
+  for (int i = 0; i < kNumThreads; ++i) {
+    workers.push_back(shared_ptr<InferenceWorker<Dtype> >(
+        new InferenceWorker<Dtype>(this->model_.get(), inputs[i].get(),
+                                   expected[i].get(), 20)));
+    threads.push_back(shared_ptr<boost::thread>(new boost::thread(
+        &InferenceWorker<Dtype>::Run, workers.back().get())));
+  }
+  for (int i = 0; i < kNumThreads; ++i) {
+    threads[i]->join();
+    EXPECT_LT(workers[i]->max_error(), 1e-5) << "thread " << i;
+  }
+}
+
+}  // namespace caffe
@@ -135,6 +135,61 @@ TYPED_TEST(InnerProductLayerTest, TestForward) {
   }
 }
 
+TYPED_TEST(InnerProductLayerTest, TestInt8Forward) {
+  typedef typename TypeParam::Dtype Dtype;
+  if (Caffe::mode() != Caffe::CPU) {
+    return;
+  }
+  this->blob_bottom_vec_.push_back(this->blob_bottom_);
+  LayerParameter layer_param;
+  InnerProductParameter* inner_product_param =
+      layer_param.mutable_inner_product_param();
+  inner_product_param->set_num_output(10);
+  inner_product_param->mutable_weight_filler()->set_type("gaussian");
+  inner_product_param->mutable_bias_filler()->set_type("uniform");
+  shared_ptr<InnerProductLayer<Dtype> > layer(
+      new InnerProductLayer<Dtype>(layer_param));
+  layer->SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer->Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  Blob<Dtype> float_top;
+  float_top.CopyFrom(*this->blob_top_, false, true);
+
+  // The bottom is uniform in [0, 1].
+  layer_param.set_phase(TEST);
+  layer_param.mutable_quantization_param()->set_input_range(1);
+  shared_ptr<InnerProductLayer<Dtype> > int8_layer(
+      new InnerProductLayer<Dtype>(layer_param));
+  int8_layer->SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  int8_layer->blobs()[0]->CopyFrom(*layer->blobs()[0]);
+  int8_layer->blobs()[1]->CopyFrom(*layer->blobs()[1]);
+  int8_layer->Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  Blob<Dtype> int8_top;
+  int8_top.CopyFrom(*this->blob_top_, false, true);
+  const int count = this->blob_top_->count();
+  for (int i = 0; i < count; ++i) {
+    EXPECT_NEAR(float_top.cpu_data()[i], int8_top.cpu_data()[i], 0.1);
+  }
+
+  // Transposed weights are quantized the same way.
+  inner_product_param->set_transpose(true);
+  shared_ptr<InnerProductLayer<Dtype> > transposed_layer(
+      new InnerProductLayer<Dtype>(layer_param));
+  transposed_layer->SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  const int num_output = 10;
+  const int dim = this->blob_bottom_->count(1);
+  for (int n = 0; n < num_output; ++n) {
+    for (int d = 0; d < dim; ++d) {
+      transposed_layer->blobs()[0]->mutable_cpu_data()[d * num_output + n] =
+          layer->blobs()[0]->cpu_data()[n * dim + d];
+    }
+  }
+  transposed_layer->blobs()[1]->CopyFrom(*layer->blobs()[1]);
+  transposed_layer->Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  for (int i = 0; i < count; ++i) {
+    EXPECT_EQ(int8_top.cpu_data()[i], this->blob_top_->cpu_data()[i]);
+  }
+}
+
 /**
  * @brief Init. an IP layer without transpose + random weights,
  * run Forward, save the result.
@@ -0,0 +1,231 @@
+#include <google/protobuf/text_format.h>
+
+#include <string>
+#include <vector>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "gtest/gtest.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/filler.hpp"
+#include "caffe/layer.hpp"
+#include "caffe/layer_autotuner.hpp"
+#include "caffe/layer_factory.hpp"
+#include "caffe/net.hpp"
+#include "caffe/util/io.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+class LayerAutotunerTest : public CPUDeviceTest<Dtype> {
+ protected:
+  LayerAutotunerTest()
+      : blob_bottom_(new Blob<Dtype>(4, 3, 6, 5)),
+        blob_top_(new Blob<Dtype>()) {
+    FillerParameter filler_param;
+    GaussianFiller<Dtype> filler(filler_param);
+    filler.Fill(this->blob_bottom_);
+    blob_bottom_vec_.push_back(blob_bottom_);
+    blob_top_vec_.push_back(blob_top_);
+    MakeTempFilename(&cache_file_);
+    autotune_param_.set_cache_file(cache_file_);
+    autotune_param_.set_iterations(1);
+    layer_param_.set_name("conv");
+    layer_param_.set_type("Convolution");
+    layer_param_.set_phase(TRAIN);
+    ConvolutionParameter* conv_param =
+        layer_param_.mutable_convolution_param();
+    conv_param->add_kernel_size(3);
+    conv_param->set_num_output(4);
+    conv_param->mutable_weight_filler()->set_type("gaussian");
+  }
+  virtual ~LayerAutotunerTest() {
+    delete blob_bottom_;
+    delete blob_top_;
+  }
+
+  // The params filled by a layer set up from layer_param_, as the net passes
+  // them to the autotuner.
+  const vector<shared_ptr<Blob<Dtype> > >& Params() {
+    layer_ = LayerRegistry<Dtype>::CreateLayer(layer_param_);
+    layer_->SetUp(blob_bottom_vec_, blob_top_vec_);
+    return layer_->blobs();
+  }
+
+  // Whether the layer_param chosen uses its num_threads.
+  static bool UsesThreads(const LayerParameter& layer_param) {
+    return layer_param.convolution_param().engine() ==
+        ConvolutionParameter_Engine_CAFFE;
+  }
+
+  // Whether there is more than one thread count to choose from.
+  bool has_threads() const {
+#ifdef _OPENMP
+    return omp_get_max_threads() > 1;
+#else
+    return false;
+#endif
+  }
+
+  Blob<Dtype>* const blob_bottom_;
+  Blob<Dtype>* const blob_top_;
+  vector<Blob<Dtype>*> blob_bottom_vec_;
+  vector<Blob<Dtype>*> blob_top_vec_;
+  string cache_file_;
+  AutotuneParameter autotune_param_;
+  LayerParameter layer_param_;
+  shared_ptr<Layer<Dtype> > layer_;
+};
+
+TYPED_TEST_CASE(LayerAutotunerTest, TestDtypes);
+
+TYPED_TEST(LayerAutotunerTest, TestTuneConvolution) {
+  if (!this->has_threads()) {
+    LOG(WARNING) << "Skipping test: a single thread";
+    return;
+  }
+  LayerAutotuner<TypeParam> autotuner(this->autotune_param_);
+  EXPECT_TRUE(autotuner.Tune(this->blob_bottom_vec_, this->blob_top_vec_,
+                             this->Params(), &this->layer_param_));
+  EXPECT_NE(ConvolutionParameter_Engine_DEFAULT,
+            this->layer_param_.convolution_param().engine());
+  // The other engines, like MKL2017, may win and do not use num_threads.
+  if (this->UsesThreads(this->layer_param_)) {
+    EXPECT_GE(this->layer_param_.num_threads(), 1);
+  } else {
+    EXPECT_EQ(0, this->layer_param_.num_threads());
+  }
+  EXPECT_LE(this->layer_param_.num_threads(), this->blob_bottom_->num());
+  vector<int> top_shape;
+  top_shape.push_back(4);
+  top_shape.push_back(4);
+  top_shape.push_back(4);
+  top_shape.push_back(3);
+  EXPECT_EQ(top_shape, this->blob_top_->shape());
+}
+
+TYPED_TEST(LayerAutotunerTest, TestNothingToTune) {
+  // Explicit choices are kept.
+  this->layer_param_.mutable_convolution_param()->set_engine(
+      ConvolutionParameter_Engine_CAFFE);
+  this->layer_param_.set_num_threads(1);
+  LayerAutotuner<TypeParam> autotuner(this->autotune_param_);
+  EXPECT_FALSE(autotuner.Tune(this->blob_bottom_vec_, this->blob_top_vec_,
+                              this->Params(), &this->layer_param_));
+  EXPECT_EQ(1, this->layer_param_.num_threads());
+  LayerParameter dropout_param;
+  dropout_param.set_type("Dropout");
+  EXPECT_FALSE(autotuner.Tune(this->blob_bottom_vec_, this->blob_top_vec_,
+                              vector<shared_ptr<Blob<TypeParam> > >(),
+                              &dropout_param));
+  autotuner.Save();
+  EXPECT_FALSE(boost::filesystem::exists(this->cache_file_));
+}
+
+TYPED_TEST(LayerAutotunerTest, TestCache) {
+  if (!this->has_threads()) {
+    LOG(WARNING) << "Skipping test: a single thread";
+    return;
+  }
+  LayerParameter other_layer_param(this->layer_param_);
+  other_layer_param.set_name("other_conv");
+  {
+    LayerAutotuner<TypeParam> autotuner(this->autotune_param_);
+    autotuner.Tune(this->blob_bottom_vec_, this->blob_top_vec_,
+                   this->Params(), &this->layer_param_);
+    autotuner.Save();
+  }
+  AutotuneCache cache;
+  ReadProtoFromTextFileOrDie(this->cache_file_, &cache);
+  ASSERT_EQ(1, cache.entry_size());
+  EXPECT_EQ(LayerAutotuner<TypeParam>::HostSignature(),
+            cache.entry(0).host());
+  EXPECT_EQ(this->layer_param_.num_threads(), cache.entry(0).num_threads());
+
+  // The same configuration under another name is found in the cache.
+  const int num_threads = this->layer_param_.num_threads() == 1 ? 2 : 1;
+  cache.mutable_entry(0)->set_num_threads(num_threads);
+  WriteProtoToTextFile(cache, this->cache_file_);
+  {
+    LayerAutotuner<TypeParam> autotuner(this->autotune_param_);
+    EXPECT_TRUE(autotuner.Tune(this->blob_bottom_vec_, this->blob_top_vec_,
+                               this->Params(), &other_layer_param));
+    autotuner.Save();
+  }
+  EXPECT_EQ(num_threads, other_layer_param.num_threads());
+  ReadProtoFromTextFileOrDie(this->cache_file_, &cache);
+  EXPECT_EQ(1, cache.entry_size());
+}
+
+TYPED_TEST(LayerAutotunerTest, TestNetForward) {
+  const string proto =
+      "name: 'TestNetwork' "
+      "layer { "
+      "  name: 'data' "
+      "  type: 'Input' "
+      "  top: 'data' "
+      "  input_param { shape: { dim: 4 dim: 3 dim: 6 dim: 5 } } "
+      "} "
+      "layer { "
+      "  name: 'conv' "
+      "  type: 'Convolution' "
+      "  bottom: 'data' "
+      "  top: 'conv' "
+      "  convolution_param { "
+      "    num_output: 4 "
+      "    kernel_size: 3 "
+      "    weight_filler { type: 'gaussian' std: 0.1 } "
+      "    bias_filler { type: 'gaussian' std: 0.1 } "
+      "  } "
+      "} "
+      "layer { "
+      "  name: 'relu' "
+      "  type: 'ReLU' "
+      "  bottom: 'conv' "
+      "  top: 'conv' "
+      "} "
+      "layer { "
+      "  name: 'pool' "
+      "  type: 'Pooling' "
+      "  bottom: 'conv' "
+      "  top: 'pool' "
+      "  pooling_param { pool: MAX kernel_size: 2 stride: 2 } "
+      "} ";
+  NetParameter param;
+  CHECK(google::protobuf::TextFormat::ParseFromString(proto, &param));
+  Caffe::set_random_seed(1701);
+  Net<TypeParam> net(param);
+  param.mutable_autotune_param()->CopyFrom(this->autotune_param_);
+  Caffe::set_random_seed(1701);
+  Net<TypeParam> tuned_net(param);
+  const LayerParameter& tuned_param =
+      tuned_net.layer_by_name("conv")->layer_param();
+  if (this->has_threads() && this->UsesThreads(tuned_param)) {
+    EXPECT_NE(0, tuned_param.num_threads());
+  }
+  // Tuning runs no fillers: the params are those of the untuned net.
+  ASSERT_EQ(net.params().size(), tuned_net.params().size());
+  for (int i = 0; i < net.params().size(); ++i) {
+    for (int j = 0; j < net.params()[i]->count(); ++j) {
+      EXPECT_EQ(net.params()[i]->cpu_data()[j],
+                tuned_net.params()[i]->cpu_data()[j]);
+    }
+  }
+
+  net.input_blobs()[0]->CopyFrom(*this->blob_bottom_);
+  tuned_net.input_blobs()[0]->CopyFrom(*this->blob_bottom_);
+  const Blob<TypeParam>* pool = net.Forward()[0];
+  const Blob<TypeParam>* tuned_pool = tuned_net.Forward()[0];
+  ASSERT_EQ(pool->shape(), tuned_pool->shape());
+  for (int i = 0; i < pool->count(); ++i) {
+    EXPECT_NEAR(pool->cpu_data()[i], tuned_pool->cpu_data()[i], 1e-5);
+  }
+}
+
+}  // namespace caffe
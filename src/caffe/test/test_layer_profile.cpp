@@ -0,0 +1,117 @@
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/common.hpp"
+#include "caffe/layer_profile.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+class LayerProfileTest : public ::testing::Test {
+ protected:
+  LayerProfileTest() {
+    LayerProfile conv;
+    conv.layer = "conv1";
+    conv.type = "Convolution";
+    conv.pass = "forward";
+    conv.min_ms = 1.5;
+    conv.median_ms = 2;
+    conv.p99_ms = 4.25;
+    conv.mean_ms = 2.5;
+    conv.flops = 1e9;
+    conv.bytes = 4e6;
+    conv.cycles = 6e9;
+    conv.instructions = 9e9;
+    conv.cache_misses = 1e6;
+    conv.vector_instructions = 2e9;
+    profiles_.push_back(conv);
+    LayerProfile odd_name = conv;
+    odd_name.layer = "a \"quoted\", name\\";
+    odd_name.pass = "backward";
+    odd_name.mean_ms = 7.5;
+    profiles_.push_back(odd_name);
+    SetProfileShares(&profiles_);
+  }
+
+  void ExpectEqual(const vector<LayerProfile>& expected,
+      const vector<LayerProfile>& actual) {
+    ASSERT_EQ(expected.size(), actual.size());
+    for (int i = 0; i < expected.size(); ++i) {
+      EXPECT_EQ(expected[i].layer, actual[i].layer);
+      EXPECT_EQ(expected[i].type, actual[i].type);
+      EXPECT_EQ(expected[i].pass, actual[i].pass);
+      EXPECT_EQ(expected[i].min_ms, actual[i].min_ms);
+      EXPECT_EQ(expected[i].median_ms, actual[i].median_ms);
+      EXPECT_EQ(expected[i].p99_ms, actual[i].p99_ms);
+      EXPECT_EQ(expected[i].mean_ms, actual[i].mean_ms);
+      EXPECT_EQ(expected[i].flops, actual[i].flops);
+      EXPECT_EQ(expected[i].bytes, actual[i].bytes);
+      EXPECT_EQ(expected[i].share, actual[i].share);
+      EXPECT_EQ(expected[i].cycles, actual[i].cycles);
+      EXPECT_EQ(expected[i].instructions, actual[i].instructions);
+      EXPECT_EQ(expected[i].cache_misses, actual[i].cache_misses);
+      EXPECT_EQ(expected[i].vector_instructions,
+          actual[i].vector_instructions);
+    }
+  }
+
+  vector<LayerProfile> profiles_;
+};
+
+TEST_F(LayerProfileTest, TestSetTimes) {
+  vector<double> times;
+  for (int i = 200; i > 0; --i) {
+    times.push_back(i);
+  }
+  LayerProfile profile;
+  profile.SetTimes(times);
+  EXPECT_EQ(1, profile.min_ms);
+  EXPECT_EQ(100.5, profile.median_ms);
+  EXPECT_EQ(198, profile.p99_ms);
+  EXPECT_EQ(100.5, profile.mean_ms);
+  times.resize(3);
+  profile.SetTimes(times);
+  EXPECT_EQ(198, profile.min_ms);
+  EXPECT_EQ(199, profile.median_ms);
+  EXPECT_EQ(200, profile.p99_ms);
+}
+
+TEST_F(LayerProfileTest, TestShares) {
+  EXPECT_EQ(0.25, profiles_[0].share);
+  EXPECT_EQ(0.75, profiles_[1].share);
+  EXPECT_EQ(500, profiles_[0].gflops_per_second());
+  EXPECT_EQ(2, profiles_[0].gbytes_per_second());
+  EXPECT_EQ(1.5, profiles_[0].ipc());
+  EXPECT_DOUBLE_EQ(25.6, profiles_[0].memory_gbytes_per_second());
+}
+
+TEST_F(LayerProfileTest, TestJsonRoundTrip) {
+  std::stringstream stream;
+  WriteProfilesJson(profiles_, &stream);
+  vector<LayerProfile> read;
+  ASSERT_TRUE(ReadProfilesJson(&stream, &read));
+  ExpectEqual(profiles_, read);
+}
+
+TEST_F(LayerProfileTest, TestCsvRoundTrip) {
+  std::stringstream stream;
+  WriteProfilesCsv(profiles_, &stream);
+  vector<LayerProfile> read;
+  ASSERT_TRUE(ReadProfilesCsv(&stream, &read));
+  ExpectEqual(profiles_, read);
+}
+
+TEST_F(LayerProfileTest, TestReadMalformed) {
+  std::stringstream json(
+      "{\"layers\": [{\"layer\": \"conv1\", \"min_ms\": x}]}");
+  vector<LayerProfile> read;
+  EXPECT_FALSE(ReadProfilesJson(&json, &read));
+  std::stringstream csv("layer,min_ms\nconv1\n");
+  EXPECT_FALSE(ReadProfilesCsv(&csv, &read));
+}
+
+}  // namespace caffe
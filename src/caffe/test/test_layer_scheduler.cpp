@@ -0,0 +1,212 @@
+#include <google/protobuf/text_format.h>
+
+#include <sstream>
+#include <string>
+#include <vector>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "gtest/gtest.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/layer_scheduler.hpp"
+#include "caffe/net.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+class LayerSchedulerTest : public CPUDeviceTest<Dtype> {
+ protected:
+  LayerSchedulerTest() : seed_(1701) {}
+
+  // An Inception-like module: three branches of different depth from conv0,
+  // concatenated.
+  string InceptionProto(const string& branch_c_extra) {
+    return
+        "name: 'InceptionNetwork' "
+        "state: { phase: TRAIN } "
+        "layer { "
+        "  name: 'data' "
+        "  type: 'DummyData' "
+        "  dummy_data_param { "
+        "    shape { dim: 1 dim: 3 dim: 6 dim: 6 } "
+        "    data_filler { type: 'gaussian' std: 1 } "
+        "  } "
+        "  top: 'data' "
+        "} " +
+        ConvProto("conv0", "data", 3) +
+        ConvProto("conv_a", "conv0", 1) +
+        "layer { "
+        "  name: 'relu_a' "
+        "  type: 'ReLU' "
+        "  bottom: 'conv_a' "
+        "  top: 'conv_a' "
+        "} " +
+        ConvProto("conv_b1", "conv0", 1) +
+        "layer { "
+        "  name: 'relu_b1' "
+        "  type: 'ReLU' "
+        "  bottom: 'conv_b1' "
+        "  top: 'conv_b1' "
+        "} " +
+        ConvProto("conv_b2", "conv_b1", 3) +
+        "layer { "
+        "  name: 'pool_c' "
+        "  type: 'Pooling' "
+        "  pooling_param { pool: MAX kernel_size: 3 stride: 1 pad: 1 } "
+        "  bottom: 'conv0' "
+        "  top: 'pool_c' "
+        "} " + branch_c_extra +
+        ConvProto("conv_c", "pool_c", 1) +
+        "layer { "
+        "  name: 'concat' "
+        "  type: 'Concat' "
+        "  bottom: 'conv_a' "
+        "  bottom: 'conv_b2' "
+        "  bottom: 'conv_c' "
+        "  top: 'concat' "
+        "} "
+        "layer { "
+        "  name: 'ip' "
+        "  type: 'InnerProduct' "
+        "  inner_product_param { "
+        "    num_output: 3 "
+        "    weight_filler { type: 'gaussian' std: 0.1 } "
+        "  } "
+        "  bottom: 'concat' "
+        "  top: 'ip' "
+        "  loss_weight: 1 "
+        "} ";
+  }
+
+  string ConvProto(const string& name, const string& bottom, int kernel) {
+    std::ostringstream proto;
+    proto << "layer { "
+        << "  name: '" << name << "' "
+        << "  type: 'Convolution' "
+        << "  convolution_param { "
+        << "    num_output: 4 "
+        << "    kernel_size: " << kernel << " "
+        << "    pad: " << kernel / 2 << " "
+        << "    weight_filler { type: 'gaussian' std: 0.1 } "
+        << "    bias_filler { type: 'gaussian' std: 0.1 } "
+        << "  } "
+        << "  bottom: '" << bottom << "' "
+        << "  top: '" << name << "' "
+        << "} ";
+    return proto.str();
+  }
+
+  shared_ptr<Net<Dtype> > CreateNet(const string& proto,
+      int parallel_branches) {
+    NetParameter param;
+    CHECK(google::protobuf::TextFormat::ParseFromString(proto, &param));
+    param.set_parallel_branches(parallel_branches);
+    Caffe::set_random_seed(seed_);
+    return shared_ptr<Net<Dtype> >(new Net<Dtype>(param));
+  }
+
+  // Whether the threads are enough for branches to pay off.
+  bool has_threads() const {
+#ifdef _OPENMP
+    return omp_get_max_threads() >= 3;
+#else
+    return false;
+#endif
+  }
+
+  int seed_;
+};
+
+TYPED_TEST_CASE(LayerSchedulerTest, TestDtypes);
+
+TYPED_TEST(LayerSchedulerTest, TestStages) {
+  const string proto = this->InceptionProto("");
+  shared_ptr<Net<TypeParam> > net = this->CreateNet(proto, 0);
+  LayerScheduler<TypeParam> scheduler(*net, 3);
+  const vector<vector<vector<int> > >& stages = scheduler.stages();
+  int num_layers = 0;
+  int branches = 0;
+  for (int i = 0; i < stages.size(); ++i) {
+    for (int j = 0; j < stages[i].size(); ++j) {
+      num_layers += stages[i][j].size();
+    }
+    if (stages[i].size() > 1) {
+      ++branches;
+      ASSERT_EQ(3, stages[i].size());
+      EXPECT_EQ("concat", net->layer_names()[stages[i + 1][0][0]]);
+      EXPECT_EQ("conv_a", net->layer_names()[stages[i][0][0]]);
+      EXPECT_EQ(2, stages[i][0].size());
+      EXPECT_EQ(3, stages[i][1].size());
+      EXPECT_EQ(2, stages[i][2].size());
+    }
+  }
+  EXPECT_EQ(net->layers().size(), num_layers);
+  if (this->has_threads()) {
+    EXPECT_EQ(1, branches);
+    EXPECT_EQ(3, scheduler.num_workers());
+  }
+}
+
+TYPED_TEST(LayerSchedulerTest, TestSerialBranchesInOrder) {
+  // Dropout in two branches draws random numbers in the order of the layers.
+  const string dropout =
+      "layer { "
+      "  name: 'drop_a' "
+      "  type: 'Dropout' "
+      "  bottom: 'conv_a' "
+      "  top: 'conv_a' "
+      "} "
+      "layer { "
+      "  name: 'drop_c' "
+      "  type: 'Dropout' "
+      "  bottom: 'pool_c' "
+      "  top: 'pool_c' "
+      "} ";
+  const string proto = this->InceptionProto(dropout);
+  shared_ptr<Net<TypeParam> > net = this->CreateNet(proto, 0);
+  LayerScheduler<TypeParam> scheduler(*net, 3);
+  const vector<vector<vector<int> > >& stages = scheduler.stages();
+  for (int i = 0; i < stages.size(); ++i) {
+    EXPECT_EQ(1, stages[i].size());
+  }
+  EXPECT_EQ(0, scheduler.num_workers());
+}
+
+TYPED_TEST(LayerSchedulerTest, TestForwardBackwardUnchanged) {
+  typedef TypeParam Dtype;
+  const string proto = this->InceptionProto("");
+  shared_ptr<Net<Dtype> > serial = this->CreateNet(proto, 0);
+  shared_ptr<Net<Dtype> > parallel = this->CreateNet(proto, 3);
+  for (int iter = 0; iter < 3; ++iter) {
+    Caffe::set_random_seed(this->seed_ + iter);
+    serial->ClearParamDiffs();
+    const Dtype serial_loss = serial->ForwardBackward();
+    Caffe::set_random_seed(this->seed_ + iter);
+    parallel->ClearParamDiffs();
+    const Dtype parallel_loss = parallel->ForwardBackward();
+    EXPECT_FLOAT_EQ(serial_loss, parallel_loss);
+    for (int i = 0; i < serial->blobs().size(); ++i) {
+      const Blob<Dtype>& expected = *serial->blobs()[i];
+      const Blob<Dtype>& actual = *parallel->blobs()[i];
+      for (int j = 0; j < expected.count(); ++j) {
+        EXPECT_FLOAT_EQ(expected.cpu_data()[j], actual.cpu_data()[j]);
+        EXPECT_FLOAT_EQ(expected.cpu_diff()[j], actual.cpu_diff()[j]);
+      }
+    }
+    for (int i = 0; i < serial->params().size(); ++i) {
+      const Blob<Dtype>& expected = *serial->params()[i];
+      const Blob<Dtype>& actual = *parallel->params()[i];
+      for (int j = 0; j < expected.count(); ++j) {
+        EXPECT_FLOAT_EQ(expected.cpu_diff()[j], actual.cpu_diff()[j]);
+      }
+    }
+  }
+}
+
+}  // namespace caffe
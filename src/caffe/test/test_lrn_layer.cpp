@@ -7,6 +7,7 @@
 #include "caffe/common.hpp"
 #include "caffe/filler.hpp"
 #include "caffe/layers/lrn_layer.hpp"
+#include "caffe/util/half.hpp"
 
 #ifdef USE_CUDNN
 #include "caffe/layers/cudnn_lcn_layer.hpp"
@@ -142,6 +143,31 @@ TYPED_TEST(LRNLayerTest, TestForwardAcrossChannels) {
   }
 }
 
+TYPED_TEST(LRNLayerTest, TestForwardAcrossChannelsHalfStorage) {
+  typedef typename TypeParam::Dtype Dtype;
+  // bf16 bottom, fp16 top: normalizes as the Dtype layer does on the rounded
+  // bottom.
+  this->blob_bottom_->set_storage(STORAGE_BF16);
+  this->blob_bottom_->mutable_cpu_storage_data();
+  Blob<Dtype> rounded;
+  rounded.CopyFrom(*this->blob_bottom_, false, true);
+  vector<Blob<Dtype>*> rounded_vec(1, &rounded);
+  Blob<Dtype> reference;
+  vector<Blob<Dtype>*> reference_vec(1, &reference);
+  LayerParameter layer_param;
+  LRNLayer<Dtype> layer(layer_param);
+  layer.SetUp(rounded_vec, reference_vec);
+  layer.Forward(rounded_vec, reference_vec);
+  layer.Reshape(this->blob_bottom_vec_, this->blob_top_vec_);
+  this->blob_top_->set_storage(STORAGE_FP16);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  const uint16_t* top_data =
+      static_cast<const uint16_t*>(this->blob_top_->cpu_storage_data());
+  for (int i = 0; i < reference.count(); ++i) {
+    EXPECT_EQ(float_to_fp16(reference.cpu_data()[i]), top_data[i]);
+  }
+}
+
 TYPED_TEST(LRNLayerTest, TestForwardAcrossChannelsLargeRegion) {
   typedef typename TypeParam::Dtype Dtype;
   LayerParameter layer_param;
@@ -1,12 +1,16 @@
 #include <stdint.h>  // for uint32_t & uint64_t
 #include <time.h>
+#include <algorithm>
 #include <cmath>  // for std::fabs
+#include <limits>
+#include <vector>
 
 #include "gtest/gtest.h"
 
 #include "caffe/blob.hpp"
 #include "caffe/common.hpp"
 #include "caffe/filler.hpp"
+#include "caffe/util/benchmark.hpp"
 #include "caffe/util/math_functions.hpp"
 
 #include "caffe/test/test_caffe_main.hpp"
@@ -119,6 +123,162 @@ TYPED_TEST(CPUMathFunctionsTest, TestCopy) {
   }
 }
 
+template <typename Dtype>
+class TranscendentalTest : public ::testing::Test {
+ protected:
+  typedef void (*Function)(const int n, const Dtype* a, Dtype* y);
+  typedef double (*Reference)(double x);
+
+  // The unit in the last place of Dtype values around x.
+  static double Ulp(double x) {
+    if (std::fabs(x) < std::numeric_limits<Dtype>::min()) {
+      return std::numeric_limits<Dtype>::denorm_min();
+    }
+    return std::ldexp(static_cast<double>(
+        std::numeric_limits<Dtype>::epsilon()), std::ilogb(x));
+  }
+
+  // The largest error of f over [lo, hi] in ulp of the exact value, which
+  // is expected to be within the documented 3 ulp.
+  double MaxError(Function f, Reference reference, double lo, double hi) {
+    const int n = 1 << 20;
+    vector<Dtype> x(n);
+    vector<Dtype> y(n);
+    for (int i = 0; i < n; ++i) {
+      x[i] = lo + (hi - lo) * i / (n - 1);
+    }
+    f(n, &x[0], &y[0]);
+    double max_error = 0;
+    for (int i = 0; i < n; ++i) {
+      const double exact = reference(x[i]);
+      const double error = std::fabs(y[i] - exact) / Ulp(exact);
+      EXPECT_LE(error, 3.)
+          << "at " << x[i] << ": " << y[i] << " vs " << exact;
+      if (error > 3) {
+        break;
+      }
+      max_error = std::max(max_error, error);
+    }
+    return max_error;
+  }
+
+  // Logs the elements per second of f and of the scalar libm loop.
+  void Throughput(const char* name, Function f, Reference reference,
+      double lo, double hi) {
+    const int n = 1 << 20;
+    const int iterations = 10;
+    vector<Dtype> x(n);
+    vector<Dtype> y(n);
+    for (int i = 0; i < n; ++i) {
+      x[i] = lo + (hi - lo) * i / (n - 1);
+    }
+    CPUTimer timer;
+    timer.Start();
+    for (int iteration = 0; iteration < iterations; ++iteration) {
+      f(n, &x[0], &y[0]);
+    }
+    const double kernel_us = timer.MicroSeconds();
+    timer.Start();
+    for (int iteration = 0; iteration < iterations; ++iteration) {
+      for (int i = 0; i < n; ++i) {
+        y[i] = reference(x[i]);
+      }
+    }
+    const double scalar_us = timer.MicroSeconds();
+    LOG(INFO) << name << ": " << n * iterations / kernel_us
+        << " M elements/s, scalar libm " << n * iterations / scalar_us
+        << " M elements/s";
+  }
+};
+
+TYPED_TEST_CASE(TranscendentalTest, TestDtypes);
+
+double sigmoid_reference(double x) { return 1. / (1. + std::exp(-x)); }
+double softplus_reference(double x) {
+  return std::max(x, 0.) + log1p(std::exp(-std::fabs(x)));
+}
+double exp_reference(double x) { return std::exp(x); }
+double log_reference(double x) { return std::log(x); }
+double tanh_reference(double x) { return std::tanh(x); }
+
+TYPED_TEST(TranscendentalTest, TestExpAccuracy) {
+  LOG(INFO) << "exp error: "
+      << this->MaxError(caffe_exp<TypeParam>, exp_reference, -87, 88)
+      << " ulp";
+  const TypeParam x[] = {-1000, 1000, 0};
+  TypeParam y[3];
+  caffe_exp(3, x, y);
+  EXPECT_EQ(0, y[0]);
+  EXPECT_EQ(std::numeric_limits<TypeParam>::infinity(), y[1]);
+  EXPECT_EQ(1, y[2]);
+}
+
+TYPED_TEST(TranscendentalTest, TestLogAccuracy) {
+  LOG(INFO) << "log error: "
+      << this->MaxError(caffe_log<TypeParam>, log_reference, 1e-6, 4)
+      << " ulp, large: "
+      << this->MaxError(caffe_log<TypeParam>, log_reference, 4, 1e30)
+      << " ulp";
+  const TypeParam x[] = {0, 1, std::numeric_limits<TypeParam>::denorm_min()};
+  TypeParam y[3];
+  caffe_log(3, x, y);
+  EXPECT_EQ(-std::numeric_limits<TypeParam>::infinity(), y[0]);
+  EXPECT_EQ(0, y[1]);
+  EXPECT_NEAR(std::log(static_cast<double>(x[2])), y[2], 1e-4);
+}
+
+TYPED_TEST(TranscendentalTest, TestTanhAccuracy) {
+  LOG(INFO) << "tanh error: "
+      << this->MaxError(caffe_tanh<TypeParam>, tanh_reference, -20, 20)
+      << " ulp";
+}
+
+TYPED_TEST(TranscendentalTest, TestSigmoidAccuracy) {
+  LOG(INFO) << "sigmoid error: "
+      << this->MaxError(caffe_sigmoid<TypeParam>, sigmoid_reference, -80, 80)
+      << " ulp";
+  const TypeParam x[] = {-1000, 1000};
+  TypeParam y[2];
+  caffe_sigmoid(2, x, y);
+  EXPECT_NEAR(0, y[0], 1e-37);
+  EXPECT_EQ(1, y[1]);
+}
+
+TYPED_TEST(TranscendentalTest, TestSoftplusAccuracy) {
+  LOG(INFO) << "softplus error: "
+      << this->MaxError(caffe_softplus<TypeParam>, softplus_reference,
+          -80, 80)
+      << " ulp";
+  const TypeParam x[] = {-1000, 1000};
+  TypeParam y[2];
+  caffe_softplus(2, x, y);
+  EXPECT_EQ(0, y[0]);
+  EXPECT_EQ(1000, y[1]);
+}
+
+// Benchmarks, run with --gtest_also_run_disabled_tests.
+TYPED_TEST(TranscendentalTest, DISABLED_TestExpThroughput) {
+  this->Throughput("exp", caffe_exp<TypeParam>, exp_reference, -10, 10);
+}
+
+TYPED_TEST(TranscendentalTest, DISABLED_TestLogThroughput) {
+  this->Throughput("log", caffe_log<TypeParam>, log_reference, 1e-3, 1e3);
+}
+
+TYPED_TEST(TranscendentalTest, DISABLED_TestTanhThroughput) {
+  this->Throughput("tanh", caffe_tanh<TypeParam>, tanh_reference, -10, 10);
+}
+
+TYPED_TEST(TranscendentalTest, DISABLED_TestSigmoidThroughput) {
+  this->Throughput("sigmoid", caffe_sigmoid<TypeParam>, sigmoid_reference,
+      -10, 10);
+}
+
+TYPED_TEST(TranscendentalTest, DISABLED_TestSoftplusThroughput) {
+  this->Throughput("softplus", caffe_softplus<TypeParam>, softplus_reference,
+      -10, 10);
+}
+
 #ifndef CPU_ONLY
 
 template <typename Dtype>
@@ -1,9 +1,17 @@
 #include <boost/bind.hpp>
 #include <boost/date_time/posix_time/posix_time.hpp>
 #include <boost/make_shared.hpp>
+#include <boost/thread.hpp>
 #include <gtest/gtest.h>
 #include <string>
+#include <vector>
 #include "caffe/internode/configuration.hpp"
+#include "caffe/internode/tree_cluster.hpp"
+#include "caffe/multinode/BlobKeyChain.hpp"
+#include "caffe/multinode/ModelDownload.hpp"
+#include "caffe/multinode/SendCallback.hpp"
+#include "caffe/proto/caffe.pb.h"
+#include "caffe/util/io.hpp"
 
 namespace caffe {
 namespace internode {
@@ -110,10 +118,176 @@ TEST_F(ConnectionTest, DISABLED_TcpConnect) {
   EXPECT_NO_FATAL_FAILURE(check_connection("tcp://127.0.0.1:6969", short_msg));
 }
 
+TEST_F(ConnectionTest, ShmConnect) {
+  EXPECT_NO_FATAL_FAILURE(check_connection("shm://caffe_test", short_msg));
+}
+
+TEST_F(ConnectionTest, ShmLargeString) {
+  EXPECT_NO_FATAL_FAILURE(check_connection("shm://caffe_test", long_msg));
+}
+
+TEST_F(ConnectionTest, ShmBroadcast) {
+  EXPECT_NO_FATAL_FAILURE(check_multicast("shm://caffe_test", short_msg));
+}
+
 TEST_F(ConnectionTest, DISABLED_UdpMulticast) {
   EXPECT_NO_FATAL_FAILURE(check_multicast("udp://127.0.0.1:6969;224.0.0.0:6970",
                                               short_msg));
 }
 
+TEST(TreeTopologyTest, FlatIsBinaryHeap) {
+  TreeTopology topology(6);
+  EXPECT_EQ(1, topology.total_groups());
+  EXPECT_EQ(0, topology.parent(0));
+  for (RemoteId i = 1; i < 6; ++i) {
+    EXPECT_EQ((i - 1) / 2, topology.parent(i));
+  }
+  std::vector<RemoteId> children = topology.children(1);
+  ASSERT_EQ(2, children.size());
+  EXPECT_EQ(3, children[0]);
+  EXPECT_EQ(4, children[1]);
+  EXPECT_TRUE(topology.children(5).empty());
+}
+
+TEST(TreeTopologyTest, HierarchicalLinksOnlyLeadersAcrossHosts) {
+  std::vector<std::string> hosts;
+  hosts.push_back("a");
+  hosts.push_back("b");
+  hosts.push_back("a");
+  hosts.push_back("b");
+  hosts.push_back("a");
+  hosts.push_back("c");
+  TreeTopology topology(hosts);
+  EXPECT_EQ(3, topology.total_groups());
+  EXPECT_TRUE(topology.is_group_leader(0));
+  EXPECT_TRUE(topology.is_group_leader(1));
+  EXPECT_TRUE(topology.is_group_leader(5));
+  EXPECT_FALSE(topology.is_group_leader(2));
+
+  EXPECT_EQ(0, topology.parent(0));
+  EXPECT_EQ(0, topology.parent(2));
+  EXPECT_EQ(0, topology.parent(4));
+  EXPECT_EQ(1, topology.parent(3));
+  EXPECT_EQ(0, topology.parent(1));
+  EXPECT_EQ(0, topology.parent(5));
+  EXPECT_EQ(4, topology.children(0).size());
+  EXPECT_EQ(1, topology.children(1).size());
+
+  for (RemoteId i = 0; i < hosts.size(); ++i) {
+    RemoteId parent = topology.parent(i);
+    if (hosts[parent] != hosts[i]) {
+      EXPECT_TRUE(topology.is_group_leader(i));
+      EXPECT_TRUE(topology.is_group_leader(parent));
+    }
+  }
+}
+
+// Answers chunk requests the way ModelServer does.
+struct FakeModelServer : Waypoint::Handler {
+  boost::shared_ptr<Daemon> daemon;
+  boost::shared_ptr<MultiWaypoint> server;
+  string model;
+  string hash;
+  uint32_t chunk_size;
+  int chunks_sent;
+  volatile bool stop;
+
+  FakeModelServer(string address, string model, uint32_t chunk_size)
+    : daemon(create_communication_daemon())
+    , server(configure_server(daemon, address, UINT_MAX))
+    , model(model)
+    , hash(model_hash(model))
+    , chunk_size(chunk_size)
+    , chunks_sent(0)
+    , stop(false) {
+    server->register_receive_handler(this);
+  }
+
+  void received(char* data, size_t size, Waypoint* remote) {
+    ModelReq req;
+    ASSERT_TRUE(req.ParseFromArray(data, size));
+    ModelChunk chunk;
+    chunk.set_hash(hash);
+    chunk.set_size(model.size());
+    chunk.set_chunk_size(chunk_size);
+    if (req.has_chunk()) {
+      size_t offset = static_cast<size_t>(req.chunk()) * chunk_size;
+      chunk.set_index(req.chunk());
+      chunk.set_data(model.substr(offset, chunk_size));
+      ++chunks_sent;
+    }
+    SendCallback callback;
+    chunk.SerializeToString(callback.buffer.get());
+    remote->async_send(
+      callback.buffer->c_str(), callback.buffer->size(), callback);
+  }
+
+  void run() {
+    while (!stop) {
+      poll_one(daemon);
+    }
+  }
+};
+
+TEST(ModelDownloadTest, HashDependsOnContent) {
+  EXPECT_EQ(model_hash("model"), model_hash("model"));
+  EXPECT_NE(model_hash("model"), model_hash("modem"));
+  EXPECT_EQ(16, model_hash("").size());
+}
+
+TEST(ModelDownloadTest, DownloadsInChunksAndCaches) {
+  string model;
+  for (int i = 0; i < 100000; ++i) {
+    model.push_back(static_cast<char>(i * 7));
+  }
+  FakeModelServer server("shm://caffe_test_model", model, 4096);
+  boost::thread server_thread(&FakeModelServer::run, &server);
+  string cache_dir;
+  MakeTempDir(&cache_dir);
+
+  string received, hash;
+  EXPECT_TRUE(ReceiveModelFromRemote(
+    "shm://caffe_test_model", cache_dir, &received, &hash));
+  EXPECT_EQ(server.hash, hash);
+  EXPECT_TRUE(received == model);
+  EXPECT_EQ((model.size() + 4095) / 4096, server.chunks_sent);
+
+  received.clear();
+  EXPECT_TRUE(ReceiveModelFromRemote(
+    "shm://caffe_test_model", cache_dir, &received, &hash));
+  EXPECT_TRUE(received == model);
+  EXPECT_EQ((model.size() + 4095) / 4096, server.chunks_sent);
+
+  server.stop = true;
+  server_thread.join();
+}
+
+
+void lock_layer(BlobKeyChain<float>* keychain, volatile bool* locked) {
+  keychain->lock(0);
+  *locked = true;
+  keychain->unlock(0);
+}
+
+TEST(BlobKeyChainTest, PartsLockIndependentlyAndExcludeLayer) {
+  shared_ptr<BlobKeyChain<float> > keychain = BlobKeyChain<float>::create(2);
+  keychain->lock(0, 0, 0);
+  keychain->lock(0, 0, 1);
+  keychain->lock(0, 1, 0);
+  keychain->lock(1);
+  volatile bool locked = false;
+  boost::thread locker(&lock_layer, keychain.get(), &locked);
+  boost::this_thread::sleep(boost::posix_time::milliseconds(50));
+  EXPECT_FALSE(locked);
+  keychain->unlock(0, 0, 0);
+  keychain->unlock(0, 0, 1);
+  boost::this_thread::sleep(boost::posix_time::milliseconds(50));
+  EXPECT_FALSE(locked);
+  keychain->unlock(0, 1, 0);
+  locker.join();
+  EXPECT_TRUE(locked);
+  keychain->unlock(1);
+}
+
 }  // namespace internode
 }  // namespace caffe
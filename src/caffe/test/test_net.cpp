@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <string>
 #include <utility>
 #include <vector>
@@ -9,6 +10,9 @@
 #include "caffe/common.hpp"
 #include "caffe/filler.hpp"
 #include "caffe/net.hpp"
+#include "caffe/parallel.hpp"
+#include "caffe/util/flat_weights.hpp"
+#include "caffe/util/io.hpp"
 #include "caffe/util/math_functions.hpp"
 
 #include "caffe/test/test_caffe_main.hpp"
@@ -21,11 +25,16 @@ class NetTest : public MultiDeviceTest<TypeParam> {
   typedef typename TypeParam::Dtype Dtype;
 
  protected:
-  NetTest() : seed_(1701) {}
+  NetTest()
+      : seed_(1701), contiguous_params_(false), zero_copy_concat_(false),
+        accumulate_split_diffs_(false) {}
 
   virtual void InitNetFromProtoString(const string& proto) {
     NetParameter param;
     CHECK(google::protobuf::TextFormat::ParseFromString(proto, &param));
+    param.set_contiguous_params(contiguous_params_);
+    param.set_zero_copy_concat(zero_copy_concat_);
+    param.set_accumulate_split_diffs(accumulate_split_diffs_);
     net_.reset(new Net<Dtype>(param));
   }
 
@@ -716,7 +725,208 @@ class NetTest : public MultiDeviceTest<TypeParam> {
     InitNetFromProtoString(proto);
   }
 
+  virtual void InitCheckpointNet(const string& checkpoint_param,
+      bool dropout) {
+    string proto =
+        "name: 'CheckpointNetwork' "
+        "state: { phase: TRAIN } " + checkpoint_param +
+        "layer { "
+        "  name: 'data' "
+        "  type: 'DummyData' "
+        "  dummy_data_param { "
+        "    shape { dim: 2 dim: 3 dim: 6 dim: 6 } "
+        "    data_filler { type: 'gaussian' std: 1 } "
+        "  } "
+        "  top: 'data' "
+        "} "
+        "layer { "
+        "  name: 'conv1' "
+        "  type: 'Convolution' "
+        "  convolution_param { "
+        "    num_output: 4 "
+        "    kernel_size: 3 "
+        "    pad: 1 "
+        "    weight_filler { type: 'gaussian' std: 0.1 } "
+        "    bias_filler { type: 'gaussian' std: 0.1 } "
+        "  } "
+        "  bottom: 'data' "
+        "  top: 'conv1' "
+        "} "
+        "layer { "
+        "  name: 'relu1' "
+        "  type: 'ReLU' "
+        "  bottom: 'conv1' "
+        "  top: 'conv1' "
+        "} ";
+    string pool_bottom = "conv1";
+    if (dropout) {
+      proto +=
+          "layer { "
+          "  name: 'drop1' "
+          "  type: 'Dropout' "
+          "  dropout_param { dropout_ratio: 0.5 } "
+          "  bottom: 'conv1' "
+          "  top: 'drop1' "
+          "} ";
+      pool_bottom = "drop1";
+    }
+    proto +=
+        "layer { "
+        "  name: 'pool1' "
+        "  type: 'Pooling' "
+        "  pooling_param { pool: MAX kernel_size: 2 stride: 2 } "
+        "  bottom: '" + pool_bottom + "' "
+        "  top: 'pool1' "
+        "} "
+        "layer { "
+        "  name: 'conv2' "
+        "  type: 'Convolution' "
+        "  checkpoint: true "
+        "  convolution_param { "
+        "    num_output: 4 "
+        "    kernel_size: 3 "
+        "    pad: 1 "
+        "    weight_filler { type: 'gaussian' std: 0.1 } "
+        "    bias_filler { type: 'gaussian' std: 0.1 } "
+        "  } "
+        "  bottom: 'pool1' "
+        "  top: 'conv2' "
+        "} "
+        "layer { "
+        "  name: 'relu2' "
+        "  type: 'ReLU' "
+        "  bottom: 'conv2' "
+        "  top: 'conv2' "
+        "} "
+        "layer { "
+        "  name: 'ip' "
+        "  type: 'InnerProduct' "
+        "  inner_product_param { "
+        "    num_output: 3 "
+        "    weight_filler { type: 'gaussian' std: 0.1 } "
+        "  } "
+        "  bottom: 'conv2' "
+        "  top: 'ip' "
+        "  loss_weight: 1 "
+        "} ";
+    InitNetFromProtoString(proto);
+  }
+
+  // Two branches concatenated, sliced apart again, one slice transformed
+  // and concatenated with the other.
+  virtual void InitConcatNet() {
+    const string filler = "{ type: 'gaussian' std: 0.5 } ";
+    const string proto =
+        "name: 'ConcatNetwork' "
+        "force_backward: true "
+        "layer { "
+        "  name: 'data' "
+        "  type: 'Input' "
+        "  input_param { shape { dim: 1 dim: 2 dim: 3 dim: 4 } } "
+        "  top: 'data' "
+        "} "
+        "layer { "
+        "  name: 'conv_a' "
+        "  type: 'Convolution' "
+        "  convolution_param { "
+        "    num_output: 3 "
+        "    kernel_size: 1 "
+        "    weight_filler " + filler +
+        "    bias_filler " + filler +
+        "  } "
+        "  bottom: 'data' "
+        "  top: 'a' "
+        "} "
+        "layer { "
+        "  name: 'conv_b' "
+        "  type: 'Convolution' "
+        "  convolution_param { "
+        "    num_output: 2 "
+        "    kernel_size: 1 "
+        "    weight_filler " + filler +
+        "    bias_filler " + filler +
+        "  } "
+        "  bottom: 'data' "
+        "  top: 'b' "
+        "} "
+        "layer { "
+        "  name: 'tanh_b' "
+        "  type: 'TanH' "
+        "  bottom: 'b' "
+        "  top: 'b' "
+        "} "
+        "layer { "
+        "  name: 'concat1' "
+        "  type: 'Concat' "
+        "  bottom: 'a' "
+        "  bottom: 'b' "
+        "  top: 'c' "
+        "} "
+        "layer { "
+        "  name: 'slice' "
+        "  type: 'Slice' "
+        "  slice_param { slice_point: 2 } "
+        "  bottom: 'c' "
+        "  top: 's1' "
+        "  top: 's2' "
+        "} "
+        "layer { "
+        "  name: 'sigmoid' "
+        "  type: 'Sigmoid' "
+        "  bottom: 's1' "
+        "  top: 't1' "
+        "} "
+        "layer { "
+        "  name: 'concat2' "
+        "  type: 'Concat' "
+        "  bottom: 't1' "
+        "  bottom: 's2' "
+        "  top: 'd' "
+        "} "
+        "layer { "
+        "  name: 'ip' "
+        "  type: 'InnerProduct' "
+        "  inner_product_param { "
+        "    num_output: 2 "
+        "    weight_filler " + filler +
+        "  } "
+        "  bottom: 'd' "
+        "  top: 'ip' "
+        "} "
+        "layer { "
+        "  name: 'loss' "
+        "  type: 'Reduction' "
+        "  reduction_param { operation: SUMSQ } "
+        "  bottom: 'ip' "
+        "  top: 'loss' "
+        "  loss_weight: 1 "
+        "} ";
+    InitNetFromProtoString(proto);
+  }
+
+  // A BatchNorm followed by a Scale writing scale_top, in place if it is
+  // 'bn', and a Euclidean loss against a second input.
+  virtual void InitBatchNormScaleNet(const string& scale_top) {
+    const string proto =
+        "name: 'BatchNormScaleNet' "
+        "force_backward: true "
+        "state { phase: TRAIN } "
+        "layer { name: 'input' type: 'Input' top: 'data' top: 'target' "
+        "  input_param { shape { dim: 2 dim: 3 dim: 4 dim: 5 } } } "
+        "layer { name: 'bn' type: 'BatchNorm' bottom: 'data' top: 'bn' } "
+        "layer { name: 'scale' type: 'Scale' bottom: 'bn' "
+        "  top: '" + scale_top + "' "
+        "  scale_param { bias_term: true filler { type: 'gaussian' } "
+        "    bias_filler { type: 'gaussian' } } } "
+        "layer { name: 'loss' type: 'EuclideanLoss' "
+        "  bottom: '" + scale_top + "' bottom: 'target' top: 'loss' } ";
+    InitNetFromProtoString(proto);
+  }
+
   int seed_;
+  bool contiguous_params_;
+  bool zero_copy_concat_;
+  bool accumulate_split_diffs_;
   shared_ptr<Net<Dtype> > net_;
 };
 
@@ -1219,6 +1429,155 @@ TYPED_TEST(NetTest, TestSharedWeightsResume) {
   }
 }
 
+TYPED_TEST(NetTest, TestSharedWeightsResumeFromFlat) {
+  typedef typename TypeParam::Dtype Dtype;
+
+  Caffe::set_random_seed(this->seed_);
+  this->InitDiffDataSharedWeightsNet();
+  this->net_->ForwardBackward();
+  this->net_->Update();
+  Blob<Dtype> shared_params;
+  shared_params.CopyFrom(*this->net_->layers()[1]->blobs()[0], false, true);
+  const int count = shared_params.count();
+  NetParameter net_param;
+  this->net_->ToProto(&net_param);
+  string filename;
+  MakeTempFilename(&filename);
+  filename += ".caffeflat";
+  WriteFlatWeights(net_param, filename);
+
+  Caffe::set_random_seed(this->seed_);
+  this->InitDiffDataSharedWeightsNet();
+  this->net_->CopyTrainedLayersFrom(filename);
+  Blob<Dtype>* ip1_weights = this->net_->layers()[1]->blobs()[0].get();
+  Blob<Dtype>* ip2_weights = this->net_->layers()[2]->blobs()[0].get();
+  EXPECT_EQ(ip1_weights->cpu_data(), ip2_weights->cpu_data());
+  EXPECT_EQ(ip1_weights->cpu_diff(), ip2_weights->cpu_diff());
+  EXPECT_EQ(0, reinterpret_cast<uintptr_t>(ip1_weights->cpu_data())
+    % kFlatWeightsAlignment);
+  for (int i = 0; i < count; ++i) {
+    EXPECT_FLOAT_EQ(shared_params.cpu_data()[i], ip1_weights->cpu_data()[i]);
+  }
+
+  // Training changes the mapped params, but not the file.
+  this->net_->ForwardBackward();
+  this->net_->Update();
+  NetParameter flat_param;
+  ReadFlatWeights(filename, &flat_param);
+  Blob<Dtype> flat_params;
+  flat_params.FromProto(flat_param.layer(0).blobs(0), true);
+  for (int i = 0; i < count; ++i) {
+    EXPECT_FLOAT_EQ(shared_params.cpu_data()[i], flat_params.cpu_data()[i]);
+  }
+}
+
+TYPED_TEST(NetTest, TestLegacyShapesFromFlat) {
+  typedef typename TypeParam::Dtype Dtype;
+  Caffe::set_random_seed(this->seed_);
+  this->InitUnsharedWeightsNet();
+  NetParameter net_param;
+  this->net_->ToProto(&net_param);
+  // Store the params the way old models do, with 4D shapes ending in the
+  // axes of the param.
+  for (int i = 0; i < net_param.layer_size(); ++i) {
+    for (int j = 0; j < net_param.layer(i).blobs_size(); ++j) {
+      BlobProto* blob = net_param.mutable_layer(i)->mutable_blobs(j);
+      vector<int> shape(4 - blob->shape().dim_size(), 1);
+      shape.insert(shape.end(), blob->shape().dim().begin(),
+                   blob->shape().dim().end());
+      ASSERT_EQ(4, shape.size());
+      blob->clear_shape();
+      blob->set_num(shape[0]);
+      blob->set_channels(shape[1]);
+      blob->set_height(shape[2]);
+      blob->set_width(shape[3]);
+    }
+  }
+  string filename;
+  MakeTempFilename(&filename);
+  filename += ".caffeflat";
+  WriteFlatWeights(net_param, filename);
+  vector<shared_ptr<Blob<Dtype> > > expected_params;
+  this->CopyNetParams(false, &expected_params);
+
+  Caffe::set_random_seed(this->seed_ + 1);
+  this->InitUnsharedWeightsNet();
+  this->net_->CopyTrainedLayersFrom(filename);
+  const vector<shared_ptr<Blob<Dtype> > >& params = this->net_->params();
+  ASSERT_EQ(expected_params.size(), params.size());
+  for (int i = 0; i < params.size(); ++i) {
+    ASSERT_EQ(expected_params[i]->shape(), params[i]->shape());
+    for (int j = 0; j < params[i]->count(); ++j) {
+      EXPECT_EQ(expected_params[i]->cpu_data()[j], params[i]->cpu_data()[j]);
+    }
+  }
+  // Converted back, they have their legacy shapes again.
+  NetParameter flat_param;
+  ReadFlatWeights(filename, &flat_param);
+  EXPECT_TRUE(params[0]->ShapeEquals(flat_param.layer(0).blobs(0)));
+  EXPECT_TRUE(flat_param.layer(0).blobs(0).has_num());
+}
+
+TYPED_TEST(NetTest, TestContiguousParamsUpdate) {
+  typedef typename TypeParam::Dtype Dtype;
+  const bool kCopyDiff = true;
+  Caffe::set_random_seed(this->seed_);
+  this->InitDiffDataUnsharedWeightsNet();
+  EXPECT_TRUE(this->net_->contiguous_params() == NULL);
+  this->net_->ForwardBackward();
+  this->net_->Update();
+  this->net_->ForwardBackward();
+  vector<shared_ptr<Blob<Dtype> > > expected_params;
+  this->CopyNetParams(!kCopyDiff, &expected_params);
+  vector<shared_ptr<Blob<Dtype> > > expected_grads;
+  this->CopyNetParams(kCopyDiff, &expected_grads);
+
+  this->contiguous_params_ = true;
+  Caffe::set_random_seed(this->seed_);
+  this->InitDiffDataUnsharedWeightsNet();
+  const CPUParams<Dtype>* params = this->net_->contiguous_params();
+  const vector<Blob<Dtype>*>& learnable_params =
+      this->net_->learnable_params();
+  if (Caffe::mode() == Caffe::CPU) {
+    ASSERT_TRUE(params != NULL);
+    size_t offset = 0;
+    for (int i = 0; i < learnable_params.size(); ++i) {
+      EXPECT_EQ(params->data() + offset, learnable_params[i]->cpu_data());
+      EXPECT_EQ(params->diff() + offset, learnable_params[i]->cpu_diff());
+      offset += learnable_params[i]->count();
+    }
+    EXPECT_EQ(offset, params->size());
+  } else {
+    EXPECT_TRUE(params == NULL);
+  }
+  this->net_->ForwardBackward();
+  this->net_->Update();
+  this->net_->ForwardBackward();
+  EXPECT_TRUE(this->net_->contiguous_params() == params);
+  const vector<shared_ptr<Blob<Dtype> > >& net_params = this->net_->params();
+  ASSERT_EQ(expected_params.size(), net_params.size());
+  for (int i = 0; i < net_params.size(); ++i) {
+    for (int j = 0; j < net_params[i]->count(); ++j) {
+      EXPECT_EQ(expected_params[i]->cpu_data()[j],
+                net_params[i]->cpu_data()[j]);
+      EXPECT_EQ(expected_grads[i]->cpu_diff()[j],
+                net_params[i]->cpu_diff()[j]);
+    }
+  }
+  this->net_->ClearParamDiffs();
+  for (int i = 0; i < learnable_params.size(); ++i) {
+    EXPECT_EQ(0, learnable_params[i]->asum_diff());
+  }
+
+  // A param moved out of the buffer disables it, the net keeps working.
+  Blob<Dtype> moved_param;
+  moved_param.CopyFrom(*learnable_params[0], false, true);
+  learnable_params[0]->data()->set_cpu_data(moved_param.mutable_cpu_data());
+  EXPECT_TRUE(this->net_->contiguous_params() == NULL);
+  this->net_->ForwardBackward();
+  this->net_->Update();
+}
+
 TYPED_TEST(NetTest, TestParamPropagateDown) {
   typedef typename TypeParam::Dtype Dtype;
   const bool kBiasTerm = true, kForceBackward = false;
@@ -1334,6 +1693,324 @@ TYPED_TEST(NetTest, TestFromTo) {
   }
 }
 
+TYPED_TEST(NetTest, TestCheckpointGradients) {
+  typedef typename TypeParam::Dtype Dtype;
+  // GPU Dropout draws from curand, whose state is not replayed.
+  const bool dropout = Caffe::mode() == Caffe::CPU;
+  const string checkpoint_params[] = {
+    "",
+    "checkpoint_param { segments: MANUAL } ",
+    "checkpoint_param { segments: SQRT } "
+  };
+  vector<shared_ptr<Blob<Dtype> > > params[3];
+  Dtype loss[3];
+  for (int i = 0; i < 3; ++i) {
+    Caffe::set_random_seed(this->seed_);
+    this->InitCheckpointNet(checkpoint_params[i], dropout);
+    // The second pass starts from a released net.
+    for (int iter = 0; iter < 2; ++iter) {
+      this->net_->ClearParamDiffs();
+      loss[i] = this->net_->ForwardBackward();
+    }
+    this->CopyNetParams(true, &params[i]);
+  }
+  for (int i = 1; i < 3; ++i) {
+    EXPECT_FLOAT_EQ(loss[0], loss[i]);
+    ASSERT_EQ(params[0].size(), params[i].size());
+    for (int j = 0; j < params[0].size(); ++j) {
+      for (int k = 0; k < params[0][j]->count(); ++k) {
+        EXPECT_FLOAT_EQ(params[0][j]->cpu_diff()[k],
+                        params[i][j]->cpu_diff()[k]);
+      }
+    }
+  }
+}
+
+TYPED_TEST(NetTest, TestCheckpointReleasesActivations) {
+  this->InitCheckpointNet("checkpoint_param { segments: MANUAL } ", false);
+  // The checkpoint moves past relu2, which computes in place on conv2.
+  const shared_ptr<Blob<typename TypeParam::Dtype> > conv1 =
+      this->net_->blob_by_name("conv1");
+  const shared_ptr<Blob<typename TypeParam::Dtype> > pool1 =
+      this->net_->blob_by_name("pool1");
+  const shared_ptr<Blob<typename TypeParam::Dtype> > conv2 =
+      this->net_->blob_by_name("conv2");
+  this->net_->Forward();
+  EXPECT_EQ(SyncedMemory::UNINITIALIZED, conv1->data()->head());
+  EXPECT_EQ(SyncedMemory::UNINITIALIZED, pool1->data()->head());
+  EXPECT_NE(SyncedMemory::UNINITIALIZED, conv2->data()->head());
+  this->net_->Backward();
+  EXPECT_EQ(SyncedMemory::UNINITIALIZED, pool1->data()->head());
+  EXPECT_EQ(SyncedMemory::UNINITIALIZED, pool1->diff()->head());
+  EXPECT_NE(SyncedMemory::UNINITIALIZED, conv2->diff()->head());
+  EXPECT_NE(0, this->net_->params()[0]->asum_diff());
+}
+
+TYPED_TEST(NetTest, TestZeroCopyConcat) {
+  typedef typename TypeParam::Dtype Dtype;
+  // Batch size 1 has contiguous parts, batch size 2 falls back to copies;
+  // the second pass reshapes from 1 to 2 and back.
+  const int nums[] = {1, 2, 1};
+  FillerParameter filler_param;
+  filler_param.set_std(1);
+  GaussianFiller<Dtype> filler(filler_param);
+  Blob<Dtype> input;
+  vector<shared_ptr<Blob<Dtype> > > blobs[2];
+  vector<shared_ptr<Blob<Dtype> > > grads[2];
+  vector<shared_ptr<Blob<Dtype> > > param_grads[2];
+  for (int zero_copy = 0; zero_copy < 2; ++zero_copy) {
+    this->zero_copy_concat_ = zero_copy;
+    Caffe::set_random_seed(this->seed_);
+    this->InitConcatNet();
+    Caffe::set_random_seed(this->seed_);
+    for (int i = 0; i < 3; ++i) {
+      input.Reshape(nums[i], 2, 3, 4);
+      filler.Fill(&input);
+      this->net_->input_blobs()[0]->ReshapeLike(input);
+      this->net_->Reshape();
+      this->net_->input_blobs()[0]->CopyFrom(input);
+      this->net_->ClearParamDiffs();
+      this->net_->ForwardBackward();
+    }
+    this->CopyNetBlobs(false, &blobs[zero_copy]);
+    this->CopyNetBlobs(true, &grads[zero_copy]);
+    this->CopyNetParams(true, &param_grads[zero_copy]);
+  }
+  ASSERT_EQ(blobs[0].size(), blobs[1].size());
+  for (int i = 0; i < blobs[0].size(); ++i) {
+    for (int j = 0; j < blobs[0][i]->count(); ++j) {
+      EXPECT_EQ(blobs[0][i]->cpu_data()[j], blobs[1][i]->cpu_data()[j]);
+    }
+  }
+  // The diffs of the wholes differ where tanh_b computed in place on a part,
+  // not that of the input.
+  for (int j = 0; j < grads[0][0]->count(); ++j) {
+    EXPECT_EQ(grads[0][0]->cpu_diff()[j], grads[1][0]->cpu_diff()[j]);
+  }
+  ASSERT_EQ(param_grads[0].size(), param_grads[1].size());
+  for (int i = 0; i < param_grads[0].size(); ++i) {
+    for (int j = 0; j < param_grads[0][i]->count(); ++j) {
+      EXPECT_EQ(param_grads[0][i]->cpu_diff()[j],
+                param_grads[1][i]->cpu_diff()[j]);
+    }
+  }
+  if (Caffe::mode() != Caffe::CPU) {
+    return;
+  }
+  // The parts are views of the wholes, but for s2 which is a part twice.
+  const Dtype* c_data = this->net_->blob_by_name("c")->cpu_data();
+  const Dtype* c_diff = this->net_->blob_by_name("c")->cpu_diff();
+  const Dtype* d_data = this->net_->blob_by_name("d")->cpu_data();
+  EXPECT_EQ(c_data, this->net_->blob_by_name("a")->cpu_data());
+  EXPECT_EQ(c_diff, this->net_->blob_by_name("a")->cpu_diff());
+  EXPECT_EQ(c_data + 36, this->net_->blob_by_name("b")->cpu_data());
+  EXPECT_EQ(c_diff + 36, this->net_->blob_by_name("b")->cpu_diff());
+  EXPECT_EQ(c_data, this->net_->blob_by_name("s1")->cpu_data());
+  EXPECT_EQ(c_data + 24, this->net_->blob_by_name("s2")->cpu_data());
+  EXPECT_EQ(d_data, this->net_->blob_by_name("t1")->cpu_data());
+}
+
+TYPED_TEST(NetTest, TestTopStorage) {
+  typedef typename TypeParam::Dtype Dtype;
+  // pool feeds lrn and concat through a split, and relu in place.
+  const string proto_template =
+      "name: 'HalfNet' "
+      "layer { name: 'input' type: 'Input' top: 'data' "
+      "  input_param { shape { dim: 2 dim: 3 dim: 6 dim: 5 } } } "
+      "layer { name: 'pool' type: 'Pooling' bottom: 'data' top: 'pool' "
+      "  pooling_param { pool: MAX kernel_size: 2 stride: 1 } STORAGE } "
+      "layer { name: 'relu' type: 'ReLU' bottom: 'pool' top: 'pool' "
+      "  STORAGE } "
+      "layer { name: 'lrn' type: 'LRN' bottom: 'pool' top: 'lrn' STORAGE } "
+      "layer { name: 'concat' type: 'Concat' bottom: 'pool' bottom: 'lrn' "
+      "  top: 'concat' } ";
+  FillerParameter filler_param;
+  filler_param.set_std(1);
+  GaussianFiller<Dtype> filler(filler_param);
+  Blob<Dtype> input(2, 3, 6, 5);
+  filler.Fill(&input);
+  Blob<Dtype> output[2];
+  for (int half = 0; half < 2; ++half) {
+    const string storage = half ? "top_storage: STORAGE_BF16" : "";
+    string proto = proto_template;
+    for (size_t pos = 0; (pos = proto.find("STORAGE ", pos)) != string::npos;
+         pos += storage.size()) {
+      proto.replace(pos, 7, storage);
+    }
+    this->InitNetFromProtoString(proto);
+    this->net_->input_blobs()[0]->CopyFrom(input);
+    this->net_->Forward();
+    output[half].CopyFrom(*this->net_->blob_by_name("concat"), false, true);
+  }
+  for (int i = 0; i < output[0].count(); ++i) {
+    const Dtype expected = output[0].cpu_data()[i];
+    EXPECT_NEAR(expected, output[1].cpu_data()[i], fabs(expected) / 64);
+  }
+  if (Caffe::mode() != Caffe::CPU) {
+    return;
+  }
+  // Written and read as bf16 only.
+  EXPECT_EQ(STORAGE_BF16, this->net_->blob_by_name("pool")->storage());
+  EXPECT_EQ(SyncedMemory::HEAD_AT_HALF,
+      this->net_->blob_by_name("pool")->data()->head());
+  EXPECT_EQ(SyncedMemory::HEAD_AT_HALF,
+      this->net_->blob_by_name("lrn")->data()->head());
+  EXPECT_EQ(STORAGE_DTYPE, this->net_->blob_by_name("concat")->storage());
+}
+
+TYPED_TEST(NetTest, TestFuseBatchNormScale) {
+  typedef typename TypeParam::Dtype Dtype;
+  FillerParameter filler_param;
+  filler_param.set_std(1);
+  GaussianFiller<Dtype> filler(filler_param);
+  Blob<Dtype> input(2, 3, 4, 5);
+  Blob<Dtype> target(2, 3, 4, 5);
+  filler.Fill(&input);
+  filler.Fill(&target);
+  Dtype loss[2];
+  Blob<Dtype> input_diff[2];
+  vector<shared_ptr<Blob<Dtype> > > param_grads[2];
+  for (int fused = 0; fused < 2; ++fused) {
+    // The Scale computes in place on the BatchNorm top only when fused.
+    Caffe::set_random_seed(this->seed_);
+    this->InitBatchNormScaleNet(fused ? "bn" : "scaled");
+    EXPECT_EQ(fused && Caffe::mode() == Caffe::CPU,
+        this->net_->layer_fused()[2]);
+    this->net_->input_blobs()[0]->CopyFrom(input);
+    this->net_->input_blobs()[1]->CopyFrom(target);
+    this->net_->ClearParamDiffs();
+    loss[fused] = this->net_->ForwardBackward();
+    input_diff[fused].CopyFrom(*this->net_->input_blobs()[0], true, true);
+    this->CopyNetParams(true, &param_grads[fused]);
+  }
+  const Dtype kErrorMargin = 1e-4;
+  EXPECT_NEAR(loss[0], loss[1], kErrorMargin * fabs(loss[0]));
+  for (int i = 0; i < input.count(); ++i) {
+    EXPECT_NEAR(input_diff[0].cpu_diff()[i], input_diff[1].cpu_diff()[i],
+        kErrorMargin);
+  }
+  // The scale and bias of the Scale layer get their gradients either way.
+  ASSERT_EQ(5, param_grads[0].size());
+  ASSERT_EQ(param_grads[0].size(), param_grads[1].size());
+  for (int i = 3; i < param_grads[0].size(); ++i) {
+    EXPECT_NE(0, param_grads[1][i]->asum_diff());
+    for (int j = 0; j < param_grads[0][i]->count(); ++j) {
+      EXPECT_NEAR(param_grads[0][i]->cpu_diff()[j],
+          param_grads[1][i]->cpu_diff()[j], kErrorMargin *
+          std::max(Dtype(1), fabs(param_grads[0][i]->cpu_diff()[j])));
+    }
+  }
+}
+
+TYPED_TEST(NetTest, TestFuseBatchNormScaleRanges) {
+  typedef typename TypeParam::Dtype Dtype;
+  FillerParameter filler_param;
+  filler_param.set_std(1);
+  GaussianFiller<Dtype> filler(filler_param);
+  Caffe::set_random_seed(this->seed_);
+  this->InitBatchNormScaleNet("bn");
+  filler.Fill(this->net_->input_blobs()[0]);
+  filler.Fill(this->net_->input_blobs()[1]);
+  Blob<Dtype>* bn = this->net_->blob_by_name("bn").get();
+  // Layers: input, bn, scale, loss.
+  const Dtype loss = this->net_->ForwardBackward();
+  Blob<Dtype> scaled, unscaled;
+  scaled.CopyFrom(*bn, false, true);
+  vector<shared_ptr<Blob<Dtype> > > blob_grads[2], param_grads[2];
+  this->CopyNetBlobs(true, &blob_grads[0]);
+  this->CopyNetParams(true, &param_grads[0]);
+  const Dtype kErrorMargin = 1e-4;
+  // Ranges ending with the BatchNorm or starting with the Scale split them.
+  this->net_->ClearParamDiffs();
+  this->net_->ForwardTo(1);
+  unscaled.CopyFrom(*bn, false, true);
+  EXPECT_NEAR(loss, this->net_->ForwardFrom(2), kErrorMargin * loss);
+  this->net_->BackwardFromTo(3, 2);
+  this->net_->BackwardFrom(1);
+  this->CopyNetBlobs(true, &blob_grads[1]);
+  this->CopyNetParams(true, &param_grads[1]);
+  const Dtype* scale = this->net_->layers()[2]->blobs()[0]->cpu_data();
+  const Dtype* bias = this->net_->layers()[2]->blobs()[1]->cpu_data();
+  const int spatial_dim = bn->count(2);
+  for (int i = 0; i < bn->count(); ++i) {
+    const int c = (i / spatial_dim) % bn->channels();
+    EXPECT_NEAR(scaled.cpu_data()[i],
+        unscaled.cpu_data()[i] * scale[c] + bias[c], kErrorMargin);
+    EXPECT_NEAR(scaled.cpu_data()[i], bn->cpu_data()[i], kErrorMargin);
+  }
+  // The input diff and the parameter gradients match the fused ones.
+  for (int i = 0; i < blob_grads[0][0]->count(); ++i) {
+    EXPECT_NEAR(blob_grads[0][0]->cpu_diff()[i],
+        blob_grads[1][0]->cpu_diff()[i], kErrorMargin);
+  }
+  for (int i = 3; i < param_grads[0].size(); ++i) {
+    for (int j = 0; j < param_grads[0][i]->count(); ++j) {
+      EXPECT_NEAR(param_grads[0][i]->cpu_diff()[j],
+          param_grads[1][i]->cpu_diff()[j], kErrorMargin *
+          std::max(Dtype(1), fabs(param_grads[0][i]->cpu_diff()[j])));
+    }
+  }
+}
+
+TYPED_TEST(NetTest, TestAccumulateSplitDiffs) {
+  typedef typename TypeParam::Dtype Dtype;
+  // innerproduct1 feeds innerproduct2 and carries a loss weight itself.
+  const Dtype loss_weight = 2;
+  const Dtype midnet_loss_weight = 1;
+  const bool kForceBackward = true;
+  Dtype loss[2];
+  vector<shared_ptr<Blob<Dtype> > > param_grads[2];
+  vector<shared_ptr<Blob<Dtype> > > data_grads[2];
+  for (int accumulate = 0; accumulate < 2; ++accumulate) {
+    this->accumulate_split_diffs_ = accumulate;
+    Caffe::set_random_seed(this->seed_);
+    this->InitUnsharedWeightsNet(&loss_weight, &midnet_loss_weight,
+                                 kForceBackward);
+    loss[accumulate] = this->net_->ForwardBackward();
+    this->CopyNetParams(true, &param_grads[accumulate]);
+    this->CopyNetBlobs(true, &data_grads[accumulate]);
+  }
+  EXPECT_EQ(loss[0], loss[1]);
+  ASSERT_EQ(param_grads[0].size(), param_grads[1].size());
+  for (int i = 0; i < param_grads[0].size(); ++i) {
+    for (int j = 0; j < param_grads[0][i]->count(); ++j) {
+      EXPECT_EQ(param_grads[0][i]->cpu_diff()[j],
+                param_grads[1][i]->cpu_diff()[j]);
+    }
+  }
+  // The bottoms of the splits get the same sums.
+  const shared_ptr<Blob<Dtype> > split_bottom =
+      this->net_->blob_by_name("innerproduct1");
+  const int split_bottom_id = std::find(this->net_->blobs().begin(),
+      this->net_->blobs().end(), split_bottom) - this->net_->blobs().begin();
+  for (int j = 0; j < split_bottom->count(); ++j) {
+    EXPECT_EQ(data_grads[0][split_bottom_id]->cpu_diff()[j],
+              data_grads[1][split_bottom_id]->cpu_diff()[j]);
+  }
+  if (Caffe::mode() == Caffe::CPU) {
+    EXPECT_TRUE(split_bottom->diff() == this->net_->blob_by_name(
+        "innerproduct1_innerproduct1_0_split_1")->diff());
+  }
+}
+
+TYPED_TEST(NetTest, TestPerfCounters) {
+  this->InitTinyNet(true);
+  if (!this->net_->EnablePerfCounters()) {
+    // No PMU or perf_event_open not permitted: nothing is counted.
+    EXPECT_TRUE(this->net_->forward_perf().empty());
+    return;
+  }
+  this->net_->ForwardBackward();
+  const int num_layers = this->net_->layers().size();
+  ASSERT_EQ(num_layers, this->net_->forward_perf().size());
+  ASSERT_EQ(num_layers, this->net_->backward_perf().size());
+  for (int i = 0; i < num_layers; ++i) {
+    EXPECT_GT(this->net_->forward_perf()[i].instructions, 0);
+  }
+  this->net_->ClearPerfCounters();
+  EXPECT_EQ(0, this->net_->forward_perf()[0].instructions);
+}
+
 class FilterNetTest : public ::testing::Test {
  protected:
   void RunFilterNetTest(
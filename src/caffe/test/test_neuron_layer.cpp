@@ -21,6 +21,7 @@
 #include "caffe/layers/sigmoid_layer.hpp"
 #include "caffe/layers/tanh_layer.hpp"
 #include "caffe/layers/threshold_layer.hpp"
+#include "caffe/util/half.hpp"
 
 #ifdef USE_CUDNN
 #include "caffe/layers/cudnn_relu_layer.hpp"
@@ -220,6 +221,24 @@ TYPED_TEST(NeuronLayerTest, TestReLU) {
   }
 }
 
+TYPED_TEST(NeuronLayerTest, TestReLUHalfStorage) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  ReLULayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  // The bottom is rounded to fp16, the top to bf16.
+  this->blob_bottom_->set_storage(STORAGE_FP16);
+  this->blob_bottom_->mutable_cpu_storage_data();
+  this->blob_top_->set_storage(STORAGE_BF16);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  const Dtype* bottom_data = this->blob_bottom_->cpu_data();
+  const uint16_t* top_data =
+      static_cast<const uint16_t*>(this->blob_top_->cpu_storage_data());
+  for (int i = 0; i < this->blob_bottom_->count(); ++i) {
+    EXPECT_EQ(float_to_bf16(std::max(bottom_data[i], Dtype(0))), top_data[i]);
+  }
+}
+
 TYPED_TEST(NeuronLayerTest, TestReLUGradient) {
   typedef typename TypeParam::Dtype Dtype;
   LayerParameter layer_param;
@@ -281,6 +300,32 @@ TYPED_TEST(NeuronLayerTest, TestELU) {
   }
 }
 
+TYPED_TEST(NeuronLayerTest, TestELUInPlaceKeepsDiff) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  CHECK(google::protobuf::TextFormat::ParseFromString(
+      "elu_param { alpha: 0.5 }", &layer_param));
+  // More values than the layer computes at a time.
+  Blob<Dtype> blob(3, 5, 17, 19);
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  filler.Fill(&blob);
+  Blob<Dtype> bottom;
+  bottom.CopyFrom(blob, false, true);
+  caffe_set(blob.count(), Dtype(7), blob.mutable_cpu_diff());
+  vector<Blob<Dtype>*> blob_vec(1, &blob);
+  ELULayer<Dtype> layer(layer_param);
+  layer.SetUp(blob_vec, blob_vec);
+  layer.Forward(blob_vec, blob_vec);
+  const Dtype kDelta = 2e-4;
+  for (int i = 0; i < blob.count(); ++i) {
+    const Dtype x = bottom.cpu_data()[i];
+    EXPECT_NEAR(x > 0 ? x : 0.5 * (exp(x) - 1), blob.cpu_data()[i], kDelta);
+    // The diff of the top, e.g. when recomputed during backward, is kept.
+    EXPECT_EQ(7, blob.cpu_diff()[i]);
+  }
+}
+
 TYPED_TEST(NeuronLayerTest, TestELUasReLU) {
   typedef typename TypeParam::Dtype Dtype;
   LayerParameter layer_param;
@@ -1,3 +1,5 @@
+#include <algorithm>
+#include <cfloat>
 #include <vector>
 
 #include "gtest/gtest.h"
@@ -6,6 +8,7 @@
 #include "caffe/common.hpp"
 #include "caffe/filler.hpp"
 #include "caffe/layers/pooling_layer.hpp"
+#include "caffe/util/half.hpp"
 
 #ifdef USE_CUDNN
 #include "caffe/layers/cudnn_pooling_layer.hpp"
@@ -456,6 +459,39 @@ TYPED_TEST(PoolingLayerTest, TestForwardMaxTopMask) {
   this->TestForwardRectWide();
 }
 
+TYPED_TEST(PoolingLayerTest, TestForwardHalfStorage) {
+  typedef typename TypeParam::Dtype Dtype;
+  // fp16 bottom, bf16 top: pools as the Dtype layer does on the rounded
+  // bottom.
+  this->blob_bottom_->set_storage(STORAGE_FP16);
+  this->blob_bottom_->mutable_cpu_storage_data();
+  Blob<Dtype> rounded;
+  rounded.CopyFrom(*this->blob_bottom_, false, true);
+  vector<Blob<Dtype>*> rounded_vec(1, &rounded);
+  Blob<Dtype> reference;
+  vector<Blob<Dtype>*> reference_vec(1, &reference);
+  for (int pool = PoolingParameter_PoolMethod_MAX;
+       pool <= PoolingParameter_PoolMethod_AVE; ++pool) {
+    LayerParameter layer_param;
+    PoolingParameter* pooling_param = layer_param.mutable_pooling_param();
+    pooling_param->set_kernel_size(3);
+    pooling_param->set_stride(2);
+    pooling_param->set_pad(1);
+    pooling_param->set_pool(static_cast<PoolingParameter_PoolMethod>(pool));
+    PoolingLayer<Dtype> layer(layer_param);
+    layer.SetUp(rounded_vec, reference_vec);
+    layer.Forward(rounded_vec, reference_vec);
+    layer.Reshape(this->blob_bottom_vec_, this->blob_top_vec_);
+    this->blob_top_->set_storage(STORAGE_BF16);
+    layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+    const uint16_t* top_data =
+        static_cast<const uint16_t*>(this->blob_top_->cpu_storage_data());
+    for (int i = 0; i < reference.count(); ++i) {
+      EXPECT_EQ(float_to_bf16(reference.cpu_data()[i]), top_data[i]);
+    }
+  }
+}
+
 TYPED_TEST(PoolingLayerTest, TestGradientMax) {
   typedef typename TypeParam::Dtype Dtype;
   for (int kernel_h = 3; kernel_h <= 4; kernel_h++) {
@@ -609,6 +645,94 @@ TYPED_TEST(PoolingLayerTest, TestGradientAvePadded) {
   }
 }
 
+TYPED_TEST(PoolingLayerTest, TestGradientAveExactFit) {
+  typedef typename TypeParam::Dtype Dtype;
+  // Overlapping windows covering the input exactly, without padding.
+  this->blob_bottom_->Reshape(2, 3, 7, 5);
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  filler.Fill(this->blob_bottom_);
+  LayerParameter layer_param;
+  PoolingParameter* pooling_param = layer_param.mutable_pooling_param();
+  pooling_param->set_kernel_size(3);
+  pooling_param->set_stride(2);
+  pooling_param->set_pool(PoolingParameter_PoolMethod_AVE);
+  PoolingLayer<Dtype> layer(layer_param);
+  GradientChecker<Dtype> checker(1e-2, 1e-2);
+  checker.CheckGradientExhaustive(&layer, this->blob_bottom_vec_,
+      this->blob_top_vec_);
+}
+
+TYPED_TEST(PoolingLayerTest, TestForwardWideRows) {
+  typedef typename TypeParam::Dtype Dtype;
+  // Rows spanning several vectors and ending in a partial one.
+  const int height = 5;
+  const int width = 37;
+  this->blob_bottom_->Reshape(2, 3, height, width);
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  filler.Fill(this->blob_bottom_);
+  this->blob_top_vec_.push_back(this->blob_top_mask_);
+  for (int i = 0; i < 8; ++i) {
+    const bool max_pool = i & 1;
+    const int stride = 1 + (i >> 1 & 1);
+    const int pad = i >> 2;
+    LayerParameter layer_param;
+    PoolingParameter* pooling_param = layer_param.mutable_pooling_param();
+    pooling_param->set_kernel_size(3);
+    pooling_param->set_stride(stride);
+    pooling_param->set_pad(pad);
+    pooling_param->set_pool(max_pool ? PoolingParameter_PoolMethod_MAX :
+                                       PoolingParameter_PoolMethod_AVE);
+    PoolingLayer<Dtype> layer(layer_param);
+    vector<Blob<Dtype>*> top(this->blob_top_vec_.begin(),
+        this->blob_top_vec_.begin() + (max_pool ? 2 : 1));
+    layer.SetUp(this->blob_bottom_vec_, top);
+    layer.Forward(this->blob_bottom_vec_, top);
+    const int pooled_height = this->blob_top_->height();
+    const int pooled_width = this->blob_top_->width();
+    for (int plane = 0; plane < 6; ++plane) {
+      const Dtype* bottom_data =
+          this->blob_bottom_->cpu_data() + plane * height * width;
+      const int top_offset = plane * pooled_height * pooled_width;
+      for (int ph = 0; ph < pooled_height; ++ph) {
+        for (int pw = 0; pw < pooled_width; ++pw) {
+          int hstart = ph * stride - pad;
+          int wstart = pw * stride - pad;
+          int hend = std::min(hstart + 3, height + pad);
+          int wend = std::min(wstart + 3, width + pad);
+          const int pool_size = (hend - hstart) * (wend - wstart);
+          hstart = std::max(hstart, 0);
+          wstart = std::max(wstart, 0);
+          hend = std::min(hend, height);
+          wend = std::min(wend, width);
+          Dtype expected = max_pool ? -FLT_MAX : 0;
+          int expected_index = -1;
+          for (int h = hstart; h < hend; ++h) {
+            for (int w = wstart; w < wend; ++w) {
+              const Dtype value = bottom_data[h * width + w];
+              if (!max_pool) {
+                expected += value;
+              } else if (value > expected) {
+                expected = value;
+                expected_index = h * width + w;
+              }
+            }
+          }
+          const int index = top_offset + ph * pooled_width + pw;
+          if (max_pool) {
+            EXPECT_EQ(expected, this->blob_top_->cpu_data()[index]);
+            EXPECT_EQ(expected_index, this->blob_top_mask_->cpu_data()[index]);
+          } else {
+            EXPECT_NEAR(expected / pool_size,
+                this->blob_top_->cpu_data()[index], 1e-5);
+          }
+        }
+      }
+    }
+  }
+}
+
 #ifdef USE_CUDNN
 template <typename Dtype>
 class CuDNNPoolingLayerTest : public GPUDeviceTest<Dtype> {
@@ -1,10 +1,16 @@
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
 #include <cmath>
+#include <vector>
 
 #include "gtest/gtest.h"
 
 #include "caffe/common.hpp"
 #include "caffe/syncedmem.hpp"
 #include "caffe/util/math_functions.hpp"
+#include "caffe/util/rng.hpp"
 
 #include "caffe/test/test_caffe_main.hpp"
 
@@ -395,6 +401,60 @@ TYPED_TEST(RandomNumberGeneratorTest, TestRngBernoulliTimesBernoulli) {
   EXPECT_NEAR(true_mean, sample_p, bound);
 }
 
+TYPED_TEST(RandomNumberGeneratorTest, TestRngBernoulliBits) {
+  const TypeParam p = 0.3;
+  int* bernoulli_data = static_cast<int*>(this->int_data_->mutable_cpu_data());
+  this->RngBernoulliFill(p, bernoulli_data);
+  Caffe::set_random_seed(this->seed_);
+  const int words = (this->sample_size_ + 31) / 32;
+  vector<unsigned int> bits(words);
+  caffe_rng_bernoulli_bits(this->sample_size_, p, &bits[0]);
+  for (int i = 0; i < this->sample_size_; ++i) {
+    EXPECT_EQ(bernoulli_data[i], (bits[i / 32] >> (i % 32)) & 1);
+  }
+  // The bits past the end are clear.
+  EXPECT_EQ(0, bits[words - 1] >> (this->sample_size_ % 32));
+}
+
+#ifdef _OPENMP
+TYPED_TEST(RandomNumberGeneratorTest, TestRngBernoulliThreadCount) {
+  const TypeParam p = 0.5;
+  const int num_threads = omp_get_max_threads();
+  omp_set_num_threads(1);
+  int* bernoulli_data = static_cast<int*>(this->int_data_->mutable_cpu_data());
+  this->RngBernoulliFill(p, bernoulli_data);
+  omp_set_num_threads(4);
+  Caffe::set_random_seed(this->seed_);
+  int* bernoulli_data_2 =
+      static_cast<int*>(this->int_data_2_->mutable_cpu_data());
+  this->RngBernoulliFill(p, bernoulli_data_2);
+  omp_set_num_threads(num_threads);
+  for (int i = 0; i < this->sample_size_; ++i) {
+    EXPECT_EQ(bernoulli_data[i], bernoulli_data_2[i]);
+  }
+}
+#endif
+
+TEST(PhiloxTest, TestKnownAnswers) {
+  // From the Random123 known-answer tests.
+  const uint32_t zero_counter[4] = {0, 0, 0, 0};
+  const uint32_t zero_key[2] = {0, 0};
+  uint32_t out[4];
+  philox4x32(zero_counter, zero_key, out);
+  EXPECT_EQ(0x6627e8d5, out[0]);
+  EXPECT_EQ(0xe169c58d, out[1]);
+  EXPECT_EQ(0xbc57ac4c, out[2]);
+  EXPECT_EQ(0x9b00dbd8, out[3]);
+  const uint32_t ones_counter[4] =
+      {0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff};
+  const uint32_t ones_key[2] = {0xffffffff, 0xffffffff};
+  philox4x32(ones_counter, ones_key, out);
+  EXPECT_EQ(0x408f276d, out[0]);
+  EXPECT_EQ(0x41c83b0e, out[1]);
+  EXPECT_EQ(0xa20bc7c6, out[2]);
+  EXPECT_EQ(0x6d5451fd, out[3]);
+}
+
 #ifndef CPU_ONLY
 
 TYPED_TEST(RandomNumberGeneratorTest, TestRngGaussianGPU) {
@@ -2,9 +2,14 @@
 #include <glog/logging.h>
 #include <gmock/gmock.h>
 #include <gtest/gtest.h>
+#include <string>
 #include <vector>
+#include "google/protobuf/text_format.h"
+
 #include "caffe/internode/configuration.hpp"
+#include "caffe/net.hpp"
 #include "caffe/serialization/BlobCodec.hpp"
+#include "caffe/util/half.hpp"
 #include "caffe/util/math_functions.hpp"
 
 namespace caffe {
@@ -298,6 +303,111 @@ TEST(BlobCodecTest, encode_decode_4width_data_alpha_0_beta_1) {
           sizeof(float)*dstblob.count()));
 }
 
+TEST(BlobCodecTest, half_conversions) {
+  EXPECT_EQ(0x3F80, float_to_bf16(1.0f));
+  // ties round to even
+  EXPECT_EQ(0x3F80, float_to_bf16(1.00390625f));
+  EXPECT_EQ(0x3F82, float_to_bf16(1.01171875f));
+  EXPECT_EQ(-2.5f, bf16_to_float(float_to_bf16(-2.5f)));
+  EXPECT_TRUE(std::isnan(bf16_to_float(float_to_bf16(NAN))));
+
+  EXPECT_EQ(0x3C00, float_to_fp16(1.0f));
+  EXPECT_EQ(0xC100, float_to_fp16(-2.5f));
+  EXPECT_EQ(0x7BFF, float_to_fp16(65504.f));
+  EXPECT_EQ(0x7C00, float_to_fp16(65520.f));
+  EXPECT_EQ(0x0001, float_to_fp16(5.9604645e-08f));
+  EXPECT_EQ(0x0400, float_to_fp16(6.1035156e-05f));
+  EXPECT_EQ(0x3C00, float_to_fp16(1.00048828125f));
+  EXPECT_EQ(65504.f, fp16_to_float(0x7BFF));
+  EXPECT_EQ(5.9604645e-08f, fp16_to_float(0x0001));
+  EXPECT_EQ(-2.5f, fp16_to_float(0xC100));
+  EXPECT_TRUE(std::isinf(fp16_to_float(0x7C00)));
+  EXPECT_TRUE(std::isnan(fp16_to_float(float_to_fp16(NAN))));
+}
+
+TEST(BlobCodecTest, encode_decode_4width_diff_bf16) {
+  BlobUpdate msg;
+  Blob<float> srcblob;
+  Blob<float> dstblob;
+  vector<int> v = boost::assign::list_of(1)(1)(1)(4);
+  srcblob.Reshape(v);
+  dstblob.Reshape(v);
+  vector<float> diff = boost::assign::list_of(1.0)(-2.5)(0.15625)(384.0);
+  caffe_copy<float>(srcblob.count(), &diff.front(),
+          srcblob.mutable_cpu_diff());
+
+  MultinodeParameter param;
+  param.mutable_outgoing_compression()->set_algo(COMPRESSION_BF16);
+  shared_ptr<BlobCodec<float> > codec =
+    BlobCodec<float>::create_codec(param, true);
+
+  codec->encode(&msg, &srcblob, BlobEncoding::GRADS, msg.info().part());
+  EXPECT_EQ(sizeof(uint16_t) * srcblob.count(), msg.data().size());
+  EXPECT_TRUE(codec->decode(msg, &dstblob, BlobEncoding::GRADS, 1.0f, 0.0f));
+
+  EXPECT_EQ(0, memcmp(dstblob.cpu_diff(), &diff.front(),
+          sizeof(float)*dstblob.count()));
+}
+
+TEST(BlobCodecTest, encode_decode_4width_data_fp16_alpha_0_5_beta_0_5) {
+  BlobUpdate msg;
+  Blob<float> srcblob;
+  Blob<float> dstblob;
+  vector<int> v = boost::assign::list_of(1)(1)(1)(4);
+  srcblob.Reshape(v);
+  dstblob.Reshape(v);
+  vector<float> data = boost::assign::list_of(4.0)(-3.25)(0.125)(65504.0);
+  vector<float> data_one = boost::assign::list_of(1.0)(1.0)(1.0)(1.0);
+  vector<float> data_expected =
+    boost::assign::list_of(2.5)(-1.125)(0.5625)(32752.5);
+  caffe_copy<float>(srcblob.count(), &data.front(),
+          srcblob.mutable_cpu_data());
+  caffe_copy<float>(dstblob.count(), &data_one.front(),
+          dstblob.mutable_cpu_data());
+
+  MultinodeParameter param;
+  param.mutable_outgoing_compression()->set_algo(COMPRESSION_FP16);
+  shared_ptr<BlobCodec<float> > codec =
+    BlobCodec<float>::create_codec(param, false);
+
+  codec->encode(&msg, &srcblob, BlobEncoding::PARAMS, msg.info().part());
+  EXPECT_EQ(sizeof(uint16_t) * srcblob.count(), msg.data().size());
+  EXPECT_TRUE(
+    codec->decode(msg, &dstblob, BlobEncoding::PARAMS, 0.5f, 0.5f));
+
+  EXPECT_EQ(0, memcmp(dstblob.cpu_data(), &data_expected.front(),
+          sizeof(float)*dstblob.count()));
+}
+
+TEST(BlobCodecTest, layer_comm_compression) {
+  const string proto =
+    "layer { name: 'data' type: 'DummyData' top: 'data' "
+    "  dummy_data_param { shape { dim: 2 dim: 3 } } } "
+    "layer { name: 'ip1' type: 'InnerProduct' bottom: 'data' top: 'ip1' "
+    "  inner_product_param { num_output: 2 } "
+    "  comm_compression { algo: COMPRESSION_BF16 } } "
+    "layer { name: 'ip2' type: 'InnerProduct' bottom: 'ip1' top: 'ip2' "
+    "  inner_product_param { num_output: 2 } } ";
+  NetParameter net_param;
+  ASSERT_TRUE(google::protobuf::TextFormat::ParseFromString(proto,
+    &net_param));
+  Net<float> net(net_param);
+  shared_ptr<BlobCodec<float> > codec = BlobCodec<float>::create_codec(
+    MultinodeParameter::default_instance(), true, &net);
+
+  BlobUpdate msg;
+  msg.mutable_info()->set_layer_id(1);
+  codec->encode(&msg, net.layers()[1]->blobs()[0].get(),
+    BlobEncoding::PARAMS, 0);
+  EXPECT_EQ(COMPRESSION_BF16, msg.compression_param().algo());
+  EXPECT_EQ(sizeof(uint16_t) * 6, msg.data().size());
+
+  msg.mutable_info()->set_layer_id(2);
+  codec->encode(&msg, net.layers()[2]->blobs()[0].get(),
+    BlobEncoding::PARAMS, 0);
+  EXPECT_EQ(COMPRESSION_NONE, msg.compression_param().algo());
+  EXPECT_EQ(sizeof(float) * 4, msg.data().size());
+}
 
 }  // namespace
 }  // namespace caffe
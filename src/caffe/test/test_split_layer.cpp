@@ -10,6 +10,7 @@
 #include "caffe/layers/split_layer.hpp"
 #include "caffe/proto/caffe.pb.h"
 #include "caffe/util/insert_splits.hpp"
+#include "caffe/util/math_functions.hpp"
 
 #include "caffe/test/test_caffe_main.hpp"
 #include "caffe/test/test_gradient_check_util.hpp"
@@ -84,6 +85,40 @@ TYPED_TEST(SplitLayerTest, TestGradient) {
       this->blob_top_vec_);
 }
 
+TYPED_TEST(SplitLayerTest, TestBackwardTops) {
+  typedef typename TypeParam::Dtype Dtype;
+  if (Caffe::mode() != Caffe::CPU) {
+    return;
+  }
+  Blob<Dtype> top_c;
+  this->blob_top_vec_.push_back(&top_c);
+  LayerParameter layer_param;
+  SplitLayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  // The diff of b is not computed, that of a goes to the bottom directly.
+  vector<bool> top_need_backward(3, true);
+  top_need_backward[1] = false;
+  layer.SetBackwardTops(top_need_backward, 0);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  EXPECT_TRUE(this->blob_top_a_->diff() == this->blob_bottom_->diff());
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  Blob<Dtype> diff(top_c.shape());
+  for (int i = 0; i < this->blob_top_vec_.size(); ++i) {
+    filler.Fill(&diff);
+    caffe_copy(diff.count(), diff.cpu_data(),
+        this->blob_top_vec_[i]->mutable_cpu_diff());
+  }
+  vector<Dtype> expected(top_c.count());
+  for (int i = 0; i < top_c.count(); ++i) {
+    expected[i] = this->blob_top_a_->cpu_diff()[i] + top_c.cpu_diff()[i];
+  }
+  layer.Backward(this->blob_top_vec_, vector<bool>(1, true),
+      this->blob_bottom_vec_);
+  for (int i = 0; i < top_c.count(); ++i) {
+    EXPECT_EQ(expected[i], this->blob_bottom_->cpu_diff()[i]);
+  }
+}
 
 class SplitLayerInsertionTest : public ::testing::Test {
  protected:
@@ -0,0 +1,79 @@
+#include <boost/thread.hpp>
+
+#include <sstream>
+#include <string>
+
+#include "gtest/gtest.h"
+
+#include "caffe/common.hpp"
+#include "caffe/util/trace.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+class TraceTest : public ::testing::Test {
+ protected:
+  virtual void TearDown() {
+    Tracer::Disable();
+    Tracer::Clear();
+  }
+
+  int Count(const string& text, const string& pattern) {
+    int count = 0;
+    for (size_t pos = text.find(pattern); pos != string::npos;
+        pos = text.find(pattern, pos + 1)) {
+      ++count;
+    }
+    return count;
+  }
+
+  static void RecordSpans(int count) {
+    for (int i = 0; i < count; ++i) {
+      TraceSpan span("test", "thread");
+    }
+  }
+};
+
+TEST_F(TraceTest, TestDisabled) {
+  {
+    TraceSpan span("test", "disabled");
+  }
+  std::ostringstream trace;
+  Tracer::Dump(&trace);
+  EXPECT_EQ(0, Count(trace.str(), "disabled"));
+}
+
+TEST_F(TraceTest, TestDump) {
+  Tracer::Enable("", 16);
+  {
+    TraceSpan span("test", "outer");
+    TraceSpan inner("test", "inner", "\"quoted\"");
+  }
+  std::ostringstream trace;
+  Tracer::Dump(&trace);
+  const string json = trace.str();
+  EXPECT_EQ(0, json.find("{\"traceEvents\": ["));
+  EXPECT_EQ(1, Count(json, "\"name\": \"outer\", \"cat\": \"test\", "
+      "\"ph\": \"X\""));
+  EXPECT_EQ(1, Count(json, "\"name\": \"inner \\\"quoted\\\"\""));
+  EXPECT_EQ(2, Count(json, "\"dur\": "));
+}
+
+TEST_F(TraceTest, TestRingBufferPerThread) {
+  Tracer::Enable("", 16);
+  boost::thread thread(&TraceTest::RecordSpans, 5);
+  thread.join();
+  for (int i = 0; i < 40; ++i) {
+    TraceSpan span("test", "main", i < 24 ? "old" : "new");
+  }
+  std::ostringstream trace;
+  Tracer::Dump(&trace);
+  const string json = trace.str();
+  // The spans of the thread outlive it; the main thread keeps its last 16.
+  EXPECT_EQ(5, Count(json, "\"thread\""));
+  EXPECT_EQ(0, Count(json, "\"main old\""));
+  EXPECT_EQ(16, Count(json, "\"main new\""));
+}
+
+}  // namespace caffe
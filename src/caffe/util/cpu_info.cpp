@@ -1,5 +1,7 @@
 #include <glog/logging.h>
+#include <algorithm>
 #include <set>
+#include <utility>
 #include <vector>
 #include "caffe/util/cpu_info.hpp"
 
@@ -206,6 +208,35 @@ void OpenMpManager::bindCurrentThreadToNonPrimaryCoreIfPossible() {
   }
 }
 
+// Bind given thread to one of the logical CPUs left to hyper-threading
+// siblings, which OpenMP threads are not bound to, so that communication
+// threads do not compete with computation. Without such CPUs behave like
+// bindCurrentThreadToNonPrimaryCoreIfPossible()
+void OpenMpManager::bindCurrentThreadToSpareCpuIfPossible(unsigned threadId) {
+  OpenMpManager &openMpManager = getInstance();
+  if (!openMpManager.isThreadsBindAllowed())
+    return;
+
+  unsigned numberOfProcessors = Collection::getNumberOfProcessors();
+  std::vector<unsigned> spareProcessors;
+  for (int processorId = 0; processorId < numberOfProcessors; processorId++) {
+    if (CPU_ISSET(processorId, &openMpManager.currentCpuSet) &&
+        !CPU_ISSET(processorId, &openMpManager.currentCoreSet)) {
+      spareProcessors.push_back(processorId);
+    }
+  }
+
+  if (spareProcessors.empty()) {
+    bindCurrentThreadToNonPrimaryCoreIfPossible();
+    return;
+  }
+
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(spareProcessors[threadId % spareProcessors.size()], &set);
+  sched_setaffinity(0, sizeof(set), &set);
+}
+
 void OpenMpManager::bindOpenMpThreads() {
   OpenMpManager &openMpManager = getInstance();
 
@@ -220,6 +251,45 @@ void OpenMpManager::bindOpenMpThreads() {
   }
 }
 
+// Split the available cores, ordered by socket, into contiguous partitions,
+// and bind the calling thread and its OpenMP threads to the cores of one of
+// them, one thread per core. With as many partitions as sockets, each one is
+// a socket, e.g. for independent replicas of a model
+void OpenMpManager::bindOpenMpThreadsToPartition(unsigned partition,
+    unsigned numberOfPartitions) {
+  OpenMpManager &openMpManager = getInstance();
+
+  if (!openMpManager.isThreadsBindAllowed())
+    return;
+
+  // (socket, processor) of the first CPU of each core
+  std::vector<std::pair<unsigned, unsigned> > cores;
+  unsigned numberOfProcessors = Collection::getNumberOfProcessors();
+  for (int processorId = 0; processorId < numberOfProcessors; processorId++) {
+    if (CPU_ISSET(processorId, &openMpManager.currentCoreSet)) {
+      unsigned socketId = Collection::getProcessor(processorId).physicalId;
+      cores.push_back(std::make_pair(socketId, processorId));
+    }
+  }
+  std::sort(cores.begin(), cores.end());
+
+  unsigned begin = cores.size() * partition / numberOfPartitions;
+  unsigned end = cores.size() * (partition + 1) / numberOfPartitions;
+  if (begin == end) {
+    // more partitions than cores
+    begin = partition % cores.size();
+    end = begin + 1;
+  }
+  omp_set_num_threads(end - begin);
+  #pragma omp parallel
+  {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cores[begin + omp_get_thread_num()].second, &set);
+    sched_setaffinity(0, sizeof(set), &set);
+  }
+}
+
 void OpenMpManager::getOpenMpEnvVars() {
   isAnyOpenMpEnvVarSpecified = false;
   for (unsigned i = 0; i < numberOfOpenMpEnvVars; i++) {
@@ -0,0 +1,227 @@
+#include <fcntl.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstring>
+#include <fstream>  // NOLINT(readability/streams)
+#include <string>
+#include <vector>
+
+#include "caffe/util/flat_weights.hpp"
+
+namespace caffe {
+
+namespace {
+
+const char kFlatWeightsMagic[8] = {'C', 'A', 'F', 'F', 'E', 'F', 'L', 'T'};
+const uint32_t kFlatWeightsVersion = 1;
+
+struct FlatWeightsHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t index_size;
+  uint64_t file_size;
+  char reserved[kFlatWeightsAlignment - 24];
+};
+
+size_t align(size_t offset) {
+  return (offset + kFlatWeightsAlignment - 1)
+    / kFlatWeightsAlignment * kFlatWeightsAlignment;
+}
+
+uint64_t shape_count(const BlobShape& shape) {
+  uint64_t count = 1;
+  for (int i = 0; i < shape.dim_size(); ++i) {
+    count *= shape.dim(i);
+  }
+  return count;
+}
+
+size_t tensor_size(const FlatWeightsIndex::Tensor& tensor) {
+  return shape_count(tensor.shape())
+    * (tensor.double_data() ? sizeof(double) : sizeof(float));
+}
+
+void get_shape(const BlobProto& proto, FlatWeightsIndex::Tensor* tensor) {
+  BlobShape* shape = tensor->mutable_shape();
+  if (proto.has_num() || proto.has_channels() ||
+      proto.has_height() || proto.has_width()) {
+    // Using deprecated 4D Blob dimensions
+    shape->add_dim(proto.num());
+    shape->add_dim(proto.channels());
+    shape->add_dim(proto.height());
+    shape->add_dim(proto.width());
+    tensor->set_legacy_shape(true);
+  } else {
+    shape->CopyFrom(proto.shape());
+  }
+}
+
+}  // namespace
+
+bool IsFlatWeightsFile(const string& filename) {
+  const string extension(".caffeflat");
+  return filename.size() >= extension.size() &&
+    filename.compare(filename.size() - extension.size(),
+                     extension.size(), extension) == 0;
+}
+
+void WriteFlatWeights(const NetParameter& param, const string& filename) {
+  FlatWeightsIndex index;
+  index.set_name(param.name());
+  vector<const char*> tensor_data;
+  for (int i = 0; i < param.layer_size(); ++i) {
+    const LayerParameter& layer = param.layer(i);
+    for (int j = 0; j < layer.blobs_size(); ++j) {
+      const BlobProto& blob = layer.blobs(j);
+      FlatWeightsIndex::Tensor* tensor = index.add_tensor();
+      tensor->set_layer(layer.name());
+      tensor->set_param(j);
+      get_shape(blob, tensor);
+      tensor->set_double_data(blob.double_data_size() > 0);
+      // set now, as the index size does not depend on fixed64 values
+      tensor->set_offset(0);
+      uint64_t count = shape_count(tensor->shape());
+      if (tensor->double_data()) {
+        CHECK_EQ(count, blob.double_data_size())
+          << "Blob " << j << " of layer " << layer.name() << " is corrupted";
+        tensor_data.push_back(
+          reinterpret_cast<const char*>(blob.double_data().data()));
+      } else {
+        CHECK_EQ(count, blob.data_size())
+          << "Blob " << j << " of layer " << layer.name() << " is corrupted";
+        tensor_data.push_back(
+          reinterpret_cast<const char*>(blob.data().data()));
+      }
+    }
+  }
+  FlatWeightsHeader header = FlatWeightsHeader();
+  memcpy(header.magic, kFlatWeightsMagic,  // NOLINT(caffe/alt_fn)
+    sizeof(header.magic));
+  header.version = kFlatWeightsVersion;
+  header.index_size = index.ByteSize();
+  size_t offset = sizeof(header) + header.index_size;
+  for (int i = 0; i < index.tensor_size(); ++i) {
+    offset = align(offset);
+    index.mutable_tensor(i)->set_offset(offset);
+    offset += tensor_size(index.tensor(i));
+  }
+  header.file_size = offset;
+  CHECK_EQ(header.index_size, index.ByteSize());
+
+  std::ofstream out(filename.c_str(),
+    std::ios::out | std::ios::trunc | std::ios::binary);
+  CHECK(out.good()) << "Couldn't open " << filename << " to save weights.";
+  out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  CHECK(index.SerializeToOstream(&out));
+  const char padding[kFlatWeightsAlignment] = {};
+  offset = sizeof(header) + header.index_size;
+  for (int i = 0; i < index.tensor_size(); ++i) {
+    out.write(padding, index.tensor(i).offset() - offset);
+    out.write(tensor_data[i], tensor_size(index.tensor(i)));
+    offset = index.tensor(i).offset() + tensor_size(index.tensor(i));
+  }
+  CHECK(out.good()) << "Error saving weights to " << filename << ".";
+}
+
+void GetFlatTensorShape(const FlatWeightsIndex::Tensor& tensor,
+                        BlobProto* proto) {
+  if (tensor.legacy_shape()) {
+    CHECK_EQ(tensor.shape().dim_size(), 4);
+    proto->set_num(tensor.shape().dim(0));
+    proto->set_channels(tensor.shape().dim(1));
+    proto->set_height(tensor.shape().dim(2));
+    proto->set_width(tensor.shape().dim(3));
+  } else {
+    proto->mutable_shape()->CopyFrom(tensor.shape());
+  }
+}
+
+void ReadFlatWeights(const string& filename, NetParameter* param) {
+  MappedFlatWeights weights(filename);
+  const FlatWeightsIndex& index = weights.index();
+  param->Clear();
+  param->set_name(index.name());
+  for (int i = 0; i < index.tensor_size(); ++i) {
+    const FlatWeightsIndex::Tensor& tensor = index.tensor(i);
+    if ((param->layer_size() == 0) ||
+        (param->layer(param->layer_size() - 1).name() != tensor.layer())) {
+      param->add_layer()->set_name(tensor.layer());
+    }
+    LayerParameter* layer = param->mutable_layer(param->layer_size() - 1);
+    CHECK_EQ(tensor.param(), layer->blobs_size())
+      << "Params of layer " << tensor.layer() << " are out of order in "
+      << filename;
+    BlobProto* blob = layer->add_blobs();
+    GetFlatTensorShape(tensor, blob);
+    uint64_t count = shape_count(tensor.shape());
+    if (tensor.double_data()) {
+      const double* data = static_cast<const double*>(weights.data(i));
+      blob->mutable_double_data()->Reserve(count);
+      for (uint64_t k = 0; k < count; ++k) {
+        blob->add_double_data(data[k]);
+      }
+    } else {
+      const float* data = static_cast<const float*>(weights.data(i));
+      blob->mutable_data()->Reserve(count);
+      for (uint64_t k = 0; k < count; ++k) {
+        blob->add_data(data[k]);
+      }
+    }
+  }
+}
+
+MappedFlatWeights::MappedFlatWeights(const string& filename)
+  : filename_(filename)
+  , addr_(NULL)
+  , length_(0) {
+  int fd = open(filename.c_str(), O_RDONLY);
+  CHECK_NE(fd, -1) << "Couldn't open " << filename;
+  struct stat st;
+  CHECK_EQ(fstat(fd, &st), 0) << "Couldn't stat " << filename;
+  length_ = st.st_size;
+  CHECK_GE(length_, sizeof(FlatWeightsHeader))
+    << filename << " is not a flat weights file";
+  // private and writable: pages are shared with the page cache until
+  // written to, e.g. by training
+  void* addr = mmap(NULL, length_, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+  close(fd);
+  CHECK(addr != MAP_FAILED) << "Couldn't map " << filename;
+  addr_ = static_cast<char*>(addr);
+
+  const FlatWeightsHeader* header =
+    reinterpret_cast<const FlatWeightsHeader*>(addr_);
+  CHECK_EQ(memcmp(header->magic, kFlatWeightsMagic, sizeof(header->magic)), 0)
+    << filename << " is not a flat weights file";
+  CHECK_EQ(header->version, kFlatWeightsVersion)
+    << "Unsupported flat weights version in " << filename;
+  CHECK_EQ(header->file_size, length_) << filename << " is truncated";
+  CHECK_LE(sizeof(*header) + header->index_size, length_)
+    << filename << " is corrupted";
+  CHECK(index_.ParseFromArray(addr_ + sizeof(*header), header->index_size))
+    << "Couldn't parse the index of " << filename;
+  for (int i = 0; i < index_.tensor_size(); ++i) {
+    const FlatWeightsIndex::Tensor& tensor = index_.tensor(i);
+    CHECK_EQ(tensor.offset() % kFlatWeightsAlignment, 0)
+      << "Misaligned blob " << tensor.param() << " of layer "
+      << tensor.layer() << " in " << filename;
+    CHECK_LE(tensor.offset() + tensor_size(tensor), length_)
+      << filename << " is corrupted";
+  }
+}
+
+MappedFlatWeights::~MappedFlatWeights() {
+  munmap(addr_, length_);
+}
+
+void* MappedFlatWeights::data(int tensor) const {
+  return addr_ + index_.tensor(tensor).offset();
+}
+
+size_t MappedFlatWeights::size(int tensor) const {
+  return tensor_size(index_.tensor(tensor));
+}
+
+}  // namespace caffe
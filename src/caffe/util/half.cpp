@@ -0,0 +1,93 @@
+#include "caffe/util/half.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+void caffe_cpu_to_bf16(int n, const Dtype* x, uint16_t* y) {
+#ifdef _OPENMP
+  #pragma omp parallel for
+#endif
+  for (int i = 0; i < n; ++i) {
+    y[i] = float_to_bf16(static_cast<float>(x[i]));
+  }
+}
+
+template <typename Dtype>
+void caffe_cpu_from_bf16(int n, const uint16_t* x, Dtype* y) {
+#ifdef _OPENMP
+  #pragma omp parallel for
+#endif
+  for (int i = 0; i < n; ++i) {
+    y[i] = bf16_to_float(x[i]);
+  }
+}
+
+template <typename Dtype>
+void caffe_cpu_to_fp16(int n, const Dtype* x, uint16_t* y) {
+#ifdef _OPENMP
+  #pragma omp parallel for
+#endif
+  for (int i = 0; i < n; ++i) {
+    y[i] = float_to_fp16(static_cast<float>(x[i]));
+  }
+}
+
+template <typename Dtype>
+void caffe_cpu_from_fp16(int n, const uint16_t* x, Dtype* y) {
+#ifdef _OPENMP
+  #pragma omp parallel for
+#endif
+  for (int i = 0; i < n; ++i) {
+    y[i] = fp16_to_float(x[i]);
+  }
+}
+
+template <typename Dtype>
+void caffe_cpu_to_storage(Storage storage, int n, const Dtype* x, void* y) {
+  switch (storage) {
+  case STORAGE_BF16:
+    caffe_cpu_to_bf16(n, x, static_cast<uint16_t*>(y));
+    break;
+  case STORAGE_FP16:
+    caffe_cpu_to_fp16(n, x, static_cast<uint16_t*>(y));
+    break;
+  default:
+    memcpy(y, x, n * sizeof(Dtype));  // NOLINT(caffe/alt_fn)
+    break;
+  }
+}
+
+template <typename Dtype>
+void caffe_cpu_from_storage(Storage storage, int n, const void* x, Dtype* y) {
+  switch (storage) {
+  case STORAGE_BF16:
+    caffe_cpu_from_bf16(n, static_cast<const uint16_t*>(x), y);
+    break;
+  case STORAGE_FP16:
+    caffe_cpu_from_fp16(n, static_cast<const uint16_t*>(x), y);
+    break;
+  default:
+    memcpy(y, x, n * sizeof(Dtype));  // NOLINT(caffe/alt_fn)
+    break;
+  }
+}
+
+template void caffe_cpu_to_bf16<float>(int n, const float* x, uint16_t* y);
+template void caffe_cpu_to_bf16<double>(int n, const double* x, uint16_t* y);
+template void caffe_cpu_from_bf16<float>(int n, const uint16_t* x, float* y);
+template void caffe_cpu_from_bf16<double>(int n, const uint16_t* x, double* y);
+template void caffe_cpu_to_fp16<float>(int n, const float* x, uint16_t* y);
+template void caffe_cpu_to_fp16<double>(int n, const double* x, uint16_t* y);
+template void caffe_cpu_from_fp16<float>(int n, const uint16_t* x, float* y);
+template void caffe_cpu_from_fp16<double>(int n, const uint16_t* x, double* y);
+
+template void caffe_cpu_to_storage<float>(Storage storage, int n,
+    const float* x, void* y);
+template void caffe_cpu_to_storage<double>(Storage storage, int n,
+    const double* x, void* y);
+template void caffe_cpu_from_storage<float>(Storage storage, int n,
+    const void* x, float* y);
+template void caffe_cpu_from_storage<double>(Storage storage, int n,
+    const void* x, double* y);
+
+}  // namespace caffe
@@ -0,0 +1,233 @@
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#if defined __x86_64__ || defined _M_X64
+# define XBYAK_NO_OP_NAMES
+# define XBYAK_USE_MMAP_ALLOCATOR
+# include "../xbyak/xbyak_util.h"
+#endif
+
+#include "caffe/util/int8.hpp"
+
+namespace caffe {
+
+namespace {
+
+// c[j] = dot(a, b + j * ld) for j in [0, 4), over ld values.
+typedef void (Int8Dot4)(const int8_t* a, const int8_t* b, int64_t ld,
+    int32_t* c);
+
+int32_t int8_dot(const int8_t* a, const int8_t* b, int ld) {
+  int32_t sum = 0;
+  for (int k = 0; k < ld; ++k) {
+    sum += static_cast<int32_t>(a[k]) * b[k];
+  }
+  return sum;
+}
+
+void int8_dot4(const int8_t* a, const int8_t* b, int64_t ld, int32_t* c) {
+  for (int j = 0; j < 4; ++j) {
+    c[j] = int8_dot(a, b + j * ld, ld);
+  }
+}
+
+#if defined __x86_64__ || defined _M_X64
+// AVX2: sign extends 16 values of each row to int16 and multiplies them
+// pairwise into int32 lanes with vpmaddwd.
+class Int8Dot4CodeGenerator : public ::Xbyak::CodeGenerator {
+ public:
+  Int8Dot4CodeGenerator() {
+    using Xbyak::Reg64;
+    // Arguments.
+    const Reg64& reg_a = rdi;
+    const Reg64& reg_b0 = rsi;
+    const Reg64& reg_ld = rdx;
+    const Reg64& reg_c = rcx;
+
+    const Reg64& reg_b1 = r8;
+    const Reg64& reg_b2 = r9;
+    const Reg64& reg_b3 = r10;
+    const Reg64& reg_k = rax;
+
+    vpxor(ymm0, ymm0, ymm0);
+    vpxor(ymm1, ymm1, ymm1);
+    vpxor(ymm2, ymm2, ymm2);
+    vpxor(ymm3, ymm3, ymm3);
+    lea(reg_b1, ptr[reg_b0 + reg_ld]);
+    lea(reg_b2, ptr[reg_b1 + reg_ld]);
+    lea(reg_b3, ptr[reg_b2 + reg_ld]);
+    xor_(reg_k, reg_k);
+
+    L("k_loop_start");
+    vpmovsxbw(ymm4, ptr[reg_a + reg_k]);
+    vpmovsxbw(ymm5, ptr[reg_b0 + reg_k]);
+    vpmaddwd(ymm5, ymm4, ymm5);
+    vpaddd(ymm0, ymm0, ymm5);
+    vpmovsxbw(ymm5, ptr[reg_b1 + reg_k]);
+    vpmaddwd(ymm5, ymm4, ymm5);
+    vpaddd(ymm1, ymm1, ymm5);
+    vpmovsxbw(ymm5, ptr[reg_b2 + reg_k]);
+    vpmaddwd(ymm5, ymm4, ymm5);
+    vpaddd(ymm2, ymm2, ymm5);
+    vpmovsxbw(ymm5, ptr[reg_b3 + reg_k]);
+    vpmaddwd(ymm5, ymm4, ymm5);
+    vpaddd(ymm3, ymm3, ymm5);
+    add(reg_k, kInt8RowAlignment);
+    cmp(reg_k, reg_ld);
+    jb("k_loop_start", T_NEAR);
+
+    // Horizontal sums: per 128-bit lane, [sum0, sum1, sum2, sum3].
+    vphaddd(ymm0, ymm0, ymm1);
+    vphaddd(ymm2, ymm2, ymm3);
+    vphaddd(ymm0, ymm0, ymm2);
+    vextracti128(xmm1, ymm0, 1);
+    vpaddd(xmm0, xmm0, xmm1);
+    vmovdqu(ptr[reg_c], xmm0);
+    vzeroupper();
+    ret();
+  }
+};
+#endif
+
+Int8Dot4* get_int8_dot4() {
+#if defined __x86_64__ || defined _M_X64
+  static Xbyak::util::Cpu current_cpu;
+  if (current_cpu.has(Xbyak::util::Cpu::tAVX2)) {
+    static Int8Dot4CodeGenerator generator;
+    return generator.getCode<Int8Dot4*>();
+  }
+#endif
+  return int8_dot4;
+}
+
+template <typename Dtype>
+int8_t quantize(Dtype x, Dtype scale) {
+  Dtype y = std::min(std::max(x * scale, Dtype(-127)), Dtype(127));
+  return static_cast<int8_t>(y < 0 ? y - Dtype(0.5) : y + Dtype(0.5));
+}
+
+}  // namespace
+
+template <typename Dtype>
+void caffe_cpu_quantize(int rows, int cols, bool transposed, const Dtype* x,
+    Dtype scale, int8_t* y) {
+  const int ld = int8_row_size(cols);
+#ifdef _OPENMP
+  #pragma omp parallel for
+#endif
+  for (int i = 0; i < rows; ++i) {
+    int8_t* y_row = y + static_cast<size_t>(i) * ld;
+    if (transposed) {
+      for (int j = 0; j < cols; ++j) {
+        y_row[j] = quantize(x[static_cast<size_t>(j) * rows + i], scale);
+      }
+    } else {
+      const Dtype* x_row = x + static_cast<size_t>(i) * cols;
+      for (int j = 0; j < cols; ++j) {
+        y_row[j] = quantize(x_row[j], scale);
+      }
+    }
+    std::fill(y_row + cols, y_row + ld, 0);
+  }
+}
+
+template void caffe_cpu_quantize<float>(int rows, int cols, bool transposed,
+    const float* x, float scale, int8_t* y);
+template void caffe_cpu_quantize<double>(int rows, int cols, bool transposed,
+    const double* x, double scale, int8_t* y);
+
+void caffe_cpu_gemm_s8(int M, int N, int K, const int8_t* A, const int8_t* B,
+    int32_t* C) {
+  const int ld = int8_row_size(K);
+  Int8Dot4* dot4 = get_int8_dot4();
+#ifdef _OPENMP
+  #pragma omp parallel for
+#endif
+  for (int m = 0; m < M; ++m) {
+    const int8_t* a = A + static_cast<size_t>(m) * ld;
+    int32_t* c = C + static_cast<size_t>(m) * N;
+    int n = 0;
+    for (; n + 4 <= N; n += 4) {
+      dot4(a, B + static_cast<size_t>(n) * ld, ld, c + n);
+    }
+    for (; n < N; ++n) {
+      c[n] = int8_dot(a, B + static_cast<size_t>(n) * ld, ld);
+    }
+  }
+}
+
+template <typename Dtype>
+void Int8Gemm<Dtype>::SetWeights(int rows, int cols, bool transposed,
+    const Dtype* weights) {
+  rows_ = rows;
+  cols_ = cols;
+  const int ld = int8_row_size(cols);
+  scales_.resize(rows);
+  weights_.resize(static_cast<size_t>(rows) * ld);
+  const size_t row_stride = transposed ? 1 : cols;
+  const size_t col_stride = transposed ? rows : 1;
+#ifdef _OPENMP
+  #pragma omp parallel for
+#endif
+  for (int i = 0; i < rows; ++i) {
+    const Dtype* w = weights + i * row_stride;
+    Dtype max_abs = 0;
+    for (int j = 0; j < cols; ++j) {
+      max_abs = std::max(max_abs,
+          static_cast<Dtype>(std::fabs(w[j * col_stride])));
+    }
+    const Dtype scale = max_abs > 0 ? Dtype(127) / max_abs : Dtype(1);
+    int8_t* w_row = &weights_[static_cast<size_t>(i) * ld];
+    for (int j = 0; j < cols; ++j) {
+      w_row[j] = quantize(w[j * col_stride], scale);
+    }
+    std::fill(w_row + cols, w_row + ld, 0);
+    scales_[i] = scale;
+  }
+}
+
+template <typename Dtype>
+void Int8Gemm<Dtype>::Forward(int row_begin, int num_rows, int n,
+    bool transposed, const Dtype* input, Dtype input_scale, Dtype* output,
+    Buffers* buffers) const {
+  CHECK_LE(row_begin + num_rows, rows_);
+  const int ld = int8_row_size(cols_);
+  buffers->input.resize(static_cast<size_t>(n) * ld);
+  buffers->output.resize(static_cast<size_t>(n) * num_rows);
+  buffers->dequantize.resize(num_rows);
+  for (int r = 0; r < num_rows; ++r) {
+    buffers->dequantize[r] = Dtype(1) / (scales_[row_begin + r] * input_scale);
+  }
+  // Each row of the quantized input holds one of the n input vectors.
+  caffe_cpu_quantize(n, cols_, !transposed, input, input_scale,
+      &buffers->input[0]);
+  const int8_t* weights = &weights_[static_cast<size_t>(row_begin) * ld];
+  const int32_t* acc = &buffers->output[0];
+  const Dtype* dequantize = &buffers->dequantize[0];
+  if (transposed) {
+    caffe_cpu_gemm_s8(n, num_rows, cols_, &buffers->input[0], weights,
+        &buffers->output[0]);
+    for (int i = 0; i < n; ++i) {
+      for (int r = 0; r < num_rows; ++r) {
+        output[i * num_rows + r] = acc[i * num_rows + r] * dequantize[r];
+      }
+    }
+  } else {
+    caffe_cpu_gemm_s8(num_rows, n, cols_, weights, &buffers->input[0],
+        &buffers->output[0]);
+    for (int r = 0; r < num_rows; ++r) {
+      for (int j = 0; j < n; ++j) {
+        output[r * n + j] = acc[r * n + j] * dequantize[r];
+      }
+    }
+  }
+}
+
+INSTANTIATE_CLASS(Int8Gemm);
+
+}  // namespace caffe
@@ -9,6 +9,7 @@
 #include <opencv2/imgproc/imgproc.hpp>
 #endif  // USE_OPENCV
 #include <stdint.h>
+#include <unistd.h>
 
 #include <algorithm>
 #include <fstream>  // NOLINT(readability/streams)
@@ -116,6 +117,13 @@ void WriteProtoToBinaryFile(const Message& proto, const char* filename) {
   CHECK(proto.SerializeToOstream(&output));
 }
 
+void SyncFileToDisk(const string& filename) {
+  int fd = open(filename.c_str(), O_RDONLY);
+  CHECK_NE(fd, -1) << "File not found: " << filename;
+  CHECK_EQ(fsync(fd), 0) << "Couldn't sync " << filename << " to disk.";
+  close(fd);
+}
+
 #ifdef USE_OPENCV
 cv::Mat ReadImageToCVMat(const string& filename,
     const int height, const int width, const bool is_color) {
@@ -9,6 +9,8 @@
 #include <boost/math/special_functions/next.hpp>
 #include <boost/random.hpp>
 
+#include <algorithm>
+#include <cmath>
 #include <limits>
 
 #include "caffe/common.hpp"
@@ -251,26 +253,227 @@ void caffe_sqr<double>(const int n, const double* a, double* y) {
   vdSqr(n, a, y);
 }
 
+namespace {
+
+// Branch-free float kernels after Cephes' expf, logf and tanhf, which the
+// compiler vectorizes: the branches are selects and the exponents are set
+// through the bits. None relies on the order of its additions, which
+// -ffast-math is free to change.
+inline float float_from_bits(int32_t i) {
+  union { int32_t i; float f; } u;
+  u.i = i;
+  return u.f;
+}
+
+inline int32_t float_bits(float f) {
+  union { int32_t i; float f; } u;
+  u.f = f;
+  return u.i;
+}
+
+// Within 2 ulp; 0 below the smallest normal float, inf above the largest.
+inline float exp_kernel(float x) {
+  const float lo = -87.3365448f;
+  const float hi = 88.7228391f;
+  const float xc = std::min(std::max(x, lo), hi);
+  // x = n ln(2) + r, with |r| <= ln(2) / 2.
+  const float fx = xc * 1.44269504088896341f + 0.5f;
+  int32_t n = static_cast<int32_t>(fx);
+  n -= static_cast<float>(n) > fx;
+  // In double rather than with ln(2) split in two floats, whose products
+  // -ffast-math would add up first.
+  const float r = static_cast<float>(
+      static_cast<double>(xc) - n * 0.693147180559945309);
+  const float p = (((((1.9875691500e-4f * r + 1.3981999507e-3f) * r +
+      8.3334519073e-3f) * r + 4.1665795894e-2f) * r + 1.6666665459e-1f) * r +
+      5.0000001201e-1f) * r * r + r + 1.f;
+  // 2^n, in two factors for n = 128.
+  const int32_t n1 = std::min(n, 127);
+  float y = p * float_from_bits((n1 + 127) << 23) * (n > 127 ? 2.f : 1.f);
+  y = x < lo ? 0.f : y;
+  return x > hi ? std::numeric_limits<float>::infinity() : y;
+}
+
+// Within 2 ulp; -inf at 0, NaN below.
+inline float log_kernel(float x) {
+  // Scales denormals up to normals.
+  const bool denormal = float_bits(x) < 0x00800000;
+  const float xs = denormal ? x * 8388608.f : x;
+  const int32_t bits = float_bits(xs);
+  // x = 2^e m, with m in [sqrt(1/2), sqrt(2)).
+  int32_t e = ((bits >> 23) & 0xff) - 126 - (denormal ? 23 : 0);
+  float m = float_from_bits((bits & 0x007fffff) | 0x3f000000);
+  const bool small = m < 0.707106781186547524f;
+  e -= small;
+  m = small ? m + m - 1.f : m - 1.f;
+  const float z = m * m;
+  const float p = ((((((((7.0376836292e-2f * m - 1.1514610310e-1f) * m +
+      1.1676998740e-1f) * m - 1.2420140846e-1f) * m + 1.4249322787e-1f) * m -
+      1.6668057665e-1f) * m + 2.0000714765e-1f) * m - 2.4999993993e-1f) * m +
+      3.3333331174e-1f) * m * z;
+  const float ef = static_cast<float>(e);
+  float y = m + (p - 2.12194440e-4f * ef - 0.5f * z) + 0.693359375f * ef;
+  const int32_t x_bits = float_bits(x);
+  y = x_bits >= 0x7f800000 ? x : y;
+  y = (x_bits & 0x7fffffff) == 0 ?
+      -std::numeric_limits<float>::infinity() : y;
+  return x_bits < 0 && (x_bits & 0x7fffffff) != 0 ?
+      std::numeric_limits<float>::quiet_NaN() : y;
+}
+
+// Within 3 ulp.
+inline float tanh_kernel(float x) {
+  const float ax = std::abs(x);
+  const float z = x * x;
+  const float small = ((((-5.70498872745e-3f * z + 2.06390887954e-2f) * z -
+      5.37397155531e-2f) * z + 1.33314422036e-1f) * z - 3.33332819422e-1f) *
+      z * x + x;
+  // tanh(9) rounds to 1.
+  const float large = 1.f - 2.f / (exp_kernel(2.f * std::min(ax, 9.f)) + 1.f);
+  return ax < 0.625f ? small : (x < 0 ? -large : large);
+}
+
+inline float sigmoid_kernel(float x) {
+  return 1.f / (1.f + exp_kernel(std::min(-x, 88.f)));
+}
+
+// log(1 + e) for e in [0, 1], as 2 atanh(s) with s = e / (2 + e) <= 1/3,
+// which keeps the bits of small e that 1 + e rounds off.
+inline float log1p_kernel(float e) {
+  const float s = e / (2.f + e);
+  const float z = s * s;
+  const float p = (((((((5.88235294e-2f * z + 6.66666667e-2f) * z +
+      7.69230769e-2f) * z + 9.09090909e-2f) * z + 1.11111111e-1f) * z +
+      1.42857143e-1f) * z + 2.e-1f) * z + 3.33333333e-1f) * z;
+  return 2.f * s + 2.f * s * p;
+}
+
+// log(1 + exp(x)) = max(x, 0) + log(1 + exp(-|x|)).
+inline float softplus_kernel(float x) {
+  return std::max(x, 0.f) + log1p_kernel(exp_kernel(-std::abs(x)));
+}
+
+inline double sigmoid_kernel(double x) {
+  return 1. / (1. + std::exp(-x));
+}
+
+inline double softplus_kernel(double x) {
+  return std::max(x, 0.) + log1p(std::exp(-std::abs(x)));
+}
+
+}  // namespace
+
 template <>
 void caffe_exp<float>(const int n, const float* a, float* y) {
+#ifdef USE_MKL
   vsExp(n, a, y);
+#else
+#ifdef _OPENMP
+  #pragma omp parallel for
+#endif
+  for (int i = 0; i < n; ++i) {
+    y[i] = exp_kernel(a[i]);
+  }
+#endif
 }
 
 template <>
 void caffe_exp<double>(const int n, const double* a, double* y) {
+#ifdef USE_MKL
   vdExp(n, a, y);
+#else
+#ifdef _OPENMP
+  #pragma omp parallel for
+#endif
+  for (int i = 0; i < n; ++i) {
+    y[i] = std::exp(a[i]);
+  }
+#endif
 }
 
 template <>
 void caffe_log<float>(const int n, const float* a, float* y) {
+#ifdef USE_MKL
   vsLn(n, a, y);
+#else
+#ifdef _OPENMP
+  #pragma omp parallel for
+#endif
+  for (int i = 0; i < n; ++i) {
+    y[i] = log_kernel(a[i]);
+  }
+#endif
 }
 
 template <>
 void caffe_log<double>(const int n, const double* a, double* y) {
+#ifdef USE_MKL
   vdLn(n, a, y);
+#else
+#ifdef _OPENMP
+  #pragma omp parallel for
+#endif
+  for (int i = 0; i < n; ++i) {
+    y[i] = std::log(a[i]);
+  }
+#endif
+}
+
+template <>
+void caffe_tanh<float>(const int n, const float* a, float* y) {
+#ifdef USE_MKL
+  vsTanh(n, a, y);
+#else
+#ifdef _OPENMP
+  #pragma omp parallel for
+#endif
+  for (int i = 0; i < n; ++i) {
+    y[i] = tanh_kernel(a[i]);
+  }
+#endif
 }
 
+template <>
+void caffe_tanh<double>(const int n, const double* a, double* y) {
+#ifdef USE_MKL
+  vdTanh(n, a, y);
+#else
+#ifdef _OPENMP
+  #pragma omp parallel for
+#endif
+  for (int i = 0; i < n; ++i) {
+    y[i] = std::tanh(a[i]);
+  }
+#endif
+}
+
+template <typename Dtype>
+void caffe_sigmoid(const int n, const Dtype* a, Dtype* y) {
+#ifdef _OPENMP
+  #pragma omp parallel for
+#endif
+  for (int i = 0; i < n; ++i) {
+    y[i] = sigmoid_kernel(a[i]);
+  }
+}
+
+template void caffe_sigmoid<float>(const int n, const float* a, float* y);
+template void caffe_sigmoid<double>(const int n, const double* a, double* y);
+
+template <typename Dtype>
+void caffe_softplus(const int n, const Dtype* a, Dtype* y) {
+#ifdef _OPENMP
+  #pragma omp parallel for
+#endif
+  for (int i = 0; i < n; ++i) {
+    y[i] = softplus_kernel(a[i]);
+  }
+}
+
+template void caffe_softplus<float>(const int n, const float* a, float* y);
+template void caffe_softplus<double>(const int n, const double* a,
+    double* y);
+
 template <>
 void caffe_abs<float>(const int n, const float* a, float* y) {
     vsAbs(n, a, y);
@@ -344,15 +547,52 @@ template
 void caffe_rng_gaussian<double>(const int n, const double mu,
                                 const double sigma, double* r);
 
-#ifdef USE_MKL
-static void bernoulli_generate(int n, double p, int* r) {
-  VSLStreamStatePtr stream;
-  int seed = 17 + caffe_rng_rand() % 4096;
-  vslNewStream(&stream, VSL_BRNG_MCG31, seed);
-  viRngBernoulli(VSL_RNG_METHOD_BERNOULLI_ICDF, stream, n, r, p);
-  vslDeleteStream(&stream);
+namespace {
+
+// Keys a Philox stream from the Caffe generator of the calling thread, so
+// that the numbers follow its seed.
+void philox_key(uint32_t key[2]) {
+  key[0] = caffe_rng_rand();
+  key[1] = caffe_rng_rand();
 }
+
+// Uniform words below the threshold are 1, with probability p.
+uint64_t bernoulli_threshold(double p) {
+  return static_cast<uint64_t>(p * 4294967296.);
+}
+
+// The Bernoulli draws of the 4 words of a block of the stream, as 4 bits.
+inline unsigned int bernoulli_block(uint64_t block, const uint32_t key[2],
+    uint64_t threshold) {
+  const uint32_t counter[4] = {static_cast<uint32_t>(block),
+      static_cast<uint32_t>(block >> 32), 0, 0};
+  uint32_t words[4];
+  philox4x32(counter, key, words);
+  return (words[0] < threshold) | (words[1] < threshold) << 1 |
+      (words[2] < threshold) << 2 | (words[3] < threshold) << 3;
+}
+
+// Draw i comes from word i % 4 of block i / 4, so that the threads fill the
+// same values whatever their count, as caffe_rng_bernoulli_bits does.
+template <typename Itype>
+void bernoulli_generate(int n, double p, Itype* r) {
+  uint32_t key[2];
+  philox_key(key);
+  const uint64_t threshold = bernoulli_threshold(p);
+  const int blocks = (n + 3) / 4;
+#ifdef _OPENMP
+  #pragma omp parallel for
 #endif
+  for (int b = 0; b < blocks; ++b) {
+    const unsigned int bits = bernoulli_block(b, key, threshold);
+    const int end = std::min(n - 4 * b, 4);
+    for (int j = 0; j < end; ++j) {
+      r[4 * b + j] = (bits >> j) & 1;
+    }
+  }
+}
+
+}  // namespace
 
 template <typename Dtype>
 void caffe_rng_bernoulli(const int n, const Dtype p, int* r) {
@@ -360,16 +600,7 @@ void caffe_rng_bernoulli(const int n, const Dtype p, int* r) {
   CHECK(r);
   CHECK_GE(p, 0);
   CHECK_LE(p, 1);
-#ifdef USE_MKL
   bernoulli_generate(n, p, r);
-#else
-  boost::bernoulli_distribution<Dtype> random_distribution(p);
-  boost::variate_generator<caffe::rng_t*, boost::bernoulli_distribution<Dtype> >
-      variate_generator(caffe_rng(), random_distribution);
-  for (int i = 0; i < n; ++i) {
-    r[i] = variate_generator();
-  }
-#endif
 }
 
 template
@@ -384,16 +615,7 @@ void caffe_rng_bernoulli(const int n, const Dtype p, unsigned int* r) {
   CHECK(r);
   CHECK_GE(p, 0);
   CHECK_LE(p, 1);
-#ifdef USE_MKL
-  bernoulli_generate(n, p, reinterpret_cast<int *>(r));
-#else
-  boost::bernoulli_distribution<Dtype> random_distribution(p);
-  boost::variate_generator<caffe::rng_t*, boost::bernoulli_distribution<Dtype> >
-      variate_generator(caffe_rng(), random_distribution);
-  for (int i = 0; i < n; ++i) {
-    r[i] = static_cast<unsigned int>(variate_generator());
-  }
-#endif
+  bernoulli_generate(n, p, r);
 }
 
 template
@@ -402,6 +624,39 @@ void caffe_rng_bernoulli<double>(const int n, const double p, unsigned int* r);
 template
 void caffe_rng_bernoulli<float>(const int n, const float p, unsigned int* r);
 
+template <typename Dtype>
+void caffe_rng_bernoulli_bits(const int n, const Dtype p, unsigned int* r) {
+  CHECK_GE(n, 0);
+  CHECK(r);
+  CHECK_GE(p, 0);
+  CHECK_LE(p, 1);
+  uint32_t key[2];
+  philox_key(key);
+  const uint64_t threshold = bernoulli_threshold(p);
+  const int words = (n + 31) / 32;
+#ifdef _OPENMP
+  #pragma omp parallel for
+#endif
+  for (int w = 0; w < words; ++w) {
+    unsigned int word = 0;
+    for (int j = 0; j < 8; ++j) {
+      word |= bernoulli_block(8 * w + j, key, threshold) << (4 * j);
+    }
+    r[w] = word;
+  }
+  if (n % 32) {
+    r[words - 1] &= (1u << (n % 32)) - 1;
+  }
+}
+
+template
+void caffe_rng_bernoulli_bits<double>(const int n, const double p,
+    unsigned int* r);
+
+template
+void caffe_rng_bernoulli_bits<float>(const int n, const float p,
+    unsigned int* r);
+
 template <>
 float caffe_cpu_strided_dot<float>(const int n, const float* x, const int incx,
     const float* y, const int incy) {
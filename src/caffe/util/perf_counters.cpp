@@ -0,0 +1,196 @@
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#endif
+#include <glog/logging.h>
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <vector>
+
+#include "caffe/util/perf_counters.hpp"
+
+namespace caffe {
+
+namespace {
+
+enum PerfEvent {
+  PERF_CYCLES,
+  PERF_INSTRUCTIONS,
+  PERF_CACHE_REFERENCES,
+  PERF_CACHE_MISSES,
+  PERF_VECTOR_INSTRUCTIONS,
+  NUM_PERF_EVENTS
+};
+
+// FP_ARITH_INST_RETIRED with the umasks of the 128, 256 and 512 bit packed
+// single and double precision instructions, from Broadwell on.
+const uint64_t kIntelPackedFpArith = 0xFCC7;
+
+bool is_intel() {
+#if defined(__x86_64__) || defined(__i386__)
+  unsigned int eax, ebx, ecx, edx;
+  if (!__get_cpuid(0, &eax, &ebx, &ecx, &edx)) {
+    return false;
+  }
+  // "Genu", "ineI", "ntel".
+  return ebx == 0x756e6547 && edx == 0x49656e69 && ecx == 0x6c65746e;
+#else
+  return false;
+#endif
+}
+
+int open_event(int event, int tid, int group) {
+  struct perf_event_attr attr = perf_event_attr();
+  attr.size = sizeof(attr);
+  switch (event) {
+  case PERF_CYCLES:
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = PERF_COUNT_HW_CPU_CYCLES;
+    break;
+  case PERF_INSTRUCTIONS:
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+    break;
+  case PERF_CACHE_REFERENCES:
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = PERF_COUNT_HW_CACHE_REFERENCES;
+    break;
+  case PERF_CACHE_MISSES:
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = PERF_COUNT_HW_CACHE_MISSES;
+    break;
+  case PERF_VECTOR_INSTRUCTIONS:
+    attr.type = PERF_TYPE_RAW;
+    attr.config = kIntelPackedFpArith;
+    break;
+  default:
+    LOG(FATAL) << "Unknown perf event " << event;
+  }
+  attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED |
+      PERF_FORMAT_TOTAL_TIME_RUNNING;
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+  return syscall(__NR_perf_event_open, &attr, tid, -1, group, 0);
+}
+
+// The ids of the calling thread and of its OpenMP threads.
+std::vector<int> openmp_thread_ids() {
+  std::vector<int> tids(1, syscall(SYS_gettid));
+#ifdef _OPENMP
+  const int num_threads = omp_get_max_threads();
+  tids.resize(num_threads, tids[0]);
+  #pragma omp parallel num_threads(num_threads)
+  tids[omp_get_thread_num()] = syscall(SYS_gettid);
+  std::sort(tids.begin(), tids.end());
+  tids.erase(std::unique(tids.begin(), tids.end()), tids.end());
+#endif
+  return tids;
+}
+
+}  // namespace
+
+PerfSample::PerfSample()
+    : cycles(0), instructions(0), cache_references(0), cache_misses(0),
+      vector_instructions(0) {}
+
+PerfSample& PerfSample::operator+=(const PerfSample& other) {
+  cycles += other.cycles;
+  instructions += other.instructions;
+  cache_references += other.cache_references;
+  cache_misses += other.cache_misses;
+  vector_instructions += other.vector_instructions;
+  return *this;
+}
+
+PerfSample& PerfSample::operator-=(const PerfSample& other) {
+  cycles -= other.cycles;
+  instructions -= other.instructions;
+  cache_references -= other.cache_references;
+  cache_misses -= other.cache_misses;
+  vector_instructions -= other.vector_instructions;
+  return *this;
+}
+
+PerfCounters::PerfCounters() : has_vector_(is_intel()) {
+  const std::vector<int> tids = openmp_thread_ids();
+  for (int i = 0; i < tids.size(); ++i) {
+    Group group;
+    if (!OpenGroup(tids[i], &group)) {
+      const int error = errno;
+      LOG(WARNING) << "Hardware performance counters are not available ("
+          << strerror(error) << "), see /proc/sys/kernel/perf_event_paranoid;"
+          << " reporting times only";
+      Close();
+      return;
+    }
+    has_vector_ = has_vector_ &&
+        group.events.back() == PERF_VECTOR_INSTRUCTIONS;
+    groups_.push_back(group);
+  }
+  LOG(INFO) << "Counting hardware events of " << groups_.size()
+      << " threads";
+}
+
+PerfCounters::~PerfCounters() {
+  Close();
+}
+
+void PerfCounters::Close() {
+  for (int i = 0; i < groups_.size(); ++i) {
+    for (int j = 0; j < groups_[i].members.size(); ++j) {
+      close(groups_[i].members[j]);
+    }
+    close(groups_[i].leader);
+  }
+  groups_.clear();
+}
+
+bool PerfCounters::OpenGroup(int tid, Group* group) {
+  group->leader = open_event(PERF_CYCLES, tid, -1);
+  if (group->leader < 0) {
+    return false;
+  }
+  group->events.push_back(PERF_CYCLES);
+  for (int event = PERF_CYCLES + 1; event < NUM_PERF_EVENTS; ++event) {
+    if (event == PERF_VECTOR_INSTRUCTIONS && !has_vector_) {
+      continue;
+    }
+    const int fd = open_event(event, tid, group->leader);
+    if (fd >= 0) {
+      group->members.push_back(fd);
+      group->events.push_back(event);
+    }
+  }
+  return true;
+}
+
+void PerfCounters::Read(PerfSample* sample) const {
+  *sample = PerfSample();
+  // nr, time_enabled, time_running, then a value per event.
+  uint64_t values[3 + NUM_PERF_EVENTS];
+  for (int i = 0; i < groups_.size(); ++i) {
+    const Group& group = groups_[i];
+    const ssize_t size = read(group.leader, values, sizeof(values));
+    if (size < static_cast<ssize_t>(3 * sizeof(uint64_t)) ||
+        values[0] != group.events.size() || values[2] == 0) {
+      continue;
+    }
+    const double scale = static_cast<double>(values[1]) / values[2];
+    double* counts[NUM_PERF_EVENTS] = {&sample->cycles,
+        &sample->instructions, &sample->cache_references,
+        &sample->cache_misses, &sample->vector_instructions};
+    for (int j = 0; j < group.events.size(); ++j) {
+      *counts[group.events[j]] += values[3 + j] * scale;
+    }
+  }
+}
+
+}  // namespace caffe
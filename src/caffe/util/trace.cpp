@@ -0,0 +1,224 @@
+#include <boost/thread.hpp>
+#include <glog/logging.h>
+#include <signal.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>  // NOLINT(readability/streams)
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "caffe/util/trace.hpp"
+
+namespace caffe {
+
+volatile bool Tracer::enabled_ = false;
+
+namespace {
+
+struct TraceEvent {
+  const char* category;
+  char name[64];
+  uint64_t begin;
+  uint64_t duration;
+};
+
+// The ring buffer of one thread. Buffers are never freed, so that the spans
+// of the threads which have exited can still be dumped.
+struct TraceBuffer {
+  explicit TraceBuffer(int capacity)
+    : tid(syscall(SYS_gettid)), events(capacity), recorded(0) {}
+
+  const int tid;
+  boost::mutex mutex;
+  std::vector<TraceEvent> events;
+  uint64_t recorded;
+};
+
+void KeepBuffer(TraceBuffer* buffer) {}
+
+boost::mutex registry_mutex;
+std::vector<TraceBuffer*>* buffers = NULL;
+boost::thread_specific_ptr<TraceBuffer>* local_buffer = NULL;
+std::string* trace_filename = NULL;
+int buffer_capacity = 0;
+
+volatile sig_atomic_t dump_requested = false;
+
+void HandleSigusr1(int signal) {
+  dump_requested = true;
+}
+
+// Dumps from a thread of its own on SIGUSR1, since the signal handler can
+// only set a flag.
+void WatchSignals() {
+  while (true) {
+    boost::this_thread::sleep(boost::posix_time::milliseconds(100));
+    if (dump_requested) {
+      dump_requested = false;
+      Tracer::Dump();
+    }
+  }
+}
+
+void DumpAtExit() {
+  Tracer::Disable();
+  Tracer::Dump();
+}
+
+void HookupDumps() {
+  struct sigaction sa;
+  sa.sa_handler = &HandleSigusr1;
+  sa.sa_flags = SA_RESTART;
+  sigfillset(&sa.sa_mask);
+  if (sigaction(SIGUSR1, &sa, NULL) == -1) {
+    LOG(FATAL) << "Cannot install SIGUSR1 handler.";
+  }
+  boost::thread(&WatchSignals).detach();
+  atexit(&DumpAtExit);
+}
+
+TraceBuffer* GetLocalBuffer() {
+  TraceBuffer* buffer = local_buffer->get();
+  if (!buffer) {
+    boost::mutex::scoped_lock lock(registry_mutex);
+    buffer = new TraceBuffer(buffer_capacity);
+    buffers->push_back(buffer);
+    local_buffer->reset(buffer);
+  }
+  return buffer;
+}
+
+void WriteJsonString(const char* str, std::ostream* stream) {
+  *stream << '"';
+  for (; *str; ++str) {
+    const unsigned char c = *str;
+    if (c == '"' || c == '\\') {
+      *stream << '\\' << c;
+    } else if (c < 0x20) {
+      char escaped[8];
+      snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+      *stream << escaped;
+    } else {
+      *stream << c;
+    }
+  }
+  *stream << '"';
+}
+
+}  // namespace
+
+void Tracer::Enable(const std::string& filename, int events_per_thread) {
+  CHECK_GT(events_per_thread, 0);
+  boost::mutex::scoped_lock lock(registry_mutex);
+  if (!buffers) {
+    buffers = new std::vector<TraceBuffer*>();
+    local_buffer = new boost::thread_specific_ptr<TraceBuffer>(&KeepBuffer);
+    trace_filename = new std::string();
+  }
+  std::string expanded = filename;
+  const size_t pid = expanded.find("%p");
+  if (pid != std::string::npos) {
+    std::ostringstream id;
+    id << getpid();
+    expanded.replace(pid, 2, id.str());
+  }
+  const bool hooked = !trace_filename->empty();
+  *trace_filename = expanded;
+  buffer_capacity = events_per_thread;
+  if (!hooked && !expanded.empty()) {
+    HookupDumps();
+    LOG(INFO) << "Tracing to " << expanded
+        << " at exit and on SIGUSR1 (kill -USR1 " << getpid() << ")";
+  }
+  enabled_ = true;
+}
+
+void Tracer::Disable() {
+  enabled_ = false;
+}
+
+uint64_t Tracer::Now() {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return static_cast<uint64_t>(now.tv_sec) * 1000000 + now.tv_nsec / 1000;
+}
+
+void Tracer::Record(const char* category, const char* name,
+    const char* detail, uint64_t begin, uint64_t end) {
+  TraceBuffer* buffer = GetLocalBuffer();
+  boost::mutex::scoped_lock lock(buffer->mutex);
+  TraceEvent& event =
+      buffer->events[buffer->recorded % buffer->events.size()];
+  event.category = category;
+  if (detail) {
+    snprintf(event.name, sizeof(event.name), "%s %s", name, detail);
+  } else {
+    snprintf(event.name, sizeof(event.name), "%s", name);
+  }
+  event.begin = begin;
+  event.duration = end - begin;
+  ++buffer->recorded;
+}
+
+void Tracer::Dump() {
+  std::string filename;
+  {
+    boost::mutex::scoped_lock lock(registry_mutex);
+    if (!trace_filename || trace_filename->empty()) return;
+    filename = *trace_filename;
+  }
+  std::ofstream file(filename.c_str());
+  if (!file) {
+    LOG(ERROR) << "Cannot write the trace to " << filename;
+    return;
+  }
+  Dump(&file);
+  LOG(INFO) << "Wrote the trace to " << filename;
+}
+
+void Tracer::Dump(std::ostream* stream) {
+  std::vector<TraceBuffer*> all;
+  {
+    boost::mutex::scoped_lock lock(registry_mutex);
+    if (buffers) all = *buffers;
+  }
+  const int pid = getpid();
+  *stream << "{\"traceEvents\": [";
+  bool first = true;
+  for (int i = 0; i < all.size(); ++i) {
+    boost::mutex::scoped_lock lock(all[i]->mutex);
+    const uint64_t size = all[i]->events.size();
+    const uint64_t recorded = all[i]->recorded;
+    // The oldest events kept first.
+    for (uint64_t j = recorded > size ? recorded - size : 0; j < recorded;
+        ++j) {
+      const TraceEvent& event = all[i]->events[j % size];
+      *stream << (first ? "\n" : ",\n") << "{\"name\": ";
+      WriteJsonString(event.name, stream);
+      *stream << ", \"cat\": ";
+      WriteJsonString(event.category, stream);
+      *stream << ", \"ph\": \"X\", \"ts\": " << event.begin
+          << ", \"dur\": " << event.duration
+          << ", \"pid\": " << pid << ", \"tid\": " << all[i]->tid << "}";
+      first = false;
+    }
+  }
+  *stream << "\n]}\n";
+}
+
+void Tracer::Clear() {
+  boost::mutex::scoped_lock lock(registry_mutex);
+  if (!buffers) return;
+  for (int i = 0; i < buffers->size(); ++i) {
+    boost::mutex::scoped_lock buffer_lock((*buffers)[i]->mutex);
+    (*buffers)[i]->recorded = 0;
+  }
+}
+
+}  // namespace caffe
@@ -6,22 +6,33 @@ namespace bp = boost::python;
 #include <gflags/gflags.h>
 #include <glog/logging.h>
 
+#include <algorithm>
+#include <cmath>
 #include <cstring>
 #include <map>
 #include <string>
+#include <utility>
 #include <vector>
 
 #include "boost/algorithm/string.hpp"
 #include "boost/make_shared.hpp"
 #include "caffe/caffe.hpp"
 #include "caffe/internode/mpiutil.hpp"
+#include "caffe/layer_profile.hpp"
+#include "caffe/layers/conv_layer.hpp"
+#include "caffe/layers/inner_product_layer.hpp"
 #include "caffe/multinode/multinode.hpp"
+#include "caffe/util/perf_counters.hpp"
 #include "caffe/util/signal_handler.h"
+#include "caffe/util/trace.hpp"
 
 using caffe::Blob;
 using caffe::Caffe;
 using caffe::Net;
 using caffe::Layer;
+using caffe::LayerProfile;
+using caffe::PerfCounters;
+using caffe::PerfSample;
 using caffe::Solver;
 using caffe::shared_ptr;
 using caffe::string;
@@ -41,9 +52,34 @@ DEFINE_string(snapshot, "",
     "Optional; the snapshot solver state to resume training.");
 DEFINE_string(weights, "",
     "Optional; the pretrained weights to initialize finetuning, "
-    "separated by ','. Cannot be set simultaneously with snapshot.");
+    "separated by ','. Cannot be set simultaneously with snapshot. "
+    ".caffeflat files (see tools/convert_weights) are mapped, not read.");
 DEFINE_int32(iterations, 50,
     "The number of iterations to run.");
+DEFINE_int32(warmup, 0,
+    "Optional; time: the number of untimed iterations to run first.");
+DEFINE_string(profile, "",
+    "Optional; time: the .json or .csv file to write the per-layer "
+    "statistics to; time_diff: the statistics to compare with the baseline.");
+DEFINE_bool(perf_counters, false,
+    "Optional; time: also count the cycles, instructions, last-level cache "
+    "misses and vector instructions of each layer, if perf_event_open is "
+    "permitted.");
+DEFINE_string(baseline, "",
+    "time_diff: the per-layer statistics of the reference build.");
+DEFINE_double(regression_threshold, 0.1,
+    "Optional; time_diff: the relative increase of the median time of a "
+    "layer over the baseline reported as a regression.");
+DEFINE_string(calibrated_model, "",
+    "Optional; calibrate: the model definition to write, with the measured "
+    "input ranges of the layers to run in int8.");
+DEFINE_string(trace, "",
+    "Optional; the file to write a Chrome trace of the forward, backward, "
+    "data, communication and snapshot spans of all threads to, at exit and "
+    "on SIGUSR1; %p is replaced by the process id.");
+DEFINE_int32(trace_buffer_size, 100000,
+    "Optional; the number of most recent spans of each thread kept for "
+    "--trace.");
 DEFINE_string(sigint_effect, "stop",
              "Optional; action to take when a SIGINT signal is received: "
               "snapshot, stop or none.");
@@ -53,7 +89,8 @@ DEFINE_string(sighup_effect, "snapshot",
 DEFINE_string(param_server, "",
     "Optional; multinode mode, "
     "the parent param server address to synchronize with, "
-    "i.e.: tcp://127.0.0.1:7777");
+    "i.e.: tcp://127.0.0.1:7777; for model_server the upstream model "
+    "server to relay");
 DEFINE_string(listen_address, "",
     "Optional; multinode mode, bind address for various servers");
 DEFINE_string(multinode_type, "sync",
@@ -61,7 +98,11 @@ DEFINE_string(multinode_type, "sync",
     "[sync, async, ave]");
 DEFINE_int32(comm_threads, 1,
     "Optional; multinode mode,"
-    " The number of threads used by communication code.");
+    " The number of threads used by communication code. With 2 or more,"
+    " blob parts are encoded and decoded in parallel on spare CPUs.");
+DEFINE_string(model_cache, "",
+    "Optional; multinode mode, directory where weights received from "
+    "a model server are cached by their content hash.");
 
 // A simple registry for caffe commands.
 typedef int (*BrewFunction)();
@@ -149,6 +190,22 @@ void CopyLayers(caffe::Solver<float>* solver, const std::string& model_list) {
   }
 }
 
+// Load the weights served by a model server into the train and test nets.
+void CopyRemoteLayers(caffe::Solver<float>* solver,
+                      const std::string& address) {
+  std::string model;
+  std::string hash;
+  CHECK(caffe::ReceiveModelFromRemote(address, FLAGS_model_cache,
+    &model, &hash)) << "Failed to receive weights from " << address;
+  caffe::NetParameter weights;
+  CHECK(weights.ParseFromString(model)) << "Failed to parse weights " << hash;
+  LOG(INFO) << "Initializing from model " << hash;
+  solver->net()->CopyTrainedLayersFrom(weights);
+  for (int j = 0; j < solver->test_nets().size(); ++j) {
+    solver->test_nets()[j]->CopyTrainedLayersFrom(weights);
+  }
+}
+
 // Translate the signal effect the user specified on the command-line to the
 // corresponding enumeration.
 caffe::SolverAction::Enum GetRequestedAction(
@@ -230,6 +287,8 @@ int train() {
     solver->Restore(FLAGS_snapshot.c_str());
   } else if (FLAGS_weights.size()) {
     CopyLayers(solver.get(), FLAGS_weights);
+  } else if (caffe::internode::is_remote_address(FLAGS_solver)) {
+    CopyRemoteLayers(solver.get(), FLAGS_solver);
   }
 
   if (FLAGS_param_server != "") {
@@ -399,7 +458,99 @@ int test() {
 RegisterBrewFunction(test);
 
 
+// Calibrate: measure the input ranges of Convolution and InnerProduct layers
+// on sample batches, for int8 inference (see QuantizationParameter).
+int calibrate() {
+  CHECK_GT(FLAGS_model.size(), 0) << "Need a model definition to calibrate.";
+  CHECK_GT(FLAGS_weights.size(), 0) << "Need model weights to calibrate.";
+  CHECK_GT(FLAGS_calibrated_model.size(), 0)
+      << "Need a file to write the calibrated model definition to.";
+  LOG(INFO) << "Use CPU.";
+  Caffe::set_mode(Caffe::CPU);
+
+  caffe::NetParameter param;
+  caffe::ReadNetParamsFromTextFileOrDie(FLAGS_model, &param);
+  // Measure the float net, without the ranges of a previous calibration.
+  caffe::NetParameter float_param(param);
+  float_param.mutable_state()->set_phase(caffe::TEST);
+  for (int i = 0; i < float_param.layer_size(); ++i) {
+    float_param.mutable_layer(i)->clear_quantization_param();
+  }
+  Net<float> caffe_net(float_param);
+  caffe_net.CopyTrainedLayersFrom(FLAGS_weights);
+
+  const vector<shared_ptr<Layer<float> > >& layers = caffe_net.layers();
+  vector<bool> quantized(layers.size());
+  for (int j = 0; j < layers.size(); ++j) {
+    quantized[j] =
+      dynamic_cast<caffe::ConvolutionLayer<float>*>(layers[j].get()) ||
+      dynamic_cast<caffe::InnerProductLayer<float>*>(layers[j].get());
+  }
+  vector<float> input_ranges(layers.size(), 0);
+  LOG(INFO) << "Running for " << FLAGS_iterations << " iterations.";
+  for (int i = 0; i < FLAGS_iterations; ++i) {
+    // Layer by layer, in-place layers may overwrite the inputs later on.
+    for (int j = 0; j < layers.size(); ++j) {
+      const vector<Blob<float>*>& bottom = caffe_net.bottom_vecs()[j];
+      for (int k = 0; quantized[j] && k < bottom.size(); ++k) {
+        const float* data = bottom[k]->cpu_data();
+        for (int l = 0; l < bottom[k]->count(); ++l) {
+          input_ranges[j] = std::max(input_ranges[j], std::fabs(data[l]));
+        }
+      }
+      caffe_net.ForwardFromTo(j, j);
+    }
+  }
+
+  for (int j = 0; j < layers.size(); ++j) {
+    if (!quantized[j]) continue;
+    const string& layer_name = caffe_net.layer_names()[j];
+    for (int i = 0; i < param.layer_size(); ++i) {
+      if (param.layer(i).name() != layer_name) continue;
+      if (input_ranges[j] > 0) {
+        param.mutable_layer(i)->mutable_quantization_param()->set_input_range(
+            input_ranges[j]);
+      } else {
+        param.mutable_layer(i)->clear_quantization_param();
+      }
+    }
+    LOG(INFO) << "Layer " << layer_name << " input range: "
+              << input_ranges[j];
+  }
+  caffe::WriteProtoToTextFile(param, FLAGS_calibrated_model);
+  LOG(INFO) << "Wrote " << FLAGS_calibrated_model << ", run caffe test with "
+            << "it and with " << FLAGS_model << " to compare the accuracy.";
+  return 0;
+}
+RegisterBrewFunction(calibrate);
+
+
 // Time: benchmark the execution time of a model.
+// Adds the events counted since begin to total.
+void count_perf(const PerfCounters& counters, const PerfSample& begin,
+    PerfSample* total) {
+  PerfSample end;
+  counters.Read(&end);
+  end -= begin;
+  *total += end;
+}
+
+// The hardware events of all the iterations of a layer, taking total_us, as
+// logged next to its time.
+string perf_summary(const PerfSample& sample, double total_us,
+    bool has_vector) {
+  ostringstream summary;
+  summary << " IPC " << sample.ipc() << ", "
+      << sample.cache_misses / FLAGS_iterations << " LLC misses ("
+      << (total_us > 0 ? sample.memory_bytes() / total_us / 1000 : 0)
+      << " GB/s)";
+  if (has_vector) {
+    summary << ", " << sample.vector_instructions / FLAGS_iterations
+        << " vector instructions";
+  }
+  return summary.str();
+}
+
 int time() {
   CHECK_GT(FLAGS_model.size(), 0) << "Need a model definition to time.";
 
@@ -433,6 +584,13 @@ int time() {
   const vector<vector<Blob<float>*> >& top_vecs = caffe_net.top_vecs();
   const vector<vector<bool> >& bottom_need_backward =
       caffe_net.bottom_need_backward();
+  // Fused layers are computed by the layer before them (see
+  // Net::layer_fused), running them again would apply them twice.
+  const vector<bool>& layer_fused = caffe_net.layer_fused();
+  for (int j = 0; j < FLAGS_warmup; ++j) {
+    caffe_net.Forward();
+    caffe_net.Backward();
+  }
   LOG(INFO) << "*** Benchmark begins ***";
   LOG(INFO) << "Testing for " << FLAGS_iterations << " iterations.";
   Timer total_timer;
@@ -442,6 +600,19 @@ int time() {
   Timer timer;
   std::vector<double> forward_time_per_layer(layers.size(), 0.0);
   std::vector<double> backward_time_per_layer(layers.size(), 0.0);
+  shared_ptr<PerfCounters> counters;
+  if (FLAGS_perf_counters) {
+    counters.reset(new PerfCounters());
+    if (!counters->available()) {
+      counters.reset();
+    }
+  }
+  vector<PerfSample> forward_perf(layers.size());
+  vector<PerfSample> backward_perf(layers.size());
+  PerfSample begin;
+  // Milliseconds of each iteration, for the statistics.
+  vector<vector<double> > forward_times(layers.size());
+  vector<vector<double> > backward_times(layers.size());
   double forward_time = 0.0;
   double backward_time = 0.0;
   for (int j = 0; j < FLAGS_iterations; ++j) {
@@ -449,17 +620,27 @@ int time() {
     iter_timer.Start();
     forward_timer.Start();
     for (int i = 0; i < layers.size(); ++i) {
+      if (layer_fused[i]) { continue; }
+      if (counters) { counters->Read(&begin); }
       timer.Start();
       layers[i]->Forward(bottom_vecs[i], top_vecs[i]);
-      forward_time_per_layer[i] += timer.MicroSeconds();
+      const double us = timer.MicroSeconds();
+      if (counters) { count_perf(*counters, begin, &forward_perf[i]); }
+      forward_time_per_layer[i] += us;
+      forward_times[i].push_back(us / 1000);
     }
     forward_time += forward_timer.MicroSeconds();
     backward_timer.Start();
     for (int i = layers.size() - 1; i >= 0; --i) {
+      if (layer_fused[i]) { continue; }
+      if (counters) { counters->Read(&begin); }
       timer.Start();
       layers[i]->Backward(top_vecs[i], bottom_need_backward[i],
                           bottom_vecs[i]);
-      backward_time_per_layer[i] += timer.MicroSeconds();
+      const double us = timer.MicroSeconds();
+      if (counters) { count_perf(*counters, begin, &backward_perf[i]); }
+      backward_time_per_layer[i] += us;
+      backward_times[i].push_back(us / 1000);
     }
     backward_time += backward_timer.MicroSeconds();
     LOG(INFO) << "Iteration: " << j + 1 << " forward-backward time: "
@@ -467,13 +648,17 @@ int time() {
   }
   LOG(INFO) << "Average time per layer: ";
   for (int i = 0; i < layers.size(); ++i) {
+    if (layer_fused[i]) { continue; }
     const caffe::string& layername = layers[i]->layer_param().name();
     LOG(INFO) << std::setfill(' ') << std::setw(10) << layername <<
       "\tforward: " << forward_time_per_layer[i] / 1000 /
-      FLAGS_iterations << " ms.";
+      FLAGS_iterations << " ms." << (counters ? perf_summary(forward_perf[i],
+      forward_time_per_layer[i], counters->has_vector_instructions()) : "");
     LOG(INFO) << std::setfill(' ') << std::setw(10) << layername  <<
       "\tbackward: " << backward_time_per_layer[i] / 1000 /
-      FLAGS_iterations << " ms.";
+      FLAGS_iterations << " ms." << (counters ? perf_summary(backward_perf[i],
+      backward_time_per_layer[i], counters->has_vector_instructions()) :
+      "");
   }
   total_timer.Stop();
   LOG(INFO) << "Average Forward pass: " << forward_time / 1000 /
@@ -484,10 +669,104 @@ int time() {
     FLAGS_iterations << " ms.";
   LOG(INFO) << "Total Time: " << total_timer.MilliSeconds() << " ms.";
   LOG(INFO) << "*** Benchmark ends ***";
+
+  if (FLAGS_profile.size() && FLAGS_iterations > 0) {
+    vector<LayerProfile> profiles;
+    for (int i = 0; i < layers.size(); ++i) {
+      if (layer_fused[i]) { continue; }
+      for (int pass = 0; pass < 2; ++pass) {
+        LayerProfile profile;
+        profile.layer = layers[i]->layer_param().name();
+        profile.type = layers[i]->type();
+        if (pass == 0) {
+          profile.pass = "forward";
+          profile.SetTimes(forward_times[i]);
+          profile.flops = caffe::layer_forward_flops(layers[i].get(),
+              bottom_vecs[i], top_vecs[i]);
+          profile.bytes = caffe::layer_forward_bytes(layers[i].get(),
+              bottom_vecs[i], top_vecs[i]);
+        } else {
+          profile.pass = "backward";
+          profile.SetTimes(backward_times[i]);
+          if (caffe_net.layer_need_backward()[i]) {
+            profile.flops = caffe::layer_backward_flops(layers[i].get(),
+                bottom_vecs[i], top_vecs[i]);
+            profile.bytes = caffe::layer_backward_bytes(layers[i].get(),
+                bottom_vecs[i], top_vecs[i]);
+          }
+        }
+        const PerfSample& perf = pass == 0 ? forward_perf[i] :
+            backward_perf[i];
+        profile.cycles = perf.cycles / FLAGS_iterations;
+        profile.instructions = perf.instructions / FLAGS_iterations;
+        profile.cache_misses = perf.cache_misses / FLAGS_iterations;
+        profile.vector_instructions =
+            perf.vector_instructions / FLAGS_iterations;
+        profiles.push_back(profile);
+      }
+    }
+    caffe::SetProfileShares(&profiles);
+    caffe::WriteProfiles(FLAGS_profile, profiles);
+    LOG(INFO) << "Wrote the per-layer statistics to " << FLAGS_profile;
+  }
   return 0;
 }
 RegisterBrewFunction(time);
 
+// Compares the per-layer statistics of two caffe time runs, e.g. of two
+// builds, and fails if a layer got slower than the threshold.
+int time_diff() {
+  CHECK_GT(FLAGS_baseline.size(), 0) << "Need the baseline statistics.";
+  CHECK_GT(FLAGS_profile.size(), 0) << "Need the statistics to compare.";
+  vector<LayerProfile> baseline;
+  vector<LayerProfile> current;
+  CHECK(caffe::ReadProfiles(FLAGS_baseline, &baseline))
+      << "Failed to read " << FLAGS_baseline;
+  CHECK(caffe::ReadProfiles(FLAGS_profile, &current))
+      << "Failed to read " << FLAGS_profile;
+  std::map<std::pair<string, string>, const LayerProfile*> baseline_passes;
+  double baseline_total = 0;
+  for (int i = 0; i < baseline.size(); ++i) {
+    baseline_passes[std::make_pair(baseline[i].layer, baseline[i].pass)] =
+        &baseline[i];
+    baseline_total += baseline[i].median_ms;
+  }
+  double current_total = 0;
+  int regressions = 0;
+  for (int i = 0; i < current.size(); ++i) {
+    const LayerProfile& now = current[i];
+    current_total += now.median_ms;
+    std::map<std::pair<string, string>, const LayerProfile*>::iterator it =
+        baseline_passes.find(std::make_pair(now.layer, now.pass));
+    if (it == baseline_passes.end()) {
+      LOG(INFO) << std::setw(10) << now.layer << "\t" << now.pass
+          << ": not in the baseline";
+      continue;
+    }
+    const LayerProfile& before = *it->second;
+    const double change = before.median_ms > 0 ?
+        now.median_ms / before.median_ms - 1 : 0;
+    // Changes within the resolution of the timers are noise.
+    const bool regression = change > FLAGS_regression_threshold &&
+        now.median_ms - before.median_ms > 0.01;
+    regressions += regression;
+    LOG(INFO) << std::setw(10) << now.layer << "\t" << now.pass << ": "
+        << before.median_ms << " -> " << now.median_ms << " ms ("
+        << std::showpos << change * 100 << std::noshowpos << "%, p99 "
+        << before.p99_ms << " -> " << now.p99_ms << " ms)"
+        << (regression ? " REGRESSION" : "");
+  }
+  LOG(INFO) << "Total median: " << baseline_total << " -> " << current_total
+      << " ms.";
+  if (regressions) {
+    LOG(ERROR) << regressions << " layer passes are more than "
+        << FLAGS_regression_threshold * 100 << "% slower than the baseline.";
+    return 1;
+  }
+  return 0;
+}
+RegisterBrewFunction(time_diff);
+
 
 // collect & compare: Debugging extansion for CPU-GPU functional comparison
 #include <stdio.h>
@@ -544,6 +823,8 @@ int collect() {
   const vector<vector<Blob<real_t>*> >& top_vecs = caffe_net.top_vecs();
   const vector<vector<bool> >& bottom_need_backward =
     caffe_net.bottom_need_backward();
+  // Fused layers are computed by the layer before them.
+  const vector<bool>& layer_fused = caffe_net.layer_fused();
 
   FILE *infoFile = fopen(use_gpu ? "GPUInfo.txt" : "CPUInfo.txt", "w+t");
   LOG(INFO) << "*** Collect procedure begins ***";
@@ -554,6 +835,7 @@ int collect() {
   }
 
   for (int i = 0; i < layers.size(); ++i) {
+    if (layer_fused[i]) { continue; }
     LOG(INFO) << "Collecting FW Layer[" << i << "]: " << layers[i]->type();
     fprintf(infoFile, "Fwrd%04i: %s\n", i, layers[i]->type());
     layers[i]->Forward(bottom_vecs[i], top_vecs[i]);
@@ -562,6 +844,7 @@ int collect() {
   }
 
   for (int i = layers.size() - 1; i >= 0; --i) {
+    if (layer_fused[i]) { continue; }
     LOG(INFO) << "Collecting BW Layer[" << i << "]: " << layers[i]->type();
     fprintf(infoFile, "Bwrd%04i: %s\n", i, layers[i]->type());
     layers[i]->Backward(top_vecs[i], bottom_need_backward[i], bottom_vecs[i]);
@@ -611,6 +894,8 @@ int compare() {
   const vector<vector<Blob<real_t>*> >& top_vecs = caffe_net.top_vecs();
   const vector<vector<bool> >& bottom_need_backward =
     caffe_net.bottom_need_backward();
+  // Fused layers are computed by the layer before them.
+  const vector<bool>& layer_fused = caffe_net.layer_fused();
 
   FILE *infoFile = fopen(use_gpu ? "GPUInfo.txt" : "CPUInfo.txt", "w+t");
   LOG(INFO) << "*** Compare procedure begins ***";
@@ -621,6 +906,7 @@ int compare() {
   }
 
   for (int i = 0; i < layers.size(); ++i) {
+    if (layer_fused[i]) { continue; }
     LOG(INFO) << "Collecting FW Layer[" << i << "]: " << layers[i]->type();
     fprintf(infoFile, "Fwrd%04i: %s\n", i, layers[i]->type());
     layers[i]->Forward(bottom_vecs[i], top_vecs[i]);
@@ -631,6 +917,7 @@ int compare() {
   }
 
   for (int i = layers.size() - 1; i >= 0; --i) {
+    if (layer_fused[i]) { continue; }
     LOG(INFO) << "Collecting BW Layer[" << i << "]: " << layers[i]->type();
     fprintf(infoFile, "Bwrd%04i: %s\n", i, layers[i]->type());
     layers[i]->Backward(top_vecs[i], bottom_need_backward[i], bottom_vecs[i]);
@@ -669,15 +956,21 @@ int main(int argc, char** argv) {
       "commands:\n"
       "  train           train or finetune a model\n"
       "  test            score a model\n"
+      "  calibrate       measure layer input ranges for int8 inference\n"
       "  param_server    run param server - weights synchronizing entity\n"
       "  model_server    run model server - remote model source\n"
       "  data_server     run data server - remote data source\n"
       "  device_query    show GPU diagnostic information\n"
       "  time            benchmark model execution time\n"
+      "  time_diff       compare the per-layer times of two time --profile "
+      "runs\n"
       "  collect         collects layer data on specified device\n"
       "  compare         collects layer data using inputs from opposite device");
   // Run tool or show usage.
   caffe::GlobalInit(&argc, &argv);
+  if (!FLAGS_trace.empty()) {
+    caffe::Tracer::Enable(FLAGS_trace, FLAGS_trace_buffer_size);
+  }
   if (argc == 2) {
 #ifdef WITH_PYTHON_LAYER
     try {
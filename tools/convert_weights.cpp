@@ -0,0 +1,104 @@
+// This program converts trained weights between the .caffemodel (binary
+// NetParameter), .h5 (HDF5) and .caffeflat (flat, memory mappable) formats.
+// The formats are chosen by the file extensions.
+// Usage:
+//    convert_weights weights_in weights_out
+
+#include <string>
+
+#include "hdf5.h"
+
+#include "caffe/caffe.hpp"
+#include "caffe/util/flat_weights.hpp"
+#include "caffe/util/hdf5.hpp"
+#include "caffe/util/io.hpp"
+
+using namespace caffe;  // NOLINT(build/namespaces)
+
+bool IsHDF5File(const string& filename) {
+  return filename.size() >= 3 &&
+    filename.compare(filename.size() - 3, 3, ".h5") == 0;
+}
+
+// Reads the layout written by Net::ToHDF5: data/<layer name>/<param id>.
+void ReadHDF5Weights(const string& filename, NetParameter* param) {
+  hid_t file_hid = H5Fopen(filename.c_str(), H5F_ACC_RDONLY, H5P_DEFAULT);
+  CHECK_GE(file_hid, 0) << "Couldn't open " << filename;
+  hid_t data_hid = H5Gopen2(file_hid, "data", H5P_DEFAULT);
+  CHECK_GE(data_hid, 0) << "Error reading weights from " << filename;
+  int num_layers = hdf5_get_num_links(data_hid);
+  for (int i = 0; i < num_layers; ++i) {
+    LayerParameter* layer = param->add_layer();
+    layer->set_name(hdf5_get_name_by_idx(data_hid, i));
+    hid_t layer_hid = H5Gopen2(data_hid, layer->name().c_str(), H5P_DEFAULT);
+    CHECK_GE(layer_hid, 0) << "Error reading weights from " << filename;
+    int num_params = hdf5_get_num_links(layer_hid);
+    for (int j = 0; j < num_params; ++j) {
+      string dataset_name = format_int(j);
+      CHECK(H5Lexists(layer_hid, dataset_name.c_str(), H5P_DEFAULT))
+          << "Param " << j << " of layer " << layer->name() << " is missing, "
+          << "weight-shared params are not saved in HDF5 files";
+      Blob<float> blob;
+      hdf5_load_nd_dataset(layer_hid, dataset_name.c_str(), 0, kMaxBlobAxes,
+                           &blob);
+      blob.ToProto(layer->add_blobs());
+    }
+    H5Gclose(layer_hid);
+  }
+  H5Gclose(data_hid);
+  H5Fclose(file_hid);
+}
+
+void WriteHDF5Weights(const NetParameter& param, const string& filename) {
+  hid_t file_hid = H5Fcreate(filename.c_str(), H5F_ACC_TRUNC, H5P_DEFAULT,
+      H5P_DEFAULT);
+  CHECK_GE(file_hid, 0) << "Couldn't open " << filename << " to save weights.";
+  hid_t data_hid = H5Gcreate2(file_hid, "data", H5P_DEFAULT, H5P_DEFAULT,
+      H5P_DEFAULT);
+  CHECK_GE(data_hid, 0) << "Error saving weights to " << filename << ".";
+  for (int i = 0; i < param.layer_size(); ++i) {
+    const LayerParameter& layer = param.layer(i);
+    hid_t layer_hid = H5Gcreate2(data_hid, layer.name().c_str(),
+        H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
+    CHECK_GE(layer_hid, 0) << "Error saving weights to " << filename << ".";
+    for (int j = 0; j < layer.blobs_size(); ++j) {
+      Blob<float> blob;
+      blob.FromProto(layer.blobs(j), true);
+      hdf5_save_nd_dataset<float>(layer_hid, format_int(j), blob);
+    }
+    H5Gclose(layer_hid);
+  }
+  H5Gclose(data_hid);
+  H5Fclose(file_hid);
+}
+
+int main(int argc, char** argv) {
+  ::google::InitGoogleLogging(argv[0]);
+  if (argc != 3) {
+    LOG(ERROR) << "Usage: convert_weights weights_in weights_out\n"
+        << "Formats: .caffemodel (or any other extension), .h5, .caffeflat";
+    return 1;
+  }
+  const string input_filename(argv[1]);
+  const string output_filename(argv[2]);
+
+  NetParameter param;
+  if (IsHDF5File(input_filename)) {
+    ReadHDF5Weights(input_filename, &param);
+  } else if (IsFlatWeightsFile(input_filename)) {
+    ReadFlatWeights(input_filename, &param);
+  } else {
+    ReadNetParamsFromBinaryFileOrDie(input_filename, &param);
+  }
+
+  if (IsHDF5File(output_filename)) {
+    WriteHDF5Weights(param, output_filename);
+  } else if (IsFlatWeightsFile(output_filename)) {
+    WriteFlatWeights(param, output_filename);
+  } else {
+    WriteProtoToBinaryFile(param, output_filename);
+  }
+  LOG(INFO) << "Wrote weights of " << param.layer_size() << " layers to "
+            << output_filename;
+  return 0;
+}
@@ -0,0 +1,383 @@
+// Serves a model to local clients over a Unix domain socket, running the
+// requests of concurrent clients as one batch.
+//
+// Protocol, in native byte order: on connection the server sends two uint32,
+// the number of floats of one input sample and of one output sample. Each
+// request is then one input sample, for the first input blob of the model,
+// and is answered with one sample of its first output blob. A client sends
+// its next request once the previous one is answered; clients wanting more
+// requests in flight open more connections. See serve_net_load for a client.
+//
+// Usage:
+//    serve_net --model=deploy.prototxt --weights=net.caffemodel
+#include <signal.h>
+#include <stdint.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/thread.hpp>
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <deque>
+#include <string>
+#include <vector>
+
+#include "caffe/caffe.hpp"
+#include "caffe/util/cpu_info.hpp"
+#include "caffe/util/math_functions.hpp"
+
+using boost::posix_time::microsec_clock;
+using boost::posix_time::ptime;
+using caffe::Blob;
+using caffe::Caffe;
+using caffe::Net;
+using caffe::shared_ptr;
+using std::string;
+using std::vector;
+
+DEFINE_string(model, "",
+    "The model definition protocol buffer text file.");
+DEFINE_string(weights, "",
+    "The trained weights, to serve.");
+DEFINE_string(socket, "/tmp/serve_net.sock",
+    "Path of the Unix domain socket to listen on.");
+DEFINE_int32(replicas, 0,
+    "Number of copies of the model serving requests, each bound to its own "
+    "share of the cores; 0 for one per socket.");
+DEFINE_int32(max_batch, 0,
+    "Most requests run as one batch; 0 for the batch size of the input "
+    "blob in the model definition.");
+DEFINE_double(max_delay_ms, 2,
+    "How long the first request of a batch waits for more requests.");
+DEFINE_int32(report_interval, 10,
+    "Seconds between reports of the throughput and latency.");
+
+namespace {
+
+volatile sig_atomic_t stop_requested = 0;
+
+void handle_signal(int signal) {
+  stop_requested = 1;
+}
+
+bool read_fully(int fd, void* data, size_t size) {
+  char* bytes = static_cast<char*>(data);
+  while (size > 0) {
+    ssize_t received = recv(fd, bytes, size, 0);
+    if (received < 0 && errno == EINTR) {
+      continue;
+    }
+    if (received <= 0) {
+      return false;
+    }
+    bytes += received;
+    size -= received;
+  }
+  return true;
+}
+
+bool write_fully(int fd, const void* data, size_t size) {
+  const char* bytes = static_cast<const char*>(data);
+  while (size > 0) {
+    ssize_t sent = send(fd, bytes, size, MSG_NOSIGNAL);
+    if (sent < 0 && errno == EINTR) {
+      continue;
+    }
+    if (sent <= 0) {
+      return false;
+    }
+    bytes += sent;
+    size -= sent;
+  }
+  return true;
+}
+
+ptime now() {
+  return microsec_clock::universal_time();
+}
+
+struct Request {
+  vector<float> input;
+  vector<float> output;
+  ptime arrival;
+  bool done;
+  boost::mutex mutex;
+  boost::condition_variable answered;
+};
+
+// Requests waiting for a replica.
+class RequestQueue {
+ public:
+  RequestQueue() : stopped_(false) {}
+
+  void Push(Request* request) {
+    boost::mutex::scoped_lock lock(mutex_);
+    queue_.push_back(request);
+    // all, as the replica woken may have a full batch already
+    not_empty_.notify_all();
+  }
+
+  // Waits for a request, then until max_delay after its arrival for more, up
+  // to max_batch of them. Returns false once stopped.
+  bool PopBatch(int max_batch, const boost::posix_time::time_duration& delay,
+      vector<Request*>* batch) {
+    boost::mutex::scoped_lock lock(mutex_);
+    while (queue_.empty() && !stopped_) {
+      not_empty_.wait(lock);
+    }
+    if (stopped_) {
+      return false;
+    }
+    const ptime deadline = queue_.front()->arrival + delay;
+    while (true) {
+      while (!queue_.empty() && batch->size() < max_batch) {
+        batch->push_back(queue_.front());
+        queue_.pop_front();
+      }
+      if (batch->size() == max_batch || stopped_ ||
+          !not_empty_.timed_wait(lock, deadline)) {
+        return true;
+      }
+    }
+  }
+
+  void Stop() {
+    boost::mutex::scoped_lock lock(mutex_);
+    stopped_ = true;
+    not_empty_.notify_all();
+  }
+
+ private:
+  std::deque<Request*> queue_;
+  bool stopped_;
+  boost::mutex mutex_;
+  boost::condition_variable not_empty_;
+};
+
+// Latencies of the requests answered since the last report.
+class ServingStats {
+ public:
+  ServingStats() : batches_(0), total_requests_(0), start_(now()) {}
+
+  void Add(const vector<double>& latencies) {
+    boost::mutex::scoped_lock lock(mutex_);
+    latencies_.insert(latencies_.end(), latencies.begin(), latencies.end());
+    ++batches_;
+  }
+
+  void Report() {
+    vector<double> latencies;
+    int batches;
+    ptime start;
+    {
+      boost::mutex::scoped_lock lock(mutex_);
+      latencies.swap(latencies_);
+      batches = batches_;
+      batches_ = 0;
+      start = start_;
+      start_ = now();
+      total_requests_ += latencies.size();
+    }
+    const double seconds = (now() - start).total_microseconds() / 1e6;
+    if (latencies.empty()) {
+      LOG(INFO) << "No requests in the last " << seconds << " s";
+      return;
+    }
+    std::sort(latencies.begin(), latencies.end());
+    LOG(INFO) << latencies.size() << " requests in " << seconds << " s: "
+        << latencies.size() / seconds << " requests/s, "
+        << static_cast<double>(latencies.size()) / batches << " per batch, "
+        << "latency p50 " << percentile(latencies, 0.5) << " ms, "
+        << "p99 " << percentile(latencies, 0.99) << " ms, "
+        << "max " << latencies.back() << " ms";
+  }
+
+  size_t total_requests() const { return total_requests_; }
+
+ private:
+  static double percentile(const vector<double>& sorted, double fraction) {
+    size_t i = static_cast<size_t>(fraction * sorted.size());
+    return sorted[std::min(i, sorted.size() - 1)];
+  }
+
+  boost::mutex mutex_;
+  vector<double> latencies_;
+  int batches_;
+  size_t total_requests_;
+  ptime start_;
+};
+
+void run_replica(int replica, int num_replicas, RequestQueue* queue,
+    ServingStats* stats) {
+  caffe::cpu::OpenMpManager::bindOpenMpThreadsToPartition(replica,
+      num_replicas);
+  // Loaded once bound, so that the weights are in the memory of its socket.
+  Net<float> net(FLAGS_model, caffe::TEST);
+  if (!FLAGS_weights.empty()) {
+    net.CopyTrainedLayersFrom(FLAGS_weights);
+  }
+  Blob<float>* input = net.input_blobs()[0];
+  vector<int> shape = input->shape();
+  const int input_size = input->count(1);
+  const boost::posix_time::time_duration delay =
+      boost::posix_time::microseconds(
+          static_cast<int64_t>(FLAGS_max_delay_ms * 1000));
+  LOG(INFO) << "Replica " << replica << " ready";
+
+  vector<Request*> batch;
+  vector<double> latencies;
+  while (queue->PopBatch(FLAGS_max_batch, delay, &batch)) {
+    if (shape[0] != static_cast<int>(batch.size())) {
+      shape[0] = batch.size();
+      input->Reshape(shape);
+      net.Reshape();
+    }
+    float* input_data = input->mutable_cpu_data();
+    for (int i = 0; i < batch.size(); ++i) {
+      caffe::caffe_copy(input_size, &batch[i]->input[0],
+          input_data + i * input_size);
+    }
+    const Blob<float>* output = net.Forward()[0];
+    const int output_size = output->count(1);
+    const float* output_data = output->cpu_data();
+    const ptime answered = now();
+    for (int i = 0; i < batch.size(); ++i) {
+      Request* request = batch[i];
+      request->output.assign(output_data + i * output_size,
+          output_data + (i + 1) * output_size);
+      latencies.push_back(
+          (answered - request->arrival).total_microseconds() / 1000.);
+      boost::mutex::scoped_lock lock(request->mutex);
+      request->done = true;
+      request->answered.notify_one();
+    }
+    stats->Add(latencies);
+    latencies.clear();
+    batch.clear();
+  }
+}
+
+void serve_connection(int fd, uint32_t input_size, uint32_t output_size,
+    RequestQueue* queue) {
+  const uint32_t sizes[2] = {input_size, output_size};
+  Request request;
+  request.input.resize(input_size);
+  bool connected = write_fully(fd, sizes, sizeof(sizes));
+  while (connected &&
+      read_fully(fd, &request.input[0], input_size * sizeof(float))) {
+    request.done = false;
+    request.arrival = now();
+    queue->Push(&request);
+    {
+      boost::mutex::scoped_lock lock(request.mutex);
+      while (!request.done) {
+        request.answered.wait(lock);
+      }
+    }
+    connected = write_fully(fd, &request.output[0],
+        output_size * sizeof(float));
+  }
+  close(fd);
+}
+
+void accept_connections(int listen_fd, uint32_t input_size,
+    uint32_t output_size, RequestQueue* queue) {
+  while (true) {
+    int fd = accept(listen_fd, NULL, NULL);
+    if (fd < 0) {
+      if (errno == EINTR || errno == ECONNABORTED) {
+        continue;
+      }
+      // the listening socket was shut down
+      return;
+    }
+    boost::thread connection(&serve_connection, fd, input_size, output_size,
+        queue);
+    connection.detach();
+  }
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  // Print output to stderr (while still logging).
+  FLAGS_alsologtostderr = 1;
+  gflags::SetUsageMessage("serves a model to local clients, batching their "
+      "requests\n"
+      "usage: serve_net --model=deploy.prototxt [--weights=net.caffemodel]");
+  caffe::GlobalInit(&argc, &argv);
+  CHECK_GT(FLAGS_model.size(), 0) << "Need a model definition to serve.";
+  Caffe::set_mode(Caffe::CPU);
+
+  uint32_t input_size, output_size;
+  {
+    Net<float> net(FLAGS_model, caffe::TEST);
+    CHECK_GT(net.input_blobs().size(), 0)
+        << "The model needs an Input layer to receive the requests.";
+    CHECK_GT(net.output_blobs().size(), 0) << "The model has no output.";
+    input_size = net.input_blobs()[0]->count(1);
+    output_size = net.output_blobs()[0]->count(1);
+    if (FLAGS_max_batch <= 0) {
+      FLAGS_max_batch = net.input_blobs()[0]->shape(0);
+    }
+  }
+  int num_replicas = FLAGS_replicas;
+  if (num_replicas <= 0) {
+    num_replicas = std::max(1U,
+        caffe::cpu::Collection::getTotalNumberOfSockets());
+  }
+
+  int listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  CHECK_GE(listen_fd, 0) << "Couldn't create a socket: " << strerror(errno);
+  struct sockaddr_un address = sockaddr_un();
+  address.sun_family = AF_UNIX;
+  CHECK_LT(FLAGS_socket.size(), sizeof(address.sun_path))
+      << "Socket path too long: " << FLAGS_socket;
+  strncpy(address.sun_path, FLAGS_socket.c_str(),
+      sizeof(address.sun_path) - 1);
+  unlink(FLAGS_socket.c_str());
+  CHECK_EQ(bind(listen_fd, reinterpret_cast<struct sockaddr*>(&address),
+      sizeof(address)), 0) << "Couldn't bind to " << FLAGS_socket << ": "
+      << strerror(errno);
+  CHECK_EQ(listen(listen_fd, SOMAXCONN), 0) << strerror(errno);
+  signal(SIGINT, handle_signal);
+  signal(SIGTERM, handle_signal);
+
+  RequestQueue queue;
+  ServingStats stats;
+  vector<shared_ptr<boost::thread> > replicas;
+  for (int i = 0; i < num_replicas; ++i) {
+    replicas.push_back(shared_ptr<boost::thread>(new boost::thread(
+        &run_replica, i, num_replicas, &queue, &stats)));
+  }
+  boost::thread acceptor(&accept_connections, listen_fd, input_size,
+      output_size, &queue);
+  LOG(INFO) << "Serving " << FLAGS_model << " on " << FLAGS_socket << " with "
+      << num_replicas << " replicas, batches of up to " << FLAGS_max_batch
+      << " within " << FLAGS_max_delay_ms << " ms";
+
+  int seconds = 0;
+  while (!stop_requested) {
+    sleep(1);
+    if (++seconds % FLAGS_report_interval == 0) {
+      stats.Report();
+    }
+  }
+  shutdown(listen_fd, SHUT_RDWR);
+  acceptor.join();
+  close(listen_fd);
+  unlink(FLAGS_socket.c_str());
+  queue.Stop();
+  for (int i = 0; i < replicas.size(); ++i) {
+    replicas[i]->join();
+  }
+  stats.Report();
+  LOG(INFO) << "Served " << stats.total_requests() << " requests";
+  return 0;
+}
@@ -0,0 +1,149 @@
+// Load generator for serve_net: keeps a number of connections busy, each
+// sending its next request as soon as the previous one is answered, and
+// reports the throughput and the latency distribution seen by the clients.
+//
+// Usage:
+//    serve_net_load --connections=32 --duration=30
+#include <stdint.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/thread.hpp>
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "caffe/common.hpp"
+
+using boost::posix_time::microsec_clock;
+using boost::posix_time::ptime;
+using caffe::shared_ptr;
+using std::string;
+using std::vector;
+
+DEFINE_string(socket, "/tmp/serve_net.sock",
+    "Path of the Unix domain socket serve_net listens on.");
+DEFINE_int32(connections, 8,
+    "Number of concurrent connections, i.e. of requests in flight.");
+DEFINE_int32(duration, 10,
+    "Seconds to send requests for.");
+
+namespace {
+
+bool read_fully(int fd, void* data, size_t size) {
+  char* bytes = static_cast<char*>(data);
+  while (size > 0) {
+    ssize_t received = recv(fd, bytes, size, 0);
+    if (received < 0 && errno == EINTR) {
+      continue;
+    }
+    if (received <= 0) {
+      return false;
+    }
+    bytes += received;
+    size -= received;
+  }
+  return true;
+}
+
+bool write_fully(int fd, const void* data, size_t size) {
+  const char* bytes = static_cast<const char*>(data);
+  while (size > 0) {
+    ssize_t sent = send(fd, bytes, size, MSG_NOSIGNAL);
+    if (sent < 0 && errno == EINTR) {
+      continue;
+    }
+    if (sent <= 0) {
+      return false;
+    }
+    bytes += sent;
+    size -= sent;
+  }
+  return true;
+}
+
+ptime now() {
+  return microsec_clock::universal_time();
+}
+
+// Sends requests on one connection until the deadline, recording their
+// latencies in milliseconds.
+void run_client(int client, ptime deadline, vector<double>* latencies) {
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  CHECK_GE(fd, 0) << "Couldn't create a socket: " << strerror(errno);
+  struct sockaddr_un address = sockaddr_un();
+  address.sun_family = AF_UNIX;
+  strncpy(address.sun_path, FLAGS_socket.c_str(),
+      sizeof(address.sun_path) - 1);
+  CHECK_EQ(connect(fd, reinterpret_cast<struct sockaddr*>(&address),
+      sizeof(address)), 0) << "Couldn't connect to " << FLAGS_socket << ": "
+      << strerror(errno);
+  uint32_t sizes[2];
+  CHECK(read_fully(fd, sizes, sizeof(sizes))) << "Connection closed";
+  vector<float> input(sizes[0]);
+  vector<float> output(sizes[1]);
+  for (int i = 0; i < input.size(); ++i) {
+    input[i] = static_cast<float>((i * 7 + client) % 255) / 255;
+  }
+  while (now() < deadline) {
+    const ptime sent = now();
+    CHECK(write_fully(fd, &input[0], input.size() * sizeof(float)))
+        << "Connection closed";
+    CHECK(read_fully(fd, &output[0], output.size() * sizeof(float)))
+        << "Connection closed";
+    latencies->push_back((now() - sent).total_microseconds() / 1000.);
+  }
+  close(fd);
+}
+
+double percentile(const vector<double>& sorted, double fraction) {
+  size_t i = static_cast<size_t>(fraction * sorted.size());
+  return sorted[std::min(i, sorted.size() - 1)];
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  FLAGS_alsologtostderr = 1;
+  gflags::SetUsageMessage("sends requests to serve_net and reports the "
+      "throughput and latency\n"
+      "usage: serve_net_load [--connections=8] [--duration=10]");
+  caffe::GlobalInit(&argc, &argv);
+  CHECK_GT(FLAGS_connections, 0);
+
+  const ptime start = now();
+  const ptime deadline = start + boost::posix_time::seconds(FLAGS_duration);
+  vector<vector<double> > latencies(FLAGS_connections);
+  vector<shared_ptr<boost::thread> > clients;
+  for (int i = 0; i < FLAGS_connections; ++i) {
+    clients.push_back(shared_ptr<boost::thread>(new boost::thread(
+        &run_client, i, deadline, &latencies[i])));
+  }
+  vector<double> all;
+  for (int i = 0; i < FLAGS_connections; ++i) {
+    clients[i]->join();
+    all.insert(all.end(), latencies[i].begin(), latencies[i].end());
+  }
+  const double seconds = (now() - start).total_microseconds() / 1e6;
+  CHECK_GT(all.size(), 0) << "No request was answered";
+  std::sort(all.begin(), all.end());
+  double sum = 0;
+  for (int i = 0; i < all.size(); ++i) {
+    sum += all[i];
+  }
+  LOG(INFO) << all.size() << " requests in " << seconds << " s over "
+      << FLAGS_connections << " connections: " << all.size() / seconds
+      << " requests/s";
+  LOG(INFO) << "Latency: mean " << sum / all.size() << " ms, p50 "
+      << percentile(all, 0.5) << " ms, p90 " << percentile(all, 0.9)
+      << " ms, p99 " << percentile(all, 0.99) << " ms, max " << all.back()
+      << " ms";
+  return 0;
+}